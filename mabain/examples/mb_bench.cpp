@@ -0,0 +1,632 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Throughput and latency benchmark. One updater and 1, 2, 4, ... up to
+// max_reader reader processes (or threads) run a mix of Find,
+// FindLongestPrefix, Add and Remove against a preloaded DB. Readers run
+// the lookups; the updater runs the updates, either directly in the writer
+// or through the async writer queue. The number of updates keeps the
+// requested mix across all clients of a round. Results of all rounds are
+// printed as JSON with the throughput and the p50/p99/p999 latency of each
+// operation. With a batch size, readers look up the keys of their Find
+// operations with FindBatch, and each lookup is counted with the batch
+// latency divided by the batch size.
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include <mabain/db.h>
+
+using namespace mabain;
+
+#define OP_FIND      0
+#define OP_PREFIX    1
+#define OP_ADD       2
+#define OP_REMOVE    3
+#define NUM_OP_TYPE  4
+
+static const char *op_names[NUM_OP_TYPE] = { "find", "find_longest_prefix", "add", "remove" };
+
+static std::string mbdir = "/var/tmp/mabain_test/";
+static int num_keys = 100000;
+static int num_ops = 100000;
+static int max_reader = 8;
+static bool use_threads = false;
+static bool async_mode = false;
+static int key_min = 16, key_max = 16;
+static int value_min = 32, value_max = 32;
+static int mix[NUM_OP_TYPE] = { 90, 5, 4, 1 };
+static int batch_size = 1;
+static std::string json_path;
+static std::string value_buff;
+
+// Samples of one client, kept in shared memory so that forked clients can
+// report back to the parent.
+typedef struct _ClientStats
+{
+    uint64_t end_ns;
+    int64_t  num_ops;
+    int64_t  num_miss;
+    int      failed;
+} ClientStats;
+
+// Start barrier of a round so that opening the DB is not measured
+typedef struct _Control
+{
+    std::atomic<int> num_ready;
+    std::atomic<int> started;
+} Control;
+
+static Control *control = NULL;
+
+typedef struct _Slot
+{
+    ClientStats *stats;
+    uint32_t *latency;
+    uint8_t  *op_type;
+} Slot;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void WaitForStart()
+{
+    control->num_ready.fetch_add(1, std::memory_order_release);
+    while(control->started.load(std::memory_order_acquire) == 0) {
+        usleep(10);
+    }
+}
+
+static uint64_t StartRound(int nclient)
+{
+    while(control->num_ready.load(std::memory_order_acquire) < nclient) {
+        usleep(10);
+    }
+    uint64_t start = now_ns();
+    control->started.store(1, std::memory_order_release);
+    return start;
+}
+
+static inline uint64_t next_rand(uint64_t &state)
+{
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+static inline uint64_t mix_hash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Size of the i-th key or value, uniformly distributed in [min, max]
+static inline int dist_size(uint64_t i, int min, int max, uint64_t seed)
+{
+    if(max <= min)
+        return min;
+    return min + mix_hash(i ^ seed) % (max - min + 1);
+}
+
+// The i-th key is "k<i>_" padded with letters up to its size. The '_'
+// makes all keys unique.
+static void get_key(uint64_t i, std::string &key)
+{
+    key = "k" + std::to_string(i) + "_";
+    int len = dist_size(i, key_min, key_max, 0x6b6579);
+    uint64_t h = mix_hash(i);
+    while((int) key.size() < len) {
+        key.push_back('a' + h % 26);
+        h = h / 26 + 7919;
+    }
+}
+
+static inline int value_size(uint64_t i)
+{
+    return dist_size(i, value_min, value_max, 0x76616c);
+}
+
+static bool parse_dist(const char *arg, int &min, int &max)
+{
+    if(sscanf(arg, "%d-%d", &min, &max) == 2)
+        return min > 0 && max >= min;
+    min = max = atoi(arg);
+    return min > 0;
+}
+
+static bool parse_mix(const char *arg)
+{
+    if(sscanf(arg, "%d:%d:%d:%d", &mix[OP_FIND], &mix[OP_PREFIX],
+              &mix[OP_ADD], &mix[OP_REMOVE]) != NUM_OP_TYPE)
+        return false;
+    for(int i = 0; i < NUM_OP_TYPE; i++) {
+        if(mix[i] < 0)
+            return false;
+    }
+    return mix[OP_FIND] + mix[OP_PREFIX] > 0;
+}
+
+static int64_t updater_ops(int nreader)
+{
+    return (int64_t) num_ops * nreader * (mix[OP_ADD] + mix[OP_REMOVE]) /
+           (mix[OP_FIND] + mix[OP_PREFIX]);
+}
+
+static void Preload()
+{
+    DB db(mbdir.c_str(), CONSTS::WriterOptions());
+    if(!db.is_open()) {
+        std::cerr << "failed to open writer: " << db.StatusStr() << "\n";
+        exit(1);
+    }
+    std::string key;
+    for(int i = 0; i < num_keys; i++) {
+        get_key(i, key);
+        if(db.Add(key.data(), key.size(), value_buff.data(), value_size(i)) != MBError::SUCCESS) {
+            std::cerr << "failed to preload " << key << "\n";
+            exit(1);
+        }
+    }
+    db.Close();
+}
+
+static void RunBatchReader(DB &db, int id, Slot &slot)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ULL * (id + 1);
+    std::vector<std::string> keys(batch_size);
+    std::vector<MBData> data(batch_size);
+    std::vector<int> rvals;
+    for(int64_t i = 0; i < num_ops; i += batch_size) {
+        int n = (int) std::min((int64_t) batch_size, num_ops - i);
+        keys.resize(n);
+        for(int j = 0; j < n; j++)
+            get_key(next_rand(state) % num_keys, keys[j]);
+        uint64_t start = now_ns();
+        if(db.FindBatch(keys, &data[0], rvals) != MBError::SUCCESS)
+            slot.stats->failed = 1;
+        uint32_t latency = static_cast<uint32_t>((now_ns() - start) / n);
+        for(int j = 0; j < n; j++) {
+            slot.latency[i + j] = latency;
+            slot.op_type[i + j] = OP_FIND;
+            if(rvals[j] == MBError::NOT_EXIST)
+                slot.stats->num_miss++;
+            else if(rvals[j] != MBError::SUCCESS)
+                slot.stats->failed = 1;
+        }
+    }
+    slot.stats->num_ops = num_ops;
+    slot.stats->end_ns = now_ns();
+}
+
+static void RunReader(DB &db, int id, Slot &slot)
+{
+    if(batch_size > 1) {
+        RunBatchReader(db, id, slot);
+        return;
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL * (id + 1);
+    int weight = mix[OP_FIND] + mix[OP_PREFIX];
+    std::string key;
+    MBData mbd;
+    for(int64_t i = 0; i < num_ops; i++) {
+        uint64_t r = next_rand(state);
+        get_key(r % num_keys, key);
+        uint8_t op = (int) ((r >> 32) % weight) < mix[OP_FIND] ? OP_FIND : OP_PREFIX;
+        int rval;
+        uint64_t start = now_ns();
+        if(op == OP_FIND) {
+            rval = db.Find(key, mbd);
+        } else {
+            key += "/suffix";
+            rval = db.FindLongestPrefix(key, mbd);
+        }
+        slot.latency[i] = static_cast<uint32_t>(now_ns() - start);
+        slot.op_type[i] = op;
+        if(rval == MBError::NOT_EXIST)
+            slot.stats->num_miss++;
+        else if(rval != MBError::SUCCESS)
+            slot.stats->failed = 1;
+    }
+    slot.stats->num_ops = num_ops;
+    slot.stats->end_ns = now_ns();
+}
+
+// Adds new keys and removes the oldest of them so that the preloaded keys
+// are always found by the readers.
+static void RunUpdater(DB &db, int64_t nops, Slot &slot)
+{
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    int weight = mix[OP_ADD] + mix[OP_REMOVE];
+    uint64_t next_add = num_keys;
+    uint64_t next_remove = num_keys;
+    std::string key;
+    for(int64_t i = 0; i < nops; i++) {
+        uint64_t r = next_rand(state);
+        uint8_t op = (int) (r % weight) < mix[OP_ADD] ? OP_ADD : OP_REMOVE;
+        if(next_remove == next_add)
+            op = OP_ADD;
+        int rval;
+        uint64_t start;
+        if(op == OP_ADD) {
+            get_key(next_add, key);
+            start = now_ns();
+            rval = db.Add(key.data(), key.size(), value_buff.data(), value_size(next_add));
+            next_add++;
+        } else {
+            get_key(next_remove, key);
+            start = now_ns();
+            rval = db.Remove(key);
+            next_remove++;
+        }
+        slot.latency[i] = static_cast<uint32_t>(now_ns() - start);
+        slot.op_type[i] = op;
+        if(rval != MBError::SUCCESS)
+            slot.stats->failed = 1;
+    }
+    slot.stats->num_ops = nops;
+    slot.stats->end_ns = now_ns();
+}
+
+static void ReaderClient(int id, Slot slot, bool updater, int64_t nops)
+{
+    DB db(mbdir.c_str(), CONSTS::ReaderOptions());
+    if(!db.is_open()) {
+        std::cerr << "failed to open reader: " << db.StatusStr() << "\n";
+        slot.stats->failed = 1;
+        return;
+    }
+    WaitForStart();
+    if(updater)
+        RunUpdater(db, nops, slot);
+    else
+        RunReader(db, id, slot);
+    db.Close();
+}
+
+static DB* OpenWriter()
+{
+    int options = CONSTS::WriterOptions();
+    if(async_mode)
+        options |= CONSTS::ASYNC_WRITER_MODE;
+    DB *db = new DB(mbdir.c_str(), options);
+    if(!db->is_open()) {
+        std::cerr << "failed to open writer: " << db->StatusStr() << "\n";
+        exit(1);
+    }
+    return db;
+}
+
+static void CloseWriter(DB *db)
+{
+    while(db->AsyncWriterBusy()) {
+        usleep(100);
+    }
+    db->Close();
+    delete db;
+}
+
+// Clients run in forked processes. The writer process tells the parent when
+// it is ready, runs the updates in direct mode and exits once the parent
+// closes the control pipe and the queue is drained. All clients start at the
+// same time once they have opened the DB.
+static uint64_t RunProcesses(int nreader, std::vector<Slot> &slots)
+{
+    int64_t nupdate = updater_ops(nreader);
+    int ready_pipe[2];
+    int ctrl_pipe[2];
+    if(pipe(ready_pipe) != 0 || pipe(ctrl_pipe) != 0)
+        abort();
+
+    pid_t writer_pid = fork();
+    if(writer_pid == 0) {
+        close(ready_pipe[0]);
+        close(ctrl_pipe[1]);
+        DB *db = OpenWriter();
+        char c = 0;
+        if(write(ready_pipe[1], &c, 1) != 1)
+            exit(1);
+        if(!async_mode) {
+            WaitForStart();
+            RunUpdater(*db, nupdate, slots[nreader]);
+        }
+        while(read(ctrl_pipe[0], &c, 1) > 0) {
+        }
+        CloseWriter(db);
+        exit(0);
+    }
+    close(ready_pipe[1]);
+    close(ctrl_pipe[0]);
+    char c = 0;
+    if(read(ready_pipe[0], &c, 1) != 1) {
+        std::cerr << "writer failed to start\n";
+        exit(1);
+    }
+
+    std::vector<pid_t> pids;
+    int nclient = async_mode ? nreader + 1 : nreader;
+    for(int i = 0; i < nclient; i++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(ctrl_pipe[1]);
+            ReaderClient(i, slots[i], i == nreader, nupdate);
+            exit(0);
+        }
+        pids.push_back(pid);
+    }
+    uint64_t start = StartRound(nreader + 1);
+    for(size_t i = 0; i < pids.size(); i++)
+        waitpid(pids[i], NULL, 0);
+    close(ctrl_pipe[1]);
+    waitpid(writer_pid, NULL, 0);
+    close(ready_pipe[0]);
+    return start;
+}
+
+static uint64_t RunThreads(int nreader, std::vector<Slot> &slots)
+{
+    int64_t nupdate = updater_ops(nreader);
+    DB *db = OpenWriter();
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < nreader; i++)
+        threads.push_back(std::thread(ReaderClient, i, slots[i], false, nupdate));
+    if(async_mode)
+        threads.push_back(std::thread(ReaderClient, nreader, slots[nreader], true, nupdate));
+    else
+        threads.push_back(std::thread([&]() {
+            WaitForStart();
+            RunUpdater(*db, nupdate, slots[nreader]);
+        }));
+    uint64_t start = StartRound(nreader + 1);
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    CloseWriter(db);
+    // The files are removed before the next round.
+    DB::ClearResources(mbdir);
+    return start;
+}
+
+static void Percentiles(std::vector<uint32_t> &samples, std::ostream &out)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    out << "\"p50_us\": " << samples[n * 50 / 100] / 1000.0
+        << ", \"p99_us\": " << samples[n * 99 / 100] / 1000.0
+        << ", \"p999_us\": " << samples[n * 999 / 1000] / 1000.0
+        << ", \"max_us\": " << samples[n - 1] / 1000.0;
+}
+
+static std::string RunRound(int nreader, std::vector<Slot> &slots)
+{
+    // The parent process never opens the db so that the forked clients do
+    // not inherit any mapping of the files removed here.
+    std::string cmd = std::string("rm -f ") + mbdir + "_*";
+    if(system(cmd.c_str()) != 0) {
+    }
+    if(use_threads) {
+        Preload();
+    } else {
+        pid_t pid = fork();
+        if(pid == 0) {
+            Preload();
+            exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+
+    for(int i = 0; i <= nreader; i++)
+        memset(slots[i].stats, 0, sizeof(ClientStats));
+    control->num_ready.store(0, std::memory_order_release);
+    control->started.store(0, std::memory_order_release);
+    uint64_t start = use_threads ? RunThreads(nreader, slots) : RunProcesses(nreader, slots);
+
+    uint64_t end = start;
+    int64_t num_miss = 0;
+    std::vector<uint32_t> samples[NUM_OP_TYPE];
+    for(int i = 0; i <= nreader; i++) {
+        ClientStats *stats = slots[i].stats;
+        if(stats->failed || (stats->num_ops == 0 && (i < nreader || updater_ops(nreader) > 0))) {
+            std::cerr << "client " << i << " failed\n";
+            exit(1);
+        }
+        end = std::max(end, stats->end_ns);
+        num_miss += stats->num_miss;
+        for(int64_t j = 0; j < stats->num_ops; j++)
+            samples[slots[i].op_type[j]].push_back(slots[i].latency[j]);
+    }
+    double elapsed = (end - start) / 1000000000.0;
+
+    std::ostringstream out;
+    int64_t total = 0;
+    out << "    {\"readers\": " << nreader << ", \"elapsed_sec\": " << elapsed
+        << ", \"lookup_misses\": " << num_miss << ",\n     \"ops\": {";
+    bool first = true;
+    for(int t = 0; t < NUM_OP_TYPE; t++) {
+        if(samples[t].empty())
+            continue;
+        total += samples[t].size();
+        out << (first ? "\n" : ",\n") << "      \"" << op_names[t] << "\": {\"count\": "
+            << samples[t].size() << ", \"ops_per_sec\": "
+            << (uint64_t) (samples[t].size() / elapsed) << ", ";
+        Percentiles(samples[t], out);
+        out << "}";
+        first = false;
+    }
+    out << "},\n     \"total_ops_per_sec\": " << (uint64_t) (total / elapsed) << "}";
+
+    std::cerr << "readers: " << nreader << "  ops/s: " << (uint64_t) (total / elapsed) << std::endl;
+    return out.str();
+}
+
+static void Usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " [-d db_dir] [-n num_keys] [-o ops_per_reader]"
+              << " [-r max_reader] [-t] [-a] [-k key_size] [-v value_size]"
+              << " [-m find:prefix:add:remove] [-b batch_size] [-j json_file]\n"
+              << "  -t: run clients as threads instead of processes\n"
+              << "  -a: run updates through the async writer\n"
+              << "  -b: look up keys with FindBatch; prefix lookups are not run\n"
+              << "  sizes are either fixed (16) or uniform in a range (8-64)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "d:n:o:r:tak:v:m:b:j:")) != -1) {
+        switch(opt) {
+            case 'd':
+                mbdir = optarg;
+                if(mbdir[mbdir.length()-1] != '/')
+                    mbdir += "/";
+                break;
+            case 'n':
+                num_keys = atoi(optarg);
+                break;
+            case 'o':
+                num_ops = atoi(optarg);
+                break;
+            case 'r':
+                max_reader = atoi(optarg);
+                break;
+            case 't':
+                use_threads = true;
+                break;
+            case 'a':
+                async_mode = true;
+                break;
+            case 'k':
+                if(!parse_dist(optarg, key_min, key_max)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'v':
+                if(!parse_dist(optarg, value_min, value_max)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm':
+                if(!parse_mix(optarg)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                break;
+            case 'j':
+                json_path = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if(num_keys <= 0 || num_ops <= 0 || max_reader <= 0 || batch_size <= 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    std::string cmd = std::string("mkdir -p ") + mbdir;
+    if(system(cmd.c_str()) != 0) {
+    }
+    DB::SetLogFile(mbdir + "mabain.log");
+    value_buff.assign(value_max, 'v');
+
+    // Samples of all clients in shared memory. The last slot of a round is
+    // used by the updater.
+    int64_t max_ops = std::max((int64_t) num_ops, updater_ops(max_reader));
+    size_t slot_size = sizeof(ClientStats) + max_ops * (sizeof(uint32_t) + sizeof(uint8_t));
+    slot_size = (slot_size + 7) / 8 * 8;
+    size_t buff_size = sizeof(Control) + slot_size * (max_reader + 1);
+    uint8_t *buff = (uint8_t *) mmap(NULL, buff_size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(buff == MAP_FAILED) {
+        std::cerr << "failed to allocate latency buffer\n";
+        return 1;
+    }
+    control = reinterpret_cast<Control *>(buff);
+
+    std::vector<std::string> rounds;
+    for(int n = 1; ; n *= 2) {
+        if(n > max_reader)
+            n = max_reader;
+        // The updater always takes the slot after the last reader.
+        std::vector<Slot> slots(n + 1);
+        for(int i = 0; i <= n; i++) {
+            uint8_t *ptr = buff + sizeof(Control) + slot_size * (i < n ? i : max_reader);
+            slots[i].stats = reinterpret_cast<ClientStats *>(ptr);
+            slots[i].latency = reinterpret_cast<uint32_t *>(ptr + sizeof(ClientStats));
+            slots[i].op_type = ptr + sizeof(ClientStats) + max_ops * sizeof(uint32_t);
+        }
+        rounds.push_back(RunRound(n, slots));
+        if(n == max_reader)
+            break;
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"config\": {\"num_keys\": " << num_keys << ", \"ops_per_reader\": " << num_ops
+         << ", \"max_reader\": " << max_reader
+         << ", \"clients\": \"" << (use_threads ? "threads" : "processes")
+         << "\", \"writer\": \"" << (async_mode ? "async" : "direct")
+         << "\", \"key_size\": [" << key_min << ", " << key_max
+         << "], \"value_size\": [" << value_min << ", " << value_max
+         << "], \"batch_size\": " << batch_size << ", \"mix\": {";
+    for(int t = 0; t < NUM_OP_TYPE; t++)
+        json << (t ? ", " : "") << "\"" << op_names[t] << "\": " << mix[t];
+    json << "}},\n  \"rounds\": [\n";
+    for(size_t i = 0; i < rounds.size(); i++)
+        json << rounds[i] << (i + 1 < rounds.size() ? ",\n" : "\n");
+    json << "  ]\n}\n";
+
+    if(json_path.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(json_path.c_str());
+        out << json.str();
+    }
+
+    munmap(buff, buff_size);
+    DB::CloseLogFile();
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Replication lag benchmark. One thread adds keys to a database with a
+// change feed as fast as it can while another thread tails the feed and
+// applies the changes to a replica. Each value carries the time it was
+// added; the lag of a change is the time from the add until the change is
+// applied to the replica.
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mabain/db.h>
+#include <mabain/change_feed.h>
+
+using namespace mabain;
+
+static std::string mbdir = "/var/tmp/mabain_test/";
+static std::string replica_dir = "/var/tmp/mabain_test/replica/";
+static int num_keys = 500000;
+static int64_t feed_size = CHANGE_FEED_SIZE_DEFAULT;
+static std::atomic<bool> writer_done(false);
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void Writer(DB *db, uint64_t *elapsed)
+{
+    uint64_t start = now_us();
+    char value[64];
+    memset(value, 'v', sizeof(value));
+    for(int i = 0; i < num_keys; i++) {
+        uint64_t ts = now_us();
+        memcpy(value, &ts, sizeof(ts));
+        std::string key = "key_" + std::to_string(i);
+        if(db->Add(key.data(), key.size(), value, sizeof(value)) != MBError::SUCCESS) {
+            std::cerr << "failed to add " << key << "\n";
+            exit(1);
+        }
+    }
+    *elapsed = now_us() - start;
+    writer_done.store(true);
+}
+
+static void Replicator(DB *replica, std::vector<uint32_t> *lags, uint64_t *max_seq_lag)
+{
+    ChangeSubscriber sub(mbdir);
+    if(!sub.is_open() || sub.Subscribe(0) != MBError::SUCCESS) {
+        std::cerr << "failed to subscribe\n";
+        exit(1);
+    }
+
+    MBChange change;
+    while(true) {
+        int rval = sub.Next(change);
+        if(rval == MBError::TRY_AGAIN) {
+            if(writer_done.load() && sub.Position() == sub.EndSeq())
+                break;
+            std::this_thread::yield();
+            continue;
+        }
+        if(rval != MBError::SUCCESS) {
+            std::cerr << "replica fell behind at change " << sub.Position() << ": "
+                      << MBError::get_error_str(rval) << "\n";
+            exit(1);
+        }
+        if(ChangeSubscriber::Apply(*replica, change) != MBError::SUCCESS) {
+            std::cerr << "failed to apply change " << change.seq << "\n";
+            exit(1);
+        }
+
+        uint64_t ts;
+        memcpy(&ts, change.value.data(), sizeof(ts));
+        lags->push_back(static_cast<uint32_t>(now_us() - ts));
+        uint64_t seq_lag = sub.EndSeq() - sub.Position();
+        if(seq_lag > *max_seq_lag)
+            *max_seq_lag = seq_lag;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1) {
+        mbdir = std::string(argv[1]);
+        if(mbdir[mbdir.length()-1] != '/')
+            mbdir += "/";
+        replica_dir = mbdir + "replica/";
+    }
+    if(argc > 2) {
+        num_keys = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        feed_size = atoll(argv[3]) * 1024 * 1024;
+    }
+    if(num_keys <= 0 || feed_size <= 0) {
+        std::cerr << "usage: " << argv[0] << " [db_dir] [num_keys] [feed_size_mb]\n";
+        return 1;
+    }
+
+    std::string cmd = "rm -rf " + mbdir + "_mabain_* " + replica_dir + " && mkdir -p " +
+                      replica_dir;
+    if(system(cmd.c_str()) != 0) {
+    }
+
+    DB::SetLogFile("/var/tmp/mabain_test/mabain.log");
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = mbdir.c_str();
+    config.options = CONSTS::WriterOptions() | CONSTS::USE_CHANGE_FEED;
+    config.change_feed_size = feed_size;
+    DB db(config);
+    DB replica(replica_dir.c_str(), CONSTS::WriterOptions());
+    if(!db.is_open() || !replica.is_open()) {
+        std::cerr << "failed to open db\n";
+        return 1;
+    }
+
+    std::vector<uint32_t> lags;
+    lags.reserve(num_keys);
+    uint64_t max_seq_lag = 0;
+    uint64_t write_us = 0;
+    uint64_t start = now_us();
+    std::thread replicator(Replicator, &replica, &lags, &max_seq_lag);
+    std::thread writer(Writer, &db, &write_us);
+    writer.join();
+    replicator.join();
+    uint64_t total_us = now_us() - start;
+
+    std::sort(lags.begin(), lags.end());
+    size_t n = lags.size();
+    std::cout << "keys: " << num_keys << "  replica count: " << replica.Count() << std::endl;
+    std::cout << "writer ops/s: " << (uint64_t) (num_keys * 1000000.0 / write_us)
+              << "  replicated ops/s: " << (uint64_t) (n * 1000000.0 / total_us) << std::endl;
+    std::cout << "lag us p50: " << lags[n / 2] << "  p99: " << lags[n * 99 / 100]
+              << "  max: " << lags[n - 1] << "  max changes behind: " << max_seq_lag
+              << std::endl;
+
+    replica.Close();
+    db.Close();
+    DB::CloseLogFile();
+    return 0;
+}
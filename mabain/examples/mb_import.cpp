@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Bulk import of key/value pairs into an empty database. Each input line
+// holds a key and a value separated by a tab; the input does not have to
+// be sorted. With -i the pairs are added one by one instead, for
+// comparing the load time and the index size.
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include <mabain/db.h>
+#include <mabain/dict.h>
+#include <mabain/bulk_loader.h>
+
+using namespace mabain;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " -d db_dir -f input_file [-t num_threads] [-i]\n";
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mbdir;
+    std::string input;
+    int num_threads = BULK_LOAD_THREADS_DEFAULT;
+    bool incremental = false;
+    int opt;
+    while((opt = getopt(argc, argv, "d:f:t:i")) != -1) {
+        switch(opt) {
+            case 'd':
+                mbdir = optarg;
+                break;
+            case 'f':
+                input = optarg;
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'i':
+                incremental = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if(mbdir.empty() || input.empty() || num_threads <= 0)
+        usage(argv[0]);
+    if(mbdir[mbdir.length()-1] != '/')
+        mbdir += "/";
+
+    std::ifstream in(input.c_str());
+    if(!in.is_open()) {
+        std::cerr << "failed to open " << input << "\n";
+        return 1;
+    }
+
+    DB db(mbdir.c_str(), CONSTS::WriterOptions());
+    if(!db.is_open()) {
+        std::cerr << "failed to open db: " << db.StatusStr() << "\n";
+        return 1;
+    }
+    if(db.Count() != 0) {
+        std::cerr << mbdir << " is not empty\n";
+        return 1;
+    }
+
+    uint64_t start = now_us();
+    BulkLoader loader(db, num_threads);
+    std::string line;
+    int64_t num_line = 0;
+    int64_t num_skip = 0;
+    int rval;
+    while(std::getline(in, line)) {
+        num_line++;
+        size_t pos = line.find('\t');
+        if(pos == std::string::npos) {
+            num_skip++;
+            continue;
+        }
+        if(incremental)
+            rval = db.Add(line.data(), pos, line.data() + pos + 1, line.size() - pos - 1, true);
+        else
+            rval = loader.Add(line.data(), pos, line.data() + pos + 1, line.size() - pos - 1);
+        if(rval != MBError::SUCCESS)
+            num_skip++;
+    }
+    uint64_t read_us = now_us() - start;
+
+    if(!incremental) {
+        rval = loader.Load();
+        if(rval != MBError::SUCCESS) {
+            std::cerr << "bulk load failed: " << MBError::get_error_str(rval) << "\n";
+            return 1;
+        }
+    }
+    uint64_t total_us = now_us() - start;
+
+    IndexHeader *header = db.GetDictPtr()->GetHeaderPtr();
+    std::cout << "lines: " << num_line << "  skipped: " << num_skip
+              << "  keys: " << db.Count() << std::endl;
+    std::cout << "read: " << read_us / 1000 << " ms  total: " << total_us / 1000 << " ms"
+              << std::endl;
+    std::cout << "index size: " << header->m_index_offset
+              << "  data size: " << header->m_data_offset << std::endl;
+    db.Close();
+    return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Shared memory queue benchmark. One async writer process and 1, 2, 4, ...
+// up to 64 producer processes adding keys through the queue. Reports the
+// update throughput and the enqueue latency percentiles for each round.
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <mabain/db.h>
+
+using namespace mabain;
+
+static std::string mbdir = "/var/tmp/mabain_test/";
+static int max_producer = 64;
+static int num_ops = 10000;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The writer process tells the parent when it is ready and waits for the
+// parent to close the control pipe. It exits once the queue is drained.
+static void Writer(int ready_fd, int ctrl_fd)
+{
+    DB db(mbdir.c_str(), CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    if(!db.is_open()) {
+        std::cerr << "failed to open writer: " << db.StatusStr() << "\n";
+        exit(1);
+    }
+
+    char c = 0;
+    if(write(ready_fd, &c, 1) != 1)
+        exit(1);
+    while(read(ctrl_fd, &c, 1) > 0) {
+    }
+
+    while(db.AsyncWriterBusy()) {
+        usleep(100);
+    }
+    db.Close();
+    exit(0);
+}
+
+static void Producer(int id, uint32_t *latency)
+{
+    DB db(mbdir.c_str(), CONSTS::ReaderOptions());
+    if(!db.is_open()) {
+        std::cerr << "failed to open reader: " << db.StatusStr() << "\n";
+        exit(1);
+    }
+
+    std::string key;
+    for(int i = 0; i < num_ops; i++) {
+        key = std::string("p") + std::to_string(id) + "_" + std::to_string(i);
+        uint64_t start = now_ns();
+        if(db.Add(key, key) != MBError::SUCCESS) {
+            std::cerr << "producer " << id << " failed to add " << key << "\n";
+            exit(1);
+        }
+        latency[i] = static_cast<uint32_t>(now_ns() - start);
+    }
+
+    db.Close();
+    exit(0);
+}
+
+static void RunRound(int nproducer, uint32_t *latency)
+{
+    // The parent process never opens the db so that the children do not
+    // inherit any mapping of the files removed here.
+    std::string cmd = std::string("rm -f ") + mbdir + "_*";
+    if(system(cmd.c_str()) != 0) {
+    }
+
+    int ready_pipe[2];
+    int ctrl_pipe[2];
+    if(pipe(ready_pipe) != 0 || pipe(ctrl_pipe) != 0)
+        abort();
+
+    pid_t writer_pid = fork();
+    if(writer_pid == 0) {
+        close(ready_pipe[0]);
+        close(ctrl_pipe[1]);
+        Writer(ready_pipe[1], ctrl_pipe[0]);
+    }
+    close(ready_pipe[1]);
+    close(ctrl_pipe[0]);
+    char c;
+    if(read(ready_pipe[0], &c, 1) != 1) {
+        std::cerr << "writer failed to start\n";
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    std::vector<pid_t> pids;
+    for(int i = 0; i < nproducer; i++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(ctrl_pipe[1]);
+            Producer(i, latency + (size_t) i * num_ops);
+        }
+        pids.push_back(pid);
+    }
+    int status;
+    int nfailed = 0;
+    for(size_t i = 0; i < pids.size(); i++) {
+        waitpid(pids[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            nfailed++;
+    }
+    close(ctrl_pipe[1]);
+    waitpid(writer_pid, NULL, 0);
+    uint64_t elapsed = now_ns() - start;
+    close(ready_pipe[0]);
+    if(nfailed > 0) {
+        std::cerr << nfailed << " of " << nproducer << " producers failed\n";
+        exit(1);
+    }
+
+    size_t total = (size_t) nproducer * num_ops;
+    std::sort(latency, latency + total);
+    std::cout << "producers: " << nproducer
+              << "  ops/s: " << (uint64_t) (total * 1000000000.0 / elapsed)
+              << "  enqueue p50: " << latency[total / 2] / 1000.0 << "us"
+              << "  p99: " << latency[total * 99 / 100] / 1000.0 << "us"
+              << "  max: " << latency[total - 1] / 1000.0 << "us" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1) {
+        mbdir = std::string(argv[1]);
+        if(mbdir[mbdir.length()-1] != '/')
+            mbdir += "/";
+    }
+    if(argc > 2) {
+        max_producer = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        num_ops = atoi(argv[3]);
+    }
+    if(max_producer <= 0 || num_ops <= 0) {
+        std::cerr << "usage: " << argv[0] << " [db_dir] [max_producer] [ops_per_producer]\n";
+        return 1;
+    }
+
+    std::string cmd = std::string("mkdir -p ") + mbdir;
+    if(system(cmd.c_str()) != 0) {
+    }
+    DB::SetLogFile(mbdir + "mabain.log");
+
+    // latency samples of all producers in shared memory
+    size_t buff_size = (size_t) max_producer * num_ops * sizeof(uint32_t);
+    void *buff = mmap(NULL, buff_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(buff == MAP_FAILED) {
+        std::cerr << "failed to allocate latency buffer\n";
+        return 1;
+    }
+
+    for(int n = 1; n <= max_producer; n *= 2) {
+        RunRound(n, reinterpret_cast<uint32_t *>(buff));
+    }
+
+    munmap(buff, buff_size);
+    DB::CloseLogFile();
+    return 0;
+}
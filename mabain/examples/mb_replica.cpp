@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Local replica of a database written with USE_CHANGE_FEED. Tails the
+// change feed of the source and applies the changes to the replica. The
+// position is kept in the replica directory so that the replica resumes
+// where it stopped. A new replica starts from a copy of the source (a
+// backup) and the sequence number the feed had when the copy was taken,
+// or from the oldest retained change if the feed holds the full history.
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include <mabain/db.h>
+#include <mabain/change_feed.h>
+
+using namespace mabain;
+
+static volatile sig_atomic_t stop_replica = 0;
+
+static void handle_signal(int sig)
+{
+    stop_replica = 1;
+}
+
+static uint64_t load_position(const std::string &path)
+{
+    uint64_t seq = 0;
+    std::ifstream in(path.c_str());
+    if(in.is_open())
+        in >> seq;
+    return seq;
+}
+
+static void save_position(const std::string &path, uint64_t seq)
+{
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp.c_str(), std::ios::trunc);
+    out << seq << std::endl;
+    out.close();
+    if(rename(tmp.c_str(), path.c_str()) != 0)
+        std::cerr << "failed to save position " << seq << "\n";
+}
+
+static void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " -s source_dir -d replica_dir [-q start_seq]\n";
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string src_dir;
+    std::string dst_dir;
+    uint64_t start_seq = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "s:d:q:")) != -1) {
+        switch(opt) {
+            case 's':
+                src_dir = optarg;
+                break;
+            case 'd':
+                dst_dir = optarg;
+                break;
+            case 'q':
+                start_seq = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if(src_dir.empty() || dst_dir.empty())
+        usage(argv[0]);
+    if(dst_dir[dst_dir.length()-1] != '/')
+        dst_dir += "/";
+
+    std::string pos_path = dst_dir + "_replica_seq";
+    if(start_seq == 0)
+        start_seq = load_position(pos_path);
+
+    ChangeSubscriber sub(src_dir);
+    if(!sub.is_open()) {
+        std::cerr << "no change feed in " << src_dir << "\n";
+        return 1;
+    }
+    int rval = sub.Subscribe(start_seq);
+    if(rval != MBError::SUCCESS) {
+        std::cerr << "cannot start from change " << start_seq << ": "
+                  << MBError::get_error_str(rval) << "; oldest retained change is "
+                  << sub.FirstSeq() << "\n";
+        return 1;
+    }
+
+    DB replica(dst_dir.c_str(), CONSTS::WriterOptions());
+    if(!replica.is_open()) {
+        std::cerr << "failed to open replica: " << replica.StatusStr() << "\n";
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    std::cout << "replicating from change " << sub.Position() << std::endl;
+
+    MBChange change;
+    uint64_t saved = sub.Position();
+    int64_t num_applied = 0;
+    int exit_code = 0;
+    while(!stop_replica) {
+        rval = sub.Next(change);
+        if(rval == MBError::SUCCESS) {
+            rval = ChangeSubscriber::Apply(replica, change);
+            if(rval != MBError::SUCCESS) {
+                std::cerr << "failed to apply change " << change.seq << ": "
+                          << MBError::get_error_str(rval) << "\n";
+                exit_code = 1;
+                break;
+            }
+            num_applied++;
+            continue;
+        }
+        if(rval != MBError::TRY_AGAIN) {
+            std::cerr << "replica fell behind at change " << sub.Position() << " ("
+                      << MBError::get_error_str(rval) << "), restore it from a backup\n";
+            exit_code = 2;
+            break;
+        }
+
+        // Caught up with the writer
+        if(saved != sub.Position()) {
+            replica.Flush();
+            saved = sub.Position();
+            save_position(pos_path, saved);
+        }
+        usleep(1000);
+    }
+
+    replica.Flush();
+    save_position(pos_path, sub.Position());
+    std::cout << "applied " << num_applied << " changes, next change " << sub.Position()
+              << std::endl;
+    replica.Close();
+    return exit_code;
+}
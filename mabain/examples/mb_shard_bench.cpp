@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Sharded database write benchmark. Adds the same number of keys into a
+// sharded database with 1, 2, 4, ... shards, using one client thread per
+// shard, and reports the update throughput until all shards are drained.
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mabain/sharded_db.h>
+
+using namespace mabain;
+
+static std::string mbdir = "/var/tmp/mabain_test/sharded/";
+static int max_shard = 8;
+static int num_keys = 200000;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void Client(ShardedDB *sdb, int id, int nthread)
+{
+    std::string key;
+    for(int i = id; i < num_keys; i += nthread) {
+        key = "key_" + std::to_string(i);
+        if(sdb->Add(key, key) != MBError::SUCCESS) {
+            std::cerr << "failed to add " << key << "\n";
+            exit(1);
+        }
+    }
+}
+
+static void RunRound(int nshard)
+{
+    std::string cmd = std::string("rm -rf ") + mbdir;
+    if(system(cmd.c_str()) != 0) {
+    }
+    ShardedDB::ClearResources(mbdir);
+
+    ShardedDB sdb(mbdir.c_str(), CONSTS::WriterOptions(), nshard);
+    if(!sdb.is_open()) {
+        std::cerr << "failed to open sharded db: " << sdb.StatusStr() << "\n";
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < nshard; i++)
+        threads.push_back(std::thread(Client, &sdb, i, nshard));
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    while(sdb.AsyncWriterBusy()) {
+        usleep(100);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    std::cout << "shards: " << nshard
+              << "  count: " << sdb.Count()
+              << "  ops/s: " << (uint64_t) (num_keys * 1000000000.0 / elapsed) << std::endl;
+    sdb.Close();
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1) {
+        mbdir = std::string(argv[1]);
+        if(mbdir[mbdir.length()-1] != '/')
+            mbdir += "/";
+    }
+    if(argc > 2) {
+        max_shard = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        num_keys = atoi(argv[3]);
+    }
+    if(max_shard <= 0 || max_shard > MB_MAX_NUM_SHARD || num_keys <= 0) {
+        std::cerr << "usage: " << argv[0] << " [db_dir] [max_shard] [num_keys]\n";
+        return 1;
+    }
+
+    DB::SetLogFile("/var/tmp/mabain_test/mabain.log");
+    for(int n = 1; n <= max_shard; n *= 2) {
+        RunRound(n);
+    }
+    DB::CloseLogFile();
+    return 0;
+}
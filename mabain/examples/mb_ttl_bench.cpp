@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+// Expiry benchmark. Adds keys with a TTL in rounds; the writer removes the
+// keys of the earlier rounds while it adds, once their one-second bucket
+// is due. The remaining keys are removed by ExpireEntries at the end.
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+
+#include <mabain/db.h>
+
+using namespace mabain;
+
+static std::string mbdir = "/var/tmp/mabain_test/";
+static int num_keys = 1000000;
+static int64_t ttl_ms = 1000;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void print_stats(DB &db, const char *phase, uint64_t elapsed_us)
+{
+    MBExpiryStats stats;
+    db.GetExpiryStats(stats);
+    std::cout << phase << ": " << elapsed_us / 1000 << " ms  count: " << db.Count()
+              << "  expired: " << stats.num_expired << "  reclaimed bytes: "
+              << stats.bytes_reclaimed << "  pending: " << stats.num_pending << std::endl;
+    if(stats.sweep_time_us > 0)
+        std::cout << "    expired/s in sweeps: "
+                  << (uint64_t) (stats.num_expired * 1000000.0 / stats.sweep_time_us)
+                  << "  sweep time us: " << stats.sweep_time_us << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1) {
+        mbdir = std::string(argv[1]);
+        if(mbdir[mbdir.length()-1] != '/')
+            mbdir += "/";
+    }
+    if(argc > 2) {
+        num_keys = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        ttl_ms = atoll(argv[3]);
+    }
+    if(num_keys <= 0 || ttl_ms <= 0) {
+        std::cerr << "usage: " << argv[0] << " [db_dir] [num_keys] [ttl_ms]\n";
+        return 1;
+    }
+
+    std::string cmd = "rm -rf " + mbdir + "_mabain_*";
+    if(system(cmd.c_str()) != 0) {
+    }
+
+    DB::SetLogFile("/var/tmp/mabain_test/mabain.log");
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = mbdir.c_str();
+    config.options = CONSTS::WriterOptions();
+    config.memcap_index = 512*1024*1024LL;
+    config.memcap_data = 512*1024*1024LL;
+    DB db(config);
+    if(!db.is_open()) {
+        std::cerr << "failed to open db\n";
+        return 1;
+    }
+
+    char value[64];
+    memset(value, 'v', sizeof(value));
+    uint64_t start = now_us();
+    for(int i = 0; i < num_keys; i++) {
+        std::string key = "key_" + std::to_string(i);
+        if(db.AddWithTTL(key.data(), key.size(), value, sizeof(value), ttl_ms) !=
+               MBError::SUCCESS) {
+            std::cerr << "failed to add " << key << "\n";
+            return 1;
+        }
+    }
+    uint64_t add_us = now_us() - start;
+    std::cout << "add ops/s: " << (uint64_t) (num_keys * 1000000.0 / add_us) << std::endl;
+    print_stats(db, "adds", add_us);
+
+    // The bucket of the last key is due one second after it expired.
+    usleep((ttl_ms + 1100) * 1000);
+    start = now_us();
+    int rval = db.ExpireEntries();
+    if(rval != MBError::SUCCESS)
+        std::cerr << "failed to expire entries: " << MBError::get_error_str(rval) << "\n";
+    print_stats(db, "final sweep", now_us() - start);
+
+    db.Close();
+    DB::CloseLogFile();
+    return 0;
+}
@@ -18,6 +18,8 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
+#include <errno.h>
 
 #include "async_writer.h"
 #include "error.h"
@@ -51,6 +53,18 @@ static void free_async_node(AsyncNode *node_ptr)
     node_ptr->type = MABAIN_ASYNC_TYPE_NONE;
 }
 
+// Key and data buffers of a queued update
+void AsyncWriter::NodeBuffers(AsyncNode *node_ptr, char* &key, char* &data) const
+{
+#ifdef __SHM_QUEUE__
+    key = reinterpret_cast<char *>(ShmqRecordPtr(header, node_ptr->rec_off)) + MB_SHMQ_REC_HDR_SIZE;
+    data = key + node_ptr->key_len;
+#else
+    key = node_ptr->key;
+    data = node_ptr->data;
+#endif
+}
+
 AsyncWriter::AsyncWriter(DB *db_ptr)
                        : db(db_ptr),
                          tid(0),
@@ -72,6 +86,8 @@ AsyncWriter::AsyncWriter(DB *db_ptr)
     dict = db->GetDictPtr();
     if(dict == NULL)
         throw (int) MBError::NOT_INITIALIZED;
+    online_backup = NULL;
+    dict->GetHeaderPtr()->backup_flag.store(0, std::memory_order_release);
 
 #ifdef __SHM_QUEUE__
     // initialize shared memory queue pointer
@@ -81,6 +97,7 @@ AsyncWriter::AsyncWriter(DB *db_ptr)
     char *hdr_ptr = (char *) header;
     queue = reinterpret_cast<AsyncNode *>(hdr_ptr + RollableFile::page_size);
     header->rc_flag.store(0, std::memory_order_release);
+    header->writer_waiting.store(0, std::memory_order_release);
 #else
     queue = new AsyncNode[MB_MAX_NUM_SHM_QUEUE_NODE];
     memset(queue, 0, MB_MAX_NUM_SHM_QUEUE_NODE * sizeof(AsyncNode));
@@ -137,7 +154,10 @@ int AsyncWriter::StopAsyncThread()
 
     stop_processing = true;
 
-#ifndef __SHM_QUEUE__
+#ifdef __SHM_QUEUE__
+    header->writer_futex.fetch_add(1, std::memory_order_release);
+    ShmFutexWake(&header->writer_futex);
+#else
     for(int i = 0; i < MB_MAX_NUM_SHM_QUEUE_NODE; i++)
     {
         pthread_cond_signal(&queue[i].cond);
@@ -169,7 +189,9 @@ int AsyncWriter::StopAsyncThread()
 bool AsyncWriter::Busy() const
 {
     uint32_t index = queue_index.load(std::memory_order_consume);
-    return index != writer_index || is_rc_running;
+    return index != writer_index || is_rc_running ||
+           dict->GetHeaderPtr()->backup_flag.load(std::memory_order_consume) != 0 ||
+           dict->GetHeaderPtr()->journal_pending.load(std::memory_order_consume) != 0;
 }
 #endif
 
@@ -205,9 +227,149 @@ int AsyncWriter::PrepareSlot(AsyncNode *node_ptr) const
 }
 #endif
 
+#ifndef __SHM_QUEUE__
+// Reserve num consecutive slots with one fetch_add and lock all of them.
+// num must not be bigger than the queue size.
+int AsyncWriter::AcquireSlots(AsyncNode **node_ptrs, int num)
+{
+    uint32_t index = queue_index.fetch_add(num, std::memory_order_release);
+    for(int i = 0; i < num; i++)
+    {
+        AsyncNode *node_ptr = queue + ((index + i) % MB_MAX_NUM_SHM_QUEUE_NODE);
+        if(pthread_mutex_lock(&node_ptr->mutex) != 0)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "failed to lock mutex");
+            // The reserved slots cannot be given back. Publish the ones
+            // we hold as no-ops so that the writer does not stall on them.
+            for(int j = 0; j < i; j++)
+            {
+                node_ptrs[j]->type = MABAIN_ASYNC_TYPE_NONE;
+                PrepareSlot(node_ptrs[j]);
+            }
+            return MBError::MUTEX_ERROR;
+        }
+
+        while(node_ptr->in_use.load(std::memory_order_consume))
+        {
+            pthread_cond_wait(&node_ptr->cond, &node_ptr->mutex);
+        }
+        node_ptrs[i] = node_ptr;
+    }
+
+    return MBError::SUCCESS;
+}
+#endif
+
+#ifndef __SHM_QUEUE__
+// The writer thread can only be waiting for the first slot of the run.
+int AsyncWriter::PrepareSlots(AsyncNode **node_ptrs, int num) const
+{
+    for(int i = 0; i < num; i++)
+        node_ptrs[i]->in_use.store(true, std::memory_order_release);
+    pthread_cond_signal(&node_ptrs[0]->cond);
+
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num; i++)
+    {
+        if(pthread_mutex_unlock(&node_ptrs[i]->mutex) != 0)
+            rval = MBError::MUTEX_ERROR;
+    }
+    return rval;
+}
+#endif
+
+#ifndef __SHM_QUEUE__
+int AsyncWriter::SubmitBatch(char type, const std::string *keys, const std::string *values,
+                             int num, bool overwrite)
+{
+    if(stop_processing)
+        return MBError::DB_CLOSED;
+
+    // Runs are limited to half of the queue so that other users of the
+    // queue are not starved while a run is being filled.
+    const int max_run = MB_MAX_NUM_SHM_QUEUE_NODE / 2;
+    AsyncNode *node_ptrs[max_run];
+
+    int rval = MBError::SUCCESS;
+    for(int start = 0; start < num && rval == MBError::SUCCESS; start += max_run)
+    {
+        int run = num - start;
+        if(run > max_run)
+            run = max_run;
+
+        rval = AcquireSlots(node_ptrs, run);
+        if(rval != MBError::SUCCESS)
+            break;
+
+        for(int i = 0; i < run; i++)
+        {
+            AsyncNode *node_ptr = node_ptrs[i];
+            const std::string &key = keys[start + i];
+            node_ptr->key = (char *) malloc(key.size());
+            if(node_ptr->key == NULL)
+            {
+                rval = MBError::NO_MEMORY;
+                break;
+            }
+            memcpy(node_ptr->key, key.data(), key.size());
+            node_ptr->key_len = key.size();
+            if(values != NULL)
+            {
+                const std::string &value = values[start + i];
+                node_ptr->data = (char *) malloc(value.size());
+                if(node_ptr->data == NULL)
+                {
+                    rval = MBError::NO_MEMORY;
+                    break;
+                }
+                memcpy(node_ptr->data, value.data(), value.size());
+                node_ptr->data_len = value.size();
+            }
+            node_ptr->overwrite = overwrite;
+            node_ptr->expiry = 0;
+            node_ptr->type = type;
+        }
+
+        if(rval != MBError::SUCCESS)
+        {
+            // Publish the whole run anyway; incomplete slots become no-ops.
+            for(int i = 0; i < run; i++)
+            {
+                if(node_ptrs[i]->type != type)
+                {
+                    free_async_node(node_ptrs[i]);
+                    node_ptrs[i]->type = MABAIN_ASYNC_TYPE_NONE;
+                }
+            }
+        }
+
+        int prval = PrepareSlots(node_ptrs, run);
+        if(rval == MBError::SUCCESS)
+            rval = prval;
+    }
+
+    return rval;
+}
+#endif
+
+#ifndef __SHM_QUEUE__
+int AsyncWriter::AddBatch(const std::string *keys, const std::string *values, int num,
+                          bool overwrite)
+{
+    return SubmitBatch(MABAIN_ASYNC_TYPE_ADD, keys, values, num, overwrite);
+}
+#endif
+
+#ifndef __SHM_QUEUE__
+int AsyncWriter::RemoveBatch(const std::string *keys, int num)
+{
+    return SubmitBatch(MABAIN_ASYNC_TYPE_REMOVE, keys, NULL, num, false);
+}
+#endif
+
 #ifndef __SHM_QUEUE__
 int AsyncWriter::Add(const char *key, int key_len, const char *data,
-                     int data_len, bool overwrite)
+                     int data_len, bool overwrite, int64_t expiry)
 {
     if(stop_processing)
         return MBError::DB_CLOSED;
@@ -229,6 +391,7 @@ int AsyncWriter::Add(const char *key, int key_len, const char *data,
     node_ptr->key_len = key_len;
     node_ptr->data_len = data_len;
     node_ptr->overwrite = overwrite;
+    node_ptr->expiry = expiry;
 
     node_ptr->type = MABAIN_ASYNC_TYPE_ADD;
 
@@ -338,45 +501,43 @@ int AsyncWriter::ProcessTask(int ntasks, bool rc_mode)
     MBData mbd;
     int rval = MBError::SUCCESS;
     int count = 0;
-#ifdef __SHM_QUEUE__
-    struct timespec tm_exp;
-#endif
+    int node_type;
+    char *key_buff;
+    char *data_buff;
 
     while(count < ntasks)
     {
 #ifdef __SHM_QUEUE__
-        node_ptr = &queue[header->writer_index % header->async_queue_size];
-        tm_exp.tv_sec = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
-        tm_exp.tv_nsec = 0;
-        rval = pthread_mutex_timedlock(&node_ptr->mutex, &tm_exp);
-        if(rval == ETIMEDOUT)
-        {
-            Logger::Log(LOG_LEVEL_WARN, "mutex lock timeout, need to re-intialize");
-            InitShmMutex(&node_ptr->mutex);
-            count = ntasks;
-            continue;
-        }
-        else if(rval != 0)
+        // Do not wait for slots that are not published yet. They are handled
+        // by the async writer thread once rc is done.
+        node_ptr = ShmqNextSlot(false);
+        if(node_ptr != NULL)
 #else
         node_ptr = &queue[writer_index % MB_MAX_NUM_SHM_QUEUE_NODE];
         if(pthread_mutex_lock(&node_ptr->mutex) != 0)
-#endif
         {
             Logger::Log(LOG_LEVEL_ERROR, "failed to lock mutex");
             throw (int) MBError::MUTEX_ERROR;
         }
 
         if(node_ptr->in_use.load(std::memory_order_consume))
+#endif
         {
+            node_type = node_ptr->type;
+            NodeBuffers(node_ptr, key_buff, data_buff);
             switch(node_ptr->type)
             {
                 case MABAIN_ASYNC_TYPE_ADD:
                     if(rc_mode)
                         mbd.options = CONSTS::OPTION_RC_MODE;
-                    mbd.buff = (uint8_t *) node_ptr->data;
+                    mbd.buff = (uint8_t *) data_buff;
                     mbd.data_len = node_ptr->data_len;
+                    mbd.expiry = node_ptr->expiry;
                     try {
-                        rval = dict->Add((uint8_t *)node_ptr->key, node_ptr->key_len, mbd, node_ptr->overwrite);
+                        rval = dict->Add((uint8_t *)key_buff, node_ptr->key_len, mbd, node_ptr->overwrite);
+                        if(rval == MBError::SUCCESS)
+                            rval = dict->JournalAdd((uint8_t *)key_buff, node_ptr->key_len,
+                                                    mbd, false);
                     } catch (int err) {
                         rval = err;
                         Logger::Log(LOG_LEVEL_ERROR, "dict->Add throws error %s",
@@ -399,6 +560,8 @@ int AsyncWriter::ProcessTask(int ntasks, bool rc_mode)
                     {
                         try {
                             rval = dict->RemoveAll();
+                            if(rval == MBError::SUCCESS)
+                                rval = dict->JournalRemoveAll(false);
                         } catch (int err) {
                             Logger::Log(LOG_LEVEL_ERROR, "dict->Add throws error %s",
                                         MBError::get_error_str(err));
@@ -423,7 +586,7 @@ int AsyncWriter::ProcessTask(int ntasks, bool rc_mode)
                         free(rc_backup_dir);
 #ifdef __SHM_QUEUE__
                     rc_backup_dir = (char *) malloc(node_ptr->data_len+1);
-                    memcpy(rc_backup_dir, node_ptr->data, node_ptr->data_len);
+                    memcpy(rc_backup_dir, data_buff, node_ptr->data_len);
                     rc_backup_dir[node_ptr->data_len] = '\0';
 #else
                     rc_backup_dir = (char *) node_ptr->data;
@@ -437,15 +600,21 @@ int AsyncWriter::ProcessTask(int ntasks, bool rc_mode)
             }
 
 #ifdef __SHM_QUEUE__
-            header->writer_index++;
+            ShmqReleaseSlot(node_ptr);
 #else
             writer_index++;
-#endif
             free_async_node(node_ptr);
             node_ptr->in_use.store(false, std::memory_order_release);
             pthread_cond_signal(&node_ptr->cond);
+#endif
             mbd.Clear();
             count++;
+
+            if(rval != MBError::SUCCESS)
+            {
+                Logger::Log(LOG_LEVEL_DEBUG, "failed to run update %d: %s",
+                            node_type, MBError::get_error_str(rval));
+            }
         }
         else
         {
@@ -453,44 +622,217 @@ int AsyncWriter::ProcessTask(int ntasks, bool rc_mode)
             count = ntasks;
         }
 
+#ifndef __SHM_QUEUE__
         if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
         {
             Logger::Log(LOG_LEVEL_ERROR, "failed to unlock mutex");
             throw (int) MBError::MUTEX_ERROR;
         }
-
-        if(rval != MBError::SUCCESS)
-        {
-            Logger::Log(LOG_LEVEL_DEBUG, "failed to run update %d: %s",
-                        (int)node_ptr->type, MBError::get_error_str(rval));
-        }
+#endif
     }
 
+    CommitJournal();
     if(stop_processing)
         return MBError::RC_SKIPPED;
     return MBError::SUCCESS;
 }
 
+void AsyncWriter::CommitJournal()
+{
+    int rval = dict->CommitJournal();
+    if(rval != MBError::SUCCESS)
+        Logger::Log(LOG_LEVEL_ERROR, "async writer failed to commit journal: %s",
+                    MBError::get_error_str(rval));
+}
+
 #ifdef __SHM_QUEUE__
-uint32_t AsyncWriter::NextShmSlot(uint32_t windex, uint32_t qindex)
+// Return the slot at the writer index once it is published. If wait is false,
+// return NULL if it is not published yet. Otherwise wait for it and skip it if
+// the producer that reserved it is gone. NULL is then only returned when the
+// async writer is being stopped.
+AsyncNode* AsyncWriter::ShmqNextSlot(bool wait)
+{
+    time_t stall_start = 0;
+    bool stall_logged = false;
+
+    while(true)
+    {
+        uint64_t windex = header->writer_index.load(std::memory_order_relaxed);
+        AsyncNode *node_ptr = &queue[windex % header->async_queue_size];
+        uint64_t state = node_ptr->state.load(std::memory_order_acquire);
+        uint32_t seq = MB_SHMQ_STATE_SEQ(state);
+        if(seq == MB_SHMQ_SEQ_PUBLISHED(windex / header->async_queue_size))
+            return node_ptr;
+        if(!wait || stop_processing)
+            return NULL;
+
+        int wait_ms = MB_ASYNC_SHM_LOCK_TMOUT * 1000;
+        if(header->queue_index.load(std::memory_order_acquire) == windex)
+        {
+            // Nothing is queued. If producers are waiting for arena space,
+            // it could be held by a producer that exited unexpectedly.
+            if(header->num_arena_waiting.load(std::memory_order_seq_cst) > 0)
+                ShmqReclaimArena(true);
+        }
+        else
+        {
+            // A producer has reserved the slot but not published it yet.
+            wait_ms = MB_SHMQ_WAIT_INTERVAL;
+            if(stall_start == 0)
+            {
+                stall_start = time(NULL);
+            }
+            else if(time(NULL) - stall_start >= MB_ASYNC_SHM_LOCK_TMOUT)
+            {
+                if(ShmqSkipSlot(node_ptr, state, windex))
+                {
+                    stall_start = 0;
+                    stall_logged = false;
+                    continue;
+                }
+                if(!stall_logged)
+                {
+                    Logger::Log(LOG_LEVEL_WARN, "async writer waiting for process %u to "
+                                "publish queue slot", MB_SHMQ_STATE_PID(state));
+                    stall_logged = true;
+                }
+            }
+        }
+
+        uint32_t ticket = header->writer_futex.load(std::memory_order_acquire);
+        header->writer_waiting.store(1, std::memory_order_seq_cst);
+        if(node_ptr->state.load(std::memory_order_seq_cst) == state && !stop_processing)
+            ShmFutexWait(&header->writer_futex, ticket, wait_ms);
+        header->writer_waiting.store(0, std::memory_order_release);
+    }
+}
+
+// Skip a slot that was reserved by a producer which exited before publishing
+// it. Return false if the producer is still alive.
+bool AsyncWriter::ShmqSkipSlot(AsyncNode *node_ptr, uint64_t state, uint64_t windex)
 {
-    int cnt = 0;
-    while(windex != qindex)
+    uint64_t lap = windex / header->async_queue_size;
+    uint32_t seq = MB_SHMQ_STATE_SEQ(state);
+    uint32_t pid = MB_SHMQ_STATE_PID(state);
+
+    if(seq == MB_SHMQ_SEQ_CLAIMED(lap) && ShmqProducerAlive(pid))
+        return false;
+    // A producer that has reserved the slot but not claimed it fails its
+    // claim once the slot is moved to the next lap.
+    if(!node_ptr->state.compare_exchange_strong(state, MB_SHMQ_STATE(MB_SHMQ_SEQ_FREE(lap + 1), 0),
+                                                std::memory_order_seq_cst))
+        return false;
+
+    Logger::Log(LOG_LEVEL_WARN, "async writer skipped queue slot %llu reserved by process %u",
+                static_cast<unsigned long long>(windex), pid);
+    header->writer_index.store(windex + 1, std::memory_order_release);
+    if(header->num_producer_waiting.load(std::memory_order_seq_cst) > 0)
+        ShmFutexWake(ShmqSeqWord(node_ptr));
+    return true;
+}
+
+// Hand a processed slot over to the next lap and wake up the producers
+// waiting for a free slot.
+void AsyncWriter::ShmqReleaseSlot(AsyncNode *node_ptr)
+{
+    uint64_t windex = header->writer_index.load(std::memory_order_relaxed);
+    uint64_t lap = windex / header->async_queue_size;
+
+    ShmqRecordPtr(header, node_ptr->rec_off)->fetch_or(MB_SHMQ_REC_CONSUMED,
+                                                       std::memory_order_release);
+    free_async_node(node_ptr);
+    header->writer_index.store(windex + 1, std::memory_order_release);
+    node_ptr->state.store(MB_SHMQ_STATE(MB_SHMQ_SEQ_FREE(lap + 1), 0),
+                          std::memory_order_seq_cst);
+    if(header->num_producer_waiting.load(std::memory_order_seq_cst) > 0)
+        ShmFutexWake(ShmqSeqWord(node_ptr));
+
+    ShmqReclaimArena(false);
+}
+
+// Move the arena head past consumed records. Records are consumed out of
+// allocation order, so the head stops at the first one still in use. With
+// check_dead, a record is also freed if its producer is gone and no
+// published slot refers to it.
+void AsyncWriter::ShmqReclaimArena(bool check_dead)
+{
+    uint64_t arena_size = MB_SHMQ_ARENA_SIZE(header->async_queue_size);
+    uint64_t head = header->arena_head.load(std::memory_order_relaxed);
+    uint64_t old_head = head;
+
+    while(head != header->arena_tail.load(std::memory_order_acquire))
     {
-        if(queue[windex % header->async_queue_size].in_use.load(std::memory_order_consume))
+        std::atomic<uint64_t> *rec_ptr = ShmqRecordPtr(header, head);
+        uint64_t rec = rec_ptr->load(std::memory_order_acquire);
+        uint32_t size = MB_SHMQ_REC_GET_SIZE(rec);
+        if(MB_SHMQ_REC_GET_TAG(rec) != MB_SHMQ_REC_TAG(head, arena_size) || size == 0)
             break;
-        if(++cnt > header->async_queue_size)
+        if(!(rec & MB_SHMQ_REC_CONSUMED))
         {
-            windex = qindex;
-            break;
+            uint32_t pid = MB_SHMQ_REC_GET_PID(rec);
+            if(!check_dead || ShmqProducerAlive(pid) || ShmqRecordQueued(head))
+                break;
+            Logger::Log(LOG_LEVEL_WARN, "async writer freed queue record left by process %u", pid);
         }
 
-        windex++;
+        // Free space must be zero so that no stale word looks like a record.
+        memset(reinterpret_cast<char *>(rec_ptr), 0, size);
+        head += size;
     }
 
-    return windex;
+    if(head != old_head)
+    {
+        header->arena_head.store(head, std::memory_order_seq_cst);
+        if(header->num_arena_waiting.load(std::memory_order_seq_cst) > 0)
+        {
+            header->arena_futex.fetch_add(1, std::memory_order_release);
+            ShmFutexWake(&header->arena_futex);
+        }
+    }
 }
+
+bool AsyncWriter::ShmqRecordQueued(uint64_t rec_off) const
+{
+    uint64_t qindex = header->queue_index.load(std::memory_order_acquire);
+    uint64_t windex = header->writer_index.load(std::memory_order_relaxed);
+    if(qindex - windex > (uint64_t) header->async_queue_size)
+        qindex = windex + header->async_queue_size;
+
+    for(uint64_t index = windex; index < qindex; index++)
+    {
+        AsyncNode *node_ptr = &queue[index % header->async_queue_size];
+        uint64_t state = node_ptr->state.load(std::memory_order_acquire);
+        if(MB_SHMQ_STATE_SEQ(state) == MB_SHMQ_SEQ_PUBLISHED(index / header->async_queue_size) &&
+           node_ptr->rec_off == rec_off)
+            return true;
+    }
+    return false;
+}
+#endif
+
+// Return the next queued update if it is available without waiting. In the
+// non-shared memory queue, the node mutex is held on return.
+AsyncNode* AsyncWriter::NextQueuedNode()
+{
+#ifdef __SHM_QUEUE__
+    return ShmqNextSlot(false);
+#else
+    AsyncNode *node_ptr = &queue[writer_index % MB_MAX_NUM_SHM_QUEUE_NODE];
+    if(pthread_mutex_lock(&node_ptr->mutex) != 0)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "async writer failed to lock shared memory mutex");
+        throw (int) MBError::MUTEX_ERROR;
+    }
+    if(node_ptr->in_use.load(std::memory_order_consume))
+        return node_ptr;
+    if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to unlock mutex");
+        throw (int) MBError::MUTEX_ERROR;
+    }
+    return NULL;
 #endif
+}
 
 void* AsyncWriter::async_writer_thread()
 {
@@ -501,169 +843,143 @@ void* AsyncWriter::async_writer_thread()
     int64_t min_data_size = 0;
     int64_t max_dbsize = MAX_6B_OFFSET;
     int64_t max_dbcount = MAX_6B_OFFSET;
-#ifdef __SHM_QUEUE__
-    struct timespec tm_exp;
-    bool skip;
-#endif
+    int node_type;
+    char *key_buff;
+    char *data_buff;
 
     Logger::Log(LOG_LEVEL_INFO, "async writer started");
     while(true)
     {
 #ifdef __SHM_QUEUE__
-        node_ptr = &queue[header->writer_index % header->async_queue_size];
-        tm_exp.tv_sec = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
-        tm_exp.tv_nsec = 0;
-        rval = pthread_mutex_timedlock(&node_ptr->mutex, &tm_exp);
-        if(rval == ETIMEDOUT)
-        {
-            Logger::Log(LOG_LEVEL_WARN, "async writer shared memory mutex lock timeout, need to re-intialize");
-            InitShmMutex(&node_ptr->mutex);
-            header->writer_index++;
-            continue;
-        }
-        else if(rval != 0)
+        node_ptr = ShmqNextSlot(true);
+        if(node_ptr == NULL)
+            break;
 #else
         node_ptr = &queue[writer_index % MB_MAX_NUM_SHM_QUEUE_NODE];
         if(pthread_mutex_lock(&node_ptr->mutex) != 0)
-#endif
         {
             Logger::Log(LOG_LEVEL_ERROR, "async writer failed to lock shared memory mutex");
             throw (int) MBError::MUTEX_ERROR;
         }
 
-#ifdef __SHM_QUEUE__
-        skip = false;
-#endif
         while(!node_ptr->in_use.load(std::memory_order_consume))
         {
             if(stop_processing)
                 break;
-#ifdef __SHM_QUEUE__
-            tm_exp.tv_sec = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
-            tm_exp.tv_nsec = 0;
-            pthread_cond_timedwait(&node_ptr->cond, &node_ptr->mutex, &tm_exp);
-
-            uint32_t windex = header->writer_index;
-            uint32_t qindex = header->queue_index.load(std::memory_order_consume);
-            if(windex != qindex)
-            {
-                // Reader process may have exited unexpectedly. Recover index.
-                skip = true;
-                header->writer_index = NextShmSlot(windex, qindex);
-                break;
-            }
-            continue;
-#else
             pthread_cond_wait(&node_ptr->cond, &node_ptr->mutex);
-#endif
         }
 
-#ifdef __SHM_QUEUE__
-        if(skip || stop_processing)
-        {
-            if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
-            {
-                Logger::Log(LOG_LEVEL_ERROR, "async writer failed to unlock shared memory mutex");
-                throw (int) MBError::MUTEX_ERROR;
-            }
-            if(stop_processing)
-                break;
-            continue;
-        }
-#else
         if(stop_processing && !node_ptr->in_use.load(std::memory_order_consume))
         {
             pthread_mutex_unlock(&node_ptr->mutex);
             break;
         }
 #endif
-        // process the node
-        switch(node_ptr->type)
+        // Apply the run of updates queued so far before checking rc, expiry
+        // and eviction, and commit their journal records together.
+        int nrun = 0;
+        while(node_ptr != NULL)
         {
-            case MABAIN_ASYNC_TYPE_ADD:
-                mbd.buff = (uint8_t *) node_ptr->data;
-                mbd.data_len = node_ptr->data_len;
-                try {
-                    rval = dict->Add((uint8_t *)node_ptr->key, node_ptr->key_len, mbd,
-                                     node_ptr->overwrite);
-                } catch (int err) {
-                    Logger::Log(LOG_LEVEL_ERROR, "dict->Add throws error %s",
-                                MBError::get_error_str(err));
-                    rval = err;
-                }
-                break;
-            case MABAIN_ASYNC_TYPE_REMOVE:
-                mbd.options |= CONSTS::OPTION_FIND_AND_STORE_PARENT;
-                try {
-                    rval = dict->Remove((uint8_t *)node_ptr->key, node_ptr->key_len, mbd);
-                } catch (int err) {
-                    Logger::Log(LOG_LEVEL_ERROR, "dict->Remmove throws error %s",
-                                MBError::get_error_str(err));
-                    rval = err;
-                }
-                mbd.options &= ~CONSTS::OPTION_FIND_AND_STORE_PARENT;
-                break;
-            case MABAIN_ASYNC_TYPE_REMOVE_ALL:
-                try {
-                    rval = dict->RemoveAll();
-                } catch (int err) {
-                    Logger::Log(LOG_LEVEL_ERROR, "dict->RemoveAll throws error %s",
-                                MBError::get_error_str(err));
-                    rval = err;
-                }
-                break;
-            case MABAIN_ASYNC_TYPE_RC:
-                rval = MBError::SUCCESS;
+            // process the node
+            node_type = node_ptr->type;
+            NodeBuffers(node_ptr, key_buff, data_buff);
+            switch(node_ptr->type)
+            {
+                case MABAIN_ASYNC_TYPE_ADD:
+                    mbd.buff = (uint8_t *) data_buff;
+                    mbd.data_len = node_ptr->data_len;
+                    mbd.expiry = node_ptr->expiry;
+                    try {
+                        rval = dict->Add((uint8_t *)key_buff, node_ptr->key_len, mbd,
+                                         node_ptr->overwrite);
+                        if(rval == MBError::SUCCESS)
+                            rval = dict->JournalAdd((uint8_t *)key_buff, node_ptr->key_len,
+                                                    mbd, false);
+                    } catch (int err) {
+                        Logger::Log(LOG_LEVEL_ERROR, "dict->Add throws error %s",
+                                    MBError::get_error_str(err));
+                        rval = err;
+                    }
+                    break;
+                case MABAIN_ASYNC_TYPE_REMOVE:
+                    mbd.options |= CONSTS::OPTION_FIND_AND_STORE_PARENT;
+                    try {
+                        rval = dict->Remove((uint8_t *)key_buff, node_ptr->key_len, mbd);
+                        if(rval == MBError::SUCCESS)
+                            rval = dict->JournalRemove((uint8_t *)key_buff, node_ptr->key_len,
+                                                       false);
+                    } catch (int err) {
+                        Logger::Log(LOG_LEVEL_ERROR, "dict->Remmove throws error %s",
+                                    MBError::get_error_str(err));
+                        rval = err;
+                    }
+                    mbd.options &= ~CONSTS::OPTION_FIND_AND_STORE_PARENT;
+                    break;
+                case MABAIN_ASYNC_TYPE_REMOVE_ALL:
+                    try {
+                        rval = dict->RemoveAll();
+                        if(rval == MBError::SUCCESS)
+                            rval = dict->JournalRemoveAll(false);
+                    } catch (int err) {
+                        Logger::Log(LOG_LEVEL_ERROR, "dict->RemoveAll throws error %s",
+                                    MBError::get_error_str(err));
+                        rval = err;
+                    }
+                    break;
+                case MABAIN_ASYNC_TYPE_RC:
+                    rval = MBError::SUCCESS;
 #ifdef __SHM_QUEUE__
-                header->rc_flag.store(1, std::memory_order_release);
+                    header->rc_flag.store(1, std::memory_order_release);
 #else
-                is_rc_running = true;
+                    is_rc_running = true;
 #endif
-                {
-                    int64_t *data_ptr = reinterpret_cast<int64_t *>(node_ptr->data);
-                    min_index_size = data_ptr[0];
-                    min_data_size  = data_ptr[1];
-                    max_dbsize = data_ptr[2];
-                    max_dbcount = data_ptr[3];
-                }
-                break;
-            case MABAIN_ASYNC_TYPE_NONE:
-                rval = MBError::SUCCESS;
-                break;
-            case MABAIN_ASYNC_TYPE_BACKUP:
-                try {
-                    DBBackup mbbk(*db);
-                    rval = mbbk.Backup((const char*) node_ptr->data);
-                } catch (int error) {
-                    rval = error;
-                }
+                    {
+                        int64_t *data_ptr = reinterpret_cast<int64_t *>(data_buff);
+                        min_index_size = data_ptr[0];
+                        min_data_size  = data_ptr[1];
+                        max_dbsize = data_ptr[2];
+                        max_dbcount = data_ptr[3];
+                    }
                     break;
-            default:
-                rval = MBError::INVALID_ARG;
-                break;
-        }
+                case MABAIN_ASYNC_TYPE_NONE:
+                    rval = MBError::SUCCESS;
+                    break;
+                case MABAIN_ASYNC_TYPE_BACKUP:
+                    rval = StartBackup((const char*) data_buff);
+                    break;
+                default:
+                    rval = MBError::INVALID_ARG;
+                    break;
+            }
 
 #ifdef __SHM_QUEUE__
-        header->writer_index++;
+            ShmqReleaseSlot(node_ptr);
 #else
-        writer_index++;
+            writer_index++;
+            free_async_node(node_ptr);
+            node_ptr->in_use.store(false, std::memory_order_release);
+            pthread_cond_signal(&node_ptr->cond);
+            if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
+            {
+                Logger::Log(LOG_LEVEL_ERROR, "failed to unlock mutex");
+                throw (int) MBError::MUTEX_ERROR;
+            }
 #endif
-        free_async_node(node_ptr);
-        node_ptr->in_use.store(false, std::memory_order_release);
-        pthread_cond_signal(&node_ptr->cond);
-        if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
-        {
-            Logger::Log(LOG_LEVEL_ERROR, "failed to unlock mutex");
-            throw (int) MBError::MUTEX_ERROR;
-        }
 
-        if(rval != MBError::SUCCESS)
-        {
-            Logger::Log(LOG_LEVEL_DEBUG, "failed to run update %d: %s",
-                        (int)node_ptr->type, MBError::get_error_str(rval));
-        }
+            if(rval != MBError::SUCCESS)
+            {
+                Logger::Log(LOG_LEVEL_DEBUG, "failed to run update %d: %s",
+                            node_type, MBError::get_error_str(rval));
+            }
+
+            mbd.Clear();
 
-        mbd.Clear();
+            // rc has to start before the updates queued after its request.
+            if(node_type == MABAIN_ASYNC_TYPE_RC || ++nrun >= MB_ASYNC_MAX_RUN)
+                break;
+            node_ptr = NextQueuedNode();
+        }
+        CommitJournal();
 
 #ifdef __SHM_QUEUE__
         if (header->rc_flag.load(std::memory_order_consume) == 1)
@@ -701,13 +1017,65 @@ void* AsyncWriter::async_writer_thread()
                 rc_backup_dir = NULL;
             }
         }
+
+        if(dict->ExpiryDue())
+        {
+            try {
+                ResourceCollection rc = ResourceCollection(*db);
+                rc.ExpireEntries(true);
+            } catch (int error) {
+                Logger::Log(LOG_LEVEL_WARN, "expiry sweep failed: %s",
+                            MBError::get_error_str(error));
+            }
+        }
+
+        if(dict->OverEvictionCap())
+        {
+            try {
+                ResourceCollection rc = ResourceCollection(*db);
+                rc.ClockEviction();
+            } catch (int error) {
+                Logger::Log(LOG_LEVEL_WARN, "clock eviction failed: %s",
+                            MBError::get_error_str(error));
+            }
+        }
     }
 
+    WaitForBackup();
     mbd.buff = NULL;
     Logger::Log(LOG_LEVEL_INFO, "async writer exiting");
     return NULL;
 }
 
+// Start an online backup. The blocks are copied in a background thread
+// while the async writer keeps applying updates.
+int AsyncWriter::StartBackup(const char *backup_dir)
+{
+    // Only one backup can run at a time.
+    WaitForBackup();
+
+    int rval;
+    try {
+        online_backup = new DBBackup(*db);
+        rval = online_backup->StartBackup(backup_dir);
+    } catch (int error) {
+        rval = error;
+        WaitForBackup();
+    }
+    return rval;
+}
+
+int AsyncWriter::WaitForBackup()
+{
+    if(online_backup == NULL)
+        return MBError::SUCCESS;
+
+    int rval = online_backup->Wait();
+    delete online_backup;
+    online_backup = NULL;
+    return rval;
+}
+
 void* AsyncWriter::async_thread_wrapper(void *context)
 {
     AsyncWriter *instance_ptr = static_cast<AsyncWriter *>(context);
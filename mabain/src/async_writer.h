@@ -20,6 +20,8 @@
 #define __ASYNC_WRITER_H__
 
 #include <pthread.h>
+#include <signal.h>
+#include <errno.h>
 
 #include "db.h"
 //#include "mb_rc.h"
@@ -35,21 +37,68 @@ namespace mabain {
 #define MABAIN_ASYNC_TYPE_RC         4
 #define MABAIN_ASYNC_TYPE_BACKUP     5
 
-#define MB_ASYNC_SHM_KEY_SIZE      256
-#define MB_ASYNC_SHM_DATA_SIZE     1024
 #define MB_ASYNC_SHM_LOCK_TMOUT    5
+// max number of queued updates the async writer applies in one run
+#define MB_ASYNC_MAX_RUN           256
+
+#ifdef __SHM_QUEUE__
+// The shared memory queue is a multi-producer single-consumer ring. Each slot
+// has a 64-bit state word, the sequence number in the lower 32 bits and the
+// pid of the producer in the upper 32 bits. For queue position pos and
+// lap = pos / async_queue_size, the sequence number of the slot goes through
+//     free      -> claimed   (producer CAS, records its pid)
+//     claimed   -> published (producer)
+//     published -> free for lap + 1 (async writer)
+// The async writer can also move a slot from free or claimed to the next lap
+// if the producer that reserved it is gone.
+#define MB_SHMQ_SEQ_FREE(lap)      ((uint32_t)(lap) * 4)
+#define MB_SHMQ_SEQ_CLAIMED(lap)   ((uint32_t)(lap) * 4 + 1)
+#define MB_SHMQ_SEQ_PUBLISHED(lap) ((uint32_t)(lap) * 4 + 2)
+#define MB_SHMQ_STATE(seq, pid)    (((uint64_t)(pid) << 32) | (uint32_t)(seq))
+#define MB_SHMQ_STATE_SEQ(state)   ((uint32_t)(state))
+#define MB_SHMQ_STATE_PID(state)   ((uint32_t)((state) >> 32))
+// spins before a waiting producer sleeps on the futex
+#define MB_SHMQ_SPIN_COUNT         256
+// futex wait interval in milliseconds
+#define MB_SHMQ_WAIT_INTERVAL      100
+
+// Keys and data are carried in a byte arena that follows the slot ring in
+// the header file. Producers allocate records at the arena tail and the
+// async writer frees them at the head. Offsets are positions in the byte
+// stream, i.e., the arena offset is rec_off % arena size. A record starts
+// with a 64-bit word
+//     tag (24 bits) | size / 8 (17 bits) | producer pid (22 bits) | consumed (1 bit)
+// followed by the key and the data. The tag is derived from the arena lap
+// of the record so that stale words from earlier laps are never mistaken
+// for a record. Producers take turns at the tail through a claim word that
+// holds the pid of the producer allocating. It writes the first word of
+// the record before it moves the tail past it, so that every record
+// between the head and the tail can be attributed to its producer.
+#define MB_ASYNC_SHM_ARENA_PER_SLOT 1024
+#define MB_SHMQ_ARENA_SIZE(qsize)   ((uint64_t)(qsize) * MB_ASYNC_SHM_ARENA_PER_SLOT)
+#define MB_SHMQ_REC_HDR_SIZE        8
+#define MB_SHMQ_REC_MAX_SIZE        (0x1FFFF << 3)
+#define MB_SHMQ_REC_CONSUMED        1ULL
+#define MB_SHMQ_REC_TAG(off, asize) ((uint32_t)(((off) / (asize) + 1) & 0xFFFFFF))
+#define MB_SHMQ_REC(tag, size, pid, consumed) \
+                   (((uint64_t)(tag) << 40) | ((uint64_t)((size) >> 3) << 23) | \
+                    ((uint64_t)((pid) & 0x3FFFFF) << 1) | (consumed))
+#define MB_SHMQ_REC_GET_TAG(rec)    ((uint32_t)((rec) >> 40))
+#define MB_SHMQ_REC_GET_SIZE(rec)   ((uint32_t)(((rec) >> 23) & 0x1FFFF) << 3)
+#define MB_SHMQ_REC_GET_PID(rec)    ((uint32_t)(((rec) >> 1) & 0x3FFFFF))
+#endif
 
-    
 typedef struct _AsyncNode
 {
+#ifdef __SHM_QUEUE__
+    std::atomic<uint64_t> state;
+    // arena record holding the key and the data
+    uint64_t rec_off;
+#else
     std::atomic<bool> in_use;
     pthread_mutex_t   mutex;
     pthread_cond_t    cond;
 
-#ifdef __SHM_QUEUE__
-    char key[MB_ASYNC_SHM_KEY_SIZE];
-    char data[MB_ASYNC_SHM_DATA_SIZE];
-#else
     char *key;
     char *data;
 #endif
@@ -57,8 +106,45 @@ typedef struct _AsyncNode
     int data_len;
     bool overwrite;
     char type;
+    // expiry time of the value to add; zero if it does not expire
+    int64_t expiry;
 } AsyncNode;
 
+#ifdef __SHM_QUEUE__
+// Producers waiting for a free slot sleep on the sequence number half of
+// the slot state.
+inline std::atomic<uint32_t>* ShmqSeqWord(AsyncNode *node_ptr)
+{
+    char *state_ptr = reinterpret_cast<char *>(&node_ptr->state);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    state_ptr += sizeof(uint32_t);
+#endif
+    return reinterpret_cast<std::atomic<uint32_t> *>(state_ptr);
+}
+
+inline bool ShmqProducerAlive(uint32_t pid)
+{
+    if(pid == 0)
+        return false;
+    // EPERM means the process exists but belongs to some other user.
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+
+// Size of the slot ring and the byte arena in the header file
+inline size_t ShmqBufferSize(uint32_t queue_size)
+{
+    return queue_size * sizeof(AsyncNode) + MB_SHMQ_ARENA_SIZE(queue_size);
+}
+
+inline std::atomic<uint64_t>* ShmqRecordPtr(IndexHeader *header, uint64_t rec_off)
+{
+    char *arena = reinterpret_cast<char *>(header) + RollableFile::page_size
+                + header->async_queue_size * sizeof(AsyncNode);
+    return reinterpret_cast<std::atomic<uint64_t> *>(arena +
+                rec_off % MB_SHMQ_ARENA_SIZE(header->async_queue_size));
+}
+#endif
+
 class AsyncWriter
 {
 public:
@@ -68,9 +154,13 @@ public:
 
 #ifndef __SHM_QUEUE__
     void UpdateNumUsers(int delta);
-    int  Add(const char *key, int key_len, const char *data, int data_len, bool overwrite);
+    int  Add(const char *key, int key_len, const char *data, int data_len, bool overwrite,
+             int64_t expiry = 0);
     int  Remove(const char *key, int len);
     int  RemoveAll();
+    int  AddBatch(const std::string *keys, const std::string *values, int num,
+                  bool overwrite);
+    int  RemoveBatch(const std::string *keys, int num);
     int  Backup(const char *backup_dir);
     int  CollectResource(int64_t m_index_rc_size, int64_t m_data_rc_size, 
                          int64_t max_dbsz, int64_t max_dbcnt);
@@ -84,9 +174,24 @@ private:
     static void *async_thread_wrapper(void *context);
     AsyncNode* AcquireSlot();
     int PrepareSlot(AsyncNode *node_ptr) const;
+#ifndef __SHM_QUEUE__
+    int AcquireSlots(AsyncNode **node_ptrs, int num);
+    int PrepareSlots(AsyncNode **node_ptrs, int num) const;
+    int SubmitBatch(char type, const std::string *keys, const std::string *values,
+                    int num, bool overwrite);
+#endif
     void* async_writer_thread();
+    int StartBackup(const char *backup_dir);
+    int WaitForBackup();
+    void CommitJournal();
+    void NodeBuffers(AsyncNode *node_ptr, char* &key, char* &data) const;
+    AsyncNode* NextQueuedNode();
 #ifdef __SHM_QUEUE__
-    uint32_t NextShmSlot(uint32_t windex, uint32_t qindex);
+    AsyncNode* ShmqNextSlot(bool wait);
+    bool ShmqSkipSlot(AsyncNode *node_ptr, uint64_t state, uint64_t windex);
+    void ShmqReleaseSlot(AsyncNode *node_ptr);
+    void ShmqReclaimArena(bool check_dead);
+    bool ShmqRecordQueued(uint64_t rec_off) const;
 #endif
 
     // db pointer
@@ -108,6 +213,8 @@ private:
 
     bool is_rc_running;
     char *rc_backup_dir;
+    // backup copying blocks in the background
+    DBBackup *online_backup;
 };
 
 }
@@ -0,0 +1,413 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+
+#include "bulk_loader.h"
+#include "dict.h"
+#include "dict_mem.h"
+#include "integer_4b_5b.h"
+#include "logger.h"
+#include "error.h"
+
+namespace mabain {
+
+// An edge length is stored in a single byte.
+#define BULK_MAX_EDGE_LEN    0xFF
+#define BULK_RECORD_HDR      4
+
+static uint64_t get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline int record_key_len(const uint8_t *rec)
+{
+    uint16_t len;
+    memcpy(&len, rec, sizeof(len));
+    return len;
+}
+
+static inline int record_data_len(const uint8_t *rec)
+{
+    uint16_t len;
+    memcpy(&len, rec + sizeof(len), sizeof(len));
+    return len;
+}
+
+static inline const uint8_t* record_key(const uint8_t *rec)
+{
+    return rec + BULK_RECORD_HDR;
+}
+
+static inline int compare_keys(const uint8_t *rec1, const uint8_t *rec2)
+{
+    int len1 = record_key_len(rec1);
+    int len2 = record_key_len(rec2);
+    int rval = memcmp(record_key(rec1), record_key(rec2), std::min(len1, len2));
+    if(rval != 0)
+        return rval;
+    return len1 - len2;
+}
+
+typedef struct _RecordLess
+{
+    const uint8_t *base;
+
+    bool operator()(size_t rec1, size_t rec2) const
+    {
+        return compare_keys(base + rec1, base + rec2) < 0;
+    }
+} RecordLess;
+
+typedef struct _PartitionLarger
+{
+    BulkPartition* const *parts;
+
+    bool operator()(int part1, int part2) const
+    {
+        return parts[part1]->records.size() > parts[part2]->records.size();
+    }
+} PartitionLarger;
+
+BulkLoader::BulkLoader(DB &db, int num_threads) : db_ref(db)
+{
+    // The loaded pairs do not go through the change feed.
+    if(!(db.GetDBOptions() & CONSTS::ACCESS_MODE_WRITER) ||
+       (db.GetDBOptions() & (CONSTS::ASYNC_WRITER_MODE | CONSTS::USE_CHANGE_FEED)))
+        throw (int) MBError::NOT_ALLOWED;
+
+    dict = db_ref.GetDictPtr();
+    if(dict == NULL)
+        throw (int) MBError::NOT_INITIALIZED;
+
+    num_thread = num_threads > 0 ? num_threads : 1;
+    for(int i = 0; i < NUM_ALPHABET; i++)
+        parts[i] = NULL;
+    count = 0;
+    loaded = 0;
+    next_part.store(0, std::memory_order_relaxed);
+}
+
+BulkLoader::~BulkLoader()
+{
+    Clear();
+}
+
+void BulkLoader::Clear()
+{
+    for(int i = 0; i < NUM_ALPHABET; i++)
+    {
+        delete parts[i];
+        parts[i] = NULL;
+    }
+    count = 0;
+}
+
+int BulkLoader::Add(const char *key, int key_len, const char *data, int data_len)
+{
+    if(key_len > CONSTS::MAX_KEY_LENGHTH || data_len > CONSTS::MAX_DATA_SIZE ||
+       key_len <= 0 || data_len <= 0)
+        return MBError::OUT_OF_BOUND;
+
+    int first = static_cast<uint8_t>(key[0]);
+    if(parts[first] == NULL)
+        parts[first] = new BulkPartition();
+    BulkPartition *part = parts[first];
+
+    uint16_t len[2];
+    len[0] = static_cast<uint16_t>(key_len);
+    len[1] = static_cast<uint16_t>(data_len);
+    part->records.push_back(part->arena.size());
+    const uint8_t *hdr = reinterpret_cast<const uint8_t*>(len);
+    part->arena.insert(part->arena.end(), hdr, hdr + BULK_RECORD_HDR);
+    part->arena.insert(part->arena.end(), key, key + key_len);
+    part->arena.insert(part->arena.end(), data, data + data_len);
+    count++;
+    return MBError::SUCCESS;
+}
+
+int BulkLoader::Add(const std::string &key, const std::string &value)
+{
+    return Add(key.data(), key.size(), value.data(), value.size());
+}
+
+int64_t BulkLoader::Count() const
+{
+    return count;
+}
+
+int64_t BulkLoader::Loaded() const
+{
+    return loaded;
+}
+
+// Records [lo, hi) share the first depth bytes of their keys.
+size_t BulkLoader::BuildNode(BulkPartition &part, size_t lo, size_t hi, int depth) const
+{
+    const uint8_t *base = &part.arena[0];
+    BulkNode node;
+    node.match = -1;
+    // Keys are sorted and distinct: only the first one can end here.
+    if(record_key_len(base + part.records[lo]) == depth)
+        node.match = lo++;
+
+    std::vector<BulkEdge> node_edges;
+    while(lo < hi)
+    {
+        uint8_t c = record_key(base + part.records[lo])[depth];
+        size_t l = lo + 1;
+        size_t h = hi;
+        while(l < h)
+        {
+            size_t mid = (l + h) / 2;
+            if(record_key(base + part.records[mid])[depth] == c)
+                l = mid + 1;
+            else
+                h = mid;
+        }
+
+        BulkEdge edge;
+        BuildEdge(part, lo, l, depth, edge);
+        node_edges.push_back(edge);
+        lo = l;
+    }
+
+    node.first_edge = part.edges.size();
+    node.nt = static_cast<int>(node_edges.size());
+    part.edges.insert(part.edges.end(), node_edges.begin(), node_edges.end());
+    part.nodes.push_back(node);
+    return part.nodes.size() - 1;
+}
+
+// Records [lo, hi) share the first depth+1 bytes of their keys. Child
+// nodes are added before the edge pointing to them.
+void BulkLoader::BuildEdge(BulkPartition &part, size_t lo, size_t hi, int depth,
+                           BulkEdge &edge) const
+{
+    const uint8_t *base = &part.arena[0];
+    const uint8_t *first = base + part.records[lo];
+    edge.label = record_key(first) + depth;
+    if(hi - lo == 1)
+    {
+        edge.len = record_key_len(first) - depth;
+        edge.leaf = true;
+        edge.target = lo;
+    }
+    else
+    {
+        const uint8_t *last = base + part.records[hi-1];
+        int max_len = std::min(record_key_len(first), record_key_len(last));
+        int match_len = depth + 1;
+        while(match_len < max_len &&
+              record_key(first)[match_len] == record_key(last)[match_len])
+            match_len++;
+        edge.len = match_len - depth;
+        edge.leaf = false;
+        edge.target = BuildNode(part, lo, hi, match_len);
+    }
+    SplitEdge(part, edge);
+}
+
+// Only a root edge of a key with the maximum length can be too long. The
+// tail of the edge moves below a node with a single edge.
+void BulkLoader::SplitEdge(BulkPartition &part, BulkEdge &edge) const
+{
+    if(edge.len <= BULK_MAX_EDGE_LEN)
+        return;
+
+    BulkEdge tail = edge;
+    tail.label = edge.label + BULK_MAX_EDGE_LEN;
+    tail.len = edge.len - BULK_MAX_EDGE_LEN;
+    BulkNode node;
+    node.match = -1;
+    node.first_edge = part.edges.size();
+    node.nt = 1;
+    part.edges.push_back(tail);
+    part.nodes.push_back(node);
+
+    edge.len = BULK_MAX_EDGE_LEN;
+    edge.leaf = false;
+    edge.target = part.nodes.size() - 1;
+}
+
+// Sort the records, keep the last of the records with the same key and
+// build the subtree.
+void BulkLoader::BuildPartition(BulkPartition &part) const
+{
+    RecordLess less;
+    less.base = &part.arena[0];
+    std::stable_sort(part.records.begin(), part.records.end(), less);
+
+    size_t num = 0;
+    for(size_t i = 0; i < part.records.size(); i++)
+    {
+        if(i + 1 < part.records.size() &&
+           compare_keys(less.base + part.records[i], less.base + part.records[i+1]) == 0)
+            continue;
+        part.records[num++] = part.records[i];
+    }
+    part.records.resize(num);
+
+    BuildEdge(part, 0, num, 0, part.root_edge);
+}
+
+void BulkLoader::BuildWorker()
+{
+    while(true)
+    {
+        int index = next_part.fetch_add(1, std::memory_order_relaxed);
+        if(index >= static_cast<int>(order.size()))
+            break;
+        BuildPartition(*parts[order[index]]);
+    }
+}
+
+void BulkLoader::SerializeEdge(const BulkEdge &edge, const std::vector<size_t> &data_off,
+                               const std::vector<size_t> &node_off, uint8_t *edge_buff)
+{
+    memset(edge_buff, 0, EDGE_SIZE);
+    if(edge.len > LOCAL_EDGE_LEN)
+    {
+        size_t edge_str_off;
+        dict->GetMM()->ReserveData(edge.label + 1, edge.len - 1, edge_str_off);
+        Write5BInteger(edge_buff, edge_str_off);
+    }
+    else if(edge.len > 1)
+    {
+        memcpy(edge_buff, edge.label + 1, edge.len - 1);
+    }
+    edge_buff[EDGE_LEN_POS] = static_cast<uint8_t>(edge.len);
+    if(edge.leaf)
+    {
+        edge_buff[EDGE_FLAG_POS] = EDGE_FLAG_DATA_OFF;
+        Write6BInteger(edge_buff + EDGE_NODE_LEADING_POS, data_off[edge.target]);
+    }
+    else
+    {
+        Write6BInteger(edge_buff + EDGE_NODE_LEADING_POS, node_off[edge.target]);
+    }
+}
+
+// Values are written in key order. Nodes are written children first so
+// that all offsets are known when a node is written.
+void BulkLoader::WritePartition(BulkPartition &part, int first)
+{
+    IndexHeader *header = dict->GetHeaderPtr();
+    const uint8_t *base = &part.arena[0];
+    std::vector<size_t> data_off(part.records.size());
+    for(size_t i = 0; i < part.records.size(); i++)
+    {
+        const uint8_t *rec = base + part.records[i];
+        dict->ReserveData(record_key(rec) + record_key_len(rec), record_data_len(rec),
+                          data_off[i]);
+        header->count++;
+        header->num_update++;
+    }
+
+    DictMem *mm = dict->GetMM();
+    std::vector<size_t> node_off(part.nodes.size());
+    uint8_t node_buff[NODE_EDGE_KEY_FIRST + NUM_ALPHABET + NUM_ALPHABET*EDGE_SIZE];
+    for(size_t i = 0; i < part.nodes.size(); i++)
+    {
+        const BulkNode &node = part.nodes[i];
+        memset(node_buff, 0, NODE_EDGE_KEY_FIRST);
+        if(node.match >= 0)
+        {
+            node_buff[0] = FLAG_NODE_MATCH;
+            Write6BInteger(node_buff + 2, data_off[node.match]);
+        }
+        node_buff[1] = static_cast<uint8_t>(node.nt - 1);
+        uint8_t *edge_buff = node_buff + NODE_EDGE_KEY_FIRST + node.nt;
+        for(int j = 0; j < node.nt; j++)
+        {
+            const BulkEdge &edge = part.edges[node.first_edge + j];
+            node_buff[NODE_EDGE_KEY_FIRST + j] = edge.label[0];
+            SerializeEdge(edge, data_off, node_off, edge_buff + j*EDGE_SIZE);
+        }
+        node_off[i] = mm->AddNode(node_buff, node.nt);
+    }
+
+    uint8_t root_edge[EDGE_SIZE];
+    SerializeEdge(part.root_edge, data_off, node_off, root_edge);
+    mm->SetRootEdge(first, root_edge);
+    loaded += part.records.size();
+}
+
+int BulkLoader::Load()
+{
+    if(!db_ref.is_open())
+        return db_ref.Status();
+    if(db_ref.Count() != 0)
+        return MBError::NOT_ALLOWED;
+
+    // The largest partitions are built first.
+    order.clear();
+    for(int i = 0; i < NUM_ALPHABET; i++)
+    {
+        if(parts[i] != NULL)
+            order.push_back(i);
+    }
+    PartitionLarger larger;
+    larger.parts = parts;
+    std::sort(order.begin(), order.end(), larger);
+
+    uint64_t start = get_time_us();
+    next_part.store(0, std::memory_order_relaxed);
+    int nthread = std::min(num_thread, static_cast<int>(order.size()));
+    std::vector<std::thread> threads;
+    for(int i = 1; i < nthread; i++)
+        threads.push_back(std::thread(&BulkLoader::BuildWorker, this));
+    BuildWorker();
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    uint64_t build_us = get_time_us() - start;
+
+    int rval = MBError::SUCCESS;
+    loaded = 0;
+    try {
+        for(int i = 0; i < NUM_ALPHABET; i++)
+        {
+            if(parts[i] == NULL)
+                continue;
+            WritePartition(*parts[i], i);
+            delete parts[i];
+            parts[i] = NULL;
+        }
+    } catch (int error) {
+        Logger::Log(LOG_LEVEL_ERROR, "bulk load failed: %s", MBError::get_error_str(error));
+        rval = error;
+    }
+
+    Clear();
+    if(rval == MBError::SUCCESS)
+    {
+        db_ref.Flush();
+        Logger::Log(LOG_LEVEL_INFO, "bulk loaded %lld keys: build %llu us, total %llu us",
+                    static_cast<long long>(loaded), static_cast<unsigned long long>(build_us),
+                    static_cast<unsigned long long>(get_time_us() - start));
+    }
+    return rval;
+}
+
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __BULK_LOADER_H__
+#define __BULK_LOADER_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "db.h"
+
+namespace mabain {
+
+// default number of threads building the index
+#define BULK_LOAD_THREADS_DEFAULT    4
+
+// Node of an index subtree built in memory; its edges are stored
+// contiguously in the edge list of the partition.
+typedef struct _BulkNode
+{
+    int64_t match;       // record matching the node, or -1
+    size_t  first_edge;
+    int     nt;          // number of edges
+} BulkNode;
+
+typedef struct _BulkEdge
+{
+    const uint8_t *label;
+    int            len;
+    bool           leaf;
+    // record index for a leaf edge, node index otherwise
+    size_t         target;
+} BulkEdge;
+
+// Key/value pairs with the same first key byte and the index subtree under
+// the root edge of that byte.
+typedef struct _BulkPartition
+{
+    // records of u16 key length, u16 value length, key and value
+    std::vector<uint8_t> arena;
+    std::vector<size_t>  records;
+    std::vector<BulkNode> nodes;
+    std::vector<BulkEdge> edges;
+    BulkEdge root_edge;
+} BulkPartition;
+
+// Loads key/value pairs into an empty DB. The pairs are partitioned by the
+// first key byte. The partitions are sorted and their index subtrees built
+// bottom-up by a pool of threads; the subtrees are then written with each
+// node allocated once at its final size, and each root edge is set after
+// its whole subtree is in place. A later pair with the same key replaces
+// an earlier one. The DB must be opened by a writer without the async
+// writer and without the change feed.
+class BulkLoader
+{
+public:
+    BulkLoader(DB &db, int num_threads = BULK_LOAD_THREADS_DEFAULT);
+    ~BulkLoader();
+
+    int Add(const char *key, int key_len, const char *data, int data_len);
+    int Add(const std::string &key, const std::string &value);
+    // Build and write the index. The added pairs are dropped afterwards.
+    int Load();
+
+    // number of pairs added since the last load
+    int64_t Count() const;
+    // number of distinct keys written by the last load
+    int64_t Loaded() const;
+
+private:
+    void BuildWorker();
+    void BuildPartition(BulkPartition &part) const;
+    size_t BuildNode(BulkPartition &part, size_t lo, size_t hi, int depth) const;
+    void BuildEdge(BulkPartition &part, size_t lo, size_t hi, int depth,
+                   BulkEdge &edge) const;
+    void SplitEdge(BulkPartition &part, BulkEdge &edge) const;
+    void WritePartition(BulkPartition &part, int first);
+    void SerializeEdge(const BulkEdge &edge, const std::vector<size_t> &data_off,
+                       const std::vector<size_t> &node_off, uint8_t *edge_buff);
+    void Clear();
+
+    DB &db_ref;
+    Dict *dict;
+    int num_thread;
+    BulkPartition *parts[NUM_ALPHABET];
+    int64_t count;
+    int64_t loaded;
+    // next partition to be built, shared by the build threads
+    std::atomic<int> next_part;
+    std::vector<int> order;
+};
+
+}
+
+#endif
@@ -0,0 +1,352 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "change_feed.h"
+#include "db.h"
+#include "error.h"
+#include "logger.h"
+#include "mabain_consts.h"
+#include "resource_pool.h"
+#include "rollable_file.h"
+
+namespace mabain {
+
+#define CHANGE_FEED_MAGIC          0x31444546474E4843ULL
+#define CHANGE_FEED_ALIGN(x)       (((x) + 7) & ~((uint64_t) 7))
+
+static inline uint64_t expiry_size(const ChangeRecord &rec)
+{
+    return (rec.flags & CHANGE_FEED_FLAG_EXPIRY) ? sizeof(int64_t) : 0;
+}
+
+static inline uint64_t record_size(const ChangeRecord &rec)
+{
+    return CHANGE_FEED_ALIGN(sizeof(rec) + expiry_size(rec) + rec.key_len + rec.data_len);
+}
+
+// The ring size is taken from an existing file; size only applies when the
+// writer creates the file.
+ChangeFeed::ChangeFeed(const std::string &mbdir, int64_t size, int mode)
+                      : header(NULL),
+                        ring(NULL)
+{
+    std::string fpath = mbdir + "_mabain_f";
+    size_t hdr_size = RollableFile::page_size;
+    size_t file_size = 0;
+    bool writer = mode & CONSTS::ACCESS_MODE_WRITER;
+    struct stat st;
+    if(!(mode & CONSTS::MEMORY_ONLY_MODE) && stat(fpath.c_str(), &st) == 0 &&
+       st.st_size >= static_cast<off_t>(hdr_size + CHANGE_FEED_SIZE_MIN))
+        file_size = st.st_size;
+    else if(writer)
+        file_size = hdr_size + CHANGE_FEED_ALIGN(std::max(size, (int64_t) CHANGE_FEED_SIZE_MIN));
+    if(file_size == 0)
+        return;
+
+    bool map_file = true;
+    feed_file = ResourcePool::getInstance().OpenFile(fpath, mode, file_size, map_file,
+                                                     writer);
+    if(feed_file == NULL || !map_file)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to open change feed %s", fpath.c_str());
+        return;
+    }
+
+    uint8_t *addr = feed_file->GetMapAddr();
+    ChangeFeedHeader *hdr = reinterpret_cast<ChangeFeedHeader *>(addr);
+    uint64_t capacity = file_size - hdr_size;
+    if(hdr->magic != CHANGE_FEED_MAGIC || hdr->capacity != capacity)
+    {
+        if(!writer)
+            return;
+        // Sequence numbers start at one.
+        hdr->capacity = capacity;
+        hdr->head_seq.store(1, std::memory_order_relaxed);
+        hdr->head_off.store(0, std::memory_order_relaxed);
+        hdr->tail_seq.store(1, std::memory_order_relaxed);
+        hdr->tail_off.store(0, std::memory_order_relaxed);
+        hdr->magic = CHANGE_FEED_MAGIC;
+    }
+
+    header = hdr;
+    ring = addr + hdr_size;
+}
+
+ChangeFeed::~ChangeFeed()
+{
+}
+
+bool ChangeFeed::IsValid() const
+{
+    return header != NULL;
+}
+
+void ChangeFeed::CopyIn(const void *buff, size_t size, uint64_t offset)
+{
+    size_t pos = offset % header->capacity;
+    size_t len = std::min(size, static_cast<size_t>(header->capacity - pos));
+    memcpy(ring + pos, buff, len);
+    if(len < size)
+        memcpy(ring, static_cast<const uint8_t *>(buff) + len, size - len);
+}
+
+void ChangeFeed::CopyOut(void *buff, size_t size, uint64_t offset) const
+{
+    size_t pos = offset % header->capacity;
+    size_t len = std::min(size, static_cast<size_t>(header->capacity - pos));
+    memcpy(buff, ring + pos, len);
+    if(len < size)
+        memcpy(static_cast<uint8_t *>(buff) + len, ring, size - len);
+}
+
+// Only called by the writer after the update is applied.
+void ChangeFeed::Append(uint8_t type, const uint8_t *key, int len, const uint8_t *data,
+                        int data_len, int64_t expiry)
+{
+    ChangeRecord rec;
+    rec.seq = header->tail_seq.load(std::memory_order_relaxed);
+    rec.data_len = data_len;
+    rec.key_len = len;
+    rec.type = type;
+    rec.flags = (expiry != 0) ? CHANGE_FEED_FLAG_EXPIRY : 0;
+    uint64_t rec_size = record_size(rec);
+    uint64_t tail = header->tail_off.load(std::memory_order_relaxed);
+    uint64_t head = header->head_off.load(std::memory_order_relaxed);
+
+    if(tail + rec_size - head > header->capacity)
+    {
+        ChangeRecord old;
+        while(tail + rec_size - head > header->capacity)
+        {
+            CopyOut(&old, sizeof(old), head);
+            head += record_size(old);
+        }
+        header->head_seq.store(old.seq + 1, std::memory_order_relaxed);
+        header->head_off.store(head, std::memory_order_relaxed);
+        // The head has to be visible before the old records are overwritten.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    CopyIn(&rec, sizeof(rec), tail);
+    uint64_t body = tail + sizeof(rec) + expiry_size(rec);
+    if(expiry != 0)
+        CopyIn(&expiry, sizeof(expiry), tail + sizeof(rec));
+    if(len > 0)
+        CopyIn(key, len, body);
+    if(data_len > 0)
+        CopyIn(data, data_len, body + len);
+    header->tail_seq.store(rec.seq + 1, std::memory_order_relaxed);
+    header->tail_off.store(tail + rec_size, std::memory_order_release);
+}
+
+uint64_t ChangeFeed::FirstSeq() const
+{
+    return header->head_seq.load(std::memory_order_acquire);
+}
+
+uint64_t ChangeFeed::EndSeq() const
+{
+    return header->tail_seq.load(std::memory_order_acquire);
+}
+
+int ChangeFeed::Read(uint64_t &offset, MBChange &change) const
+{
+    if(offset == header->tail_off.load(std::memory_order_acquire))
+        return MBError::TRY_AGAIN;
+
+    ChangeRecord rec;
+    CopyOut(&rec, sizeof(rec), offset);
+    // The record can be overwritten while it is read; it is only used once
+    // the head shows that it was not.
+    if(rec.key_len <= CONSTS::MAX_KEY_LENGHTH &&
+       rec.data_len <= static_cast<uint32_t>(CONSTS::MAX_DATA_SIZE))
+    {
+        uint64_t body = offset + sizeof(rec) + expiry_size(rec);
+        change.expiry = 0;
+        if(rec.flags & CHANGE_FEED_FLAG_EXPIRY)
+            CopyOut(&change.expiry, sizeof(change.expiry), offset + sizeof(rec));
+        change.key.resize(rec.key_len);
+        change.value.resize(rec.data_len);
+        if(rec.key_len > 0)
+            CopyOut(&change.key[0], rec.key_len, body);
+        if(rec.data_len > 0)
+            CopyOut(&change.value[0], rec.data_len, body + rec.key_len);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(header->head_off.load(std::memory_order_relaxed) > offset)
+        return MBError::BUFFER_LOST;
+
+    change.seq = rec.seq;
+    change.type = rec.type;
+    offset += record_size(rec);
+    return MBError::SUCCESS;
+}
+
+// Walk from the oldest retained change; the records only know their own
+// size.
+int ChangeFeed::Seek(uint64_t seq, uint64_t &offset) const
+{
+    if(seq > EndSeq())
+        return MBError::INVALID_ARG;
+
+    while(true)
+    {
+        uint64_t head = header->head_off.load(std::memory_order_acquire);
+        uint64_t tail = header->tail_off.load(std::memory_order_acquire);
+        offset = head;
+        ChangeRecord rec;
+        uint64_t end_seq = 0;
+        bool lost = false;
+        while(offset < tail)
+        {
+            CopyOut(&rec, sizeof(rec), offset);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(header->head_off.load(std::memory_order_relaxed) > offset)
+            {
+                lost = true;
+                break;
+            }
+            if(rec.seq >= seq)
+            {
+                // The head moved past the requested change.
+                if(rec.seq > seq && seq != 0)
+                    return MBError::BUFFER_LOST;
+                return MBError::SUCCESS;
+            }
+            offset += record_size(rec);
+            end_seq = rec.seq + 1;
+        }
+        if(lost)
+            continue;
+
+        // The ring is only empty before the first change.
+        if(offset == head)
+            end_seq = FirstSeq();
+        return seq == 0 || seq == end_seq ? MBError::SUCCESS : MBError::BUFFER_LOST;
+    }
+}
+
+void ChangeFeed::PrintStats(std::ostream &out_stream) const
+{
+    uint64_t head = header->head_off.load(std::memory_order_relaxed);
+    uint64_t tail = header->tail_off.load(std::memory_order_relaxed);
+    out_stream << "Change feed: changes " << FirstSeq() << " to " << EndSeq() - 1
+               << " in " << tail - head << " of " << header->capacity << " bytes" << std::endl;
+}
+
+ChangeSubscriber::ChangeSubscriber(const std::string &mbdir)
+{
+    std::string dir = mbdir;
+    if(!dir.empty() && dir[dir.length()-1] != '/')
+        dir += "/";
+    feed = new ChangeFeed(dir, 0, CONSTS::ACCESS_MODE_READER);
+    next_seq = 0;
+    next_off = 0;
+    if(feed->IsValid())
+        Subscribe(feed->EndSeq());
+}
+
+ChangeSubscriber::~ChangeSubscriber()
+{
+    delete feed;
+}
+
+bool ChangeSubscriber::is_open() const
+{
+    return feed->IsValid();
+}
+
+int ChangeSubscriber::Subscribe(uint64_t seq)
+{
+    if(!feed->IsValid())
+        return MBError::NOT_INITIALIZED;
+
+    uint64_t offset;
+    int rval = feed->Seek(seq, offset);
+    if(rval != MBError::SUCCESS)
+        return rval;
+
+    next_off = offset;
+    next_seq = seq == 0 ? feed->FirstSeq() : seq;
+    return MBError::SUCCESS;
+}
+
+int ChangeSubscriber::Next(MBChange &change)
+{
+    if(!feed->IsValid())
+        return MBError::NOT_INITIALIZED;
+
+    int rval = feed->Read(next_off, change);
+    if(rval != MBError::SUCCESS)
+        return rval;
+    next_seq = change.seq + 1;
+    return MBError::SUCCESS;
+}
+
+uint64_t ChangeSubscriber::Position() const
+{
+    return next_seq;
+}
+
+uint64_t ChangeSubscriber::FirstSeq() const
+{
+    return feed->IsValid() ? feed->FirstSeq() : 0;
+}
+
+uint64_t ChangeSubscriber::EndSeq() const
+{
+    return feed->IsValid() ? feed->EndSeq() : 0;
+}
+
+// Applying a change again has no effect, so that a replica can resume
+// from the last change it knows to be applied. Values keep the expiry
+// time they got from the writer.
+int ChangeSubscriber::Apply(DB &db, const MBChange &change)
+{
+    int rval = MBError::INVALID_ARG;
+    MBData mbd;
+    switch(change.type)
+    {
+        case CHANGE_FEED_ADD:
+            if(change.expiry == 0)
+            {
+                rval = db.Add(change.key, change.value, true);
+                break;
+            }
+            mbd.buff = (uint8_t *) change.value.data();
+            mbd.data_len = change.value.size();
+            mbd.expiry = change.expiry;
+            rval = db.Add(change.key.data(), change.key.size(), mbd, true);
+            mbd.buff = NULL;
+            break;
+        case CHANGE_FEED_REMOVE:
+            rval = db.Remove(change.key);
+            if(rval == MBError::NOT_EXIST)
+                rval = MBError::SUCCESS;
+            break;
+        case CHANGE_FEED_REMOVE_ALL:
+            rval = db.RemoveAll();
+            break;
+    }
+    return rval;
+}
+
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __CHANGE_FEED_H__
+#define __CHANGE_FEED_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <iostream>
+
+#include "mmap_file.h"
+
+namespace mabain {
+
+// default size of the change ring
+#define CHANGE_FEED_SIZE_DEFAULT   (64LL*1024*1024)
+#define CHANGE_FEED_SIZE_MIN       (1024*1024)
+
+#define CHANGE_FEED_ADD            1
+#define CHANGE_FEED_REMOVE         2
+#define CHANGE_FEED_REMOVE_ALL     3
+// set if the expiry time of the value (8 bytes) precedes the key
+#define CHANGE_FEED_FLAG_EXPIRY    0x01
+
+class DB;
+
+// Header of the change feed file, followed by the ring. Offsets are
+// logical byte positions that only grow; a record is at offset modulo the
+// ring size.
+typedef struct _ChangeFeedHeader
+{
+    uint64_t magic;
+    uint64_t capacity;
+    // oldest retained change
+    std::atomic<uint64_t> head_seq;
+    std::atomic<uint64_t> head_off;
+    // next change to be appended
+    std::atomic<uint64_t> tail_seq;
+    std::atomic<uint64_t> tail_off;
+} ChangeFeedHeader;
+
+typedef struct _ChangeRecord
+{
+    uint64_t seq;
+    uint32_t data_len;
+    uint16_t key_len;
+    uint8_t  type;
+    uint8_t  flags;
+} ChangeRecord;
+
+// A change read from the feed
+typedef struct _MBChange
+{
+    uint64_t    seq;
+    int         type;   // CHANGE_FEED_*
+    std::string key;
+    std::string value;
+    int64_t     expiry; // expiry time of the value; zero if it does not expire
+} MBChange;
+
+// Ring of the updates applied by the writer, in the _mabain_f file of the
+// DB directory. Every Add, Remove and RemoveAll gets the next sequence
+// number; the oldest changes are dropped once the ring is full. The writer
+// moves the head past the changes it is about to overwrite before writing,
+// so that a subscriber can tell whether the change it copied is still
+// intact by checking the head afterwards.
+class ChangeFeed
+{
+public:
+    ChangeFeed(const std::string &mbdir, int64_t size, int mode);
+    ~ChangeFeed();
+
+    bool IsValid() const;
+    // Writer side
+    void Append(uint8_t type, const uint8_t *key, int len, const uint8_t *data,
+                int data_len, int64_t expiry = 0);
+    // Sequence numbers of the oldest retained change and of the next change
+    uint64_t FirstSeq() const;
+    uint64_t EndSeq() const;
+    // Find the offset of a retained change
+    int  Seek(uint64_t seq, uint64_t &offset) const;
+    // Copy the change at offset and advance offset past it
+    int  Read(uint64_t &offset, MBChange &change) const;
+    void PrintStats(std::ostream &out_stream) const;
+
+private:
+    void CopyIn(const void *buff, size_t size, uint64_t offset);
+    void CopyOut(void *buff, size_t size, uint64_t offset) const;
+
+    std::shared_ptr<MmapFileIO> feed_file;
+    ChangeFeedHeader *header;
+    uint8_t *ring;
+};
+
+// Tails the change feed of a DB from any retained sequence number. The
+// changes can be applied to another DB to keep it in sync with the
+// writer's DB.
+class ChangeSubscriber
+{
+public:
+    ChangeSubscriber(const std::string &mbdir);
+    ~ChangeSubscriber();
+
+    bool is_open() const;
+    // Start with the change of sequence number seq. Zero starts with the
+    // oldest retained change. Returns BUFFER_LOST if the change is no longer
+    // retained.
+    int  Subscribe(uint64_t seq);
+    // Get the next change. Returns TRY_AGAIN if there is no new change and
+    // BUFFER_LOST if the subscriber fell behind by more than the ring size.
+    int  Next(MBChange &change);
+    // Sequence number of the next change to be read
+    uint64_t Position() const;
+    uint64_t FirstSeq() const;
+    uint64_t EndSeq() const;
+
+    static int Apply(DB &db, const MBChange &change);
+
+private:
+    ChangeFeed *feed;
+    uint64_t next_seq;
+    uint64_t next_off;
+};
+
+}
+
+#endif
@@ -17,6 +17,7 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <iostream>
+#include <random>
 #include <unistd.h>
 #include <sys/syscall.h>
 
@@ -39,8 +40,8 @@
 
 namespace mabain {
 
-// Current mabain version 1.2.0
-uint16_t version[4] = {1, 2, 0, 0};
+// Current mabain version 1.4.0
+uint16_t version[4] = {1, 4, 0, 0};
 
 DB::~DB()
 {
@@ -156,6 +157,18 @@ int DB::ValidateConfig(MBConfig &config)
             std::cerr << "count in eviction bucket must be greater than 7\n";
             return MBError::INVALID_ARG;
         }
+        if(config.rc_max_pause_us <= 0)
+            config.rc_max_pause_us = MB_RC_MAX_PAUSE_DEFAULT;
+        if(config.journal_size <= 0)
+            config.journal_size = JOURNAL_SIZE_DEFAULT;
+        if(config.change_feed_size <= 0)
+            config.change_feed_size = CHANGE_FEED_SIZE_DEFAULT;
+        if((config.options & CONSTS::USE_JOURNAL) &&
+           (config.options & CONSTS::MEMORY_ONLY_MODE))
+        {
+            std::cerr << "journal is not supported in memory-only mode\n";
+            return MBError::INVALID_ARG;
+        }
     }
     if(config.options & CONSTS::USE_SLIDING_WINDOW)
     {
@@ -180,6 +193,12 @@ int DB::ValidateConfig(MBConfig &config)
         config.max_num_data_block = 1024;
     if (config.queue_size == 0)
         config.queue_size = MB_MAX_NUM_SHM_QUEUE_NODE;
+    if(config.prefault_threads <= 0)
+        config.prefault_threads = MB_PREFAULT_THREADS_DEFAULT;
+    if(config.hot_node_depth == 0)
+        config.hot_node_depth = HOT_NODE_DEPTH_DEFAULT;
+    if(config.hot_node_max <= 0)
+        config.hot_node_max = HOT_NODE_MAX_DEFAULT;
 
     return MBError::SUCCESS;
 }
@@ -257,8 +276,13 @@ void DB::PreCheckDB(const MBConfig &config, bool &init_header, bool &update_head
     if(!init_header && !(config.options & CONSTS::MEMORY_ONLY_MODE))
     {
         try {
+#ifdef __SHM_QUEUE__
+            DRMBase::ValidateHeaderFile(mb_dir + "_mabain_h", config.options,
+                                        ShmqBufferSize(config.queue_size), update_header);
+#else
             DRMBase::ValidateHeaderFile(mb_dir + "_mabain_h", config.options,
                                         config.queue_size * sizeof(AsyncNode), update_header);
+#endif
         } catch (int error) {
             status = error;
             return;
@@ -293,15 +317,15 @@ void DB::PostDBUpdate(const MBConfig &config, bool init_header, bool update_head
         return;
     }
 
-    lock.Init(dict->GetShmLockPtrs());
-    UpdateNumHandlers(config.options, 1);
-
-    if(config.options & CONSTS::ACCESS_MODE_WRITER)
+    if(dict->InitEviction(mb_dir, config.eviction_cap) != MBError::SUCCESS)
     {
-        if(config.options & CONSTS::ASYNC_WRITER_MODE)
-            async_writer = new AsyncWriter(this);
+        status = MBError::MMAP_FAILED;
+        return;
     }
 
+    lock.Init(dict->GetShmLockPtrs());
+    UpdateNumHandlers(config.options, 1);
+
 #ifdef __SHM_QUEUE__
     if(!(init_header || update_header))
     {
@@ -321,11 +345,45 @@ void DB::PostDBUpdate(const MBConfig &config, bool init_header, bool update_head
                 (config.options & CONSTS::ACCESS_MODE_WRITER) ? "writing":"reading");
     status = MBError::SUCCESS;
 
+    if(config.options & CONSTS::PREFAULT_ON_OPEN)
+        dict->Prefault(config.prefault_threads);
+
+    if(!(config.options & CONSTS::ACCESS_MODE_WRITER) && config.hot_node_depth > 0)
+        dict->InitHotNodeCache(config.hot_node_depth, config.hot_node_max);
+
     if(config.options & CONSTS::ACCESS_MODE_WRITER)
     {
         // Run rc exception recovery
         ResourceCollection rc(*this);
         rc.ExceptionRecovery();
+
+        // Replay the journal before the async writer starts taking updates.
+        if(config.options & CONSTS::USE_JOURNAL)
+        {
+            int rval = dict->InitJournal(mb_dir, config.journal_size);
+            if(rval != MBError::SUCCESS)
+            {
+                Logger::Log(LOG_LEVEL_ERROR, "failed to initialize journal: %s",
+                            MBError::get_error_str(rval));
+                status = rval;
+                return;
+            }
+        }
+
+        if(config.options & CONSTS::USE_CHANGE_FEED)
+        {
+            int rval = dict->InitChangeFeed(mb_dir, config.change_feed_size);
+            if(rval != MBError::SUCCESS)
+            {
+                Logger::Log(LOG_LEVEL_ERROR, "failed to initialize change feed: %s",
+                            MBError::get_error_str(rval));
+                status = rval;
+                return;
+            }
+        }
+
+        if(config.options & CONSTS::ASYNC_WRITER_MODE)
+            async_writer = new AsyncWriter(this);
     }
 }
 
@@ -425,7 +483,9 @@ int DB::Find(const char* key, int len, MBData &mdata) const
     if(options & CONSTS::ASYNC_WRITER_MODE)
         return MBError::NOT_ALLOWED;
 
-    return dict->Find(reinterpret_cast<const uint8_t*>(key), len, mdata);
+    int rval = dict->Find(reinterpret_cast<const uint8_t*>(key), len, mdata);
+    dict->RecordLookup(reinterpret_cast<const uint8_t*>(key), len, rval == MBError::SUCCESS);
+    return rval;
 }
 
 int DB::Find(const std::string &key, MBData &mdata) const
@@ -433,6 +493,28 @@ int DB::Find(const std::string &key, MBData &mdata) const
     return Find(key.data(), key.size(), mdata);
 }
 
+int DB::FindBatch(const std::vector<std::string> &keys, MBData *data,
+                  std::vector<int> &rvals) const
+{
+    if(data == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+    // Writer in async mode cannot be used for lookup
+    if(options & CONSTS::ASYNC_WRITER_MODE)
+        return MBError::NOT_ALLOWED;
+
+    rvals.resize(keys.size());
+    if(keys.empty())
+        return MBError::SUCCESS;
+
+    dict->FindBatch(&keys[0], data, &rvals[0], keys.size());
+    for(size_t i = 0; i < keys.size(); i++)
+        dict->RecordLookup(reinterpret_cast<const uint8_t*>(keys[i].data()), keys[i].size(),
+                           rvals[i] == MBError::SUCCESS);
+    return MBError::SUCCESS;
+}
+
 // Find all possible prefix matches. The caller needs to call this function
 // repeatedly if data.next is true.
 int DB::FindPrefix(const char* key, int len, MBData &data) const
@@ -489,18 +571,27 @@ int DB::Add(const char* key, int len, MBData &mbdata, bool overwrite)
 #ifndef __SHM_QUEUE__
     if(async_writer != NULL)
         return async_writer->Add(key, len, reinterpret_cast<const char *>(mbdata.buff),
-                                 mbdata.data_len, overwrite);
+                                 mbdata.data_len, overwrite, mbdata.expiry);
 
     rval = dict->Add(reinterpret_cast<const uint8_t*>(key), len, mbdata, overwrite);
+    if(rval == MBError::SUCCESS)
+        rval = dict->JournalAdd(reinterpret_cast<const uint8_t*>(key), len, mbdata, true);
+    if(rval == MBError::SUCCESS)
+        CheckSweeps();
 #else
     if (async_writer == NULL && (options & CONSTS::ACCESS_MODE_WRITER))
     {
         rval = dict->Add(reinterpret_cast<const uint8_t*>(key), len, mbdata, overwrite);
+        if(rval == MBError::SUCCESS)
+            rval = dict->JournalAdd(reinterpret_cast<const uint8_t*>(key), len, mbdata, true);
+        if(rval == MBError::SUCCESS)
+            CheckSweeps();
     }
     else
     {
         rval = dict->SHMQ_Add(reinterpret_cast<const char*>(key), len,
-                     reinterpret_cast<const char*>(mbdata.buff), mbdata.data_len, overwrite);
+                     reinterpret_cast<const char*>(mbdata.buff), mbdata.data_len, overwrite,
+                     mbdata.expiry);
     }
 #endif
 
@@ -526,10 +617,18 @@ int DB::Add(const char* key, int len, const char* data, int data_len, bool overw
     int rval = MBError::SUCCESS;
 #ifndef __SHM_QUEUE__
     rval = dict->Add(reinterpret_cast<const uint8_t*>(key), len, mbdata, overwrite);
+    if(rval == MBError::SUCCESS)
+        rval = dict->JournalAdd(reinterpret_cast<const uint8_t*>(key), len, mbdata, true);
+    if(rval == MBError::SUCCESS)
+        CheckSweeps();
 #else
     if (async_writer == NULL && (options & CONSTS::ACCESS_MODE_WRITER))
     {
         rval = dict->Add(reinterpret_cast<const uint8_t*>(key), len, mbdata, overwrite);
+        if(rval == MBError::SUCCESS)
+            rval = dict->JournalAdd(reinterpret_cast<const uint8_t*>(key), len, mbdata, true);
+        if(rval == MBError::SUCCESS)
+            CheckSweeps();
     }
     else
     {
@@ -542,6 +641,27 @@ int DB::Add(const char* key, int len, const char* data, int data_len, bool overw
     return rval;
 }
 
+int DB::AddWithTTL(const char* key, int len, const char* data, int data_len, int64_t ttl_ms,
+                   bool overwrite)
+{
+    if(data == NULL || ttl_ms <= 0)
+        return MBError::INVALID_ARG;
+
+    MBData mbdata;
+    mbdata.data_len = data_len;
+    mbdata.buff = (uint8_t*) data;
+    mbdata.expiry = CurrentTimeMs() + ttl_ms;
+    int rval = Add(key, len, mbdata, overwrite);
+    mbdata.buff = NULL;
+    return rval;
+}
+
+int DB::AddWithTTL(const std::string &key, const std::string &value, int64_t ttl_ms,
+                   bool overwrite)
+{
+    return AddWithTTL(key.data(), key.size(), value.data(), value.size(), ttl_ms, overwrite);
+}
+
 int DB::Add(const std::string &key, const std::string &value, bool overwrite)
 {
     return Add(key.data(), key.size(), value.data(), value.size(), overwrite);
@@ -561,10 +681,14 @@ int DB::Remove(const char *key, int len)
         return async_writer->Remove(key, len);
 
     rval = dict->Remove(reinterpret_cast<const uint8_t*>(key), len);
+    if(rval == MBError::SUCCESS)
+        rval = dict->JournalRemove(reinterpret_cast<const uint8_t*>(key), len, true);
 #else
     if (async_writer == NULL && (options & CONSTS::ACCESS_MODE_WRITER))
     {
         rval = dict->Remove(reinterpret_cast<const uint8_t*>(key), len);
+        if(rval == MBError::SUCCESS)
+            rval = dict->JournalRemove(reinterpret_cast<const uint8_t*>(key), len, true);
     }
     else
     {
@@ -580,6 +704,81 @@ int DB::Remove(const std::string &key)
     return Remove(key.data(), key.size());
 }
 
+int DB::AddBatch(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                 bool overwrite)
+{
+    if(keys.size() != values.size())
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+    if(keys.empty())
+        return MBError::SUCCESS;
+
+    int rval = MBError::SUCCESS;
+#ifndef __SHM_QUEUE__
+    if(async_writer != NULL)
+        return async_writer->AddBatch(&keys[0], &values[0], keys.size(), overwrite);
+#else
+    if(async_writer != NULL || !(options & CONSTS::ACCESS_MODE_WRITER))
+        return dict->SHMQ_AddBatch(&keys[0], &values[0], keys.size(), overwrite);
+#endif
+
+    MBData mbdata;
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        mbdata.data_len = values[i].size();
+        mbdata.buff = (uint8_t*) values[i].data();
+        int ret = dict->Add(reinterpret_cast<const uint8_t*>(keys[i].data()), keys[i].size(),
+                            mbdata, overwrite);
+        if(ret == MBError::SUCCESS)
+            ret = dict->JournalAdd(reinterpret_cast<const uint8_t*>(keys[i].data()),
+                                   keys[i].size(), mbdata, false);
+        if(ret == MBError::SUCCESS)
+            CheckSweeps();
+        else if(rval == MBError::SUCCESS)
+            rval = ret;
+    }
+
+    // One journal commit for the whole batch
+    int ret = dict->CommitJournal();
+    if(rval == MBError::SUCCESS)
+        rval = ret;
+    mbdata.buff = NULL;
+    return rval;
+}
+
+int DB::RemoveBatch(const std::vector<std::string> &keys)
+{
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+    if(keys.empty())
+        return MBError::SUCCESS;
+
+    int rval = MBError::SUCCESS;
+#ifndef __SHM_QUEUE__
+    if(async_writer != NULL)
+        return async_writer->RemoveBatch(&keys[0], keys.size());
+#else
+    if(async_writer != NULL || !(options & CONSTS::ACCESS_MODE_WRITER))
+        return dict->SHMQ_RemoveBatch(&keys[0], keys.size());
+#endif
+
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        int ret = dict->Remove(reinterpret_cast<const uint8_t*>(keys[i].data()), keys[i].size());
+        if(ret == MBError::SUCCESS)
+            ret = dict->JournalRemove(reinterpret_cast<const uint8_t*>(keys[i].data()),
+                                      keys[i].size(), false);
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+    }
+
+    int ret = dict->CommitJournal();
+    if(rval == MBError::SUCCESS)
+        rval = ret;
+    return rval;
+}
+
 int DB::RemoveAll()
 {
     if(status != MBError::SUCCESS)
@@ -588,10 +787,15 @@ int DB::RemoveAll()
 #ifndef __SHM_QUEUE__
     if(async_writer != NULL)
         return async_writer->RemoveAll();
+#else
+    if(async_writer != NULL || !(options & CONSTS::ACCESS_MODE_WRITER))
+        return dict->SHMQ_RemoveAll();
 #endif
 
     int rval;
     rval = dict->RemoveAll();
+    if(rval == MBError::SUCCESS)
+        rval = dict->JournalRemoveAll(true);
     return rval;
 }
 
@@ -695,6 +899,155 @@ int DB::CollectResource(int64_t min_index_rc_size, int64_t min_data_rc_size,
     return MBError::SUCCESS;
 }
 
+int DB::GetRCStats(MBRCStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    return dict->GetRCStats(stats);
+}
+
+int DB::GetEvictionStats(MBEvictionStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    dict->GetEvictionStats(stats);
+    return MBError::SUCCESS;
+}
+
+int DB::GetExpiryStats(MBExpiryStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    dict->GetExpiryStats(stats);
+    return MBError::SUCCESS;
+}
+
+int DB::ExpireEntries()
+{
+    if(status != MBError::SUCCESS)
+        return status;
+    if(!(options & CONSTS::ACCESS_MODE_WRITER) || (options & CONSTS::ASYNC_WRITER_MODE))
+        return MBError::NOT_ALLOWED;
+
+    int rval;
+    try {
+        ResourceCollection rc(*this);
+        rval = rc.ExpireEntries(false);
+    } catch (int error) {
+        rval = error;
+    }
+    if(rval != MBError::SUCCESS)
+        Logger::Log(LOG_LEVEL_WARN, "failed to expire entries: %s",
+                    MBError::get_error_str(rval));
+    return rval;
+}
+
+int DB::TrainValueCodec(int max_sample)
+{
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+    // The async writer thread keeps adding values while the sample is
+    // taken and the codec is installed.
+    if(options & CONSTS::ASYNC_WRITER_MODE)
+        return MBError::NOT_ALLOWED;
+    if(max_sample <= 0)
+        return MBError::INVALID_ARG;
+
+    // Reservoir sampling over the stored values
+    std::vector<std::string> samples;
+    std::minstd_rand gen(max_sample);
+    int64_t num = 0;
+    for(DB::iterator iter = begin(false); iter != end(); ++iter)
+    {
+        std::string value((const char *) iter.value.buff, iter.value.data_len);
+        if(num < max_sample)
+        {
+            samples.push_back(value);
+        }
+        else
+        {
+            int64_t j = gen() % (num + 1);
+            if(j < max_sample)
+                samples[j] = value;
+        }
+        num++;
+    }
+    return TrainValueCodec(samples);
+}
+
+int DB::TrainValueCodec(const std::vector<std::string> &samples)
+{
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+    if(options & CONSTS::ASYNC_WRITER_MODE)
+        return MBError::NOT_ALLOWED;
+
+    return dict->InitValueCodec(samples);
+}
+
+int DB::GetPrefaultStats(MBPrefaultStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    dict->GetPrefaultStats(stats);
+    return MBError::SUCCESS;
+}
+
+int DB::GetHotNodeStats(MBHotNodeStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    dict->GetHotNodeStats(stats);
+    return MBError::SUCCESS;
+}
+
+int DB::GetRetryStats(MBRetryStats &stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    LockFree::GetRetryStats(stats);
+    return MBError::SUCCESS;
+}
+
+int DB::GetFreeListStats(MBFreeListStats &index_stats, MBFreeListStats &data_stats) const
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    return dict->GetFreeListStats(index_stats, data_stats);
+}
+
+// Remove the entries of the expired buckets and run the CLOCK sweeper once
+// the writer goes over the eviction cap. Updates in async writer mode are
+// checked by the async writer thread instead.
+void DB::CheckSweeps()
+{
+    if(!(options & CONSTS::ACCESS_MODE_WRITER))
+        return;
+
+    try {
+        if(dict->ExpiryDue())
+        {
+            ResourceCollection rc(*this);
+            rc.ExpireEntries(true);
+        }
+        if(dict->OverEvictionCap())
+        {
+            ResourceCollection rc(*this);
+            rc.ClockEviction();
+        }
+    } catch (int error) {
+        Logger::Log(LOG_LEVEL_WARN, "writer sweep failed: %s",
+                    MBError::get_error_str(error));
+    }
+}
+
 int64_t DB::Count() const
 {
     if(status != MBError::SUCCESS)
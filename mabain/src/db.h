@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "mb_data.h"
 #include "error.h"
@@ -31,6 +32,18 @@ namespace mabain {
 
 
 #define MB_MAX_NUM_SHM_QUEUE_NODE  64
+// default maximum time in microseconds resource collection runs before
+// letting queued async updates through
+#define MB_RC_MAX_PAUSE_DEFAULT    5000
+// default number of threads prefaulting the mapped blocks at open
+#define MB_PREFAULT_THREADS_DEFAULT 4
+
+// resource collection phases reported in MBRCStats
+#define MB_RC_PHASE_NONE           0
+#define MB_RC_PHASE_EVICTION       1
+#define MB_RC_PHASE_REORDER        2
+#define MB_RC_PHASE_COLLECT        3
+#define MB_RC_PHASE_RC_TREE        4
 
 class Dict;
 class MBlsq;
@@ -55,8 +68,120 @@ typedef struct _MBConfig
     // All entries in the oldest buckets will be pruned.
     int num_entry_per_bucket;
     uint32_t queue_size;
+
+    // Maximum time in microseconds resource collection in the async writer
+    // runs before processing the queued updates. Zero uses the default.
+    int64_t rc_max_pause_us;
+
+    // Maximum index plus data size in bytes in use. Once exceeded, the writer
+    // sweeps the keys CLOCK-style and evicts the entries not looked up in the
+    // current or the previous round until the size drops below 95% of the
+    // cap. Zero disables the eviction.
+    int64_t eviction_cap;
+
+    // Size in bytes the redo journal grows to before the DB files are
+    // flushed and the journal is truncated. Only used with USE_JOURNAL. Zero
+    // uses the default.
+    // The journal is not write-ahead: an update is logged after it is applied
+    // to the mapped DB files, whose pages the kernel may write back before
+    // the record is committed. Synchronous updates return once their record
+    // is committed; the async writer commits in groups. After a crash, replay
+    // restores the committed updates; the uncommitted ones may be lost or
+    // partially applied.
+    int64_t journal_size;
+
+    // Number of threads faulting in the mapped blocks in the background
+    // with PREFAULT_ON_OPEN. Zero uses the default.
+    int prefault_threads;
+
+    // Number of index levels below the root and maximum number of nodes
+    // kept in the hot node cache of reader handles. Zero uses the default;
+    // a negative depth disables the cache.
+    int hot_node_depth;
+    int hot_node_max;
+
+    // Size in bytes of the change ring with USE_CHANGE_FEED. Only used when
+    // the ring is created. Zero uses the default.
+    int64_t change_feed_size;
 } MBConfig;
 
+// Progress of the running or the last resource collection
+typedef struct _MBRCStats
+{
+    int     phase;          // MB_RC_PHASE_*; MB_RC_PHASE_NONE if not running
+    int64_t work_total;     // bytes (entries for eviction and rc tree) of the phase
+    int64_t work_done;      // bytes (entries) of the phase processed so far
+    int64_t bytes_moved;    // index and data bytes copied
+    int64_t num_pause;      // number of times queued updates were let through
+    int64_t max_pause_us;   // longest time updates were held back
+    int64_t p99_pause_us;   // 99th percentile of the time updates were held back
+} MBRCStats;
+
+// CLOCK eviction counters. The lookup counters are kept per handle; the
+// others are shared by all handles of the DB.
+typedef struct _MBEvictionStats
+{
+    int64_t cap;            // eviction cap; zero if eviction is disabled
+    int64_t live_size;      // index and data bytes in use
+    int64_t num_evicted;    // entries evicted by the sweeper
+    int64_t num_scanned;    // entries visited by the sweeper
+    int64_t sweep_time_us;  // time spent sweeping
+    int64_t num_lookup;     // Find calls on this handle
+    int64_t num_hit;        // Find calls on this handle that found the key
+} MBEvictionStats;
+
+// Expiry counters, shared by all handles of the DB
+typedef struct _MBExpiryStats
+{
+    int64_t num_add;          // entries added with an expiry time
+    int64_t num_expired;      // expired entries removed by expiry sweeps
+    int64_t bytes_reclaimed;  // index and data bytes released by these removals
+    int64_t sweep_time_us;    // time spent in expiry sweeps
+    int64_t num_pending;      // keys in the writer's expiry index; zero for readers
+} MBExpiryStats;
+
+// Prefaulting of the index and data blocks at open (PREFAULT_ON_OPEN)
+typedef struct _MBPrefaultStats
+{
+    bool    done;           // all prefault threads have finished
+    int64_t bytes;          // mapped bytes prefaulted
+    int64_t minor_faults;   // page faults taken by the prefault threads
+    int64_t major_faults;   // page faults that had to read from disk
+    int64_t warm_us;        // time from open until all pages were faulted in
+} MBPrefaultStats;
+
+// Hot node cache of a reader handle
+typedef struct _MBHotNodeStats
+{
+    int64_t num_node;         // nodes in the cache
+    int64_t num_hit;          // node reads served from the cache
+    int64_t num_miss;         // node reads of the cached levels that went to the index
+    int64_t num_invalidation; // times the cache was dropped after index updates
+} MBHotNodeStats;
+
+// Lock-free reader retries of all DB handles in the process
+typedef struct _MBRetryStats
+{
+    int64_t num_lookup;       // lookups that had to retry
+    int64_t num_retry;        // retries of these lookups
+    int64_t max_retry_chain;  // most retries of a single lookup
+    int64_t retry_time_us;    // time spent by lookups from the first try to success
+    int64_t num_starved;      // lookups that used up the retry budget
+    int64_t writer_yield_us;  // time the writer in this process backed off for them
+} MBRetryStats;
+
+// Free buffers of the index or the data file of the writer
+typedef struct _MBFreeListStats
+{
+    int64_t num_buffer;       // free buffers
+    int64_t free_size;        // bytes in free buffers
+    int64_t largest_buffer;   // size of the largest free buffer
+    int64_t num_reuse;        // allocations served by a buffer of the same size
+    int64_t num_split;        // allocations served by splitting a larger buffer
+    int64_t num_miss;         // allocations that had to grow the file
+    int64_t num_coalesce;     // free buffers merged into the buffer before them
+} MBFreeListStats;
+
 // Database handle class
 class DB
 {
@@ -74,7 +199,13 @@ public:
         iterator(const DB &db, int iter_state);
         // Copy constructor
         iterator(const iterator &rhs);
-        void init(bool check_async_mode = true);
+        // Expired entries are skipped unless keep_expired is set, which is
+        // only done by the writer's internal scans.
+        void init(bool check_async_mode = true, bool keep_expired = false);
+        // Only iterate over the keys in [lower, upper). An empty upper means
+        // no upper bound. Subtrees out of the range are not visited.
+        void init_range(const std::string &lower, const std::string &upper,
+                        bool check_async_mode = true, bool keep_expired = false);
         int init_no_next();
         ~iterator();
 
@@ -92,6 +223,8 @@ public:
         bool next_dbt_buffer(struct _DBTraverseNode *dbt_n);
         void add_node_offset(size_t node_offset);
         iterator* next();
+        bool key_in_range(const std::string &key) const;
+        bool node_in_range(const std::string &node_key) const;
 
         const DB &db_ref;
         int state;
@@ -101,8 +234,15 @@ public:
         MBlsq *node_stack;
         MBlsq *kv_per_node;
         LockFree *lfree;
+        bool bounded;
+        bool keep_expired;
+        std::string lower_bound;
+        std::string upper_bound;
     };
 
+    // Callback for ParallelIterate. It is called from multiple threads.
+    typedef void (*IterCallback)(const std::string &key, const MBData &value, void *arg);
+
     // db_path: database directory
     // db_options: db access option (read/write)
     // memcap_index: maximum memory size in bytes for key index
@@ -121,9 +261,24 @@ public:
     int Add(const char* key, int len, const char* data, int data_len, bool overwrite = false);
     int Add(const char* key, int len, MBData &data, bool overwrite = false);
     int Add(const std::string &key, const std::string &value, bool overwrite = false);
+    // Add a key-value pair that expires ttl_ms milliseconds from now. Expired
+    // entries are not found by Find, FindBatch and FindPrefix and can be
+    // added again without overwrite. They are removed by the writer in bulk
+    // once all keys of their one-second bucket expired, and by
+    // CollectResource and ExpireEntries. Add with an MBData sets the
+    // absolute expiry time (ms since epoch) in MBData::expiry instead.
+    int AddWithTTL(const char* key, int len, const char* data, int data_len, int64_t ttl_ms,
+                   bool overwrite = false);
+    int AddWithTTL(const std::string &key, const std::string &value, int64_t ttl_ms,
+                   bool overwrite = false);
     // Find an entry by exact match using a key
     int Find(const char* key, int len, MBData &mdata) const;
     int Find(const std::string &key, MBData &mdata) const;
+    // Find entries of multiple keys by exact match. The lookups are
+    // interleaved so that their index reads overlap. data must hold
+    // keys.size() entries; rvals[i] is what Find returns for keys[i].
+    int FindBatch(const std::vector<std::string> &keys, MBData *data,
+                  std::vector<int> &rvals) const;
     // Find all possible prefix matches using a key
     // This is not fully implemented yet.
     int FindPrefix(const char* key, int len, MBData &data) const;
@@ -134,6 +289,12 @@ public:
     int Remove(const char *key, int len);
     int Remove(const std::string &key);
     int RemoveAll();
+    // Add/remove multiple entries. In async mode, the updates are submitted
+    // to the async writer in runs of queue slots instead of one by one.
+    // The first error encountered is returned.
+    int AddBatch(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                 bool overwrite = false);
+    int RemoveBatch(const std::vector<std::string> &keys);
     // DB Backup
     int Backup(const char *backup_dir);
 
@@ -149,8 +310,29 @@ public:
     // than min_data_rc_size, rc will be ignored for data segment.
     // eviction will be ignored if db size is less than 0xFFFFFFFFFFFF and db count is
     // less than 0xFFFFFFFFFFFF.
+    // In async writer mode, rc runs in slices of at most rc_max_pause_us
+    // (see MBConfig) and processes the queued updates between the slices.
     int CollectResource(int64_t min_index_rc_size = 33554432 , int64_t min_data_rc_size = 33554432,
                         int64_t max_dbsiz = MAX_6B_OFFSET, int64_t max_dbcnt = MAX_6B_OFFSET);
+    int GetRCStats(MBRCStats &stats) const;
+    int GetEvictionStats(MBEvictionStats &stats) const;
+    int GetExpiryStats(MBExpiryStats &stats) const;
+    int GetPrefaultStats(MBPrefaultStats &stats) const;
+    int GetHotNodeStats(MBHotNodeStats &stats) const;
+    int GetRetryStats(MBRetryStats &stats) const;
+    // Writer only
+    int GetFreeListStats(MBFreeListStats &index_stats, MBFreeListStats &data_stats) const;
+    // Remove all expired entries now. Writer only; not allowed in async
+    // writer mode, where the async writer thread removes them.
+    int ExpireEntries();
+
+    // Compress the values added from now on with a dictionary trained from
+    // a sample of the stored values, or from the given samples. Values are
+    // only stored compressed if they get smaller. The dictionary is kept in
+    // the DB header and cannot be retrained. Writer only; not allowed in
+    // async writer mode.
+    int TrainValueCodec(int max_sample = 1000);
+    int TrainValueCodec(const std::vector<std::string> &samples);
 
     // Multi-thread update using async thread
     // FOR THIS TO WORK, WRITER MUST BE THE LAST ONE TO CLOSE HANDLE.
@@ -196,14 +378,27 @@ public:
     void GetDBConfig(MBConfig &config) const;
 
     //iterator
-    const iterator begin(bool check_async_mode = true, bool rc_mode = false) const;
+    // Iterators skip expired entries. The rc and eviction scans keep them.
+    const iterator begin(bool check_async_mode = true, bool rc_mode = false,
+                         bool keep_expired = false) const;
     const iterator end() const;
+    // iterator over the keys in [lower, upper); an empty upper means no upper bound
+    const iterator range_begin(const std::string &lower, const std::string &upper,
+                               bool check_async_mode = true, bool keep_expired = false) const;
+    // iterator over the keys starting with prefix
+    const iterator prefix_begin(const std::string &prefix, bool check_async_mode = true) const;
+    // Iterate over the keys starting with prefix using num_threads threads.
+    // The edges below the prefix are split into num_threads ranges of the
+    // next key byte and each range is walked by its own reader handle.
+    int ParallelIterate(int num_threads, IterCallback callback, void *arg,
+                        const std::string &prefix = "") const;
 
 private:
     void InitDB(MBConfig &config);
     void PreCheckDB(const MBConfig &config, bool &init_header, bool &update_header);
     void PostDBUpdate(const MBConfig &config, bool init_header, bool update_header);
     static int ValidateConfig(MBConfig &config);
+    void CheckSweeps();
 
     // DB directory
     std::string mb_dir;
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <iostream>
+#include <algorithm>
 #include <errno.h>
 
 #include "mabain_consts.h"
@@ -28,10 +29,19 @@
 #include "integer_4b_5b.h"
 #include "async_writer.h"
 #include "util/shm_mutex.h"
+#include "resource_pool.h"
 
 #define MAX_DATA_BUFFER_RESERVE_SIZE    0xFFFF
 #define NUM_DATA_BUFFER_RESERVE         MAX_DATA_BUFFER_RESERVE_SIZE/DATA_BUFFER_ALIGNMENT
 #define DATA_HEADER_SIZE                32
+#define EVICTION_REF_SIZE               1024*1024     // number of reference slots
+#define FIND_BATCH_WIDTH                16            // lookups FindBatch keeps in flight
+#define FIND_PREFETCH_SIZE              128
+#define EXPIRY_BUCKET_MS                1000          // time span of an expiry index bucket
+
+#define FIND_STATE_EDGE                 1
+#define FIND_STATE_DATA                 2
+#define FIND_STATE_DONE                 3
 
 #define READER_LOCK_FREE_START               \
     LockFreeData snapshot;                   \
@@ -44,6 +54,15 @@
 
 namespace mabain {
 
+// Expired entries are absent to lookups until they are removed by the
+// expiry sweep.
+static inline int check_expiry(const MBData &data, int rval)
+{
+    if(rval == MBError::SUCCESS && data.expiry != 0 && data.expiry <= CurrentTimeMs())
+        return MBError::NOT_EXIST;
+    return rval;
+}
+
 Dict::Dict(const std::string &mbdir, bool init_header, int datasize,
            int db_options, size_t memsize_index, size_t memsize_data,
            uint32_t block_sz_idx, uint32_t block_sz_data,
@@ -59,6 +78,17 @@ Dict::Dict(const std::string &mbdir, bool init_header, int datasize,
 {
     status = MBError::NOT_INITIALIZED;
     reader_rc_off = 0;
+    ref_rounds = NULL;
+    clock_hand.pos = 0;
+    clock_hand.sample_step = 1;
+    expiry_index.num_key = 0;
+    expiry_index.rebuild = false;
+    num_lookup = 0;
+    num_hit = 0;
+    journal = NULL;
+    journal_replay = false;
+    feed = NULL;
+    hot_cache = NULL;
 
     header = mm.GetHeaderPtr();
     if(header == NULL)
@@ -112,7 +142,8 @@ Dict::Dict(const std::string &mbdir, bool init_header, int datasize,
         header->m_data_offset = GetStartDataOffset(); // start from a non-zero offset
         // We known that only writers will set init_header to true.
         free_lists = new FreeList(mbdir+"_dbfl", DATA_BUFFER_ALIGNMENT,
-                                  NUM_DATA_BUFFER_RESERVE);
+                                  NUM_DATA_BUFFER_RESERVE, MAX_BUFFER_PER_LIST,
+                                  header->data_block_size);
     }
     else
     {
@@ -127,7 +158,9 @@ Dict::Dict(const std::string &mbdir, bool init_header, int datasize,
             mm.ResetSlidingWindow();
             ResetSlidingWindow();
             free_lists = new FreeList(mbdir+"_dbfl", DATA_BUFFER_ALIGNMENT,
-                                      NUM_DATA_BUFFER_RESERVE);
+                                      NUM_DATA_BUFFER_RESERVE, MAX_BUFFER_PER_LIST,
+                                      header->data_block_size);
+            expiry_index.rebuild = header->expiry_num_add > 0;
             if(mm.IsValid())
             {
                 int rval = ExceptionRecovery();
@@ -190,12 +223,32 @@ int Dict::Init(uint32_t id)
 
 void Dict::Destroy()
 {
+    if(journal != NULL)
+    {
+        // Nothing is left to replay after a clean close.
+        if(CommitJournal() == MBError::SUCCESS)
+            CheckpointJournal();
+        delete journal;
+        journal = NULL;
+    }
+    if(feed != NULL)
+    {
+        delete feed;
+        feed = NULL;
+    }
+
     if(options & CONSTS::ACCESS_MODE_WRITER)
     {
         mm.ResetSlidingWindow();
         ResetSlidingWindow();
     }
 
+    if(hot_cache != NULL)
+    {
+        delete hot_cache;
+        hot_cache = NULL;
+    }
+
     mm.Destroy();
 
     if(free_lists != NULL)
@@ -212,7 +265,8 @@ int Dict::Status() const
 
 // Add a key-value pair
 // if overwrite is true and an entry with input key already exists, the old data will
-// be overwritten. Otherwise, IN_DICT will be returned.
+// be overwritten. Otherwise, IN_DICT will be returned. An expired entry is
+// overwritten either way.
 int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
 {
     if(!(options & CONSTS::ACCESS_MODE_WRITER))
@@ -220,11 +274,13 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
         return MBError::NOT_ALLOWED;
     }
     if(len > CONSTS::MAX_KEY_LENGHTH || data.data_len > CONSTS::MAX_DATA_SIZE ||
-       len <= 0 || data.data_len <= 0)
+       len <= 0 || data.data_len <= 0 || data.expiry < 0 ||
+       data.expiry > (int64_t) MAX_6B_OFFSET)
         return MBError::OUT_OF_BOUND;
 
     EdgePtrs edge_ptrs;
     size_t data_offset = 0;
+    int key_len = len;
     int rval;
 
     rval = mm.GetRootEdge_Writer(data.options & CONSTS::OPTION_RC_MODE, key[0], edge_ptrs);
@@ -233,7 +289,7 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
 
     if(edge_ptrs.len_ptr[0] == 0)
     {
-        ReserveData(data.buff, data.data_len, data_offset);
+        ReserveData(data.buff, data.data_len, data_offset, data.expiry);
         // Add the first edge along this edge
         mm.AddRootEdge(edge_ptrs, key, len, data_offset);
         if(data.options & CONSTS::OPTION_RC_MODE)
@@ -245,6 +301,8 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
             header->count++;
             header->num_update++;
         }
+        if(data.expiry != 0)
+            AddedWithExpiry(key, key_len, data);
 
         return MBError::SUCCESS;
     }
@@ -290,31 +348,31 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
             }
             if(!next)
             {
-                ReserveData(data.buff, data.data_len, data_offset);
+                ReserveData(data.buff, data.data_len, data_offset, data.expiry);
                 rval = mm.UpdateNode(edge_ptrs, p, len, data_offset);
             }
             else if(match_len < static_cast<int>(edge_ptrs.len_ptr[0]))
             {
                 if(len > match_len)
                 {
-                    ReserveData(data.buff, data.data_len, data_offset);
+                    ReserveData(data.buff, data.data_len, data_offset, data.expiry);
                     rval = mm.AddLink(edge_ptrs, match_len, p+match_len, len-match_len,
                                       data_offset, data);
                 }
                 else if(len == match_len)
                 {
-                    ReserveData(data.buff, data.data_len, data_offset);
+                    ReserveData(data.buff, data.data_len, data_offset, data.expiry);
                     rval = mm.InsertNode(edge_ptrs, match_len, data_offset, data);
                 }
             }
             else if(len == 0)
             {
-                rval = UpdateDataBuffer(edge_ptrs, overwrite, data.buff, data.data_len, inc_count);
+                rval = UpdateDataBuffer(edge_ptrs, overwrite, data, inc_count);
             }
         }
         else
         {
-            ReserveData(data.buff, data.data_len, data_offset);
+            ReserveData(data.buff, data.data_len, data_offset, data.expiry);
             rval = mm.AddLink(edge_ptrs, i, p+i, len-i, data_offset, data);
         }
     }
@@ -327,19 +385,19 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
         }
         if(i < len)
         {
-            ReserveData(data.buff, data.data_len, data_offset);
+            ReserveData(data.buff, data.data_len, data_offset, data.expiry);
             rval = mm.AddLink(edge_ptrs, i, p+i, len-i, data_offset, data);
         }
         else
         {
             if(edge_ptrs.len_ptr[0] > len)
             {
-                ReserveData(data.buff, data.data_len, data_offset);
+                ReserveData(data.buff, data.data_len, data_offset, data.expiry);
                 rval = mm.InsertNode(edge_ptrs, i, data_offset, data);
             }
             else
             {
-                rval = UpdateDataBuffer(edge_ptrs, overwrite, data.buff, data.data_len, inc_count);
+                rval = UpdateDataBuffer(edge_ptrs, overwrite, data, inc_count);
             }
         }
     }
@@ -356,6 +414,8 @@ int Dict::Add(const uint8_t *key, int len, MBData &data, bool overwrite)
         if(inc_count)
             header->count++;
     }
+    if(rval == MBError::SUCCESS && data.expiry != 0)
+        AddedWithExpiry(key, key_len, data);
     return rval;
 }
 
@@ -377,13 +437,31 @@ int Dict::ReadDataFromEdge(MBData &data, const EdgePtrs &edge_ptrs) const
         data_off = Get6BInteger(node_buff+2);
     }
     data.data_offset = data_off;
+    return ReadDataBuffer(data, data_off);
+}
 
+int Dict::ReadDataBuffer(MBData &data, size_t data_off) const
+{
     uint16_t data_len[2];
     // Read data length first
     if(ReadData(reinterpret_cast<uint8_t*>(&data_len[0]), DATA_HDR_BYTE, data_off)
                != DATA_HDR_BYTE)
         return MBError::READ_ERROR;
     data_off += DATA_HDR_BYTE;
+    data.bucket_index = data_len[1];
+    data.expiry = 0;
+    if(data_len[1] == DATA_TTL_BUCKET)
+    {
+        uint8_t ttl_buff[DATA_TTL_BYTE];
+        if(ReadData(ttl_buff, DATA_TTL_BYTE, data_off) != DATA_TTL_BYTE)
+            return MBError::READ_ERROR;
+        memcpy(&data.bucket_index, ttl_buff, sizeof(data.bucket_index));
+        data.expiry = Get6BInteger(ttl_buff + 2);
+        data_off += DATA_TTL_BYTE;
+    }
+    if(data_len[0] & DATA_COMPRESSED_FLAG)
+        return ReadCompressedData(data, data_len[0] & DATA_SIZE_MASK, data_off);
+
     if(data.buff_len < data_len[0] + 1)
     {
         if(data.Resize(data_len[0]) != MBError::SUCCESS)
@@ -393,7 +471,35 @@ int Dict::ReadDataFromEdge(MBData &data, const EdgePtrs &edge_ptrs) const
         return MBError::READ_ERROR;
 
     data.data_len = data_len[0];
-    data.bucket_index = data_len[1];
+    return MBError::SUCCESS;
+}
+
+// The compressed value is read into the tail of the data buffer and
+// decompressed into the head, which is raw_len bytes and does not overlap
+// the tail.
+int Dict::ReadCompressedData(MBData &data, int size, size_t data_off) const
+{
+    uint16_t raw_len;
+    if(size < (int) sizeof(raw_len) ||
+       ReadData(reinterpret_cast<uint8_t*>(&raw_len), sizeof(raw_len), data_off)
+               != sizeof(raw_len))
+        return MBError::READ_ERROR;
+    if(raw_len > CONSTS::MAX_DATA_SIZE)
+        return MBError::READ_ERROR;
+
+    if(data.buff_len < raw_len + size)
+    {
+        if(data.Resize(raw_len + size) != MBError::SUCCESS)
+            return MBError::NO_MEMORY;
+    }
+    uint8_t *src = data.buff + raw_len;
+    if(ReadData(src, size, data_off) != size)
+        return MBError::READ_ERROR;
+    if(!ValueCodec::Decompress(header->codec_dict, header->codec_dict_size, src, size,
+                               data.buff, raw_len))
+        return MBError::READ_ERROR;
+
+    data.data_len = raw_len;
     return MBError::SUCCESS;
 }
 
@@ -404,18 +510,18 @@ int Dict::DeleteDataFromEdge(MBData &data, EdgePtrs &edge_ptrs)
 {
     int rval = MBError::SUCCESS;
     size_t data_off;
-    uint16_t data_len;
+    uint16_t data_len[2];
     int rel_size;
 
     // Check if this is a leaf node first by using the EDGE_FLAG_DATA_OFF bit
     if(edge_ptrs.flag_ptr[0] & EDGE_FLAG_DATA_OFF)
     {
         data_off = Get6BInteger(edge_ptrs.offset_ptr);
-        if(ReadData(reinterpret_cast<uint8_t*>(&data_len), DATA_SIZE_BYTE, data_off)
-                   != DATA_SIZE_BYTE)
+        if(ReadData(reinterpret_cast<uint8_t*>(&data_len[0]), DATA_HDR_BYTE, data_off)
+                   != DATA_HDR_BYTE)
             return MBError::READ_ERROR;
 
-        rel_size = free_lists->GetAlignmentSize(data_len + DATA_HDR_BYTE);
+        rel_size = free_lists->GetAlignmentSize(DATA_RECORD_SIZE(data_len));
         header->pending_data_buff_size += rel_size;
         free_lists->ReleaseBuffer(data_off, rel_size);
 
@@ -442,11 +548,11 @@ int Dict::DeleteDataFromEdge(MBData &data, EdgePtrs &edge_ptrs)
 
             // Release data buffer
             data_off = Get6BInteger(node_buff+2);
-            if(ReadData(reinterpret_cast<uint8_t*>(&data_len), DATA_SIZE_BYTE, data_off)
-                       != DATA_SIZE_BYTE)
+            if(ReadData(reinterpret_cast<uint8_t*>(&data_len[0]), DATA_HDR_BYTE, data_off)
+                       != DATA_HDR_BYTE)
                 return MBError::READ_ERROR;
 
-            rel_size = free_lists->GetAlignmentSize(data_len + DATA_HDR_BYTE);
+            rel_size = free_lists->GetAlignmentSize(DATA_RECORD_SIZE(data_len));
             header->pending_data_buff_size += rel_size;
             free_lists->ReleaseBuffer(data_off, rel_size);
         }
@@ -466,28 +572,30 @@ int Dict::ReadDataFromNode(MBData &data, const uint8_t *node_ptr) const
         return MBError::NOT_EXIST;
 
     data.data_offset = data_off;
+    return ReadDataBuffer(data, data_off);
+}
 
-    // Read data length first
-    uint16_t data_len[2];
-    if(ReadData(reinterpret_cast<uint8_t *>(&data_len[0]), DATA_HDR_BYTE, data_off)
-               != DATA_HDR_BYTE)
-        return MBError::READ_ERROR;
-    data_off += DATA_HDR_BYTE;
+int Dict::FindPrefix(const uint8_t *key, int len, MBData &data)
+{
+    int rval = FindPrefix_Match(key, len, data);
+    if(data.options & CONSTS::OPTION_ALL_PREFIX)
+        return check_expiry(data, rval);
 
-    if(data.buff_len < data_len[0] + 1)
+    // An expired match can hide a shorter live one. Look again with the key
+    // cut short of the expired match.
+    while(check_expiry(data, rval) != rval)
     {
-        if(data.Resize(data_len[0]) != MBError::SUCCESS)
-            return MBError::NO_MEMORY;
+        if(data.match_len <= 1)
+            return MBError::NOT_EXIST;
+        len = data.match_len - 1;
+        data.Clear();
+        rval = FindPrefix_Match(key, len, data);
     }
-    if(ReadData(data.buff, data_len[0], data_off) != data_len[0])
-        return MBError::READ_ERROR;
-
-    data.data_len = data_len[0];
-    data.bucket_index = data_len[1];
-    return MBError::SUCCESS;
+    return rval;
 }
 
-int Dict::FindPrefix(const uint8_t *key, int len, MBData &data)
+// Longest match in the current and the rc root trees
+int Dict::FindPrefix_Match(const uint8_t *key, int len, MBData &data)
 {
     int rval;
     MBData data_rc;
@@ -497,11 +605,15 @@ int Dict::FindPrefix(const uint8_t *key, int len, MBData &data)
         reader_rc_off = rc_root_offset;
         rval = FindPrefix_Internal(rc_root_offset, key, len, data_rc);
 #ifdef __LOCK_FREE__
-        while(rval == MBError::TRY_AGAIN)
+        if(rval == MBError::TRY_AGAIN)
         {
-            nanosleep((const struct timespec[]){{0, 10L}}, NULL);
-            data_rc.Clear();
-            rval = FindPrefix_Internal(rc_root_offset, key, len, data_rc);
+            LockFreeRetry retry(lfree);
+            while(rval == MBError::TRY_AGAIN)
+            {
+                retry.Wait();
+                data_rc.Clear();
+                rval = FindPrefix_Internal(rc_root_offset, key, len, data_rc);
+            }
         }
 #endif
         if(rval != MBError::NOT_EXIST && rval != MBError::SUCCESS)
@@ -520,11 +632,15 @@ int Dict::FindPrefix(const uint8_t *key, int len, MBData &data)
 
     rval = FindPrefix_Internal(0, key, len, data);
 #ifdef __LOCK_FREE__
-    while(rval == MBError::TRY_AGAIN)
+    if(rval == MBError::TRY_AGAIN)
     {
-        nanosleep((const struct timespec[]){{0, 10L}}, NULL);
-        data.Clear();
-        rval = FindPrefix_Internal(0, key, len, data);
+        LockFreeRetry retry(lfree);
+        while(rval == MBError::TRY_AGAIN)
+        {
+            retry.Wait();
+            data.Clear();
+            rval = FindPrefix_Internal(0, key, len, data);
+        }
     }
 #endif
 
@@ -532,10 +648,11 @@ int Dict::FindPrefix(const uint8_t *key, int len, MBData &data)
     if(data_rc.match_len > data.match_len)
     {
         data_rc.TransferValueTo(data.buff, data.data_len);
+        data.expiry = data_rc.expiry;
+        data.match_len = data_rc.match_len;
         rval = MBError::SUCCESS;
     }
     return rval;
-
 }
 
 int Dict::FindPrefix_Internal(size_t root_off, const uint8_t *key, int len, MBData &data)
@@ -708,16 +825,20 @@ int Dict::Find(const uint8_t *key, int len, MBData &data)
         reader_rc_off = rc_root_offset;
         rval = Find_Internal(rc_root_offset, key, len, data);
 #ifdef __LOCK_FREE__
-        while(rval == MBError::TRY_AGAIN)
+        if(rval == MBError::TRY_AGAIN)
         {
-            nanosleep((const struct timespec[]){{0, 10L}}, NULL);
-            rval = Find_Internal(rc_root_offset, key, len, data);
+            LockFreeRetry retry(lfree);
+            while(rval == MBError::TRY_AGAIN)
+            {
+                retry.Wait();
+                rval = Find_Internal(rc_root_offset, key, len, data);
+            }
         }
 #endif
         if(rval == MBError::SUCCESS)
         {
             data.match_len = len;
-            return rval;
+            return check_expiry(data, rval);
         }
         else if(rval != MBError::NOT_EXIST)
             return rval;
@@ -735,26 +856,202 @@ int Dict::Find(const uint8_t *key, int len, MBData &data)
 
     rval = Find_Internal(0, key, len, data);
 #ifdef __LOCK_FREE__
-    while(rval == MBError::TRY_AGAIN)
+    if(rval == MBError::TRY_AGAIN)
     {
-        nanosleep((const struct timespec[]){{0, 10L}}, NULL);
-        rval = Find_Internal(0, key, len, data);
+        LockFreeRetry retry(lfree);
+        while(rval == MBError::TRY_AGAIN)
+        {
+            retry.Wait();
+            rval = Find_Internal(0, key, len, data);
+        }
     }
 #endif
     if(rval == MBError::SUCCESS)
         data.match_len = len;
 
+    return check_expiry(data, rval);
+}
+
+// Traversal of a key in FindBatch
+struct _FindCursor
+{
+    const uint8_t *p;        // key bytes not matched yet
+    int len;                 // number of bytes at p
+    int state;
+    size_t edge_offset_prev;
+    LockFreeData snapshot;
+};
+
+// The lookups of a batch go down the tree one level per round. Each lookup
+// prefetches the node or data it reads next before the other lookups take
+// their turn, so that the cache misses of up to FIND_BATCH_WIDTH lookups
+// overlap instead of being taken one after another. Every lookup checks its
+// own lock-free snapshot; a lookup that raced with the writer is redone by
+// Find.
+void Dict::FindBatch(const std::string *keys, MBData *data, int *rvals, int num)
+{
+    // During resource collection lookups also need to check the rc root.
+    if(header->rc_root_offset.load(MEMORY_ORDER_READER) != 0 || reader_rc_off != 0)
+    {
+        for(int i = 0; i < num; i++)
+            rvals[i] = Find(reinterpret_cast<const uint8_t*>(keys[i].data()), keys[i].size(),
+                            data[i]);
+        return;
+    }
+
+    FindCursor cursors[FIND_BATCH_WIDTH];
+    for(int start = 0; start < num; start += FIND_BATCH_WIDTH)
+    {
+        int end = std::min(start + FIND_BATCH_WIDTH, num);
+        int active = 0;
+        for(int i = start; i < end; i++)
+        {
+            FindCursor &cur = cursors[i - start];
+            rvals[i] = FindBatchStart(reinterpret_cast<const uint8_t*>(keys[i].data()),
+                                      keys[i].size(), data[i], cur);
+            if(cur.state != FIND_STATE_DONE)
+                active++;
+        }
+
+        while(active > 0)
+        {
+            for(int i = start; i < end; i++)
+            {
+                FindCursor &cur = cursors[i - start];
+                if(cur.state == FIND_STATE_DONE)
+                    continue;
+                rvals[i] = FindBatchStep(data[i], cur);
+                if(cur.state == FIND_STATE_DONE)
+                    active--;
+            }
+        }
+
+        for(int i = start; i < end; i++)
+        {
+            if(rvals[i] == MBError::TRY_AGAIN)
+                rvals[i] = Find(reinterpret_cast<const uint8_t*>(keys[i].data()),
+                                keys[i].size(), data[i]);
+            else if(rvals[i] == MBError::SUCCESS)
+            {
+                data[i].match_len = keys[i].size();
+                rvals[i] = check_expiry(data[i], rvals[i]);
+            }
+        }
+    }
+}
+
+int Dict::FindBatchStart(const uint8_t *key, int len, MBData &data, FindCursor &cur)
+{
+    EdgePtrs &edge_ptrs = data.edge_ptrs;
+#ifdef __LOCK_FREE__
+    lfree.ReaderLockFreeStart(cur.snapshot);
+#endif
+    cur.p = key;
+    cur.len = len;
+    cur.state = FIND_STATE_DONE;
+
+    if(mm.GetRootEdge(0, key[0], edge_ptrs) != MBError::SUCCESS)
+        return MBError::READ_ERROR;
+    if(edge_ptrs.len_ptr[0] == 0)
+        return FindBatchStop(data, cur, MBError::NOT_EXIST);
+    return FindBatchMatchEdge(data, cur);
+}
+
+int Dict::FindBatchStep(MBData &data, FindCursor &cur)
+{
+    EdgePtrs &edge_ptrs = data.edge_ptrs;
+    if(cur.state == FIND_STATE_DATA)
+        return FindBatchStop(data, cur, ReadDataFromEdge(data, edge_ptrs));
+
+    int rval = mm.NextEdge(cur.p, edge_ptrs, data.node_buff, data);
+    if(rval != MBError::SUCCESS)
+        return FindBatchStop(data, cur, rval);
+#ifdef __LOCK_FREE__
+    rval = lfree.ReaderLockFreeStop(cur.snapshot, cur.edge_offset_prev, data);
+    if(rval != MBError::SUCCESS)
+    {
+        cur.state = FIND_STATE_DONE;
+        return rval;
+    }
+#endif
+    return FindBatchMatchEdge(data, cur);
+}
+
+// Match the edge just read against the key. If the key is used up, its data
+// is read in the next round; otherwise the next node is. Either one is
+// prefetched now.
+int Dict::FindBatchMatchEdge(MBData &data, FindCursor &cur)
+{
+    EdgePtrs &edge_ptrs = data.edge_ptrs;
+    int edge_len = edge_ptrs.len_ptr[0];
+    if(edge_len == 0 || edge_len > cur.len)
+        return FindBatchStop(data, cur, MBError::NOT_EXIST);
+
+    if(edge_len > 1)
+    {
+        const uint8_t *key_buff = edge_ptrs.ptr;
+        if(edge_len > LOCAL_EDGE_LEN)
+        {
+            if(mm.ReadData(data.node_buff, edge_len - 1, Get5BInteger(edge_ptrs.ptr))
+                          != edge_len - 1)
+                return FindBatchStop(data, cur, MBError::READ_ERROR);
+            key_buff = data.node_buff;
+        }
+        if(memcmp(key_buff, cur.p + 1, edge_len - 1) != 0)
+            return FindBatchStop(data, cur, MBError::NOT_EXIST);
+    }
+
+    size_t next_off = Get6BInteger(edge_ptrs.offset_ptr);
+    bool leaf = edge_ptrs.flag_ptr[0] & EDGE_FLAG_DATA_OFF;
+    cur.len -= edge_len;
+    if(cur.len == 0)
+    {
+        if(leaf)
+            Prefetch(next_off, FIND_PREFETCH_SIZE);
+        else
+            mm.Prefetch(next_off, NODE_EDGE_KEY_FIRST);
+        cur.state = FIND_STATE_DATA;
+        return MBError::SUCCESS;
+    }
+    if(leaf)
+        return FindBatchStop(data, cur, MBError::NOT_EXIST);
+
+    cur.p += edge_len;
+    cur.edge_offset_prev = edge_ptrs.offset;
+    mm.Prefetch(next_off, FIND_PREFETCH_SIZE);
+    cur.state = FIND_STATE_EDGE;
+    return MBError::SUCCESS;
+}
+
+int Dict::FindBatchStop(MBData &data, FindCursor &cur, int rval)
+{
+    cur.state = FIND_STATE_DONE;
+#ifdef __LOCK_FREE__
+    int lf_ret = lfree.ReaderLockFreeStop(cur.snapshot, data.edge_ptrs.offset, data);
+    if(lf_ret != MBError::SUCCESS)
+        return lf_ret;
+#endif
     return rval;
 }
 
 int Dict::Find_Internal(size_t root_off, const uint8_t *key, int len, MBData &data)
 {
     EdgePtrs &edge_ptrs = data.edge_ptrs;
+    // Lookups from the root of a reader go through the hot node cache.
+    HotNodeCache *cache = NULL;
 #ifdef __LOCK_FREE__
     READER_LOCK_FREE_START
+    if(hot_cache != NULL && root_off == 0)
+    {
+        cache = hot_cache;
+        cache->Begin(snapshot.counter);
+    }
 #endif
     int rval;
-    rval = mm.GetRootEdge(root_off, key[0], edge_ptrs);
+    if(cache != NULL)
+        rval = cache->GetRootEdge(key[0], edge_ptrs);
+    else
+        rval = mm.GetRootEdge(root_off, key[0], edge_ptrs);
 
     if(rval != MBError::SUCCESS)
         return MBError::READ_ERROR;
@@ -810,7 +1107,10 @@ int Dict::Find_Internal(size_t root_off, const uint8_t *key, int len, MBData &da
 #endif
         while(true)
         {
-            rval = mm.NextEdge(p, edge_ptrs, node_buff, data);
+            if(cache != NULL)
+                rval = cache->NextEdge(p, edge_ptrs, node_buff, data);
+            else
+                rval = mm.NextEdge(p, edge_ptrs, node_buff, data);
             if(rval != MBError::SUCCESS)
                 break;
 
@@ -918,10 +1218,62 @@ void Dict::PrintStats(std::ostream &out_stream) const
     out_stream << "\tData size: " << header->m_data_offset << std::endl;
     out_stream << "\tPending Buffer Size: " << header->pending_data_buff_size << std::endl;
     if(free_lists)
+    {
         out_stream << "\tTrackable Buffer Size: " << free_lists->GetTotSize() << std::endl;
+        free_lists->PrintStats(out_stream);
+    }
+    if(header->eviction_cap > 0)
+    {
+        out_stream << "\tEviction cap: " << header->eviction_cap << std::endl;
+        out_stream << "\tLive size: " << LiveSize() << std::endl;
+        out_stream << "\tEvicted: " << header->num_evicted << " scanned: "
+                   << header->num_evict_scan << " in " << header->evict_time_us
+                   << "us" << std::endl;
+    }
+    if(header->expiry_num_add > 0)
+    {
+        out_stream << "\tAdded with expiry: " << header->expiry_num_add << " pending: "
+                   << expiry_index.num_key << std::endl;
+        out_stream << "\tExpired: " << header->num_expired << " reclaimed bytes: "
+                   << header->expiry_bytes_reclaimed << " in " << header->expiry_time_us
+                   << "us" << std::endl;
+    }
+    out_stream << "\tLookups: " << num_lookup << " hits: " << num_hit << std::endl;
+    if(hot_cache != NULL)
+        hot_cache->PrintStats(out_stream);
+#ifdef __LOCK_FREE__
+    MBRetryStats retry_stats;
+    LockFree::GetRetryStats(retry_stats);
+    out_stream << "\tReader retries: " << retry_stats.num_retry << " in "
+               << retry_stats.num_lookup << " lookups, longest chain: "
+               << retry_stats.max_retry_chain << " time: " << retry_stats.retry_time_us
+               << "us starved: " << retry_stats.num_starved << " writer backoff: "
+               << retry_stats.writer_yield_us << "us" << std::endl;
+#endif
+    if(header->rc_phase != MB_RC_PHASE_NONE || header->rc_work_total > 0)
+    {
+        out_stream << "\tResource collection phase: " << header->rc_phase << std::endl;
+        out_stream << "\tResource collection progress: " << header->rc_work_done
+                   << "/" << header->rc_work_total << std::endl;
+        out_stream << "\tResource collection bytes moved: " << header->rc_bytes_moved << std::endl;
+        out_stream << "\tResource collection pauses: " << header->rc_num_pause
+                   << " max " << header->rc_max_pause_us << "us p99 "
+                   << header->rc_p99_pause_us << "us" << std::endl;
+    }
+    if(header->value_codec != VALUE_CODEC_NONE)
+    {
+        out_stream << "\tValue codec dictionary size: " << header->codec_dict_size << std::endl;
+        out_stream << "\tCompressed values: " << header->codec_num_compressed
+                   << " raw bytes: " << header->codec_raw_bytes << " stored bytes: "
+                   << header->codec_stored_bytes << std::endl;
+    }
     mm.PrintStats(out_stream);
 
     kv_file->PrintStats(out_stream);
+    if(journal != NULL)
+        journal->PrintStats(out_stream);
+    if(feed != NULL)
+        feed->PrintStats(out_stream);
 }
 
 int64_t Dict::Count() const
@@ -936,6 +1288,269 @@ int64_t Dict::Count() const
     return header->count;
 }
 
+int Dict::GetRCStats(MBRCStats &stats) const
+{
+    if(header == NULL)
+        return status;
+
+    stats.phase = header->rc_phase;
+    stats.work_total = header->rc_work_total;
+    stats.work_done = header->rc_work_done;
+    stats.bytes_moved = header->rc_bytes_moved;
+    stats.num_pause = header->rc_num_pause;
+    stats.max_pause_us = header->rc_max_pause_us;
+    stats.p99_pause_us = header->rc_p99_pause_us;
+    return MBError::SUCCESS;
+}
+
+// FNV-1a
+static inline uint64_t ref_slot_hash(const uint8_t *key, int len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(int i = 0; i < len; i++)
+    {
+        h ^= key[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// The writer publishes the eviction cap in the header and creates the
+// reference slots. Readers map the slots if the cap is set when they open
+// the DB; lookups from readers opened earlier do not protect their keys.
+//
+// Instead of a reference bit cleared by the sweeper, a lookup stamps the slot
+// of the key with the current sweep round. The sweeper keeps keys stamped in
+// the current or the previous round. A sweep stopping in the middle of a key
+// range starts the range over the next time; keys visited again keep their
+// stamps where cleared reference bits would get them evicted.
+int Dict::InitEviction(const std::string &mbdir, int64_t eviction_cap)
+{
+    if(options & CONSTS::ACCESS_MODE_WRITER)
+    {
+        header->eviction_cap = eviction_cap;
+        if(header->clock_round == 0)
+            header->clock_round = 1;
+    }
+    if(header->eviction_cap <= 0)
+        return MBError::SUCCESS;
+
+    bool map_file = true;
+    ref_file = ResourcePool::getInstance().OpenFile(mbdir + "_mabain_r", options,
+                                                    EVICTION_REF_SIZE, map_file,
+                                                    options & CONSTS::ACCESS_MODE_WRITER);
+    if(ref_file == NULL || !map_file)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to map eviction reference slots");
+        return MBError::MMAP_FAILED;
+    }
+    ref_rounds = ref_file->GetMapAddr();
+    return MBError::SUCCESS;
+}
+
+// Count the lookup and stamp the slot of the key if it was found. The slot
+// is only written if the stamp changes to keep the cache line shared.
+void Dict::RecordLookup(const uint8_t *key, int len, bool hit)
+{
+    num_lookup++;
+    if(!hit)
+        return;
+    num_hit++;
+
+    if(ref_rounds == NULL)
+        return;
+    uint8_t *slot = &ref_rounds[ref_slot_hash(key, len) % EVICTION_REF_SIZE];
+    uint8_t round = __atomic_load_n(&header->clock_round, __ATOMIC_RELAXED);
+    if(__atomic_load_n(slot, __ATOMIC_RELAXED) != round)
+        __atomic_store_n(slot, round, __ATOMIC_RELAXED);
+}
+
+// Check if the key was looked up in the current or the previous sweep round.
+bool Dict::IsReferenced(const uint8_t *key, int len) const
+{
+    if(ref_rounds == NULL)
+        return false;
+    uint8_t stamp = __atomic_load_n(&ref_rounds[ref_slot_hash(key, len) % EVICTION_REF_SIZE],
+                                    __ATOMIC_RELAXED);
+    if(stamp == 0)
+        return false;
+    uint8_t round = header->clock_round;
+    uint8_t prev_round = (round == 1) ? 255 : round - 1;
+    return stamp == round || stamp == prev_round;
+}
+
+// Called by the sweeper when the hand wraps around. Zero marks slots never
+// stamped and is skipped.
+void Dict::NextClockRound()
+{
+    uint8_t round = (header->clock_round == 255) ? 1 : header->clock_round + 1;
+    __atomic_store_n(&header->clock_round, round, __ATOMIC_RELAXED);
+}
+
+// Index and data bytes in use
+int64_t Dict::LiveSize() const
+{
+    return static_cast<int64_t>(header->m_index_offset + header->m_data_offset)
+           - header->pending_index_buff_size - header->pending_data_buff_size;
+}
+
+ClockHand& Dict::GetClockHand()
+{
+    return clock_hand;
+}
+
+void Dict::GetEvictionStats(MBEvictionStats &stats) const
+{
+    stats.cap = header->eviction_cap;
+    stats.live_size = LiveSize();
+    stats.num_evicted = header->num_evicted;
+    stats.num_scanned = header->num_evict_scan;
+    stats.sweep_time_us = header->evict_time_us;
+    stats.num_lookup = num_lookup;
+    stats.num_hit = num_hit;
+}
+
+void Dict::RecordExpiry(const uint8_t *key, int len, int64_t expiry)
+{
+    header->expiry_num_add++;
+    expiry_index.buckets[expiry / EXPIRY_BUCKET_MS].push_back(
+        std::string(reinterpret_cast<const char *>(key), len));
+    expiry_index.num_key++;
+}
+
+// Entries added to the rc tree are recorded once the rc moves them to the
+// main tree. Replayed entries may have been recorded before the writer went
+// down; they are recorded by the scan of the first full sweep instead, like
+// the entries added before the writer opened the DB.
+void Dict::AddedWithExpiry(const uint8_t *key, int len, const MBData &data)
+{
+    if(data.options & CONSTS::OPTION_RC_MODE)
+        return;
+    if(journal_replay)
+    {
+        expiry_index.rebuild = true;
+        return;
+    }
+    RecordExpiry(key, len, data.expiry);
+}
+
+// Check if all keys in the oldest bucket have expired.
+bool Dict::ExpiryDue() const
+{
+    if(expiry_index.buckets.empty())
+        return false;
+    return expiry_index.buckets.begin()->first < CurrentTimeMs() / EXPIRY_BUCKET_MS;
+}
+
+// Take the next key from the buckets in which all keys have expired by now.
+bool Dict::NextExpiredKey(int64_t now, std::string &key)
+{
+    std::map<int64_t, std::vector<std::string> >::iterator it;
+    while((it = expiry_index.buckets.begin()) != expiry_index.buckets.end() &&
+          it->first < now / EXPIRY_BUCKET_MS)
+    {
+        if(it->second.empty())
+        {
+            expiry_index.buckets.erase(it);
+            continue;
+        }
+        key.swap(it->second.back());
+        it->second.pop_back();
+        expiry_index.num_key--;
+        return true;
+    }
+    return false;
+}
+
+// Remove the entry of the key if it has expired by now. Returns NOT_EXIST
+// if the entry was removed or got a later or no expiry time since the key
+// was recorded.
+int Dict::RemoveExpired(const uint8_t *key, int len, int64_t now, MBData &data)
+{
+    int rval = Find_Internal(0, key, len, data);
+    if(rval != MBError::SUCCESS)
+        return rval;
+    if(data.expiry == 0 || data.expiry > now)
+        return MBError::NOT_EXIST;
+    return Remove(key, len);
+}
+
+ExpiryIndex& Dict::GetExpiryIndex()
+{
+    return expiry_index;
+}
+
+void Dict::GetExpiryStats(MBExpiryStats &stats) const
+{
+    stats.num_add = header->expiry_num_add;
+    stats.num_expired = header->num_expired;
+    stats.bytes_reclaimed = header->expiry_bytes_reclaimed;
+    stats.sweep_time_us = header->expiry_time_us;
+    stats.num_pending = expiry_index.num_key;
+}
+
+bool Dict::DataExpired(size_t data_off) const
+{
+    uint16_t data_hdr[2 + DATA_TTL_BYTE / 2];
+    if(ReadData(reinterpret_cast<uint8_t*>(&data_hdr[0]), DATA_HDR_BYTE, data_off)
+               != DATA_HDR_BYTE || data_hdr[1] != DATA_TTL_BUCKET)
+        return false;
+    if(ReadData(reinterpret_cast<uint8_t*>(&data_hdr[2]), DATA_TTL_BYTE,
+                data_off + DATA_HDR_BYTE) != DATA_TTL_BYTE)
+        return false;
+    return (int64_t) Get6BInteger(reinterpret_cast<uint8_t*>(&data_hdr[3])) <= CurrentTimeMs();
+}
+
+void Dict::Prefault(int num_threads)
+{
+    mm.Prefault(header->m_index_offset, num_threads);
+    DRMBase::Prefault(header->m_data_offset, num_threads);
+}
+
+void Dict::GetPrefaultStats(MBPrefaultStats &stats) const
+{
+    stats.done = true;
+    stats.bytes = 0;
+    stats.minor_faults = 0;
+    stats.major_faults = 0;
+    stats.warm_us = 0;
+    mm.AddPrefaultStats(stats);
+    AddPrefaultStats(stats);
+}
+
+void Dict::InitHotNodeCache(int depth, int max_nodes)
+{
+#ifdef __LOCK_FREE__
+    if(hot_cache != NULL || (options & CONSTS::ACCESS_MODE_WRITER))
+        return;
+    hot_cache = new HotNodeCache(&mm, &header->lock_free, mm.GetRootOffset(),
+                                 depth, max_nodes);
+#endif
+}
+
+int Dict::GetFreeListStats(MBFreeListStats &index_stats, MBFreeListStats &data_stats) const
+{
+    if(free_lists == NULL || mm.GetFreeList() == NULL)
+        return MBError::NOT_ALLOWED;
+
+    mm.GetFreeList()->GetStats(index_stats);
+    free_lists->GetStats(data_stats);
+    return MBError::SUCCESS;
+}
+
+void Dict::GetHotNodeStats(MBHotNodeStats &stats) const
+{
+    if(hot_cache != NULL)
+    {
+        hot_cache->GetStats(stats);
+        return;
+    }
+    stats.num_node = 0;
+    stats.num_hit = 0;
+    stats.num_miss = 0;
+    stats.num_invalidation = 0;
+}
+
 // For DB iterator
 int Dict::ReadNextEdge(const uint8_t *node_buff, EdgePtrs &edge_ptrs,
                        int &match, MBData &data, std::string &match_str,
@@ -1152,6 +1767,10 @@ int Dict::RemoveAll()
 
     header->eviction_bucket_index = 0;
     header->num_update = 0;
+
+    expiry_index.buckets.clear();
+    expiry_index.num_key = 0;
+    expiry_index.rebuild = false;
     return rval;
 }
 
@@ -1174,31 +1793,57 @@ int Dict::InitShmObjects()
 #endif
 
 #ifdef __SHM_QUEUE__
+    // All slots are free for the first lap.
+    header->queue_index.store(0, std::memory_order_release);
+    header->writer_index.store(0, std::memory_order_release);
+    header->writer_waiting.store(0, std::memory_order_release);
+    header->num_producer_waiting.store(0, std::memory_order_release);
     for(int i = 0; i < header->async_queue_size; i++)
     {
-        status = InitShmMutex(&queue[i].mutex);
-        if(status  != MBError::SUCCESS)
-            break;
-        status = InitShmCond(&queue[i].cond);
-        if(status  != MBError::SUCCESS)
-            break;
+        queue[i].state.store(MB_SHMQ_STATE(MB_SHMQ_SEQ_FREE(0), 0), std::memory_order_release);
+        queue[i].type = MABAIN_ASYNC_TYPE_NONE;
     }
+    header->arena_head.store(0, std::memory_order_release);
+    header->arena_tail.store(0, std::memory_order_release);
+    header->arena_claim.store(0, std::memory_order_release);
+    header->num_arena_waiting.store(0, std::memory_order_release);
+    memset(reinterpret_cast<char *>(queue + header->async_queue_size), 0,
+           MB_SHMQ_ARENA_SIZE(header->async_queue_size));
 #endif
 
     return status;
 }
 
-// Reserve buffer and write to it
-void Dict::ReserveData(const uint8_t* buff, int size, size_t &offset)
+// Reserve buffer and write to it. A value with an expiry time gets the
+// extended data header.
+void Dict::ReserveData(const uint8_t* buff, int size, size_t &offset, int64_t expiry)
 {
 #ifdef __DEBUG__
     assert(size <= CONSTS::MAX_DATA_SIZE);
 #endif
 
-    int buf_size  = free_lists->GetAlignmentSize(size + DATA_HDR_BYTE);
+    uint16_t flag = 0;
+    if(header->value_codec.load(std::memory_order_acquire) != VALUE_CODEC_NONE)
+    {
+        const uint8_t *cbuff;
+        int csize = codec.Compress(header->codec_dict, header->codec_dict_size, buff,
+                                   size, cbuff);
+        if(csize > 0)
+        {
+            header->codec_num_compressed++;
+            header->codec_raw_bytes += size;
+            header->codec_stored_bytes += csize;
+            buff = cbuff;
+            size = csize;
+            flag = DATA_COMPRESSED_FLAG;
+        }
+    }
+
+    int hdr_size  = (expiry != 0) ? DATA_HDR_BYTE + DATA_TTL_BYTE : DATA_HDR_BYTE;
+    int buf_size  = free_lists->GetAlignmentSize(size + hdr_size);
     int buf_index = free_lists->GetBufferIndex(buf_size);
-    uint16_t dsize[2];
-    dsize[0] = static_cast<uint16_t>(size);
+    uint16_t dsize[2 + DATA_TTL_BYTE / 2];
+    dsize[0] = static_cast<uint16_t>(size) | flag;
     // store bucket index for LRU eviction
     dsize[1] = (header->num_update / header->entry_per_bucket) % 0xFFFF;
     if(dsize[1] == header->eviction_bucket_index &&
@@ -1206,12 +1851,17 @@ void Dict::ReserveData(const uint8_t* buff, int size, size_t &offset)
     {
         header->eviction_bucket_index++;
     }
+    if(expiry != 0)
+    {
+        dsize[2] = dsize[1];
+        dsize[1] = DATA_TTL_BUCKET;
+        Write6BInteger(reinterpret_cast<uint8_t*>(&dsize[3]), expiry);
+    }
 
-    if(free_lists->GetBufferCountByIndex(buf_index) > 0)
+    if(free_lists->GetBufferByIndex(buf_index, offset))
     {
-        offset = free_lists->RemoveBufferByIndex(buf_index);
-        WriteData(reinterpret_cast<const uint8_t*>(&dsize[0]), DATA_HDR_BYTE, offset);
-        WriteData(buff, size, offset+DATA_HDR_BYTE);
+        WriteData(reinterpret_cast<const uint8_t*>(&dsize[0]), hdr_size, offset);
+        WriteData(buff, size, offset+hdr_size);
         header->pending_data_buff_size -= buf_size;
     }
     else
@@ -1234,32 +1884,32 @@ void Dict::ReserveData(const uint8_t* buff, int size, size_t &offset)
         header->m_data_offset += buf_size;
         if(ptr != NULL)
         {
-            memcpy(ptr, &dsize[0], DATA_HDR_BYTE);
-            memcpy(ptr+DATA_HDR_BYTE, buff, size);
+            memcpy(ptr, &dsize[0], hdr_size);
+            memcpy(ptr+hdr_size, buff, size);
         }
         else
         {
-            WriteData(reinterpret_cast<const uint8_t*>(&dsize[0]), DATA_HDR_BYTE, offset);
-            WriteData(buff, size, offset+DATA_HDR_BYTE);
+            WriteData(reinterpret_cast<const uint8_t*>(&dsize[0]), hdr_size, offset);
+            WriteData(buff, size, offset+hdr_size);
         }
     }
 }
 
 int Dict::ReleaseBuffer(size_t offset)
 {
-    uint16_t data_size;
+    uint16_t data_size[2];
 
-    if(ReadData(reinterpret_cast<uint8_t*>(&data_size), DATA_SIZE_BYTE, offset)
-               != DATA_SIZE_BYTE)
+    if(ReadData(reinterpret_cast<uint8_t*>(&data_size[0]), DATA_HDR_BYTE, offset)
+               != DATA_HDR_BYTE)
         return MBError::READ_ERROR;
 
-    int rel_size = free_lists->GetAlignmentSize(data_size + DATA_HDR_BYTE);
+    int rel_size = free_lists->GetAlignmentSize(DATA_RECORD_SIZE(data_size));
     header->pending_data_buff_size += rel_size;
     return free_lists->ReleaseBuffer(offset, rel_size);
 }
 
-int Dict::UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const uint8_t *buff,
-                           int len, bool &inc_count)
+int Dict::UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const MBData &data,
+                           bool &inc_count)
 {
     size_t data_off;
 
@@ -1267,13 +1917,13 @@ int Dict::UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const uint8_t *b
     {
         inc_count = false;
         // leaf node
-        if(!overwrite)
+        data_off = Get6BInteger(edge_ptrs.offset_ptr);
+        if(!overwrite && !DataExpired(data_off))
             return MBError::IN_DICT;
 
-        data_off = Get6BInteger(edge_ptrs.offset_ptr);
         if(ReleaseBuffer(data_off) != MBError::SUCCESS)
             Logger::Log(LOG_LEVEL_WARN, "failed to release data buffer: %llu", data_off);
-        ReserveData(buff, len, data_off);
+        ReserveData(data.buff, data.data_len, data_off, data.expiry);
         Write6BInteger(edge_ptrs.offset_ptr, data_off);
 
         header->excep_lf_offset = edge_ptrs.offset;
@@ -1299,10 +1949,10 @@ int Dict::UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const uint8_t *b
         if(node_buff[0] & FLAG_NODE_MATCH)
         {
             inc_count = false;
-            if(!overwrite)
+            data_off = Get6BInteger(node_buff+2);
+            if(!overwrite && !DataExpired(data_off))
                 return MBError::IN_DICT;
 
-            data_off = Get6BInteger(node_buff+2);
             if(ReleaseBuffer(data_off) != MBError::SUCCESS)
                 Logger::Log(LOG_LEVEL_WARN, "failed to release data buffer %llu", data_off);
 
@@ -1316,7 +1966,7 @@ int Dict::UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const uint8_t *b
             node_buff[NODE_EDGE_KEY_FIRST] = 1;
         }
 
-        ReserveData(buff, len, data_off);
+        ReserveData(data.buff, data.data_len, data_off, data.expiry);
         Write6BInteger(node_buff+2, data_off);
 
         header->excep_offset = node_off;
@@ -1383,6 +2033,143 @@ size_t Dict::GetStartDataOffset() const
     return DATA_HEADER_SIZE;
 }
 
+// Open the journal and replay the updates committed since the last
+// checkpoint. The journal is left in place if the replay fails so that
+// the next writer can retry it.
+int Dict::InitJournal(const std::string &mbdir, int64_t max_size)
+{
+    if(!(options & CONSTS::ACCESS_MODE_WRITER))
+        return MBError::NOT_ALLOWED;
+
+    journal = new Journal(mbdir + "_mabain_j", max_size);
+    int rval = journal->Init();
+    if(rval == MBError::SUCCESS)
+    {
+        journal_replay = true;
+        rval = journal->Replay(this);
+        journal_replay = false;
+    }
+    if(rval == MBError::SUCCESS)
+        rval = CheckpointJournal();
+    if(rval != MBError::SUCCESS)
+    {
+        delete journal;
+        journal = NULL;
+    }
+    header->journal_pending.store(0, std::memory_order_release);
+    return rval;
+}
+
+int Dict::InitChangeFeed(const std::string &mbdir, int64_t size)
+{
+    if(!(options & CONSTS::ACCESS_MODE_WRITER))
+        return MBError::NOT_ALLOWED;
+
+    feed = new ChangeFeed(mbdir, size, options);
+    if(!feed->IsValid())
+    {
+        delete feed;
+        feed = NULL;
+        return MBError::OPEN_FAILURE;
+    }
+    return MBError::SUCCESS;
+}
+
+// Log an update applied by the writer. The record is only durable once
+// committed; the change is visible to subscribers right away. Removals done
+// by eviction and the expiry sweep are not journaled; keys evicted after the
+// last checkpoint may be brought back by a replay and evicted again. The
+// expiry time goes with the value, so that replicas and replays expire it
+// at the same time.
+int Dict::JournalAdd(const uint8_t *key, int len, const MBData &data, bool commit)
+{
+    if(feed != NULL)
+        feed->Append(CHANGE_FEED_ADD, key, len, data.buff, data.data_len, data.expiry);
+    if(journal == NULL)
+        return MBError::SUCCESS;
+    return JournalLogged(journal->LogAdd(key, len, data.buff, data.data_len, data.expiry),
+                         commit);
+}
+
+int Dict::JournalRemove(const uint8_t *key, int len, bool commit)
+{
+    if(feed != NULL)
+        feed->Append(CHANGE_FEED_REMOVE, key, len, NULL, 0);
+    if(journal == NULL)
+        return MBError::SUCCESS;
+    return JournalLogged(journal->LogRemove(key, len), commit);
+}
+
+// Evictions reach the change feed so that replicas drop the evicted keys
+// as well. They are not journaled.
+void Dict::FeedEviction(const uint8_t *key, int len)
+{
+    if(feed != NULL)
+        feed->Append(CHANGE_FEED_REMOVE, key, len, NULL, 0);
+}
+
+int Dict::JournalRemoveAll(bool commit)
+{
+    if(feed != NULL)
+        feed->Append(CHANGE_FEED_REMOVE_ALL, NULL, 0, NULL, 0);
+    if(journal == NULL)
+        return MBError::SUCCESS;
+    return JournalLogged(journal->LogRemoveAll(), commit);
+}
+
+int Dict::JournalLogged(int rval, bool commit)
+{
+    if(rval != MBError::SUCCESS)
+        return rval;
+    if(commit)
+        return CommitJournal();
+    if(header->journal_pending.load(std::memory_order_relaxed) == 0)
+        header->journal_pending.store(1, std::memory_order_release);
+    return MBError::SUCCESS;
+}
+
+// Commit the logged updates with a single sync. Once the journal outgrows
+// its limit, the DB files are flushed and the journal is truncated.
+int Dict::CommitJournal()
+{
+    if(journal == NULL)
+        return MBError::SUCCESS;
+
+    int rval = journal->Commit();
+    if(rval != MBError::SUCCESS)
+        return rval;
+    if(journal->NeedCheckpoint())
+        rval = CheckpointJournal();
+    header->journal_pending.store(0, std::memory_order_release);
+    return rval;
+}
+
+int Dict::CheckpointJournal()
+{
+    Flush();
+    return journal->Reset();
+}
+
+int Dict::InitValueCodec(const std::vector<std::string> &samples)
+{
+    if(!(options & CONSTS::ACCESS_MODE_WRITER))
+        return MBError::NOT_ALLOWED;
+    // Stored values refer to the dictionary; it cannot be replaced.
+    if(header->value_codec.load(std::memory_order_acquire) != VALUE_CODEC_NONE)
+        return MBError::NOT_ALLOWED;
+
+    int dict_size = ValueCodec::TrainDictionary(samples, header->codec_dict,
+                                                VALUE_CODEC_DICT_SIZE);
+    header->codec_dict_size = static_cast<uint16_t>(dict_size);
+    header->codec_num_compressed = 0;
+    header->codec_raw_bytes = 0;
+    header->codec_stored_bytes = 0;
+    header->value_codec.store(VALUE_CODEC_LZ_DICT, std::memory_order_release);
+    Logger::Log(LOG_LEVEL_INFO, "value codec dictionary of %d bytes from %d samples",
+                dict_size, (int) samples.size());
+    return MBError::SUCCESS;
+}
+
 void Dict::ResetSlidingWindow() const
 {
     kv_file->ResetSlidingWindow();
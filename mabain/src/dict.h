@@ -21,12 +21,18 @@
 
 #include <stdint.h>
 #include <string>
+#include <memory>
+#include <vector>
+#include <map>
 
 #include "drm_base.h"
 #include "dict_mem.h"
 #include "rollable_file.h"
 #include "mb_data.h"
 #include "lock_free.h"
+#include "journal.h"
+#include "change_feed.h"
+#include "hot_node_cache.h"
 
 namespace mabain {
 
@@ -34,6 +40,32 @@ namespace mabain {
 struct _AsyncNode;
 typedef struct _AsyncNode AsyncNode;
 #endif
+struct _FindCursor;
+typedef struct _FindCursor FindCursor;
+
+// Position of the CLOCK sweep. Each round the keys are split into ranges at
+// the keys sampled in the previous round and the sweep goes through the
+// ranges in key order.
+typedef struct _ClockHand
+{
+    std::vector<std::string> splits;
+    size_t pos;
+    // keys sampled from the ranges swept so far in this round
+    std::vector<std::string> samples;
+    int64_t sample_step;
+} ClockHand;
+
+// Keys added with an expiry time by expiry bucket of EXPIRY_BUCKET_MS. It is
+// only kept in the memory of the writer. A key updated or removed after it
+// was recorded is checked and skipped by the sweep. Keys added before the
+// writer opened the DB are recorded by a scan of the DB in the first full
+// sweep.
+typedef struct _ExpiryIndex
+{
+    std::map<int64_t, std::vector<std::string> > buckets;
+    int64_t num_key;
+    bool rebuild;
+} ExpiryIndex;
 
 // dictionary class
 // This is the work horse class for basic db operations (add, find and remove).
@@ -50,10 +82,12 @@ public:
 
     // Called by writer only
     int Init(uint32_t id);
-    // Add key-value pair
+    // Add key-value pair; the value expires at data.expiry if it is set
     int Add(const uint8_t *key, int len, MBData &data, bool overwrite);
     // Find value by key
     int Find(const uint8_t *key, int len, MBData &data);
+    // Find values of multiple keys with the lookups interleaved
+    void FindBatch(const std::string *keys, MBData *data, int *rvals, int num);
     // Find value by key using prefix match
     int FindPrefix(const uint8_t *key, int len, MBData &data);
     // Delete entry by key
@@ -67,16 +101,19 @@ public:
 #ifdef __SHM_QUEUE__
     // multiple-process updates using shared memory queue
     int  SHMQ_Add(const char *key, int key_len, const char *data, int data_len,
-                  bool overwrite);
+                  bool overwrite, int64_t expiry = 0);
     int  SHMQ_Remove(const char *key, int len);
     int  SHMQ_RemoveAll();
+    int  SHMQ_AddBatch(const std::string *keys, const std::string *values, int num,
+                       bool overwrite);
+    int  SHMQ_RemoveBatch(const std::string *keys, int num);
     int  SHMQ_Backup(const char *backup_dir);
     int  SHMQ_CollectResource(int64_t m_index_rc_size, int64_t m_data_rc_size,
                               int64_t max_dbsz, int64_t max_dbcnt);
     bool SHMQ_Busy() const;
 #endif
 
-    void ReserveData(const uint8_t* buff, int size, size_t &offset);
+    void ReserveData(const uint8_t* buff, int size, size_t &offset, int64_t expiry = 0);
     void WriteData(const uint8_t *buff, unsigned len, size_t offset) const;
 
     // Print dictinary stats
@@ -84,9 +121,47 @@ public:
     void PrintStats(std::ostream &out_stream) const;
     int Status() const;
     int64_t Count() const;
+    int GetRCStats(MBRCStats &stats) const;
+
+    // CLOCK eviction
+    int  InitEviction(const std::string &mbdir, int64_t eviction_cap);
+    void RecordLookup(const uint8_t *key, int len, bool hit);
+    bool IsReferenced(const uint8_t *key, int len) const;
+    void NextClockRound();
+    int64_t LiveSize() const;
+    inline bool OverEvictionCap() const;
+    ClockHand& GetClockHand();
+    void GetEvictionStats(MBEvictionStats &stats) const;
+    // Expiry index of the writer
+    void RecordExpiry(const uint8_t *key, int len, int64_t expiry);
+    bool ExpiryDue() const;
+    bool NextExpiredKey(int64_t now, std::string &key);
+    int  RemoveExpired(const uint8_t *key, int len, int64_t now, MBData &data);
+    ExpiryIndex& GetExpiryIndex();
+    void GetExpiryStats(MBExpiryStats &stats) const;
+    void Prefault(int num_threads);
+    void GetPrefaultStats(MBPrefaultStats &stats) const;
+    // Cache the upper index levels for the lookups of a reader handle
+    void InitHotNodeCache(int depth, int max_nodes);
+    void GetHotNodeStats(MBHotNodeStats &stats) const;
+    int  GetFreeListStats(MBFreeListStats &index_stats, MBFreeListStats &data_stats) const;
     size_t GetRootOffset() const;
     size_t GetStartDataOffset() const;
 
+    // Redo journal and change feed of the updates applied by the
+    // writer; the calls below do nothing if neither is enabled.
+    int  InitJournal(const std::string &mbdir, int64_t max_size);
+    int  InitChangeFeed(const std::string &mbdir, int64_t size);
+    int  JournalAdd(const uint8_t *key, int len, const MBData &data, bool commit);
+    int  JournalRemove(const uint8_t *key, int len, bool commit);
+    int  JournalRemoveAll(bool commit);
+    void FeedEviction(const uint8_t *key, int len);
+    int  CommitJournal();
+
+    // Set up the value codec with a dictionary trained from sample values.
+    // New values are compressed from then on.
+    int  InitValueCodec(const std::vector<std::string> &samples);
+
     DictMem *GetMM() const;
 
     LockFree* GetLockFreePtr();
@@ -115,17 +190,39 @@ public:
 
 private:
     int Find_Internal(size_t root_off, const uint8_t *key, int len, MBData &data);
+    int FindBatchStart(const uint8_t *key, int len, MBData &data, FindCursor &cur);
+    int FindBatchStep(MBData &data, FindCursor &cur);
+    int FindBatchMatchEdge(MBData &data, FindCursor &cur);
+    int FindBatchStop(MBData &data, FindCursor &cur, int rval);
+    int FindPrefix_Match(const uint8_t *key, int len, MBData &data);
     int FindPrefix_Internal(size_t root_off, const uint8_t *key, int len, MBData &data);
     int ReleaseBuffer(size_t offset);
-    int UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const uint8_t *buff,
-                         int len, bool &inc_count);
+    int UpdateDataBuffer(EdgePtrs &edge_ptrs, bool overwrite, const MBData &data,
+                         bool &inc_count);
+    bool DataExpired(size_t data_off) const;
+    void AddedWithExpiry(const uint8_t *key, int len, const MBData &data);
     int ReadDataFromEdge(MBData &data, const EdgePtrs &edge_ptrs) const;
     int ReadDataFromNode(MBData &data, const uint8_t *node_ptr) const;
+    int ReadDataBuffer(MBData &data, size_t data_off) const;
+    int ReadCompressedData(MBData &data, int size, size_t data_off) const;
     int DeleteDataFromEdge(MBData &data, EdgePtrs &edge_ptrs);
     int ReadNodeMatch(size_t node_off, int &match, MBData &data) const;
+    int JournalLogged(int rval, bool commit);
+    int CheckpointJournal();
 #ifdef __SHM_QUEUE__
     int SHMQ_PrepareSlot(AsyncNode *node_ptr) const;
-    AsyncNode* SHMQ_AcquireSlot() const;
+    int SHMQ_AcquireSlot(AsyncNode* &node_ptr) const;
+    int SHMQ_ClaimSlot(uint64_t index, AsyncNode* &node_ptr) const;
+    int SHMQ_AcquireSlots(AsyncNode **node_ptrs, int num) const;
+    int SHMQ_PrepareSlots(AsyncNode **node_ptrs, int num) const;
+    int SHMQ_SubmitBatch(char type, const std::string *keys, const std::string *values,
+                         int num, bool overwrite);
+    int SHMQ_Submit(char type, const char *key, int key_len, const char *data,
+                    int data_len, bool overwrite, int64_t expiry = 0);
+    uint32_t SHMQ_RecordSize(int key_len, int data_len) const;
+    int SHMQ_AllocRecord(int key_len, int data_len, uint64_t &rec_off, char* &rec_buff) const;
+    void SHMQ_FreeRecord(uint64_t rec_off) const;
+    bool SHMQ_ClaimArena(uint32_t pid) const;
 #endif
 
     // DB access permission
@@ -142,8 +239,29 @@ private:
 #ifdef __SHM_QUEUE__
     AsyncNode *queue;
 #endif
+
+    // Rounds of the CLOCK sweep in which keys were looked up, one byte per
+    // key hash, shared by all handles
+    std::shared_ptr<MmapFileIO> ref_file;
+    uint8_t *ref_rounds;
+    ClockHand clock_hand;
+    ExpiryIndex expiry_index;
+    int64_t num_lookup;
+    int64_t num_hit;
+
+    Journal *journal;
+    bool journal_replay;
+    ChangeFeed *feed;
+    // compression scratch buffers of the writer
+    ValueCodec codec;
+    HotNodeCache *hot_cache;
 };
 
+bool Dict::OverEvictionCap() const
+{
+    return header->eviction_cap > 0 && LiveSize() > header->eviction_cap;
+}
+
 }
 
 #endif
@@ -81,7 +81,7 @@ DictMem::DictMem(const std::string &mbdir, bool init_header, size_t memsize,
     if(mode & CONSTS::ACCESS_MODE_WRITER)
         create_hdr = true;
 #ifdef __SHM_QUEUE__
-    hdr_size += sizeof(AsyncNode) * queue_size;
+    hdr_size += ShmqBufferSize(queue_size);
 #endif
     header_file = ResourcePool::getInstance().OpenFile(mbdir + "_mabain_h",
                                                        mode,
@@ -113,9 +113,14 @@ DictMem::DictMem(const std::string &mbdir, bool init_header, size_t memsize,
         memset(header, 0, sizeof(IndexHeader));
         header->index_block_size = block_size;
     }
+    // The index is walked on every lookup; back it by hugetlbfs pages in
+    // memory-only mode to save TLB misses.
+    int index_mode = mode;
+    if((mode & CONSTS::MEMORY_ONLY_MODE) && (mode & CONSTS::USE_HUGE_PAGES))
+        index_mode |= MMAP_HUGETLB_MODE;
     kv_file = new RollableFile(mbdir + "_mabain_i",
                                static_cast<size_t>(header->index_block_size),
-                               memsize, mode, max_num_blk);
+                               memsize, index_mode, max_num_blk);
 
     kv_file->InitShmSlidingAddr(&header->shm_index_sliding_start);
 
@@ -144,7 +149,8 @@ DictMem::DictMem(const std::string &mbdir, bool init_header, size_t memsize,
     }
 
     node_ptr = new uint8_t[ node_size[NUM_ALPHABET-1] ];
-    free_lists = new FreeList(mbdir+"_ibfl", BUFFER_ALIGNMENT, NUM_BUFFER_RESERVE);
+    free_lists = new FreeList(mbdir+"_ibfl", BUFFER_ALIGNMENT, NUM_BUFFER_RESERVE,
+                              MAX_BUFFER_PER_LIST, header->index_block_size);
 
     if(init_header)
     {
@@ -641,7 +647,6 @@ bool DictMem::ReserveNode(int nt, size_t &offset, uint8_t* &ptr)
     int buf_index = free_lists->GetBufferIndex(buf_size);
 
     header->n_states++;
-#ifdef __LOCK_FREE__
     if(free_lists->GetBufferByIndex(buf_index, offset))
     {
         ptr = node_ptr;
@@ -649,16 +654,6 @@ bool DictMem::ReserveNode(int nt, size_t &offset, uint8_t* &ptr)
         header->pending_index_buff_size -= buf_size;
         return true;
     }
-#else
-    if(free_lists->GetBufferCountByIndex(buf_index) > 0)
-    {
-        offset = free_lists->RemoveBufferByIndex(buf_index);
-        ptr = node_ptr;
-        memset(ptr, 0, buf_size);
-        header->pending_index_buff_size -= buf_size;
-        return true;
-    }
-#endif
 
     ptr = NULL;
     size_t old_off = header->m_index_offset;
@@ -692,20 +687,11 @@ void DictMem::ReserveData(const uint8_t* key, int size, size_t &offset,
     int buf_index = free_lists->GetBufferIndex(size);
     int buf_size  = free_lists->GetAlignmentSize(size);
 
-#ifdef __LOCK_FREE__
     if(free_lists->GetBufferByIndex(buf_index, offset))
     {
         WriteData(key, size, offset);
         header->pending_index_buff_size -= buf_size;
     }
-#else
-    if(free_lists->GetBufferCountByIndex(buf_index) > 0)
-    {
-        offset = free_lists->RemoveBufferByIndex(buf_index);
-        WriteData(key, size, offset);
-        header->pending_index_buff_size -= buf_size;
-    }
-#endif
     else
     {
         size_t old_off = header->m_index_offset;
@@ -840,6 +826,36 @@ int DictMem::ClearRootEdge(int nt) const
     return MBError::SUCCESS;
 }
 
+size_t DictMem::AddNode(const uint8_t *node, int nt)
+{
+    size_t offset;
+    uint8_t *ptr;
+    bool node_move = ReserveNode(nt-1, offset, ptr);
+    memcpy(ptr, node, node_size[nt-1]);
+    if(node_move)
+        WriteData(ptr, node_size[nt-1], offset);
+
+    header->n_edges += nt;
+    return offset;
+}
+
+void DictMem::SetRootEdge(int nt, const uint8_t *edge) const
+{
+    size_t offset = root_offset + NODE_EDGE_KEY_FIRST + NUM_ALPHABET + nt*EDGE_SIZE;
+    // Readers take the edge from the header while it is being written.
+    memcpy(header->excep_buff, edge, EDGE_SIZE);
+#ifdef __LOCK_FREE__
+    header->excep_lf_offset = offset;
+    header->excep_updating_status = EXCEP_STATUS_ADD_EDGE;
+    lfree->WriterLockFreeStart(offset);
+#endif
+    WriteData(header->excep_buff, EDGE_SIZE, offset);
+#ifdef __LOCK_FREE__
+    lfree->WriterLockFreeStop();
+    header->excep_updating_status = EXCEP_STATUS_NONE;
+#endif
+}
+
 int DictMem::ClearRootEdges_RC() const
 {
     if(root_offset_rc == 0)
@@ -1125,7 +1141,10 @@ void DictMem::PrintStats(std::ostream &out_stream) const
     out_stream << "\tException flag: " << header->excep_updating_status << std::endl;
     out_stream << "\tPending Buffer Size: " << header->pending_index_buff_size << std::endl;
     if(free_lists != NULL)
+    {
         out_stream << "\tTrackable Buffer Size: " << free_lists->GetTotSize() << std::endl;
+        free_lists->PrintStats(out_stream);
+    }
     kv_file->PrintStats(out_stream);
 }
 
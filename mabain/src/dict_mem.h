@@ -75,6 +75,9 @@ public:
     int  GetRootEdge(size_t rc_off, int nt, EdgePtrs &edge_ptrs) const;
     int  GetRootEdge_Writer(bool rc_mode, int nt, EdgePtrs &edge_ptrs) const;
     int  ClearRootEdge(int nt) const;
+    // Bulk loading: add a complete node with nt edges and set a root edge
+    size_t AddNode(const uint8_t *node, int nt);
+    void SetRootEdge(int nt, const uint8_t *edge) const;
     void ReserveData(const uint8_t* key, int size, size_t &offset,
                      bool map_new_sliding=true);
     int  NextEdge(const uint8_t *key, EdgePtrs &edge_ptrs,
@@ -94,7 +94,8 @@ void DRMBase::ValidateHeaderFile(const std::string &header_path, int mode,
 {
     uint16_t hdr_ver[4];
     ReadHeaderVersion(header_path, hdr_ver);
-    if(hdr_ver[0] >= 1 && hdr_ver[1] >= 2) return;
+    // Headers older than 1.4 have a different shared memory queue layout.
+    if(hdr_ver[0] > 1 || (hdr_ver[0] == 1 && hdr_ver[1] >= 4)) return;
     if(!(mode & CONSTS::ACCESS_MODE_WRITER))
         throw (int) MBError::VERSION_MISMATCH;
 
@@ -183,6 +184,11 @@ void DRMBase::PrintHeader(std::ostream &out_stream) const
     out_stream << "shared memory queue index: " << header->queue_index << std::endl;
     out_stream << "shared memory writer index: " << header->writer_index << std::endl;
     out_stream << "resource flag: " << header->rc_flag << std::endl;
+    out_stream << "backup flag: " << header->backup_flag << std::endl;
+    out_stream << "journal pending: " << header->journal_pending << std::endl;
+    out_stream << "value codec: " << header->value_codec << std::endl;
+    out_stream << "codec dictionary size: " << header->codec_dict_size << std::endl;
+    out_stream << "reader starving until: " << header->reader_starving_until << std::endl;
     out_stream << "---------------- END OF HEADER ----------------" << std::endl;
 }
 
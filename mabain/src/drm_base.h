@@ -19,12 +19,26 @@
 #ifndef __DRM_BASE_H__
 #define __DRM_BASE_H__
 
+#include <time.h>
+
 #include "rollable_file.h"
 #include "free_list.h"
+#include "value_codec.h"
 
 #define DATA_BUFFER_ALIGNMENT      1
 #define DATA_SIZE_BYTE             2
 #define DATA_HDR_BYTE              4
+// set in the data length if the value is stored compressed
+#define DATA_COMPRESSED_FLAG       0x8000
+#define DATA_SIZE_MASK             0x7FFF
+// set as the bucket index in the data header if the value has an expiry
+// time; the header is then followed by the bucket index (2 bytes) and the
+// expiry time (6 bytes)
+#define DATA_TTL_BUCKET            0xFFFF
+#define DATA_TTL_BYTE              8
+// bytes taken by a value and its data header
+#define DATA_RECORD_SIZE(hdr)      (((hdr)[0] & DATA_SIZE_MASK) + DATA_HDR_BYTE + \
+                                    ((hdr)[1] == DATA_TTL_BUCKET ? DATA_TTL_BYTE : 0))
 #define OFFSET_SIZE                6
 #define EDGE_SIZE                  13
 #define EDGE_LEN_POS               5
@@ -98,11 +112,71 @@ typedef struct _IndexHeader
 
     // multi-process async queue
     int                   async_queue_size;
-    std::atomic<uint32_t> queue_index;
-    uint32_t              writer_index;
+    std::atomic<uint64_t> queue_index;
+    std::atomic<uint64_t> writer_index;
     std::atomic<uint32_t> rc_flag;
+    // async writer futex word and waiter flags of the async queue
+    std::atomic<uint32_t> writer_futex;
+    std::atomic<uint32_t> writer_waiting;
+    std::atomic<uint32_t> num_producer_waiting;
+    // byte arena of the async queue
+    std::atomic<uint64_t> arena_head;
+    std::atomic<uint64_t> arena_tail;
+    std::atomic<uint32_t> arena_futex;
+    std::atomic<uint32_t> num_arena_waiting;
+    // pid of the producer allocating at the arena tail, zero if none
+    std::atomic<uint32_t> arena_claim;
+
+    // progress of the running or the last rc
+    int      rc_phase;
+    int64_t  rc_work_total;
+    int64_t  rc_work_done;
+    int64_t  rc_bytes_moved;
+    int64_t  rc_num_pause;
+    int64_t  rc_max_pause_us;
+    int64_t  rc_p99_pause_us;
+
+    // CLOCK eviction
+    int64_t  eviction_cap;
+    int64_t  num_evicted;
+    int64_t  num_evict_scan;
+    int64_t  evict_time_us;
+    uint8_t  clock_round;
+
+    // set while an online backup copies blocks in the background
+    std::atomic<uint32_t> backup_flag;
+    // set while the writer holds journal records not committed yet
+    std::atomic<uint32_t> journal_pending;
+
+    // value codec; the dictionary is written before the codec is set and
+    // does not change afterwards
+    std::atomic<uint32_t> value_codec;
+    uint16_t codec_dict_size;
+    int64_t  codec_num_compressed;
+    int64_t  codec_raw_bytes;
+    int64_t  codec_stored_bytes;
+    uint8_t  codec_dict[VALUE_CODEC_DICT_SIZE];
+
+    // monotonic time in microseconds until which lock-free readers that
+    // used up their retry budget want the writer to back off
+    std::atomic<uint64_t> reader_starving_until;
+
+    // entries added with an expiry time and the expiry sweeps
+    int64_t  expiry_num_add;
+    int64_t  num_expired;
+    int64_t  expiry_bytes_reclaimed;
+    int64_t  expiry_time_us;
 } IndexHeader;
 
+// Expiry times are in milliseconds since the epoch so that all processes
+// and restarts agree on them.
+inline int64_t CurrentTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 // An abstract interface class for Dict and DictMem
 class DRMBase
 {
@@ -121,6 +195,9 @@ public:
     inline virtual void WriteData(const uint8_t *buff, unsigned len, size_t offset) const = 0;
     inline int Reserve(size_t &offset, int size, uint8_t* &ptr);
     inline uint8_t* GetShmPtr(size_t offset, int size) const;
+    inline void Prefetch(size_t offset, int size) const;
+    inline void Prefault(size_t max_offset, int num_threads);
+    inline void AddPrefaultStats(MBPrefaultStats &stats) const;
     inline size_t CheckAlignment(size_t offset, int size) const;
     inline int ReadData(uint8_t *buff, unsigned len, size_t offset) const;
     inline size_t GetResourceCollectionOffset() const;
@@ -131,6 +208,11 @@ public:
         return free_lists;
     }
 
+    RollableFile *GetKVFile() const
+    {
+        return kv_file;
+    }
+
     IndexHeader *GetHeaderPtr() const
     {
         return header;
@@ -167,6 +249,21 @@ inline uint8_t* DRMBase::GetShmPtr(size_t offset, int size) const
     return kv_file->GetShmPtr(offset, size);
 }
 
+inline void DRMBase::Prefetch(size_t offset, int size) const
+{
+    kv_file->Prefetch(offset, size);
+}
+
+inline void DRMBase::Prefault(size_t max_offset, int num_threads)
+{
+    kv_file->Prefault(max_offset, num_threads);
+}
+
+inline void DRMBase::AddPrefaultStats(MBPrefaultStats &stats) const
+{
+    kv_file->AddPrefaultStats(stats);
+}
+
 inline size_t DRMBase::CheckAlignment(size_t offset, int size) const
 {
     return kv_file->CheckAlignment(offset, size);
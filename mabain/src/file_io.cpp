@@ -163,6 +163,18 @@ void FileIO::Flush()
         fsync(fd);
 }
 
+// Sync the file content and the metadata needed to read it back.
+int FileIO::FlushData()
+{
+    if(fd <= 0)
+        return -1;
+#ifdef __APPLE__
+    return fsync(fd);
+#else
+    return fdatasync(fd);
+#endif
+}
+
 const std::string& FileIO::GetFilePath() const
 {
     return path;
@@ -30,6 +30,9 @@
 namespace mabain {
 
 #define MMAP_ANONYMOUS_MODE 0x80000000 // This bit should not be used in fcntl.h.
+// Huge page backing of anonymous maps, not used in fcntl.h either
+#define MMAP_HUGEPAGE_MODE  0x40000000 // transparent huge pages (MADV_HUGEPAGE)
+#define MMAP_HUGETLB_MODE   0x20000000 // hugetlbfs pages (MAP_HUGETLB)
 
 // This is the basic file io class
 class FileIO
@@ -50,6 +53,7 @@ public:
     virtual size_t RandomWrite(const void *data, size_t size, off_t offset);
     virtual size_t RandomRead(void *buff, size_t size, off_t offset);
     virtual void   Flush();
+    int    FlushData();
 
     const std::string& GetFilePath() const;
 
@@ -17,27 +17,36 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <iostream>
+#include <fstream>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 
 #include "free_list.h"
+#include "db.h"
 #include "error.h"
 #include "logger.h"
 #include "lock_free.h"
 
+// Lists stored in the earlier format start with a buffer index instead.
+#define FREE_LIST_FILE_MAGIC   0x32464C4E49414241ULL
+
 namespace mabain {
 
 FreeList::FreeList(const std::string &file_path, size_t buff_alignment,
-                   size_t max_n_buff, size_t max_buff_per_list)
+                   size_t max_n_buff, size_t max_buff_per_list, size_t block_sz)
                : list_path(file_path),
                  alignment(buff_alignment),
                  max_num_buffer(max_n_buff),
                  max_buffer_per_list(max_buff_per_list),
-                 buffer_free_list(NULL),
+                 block_size(block_sz),
                  count(0),
-                 tot_size(0)
+                 tot_size(0),
+                 num_reuse(0),
+                 num_split(0),
+                 num_miss(0),
+                 num_coalesce(0)
 {
     // rel_parent_off in ResourceCollection is defined as 2-byte signed integer.
     // The maximal buffer size cannot be greather than 32767.
@@ -45,44 +54,64 @@ FreeList::FreeList(const std::string &file_path, size_t buff_alignment,
 
     Logger::Log(LOG_LEVEL_INFO, "%s maximum number of buffers: %d", file_path.c_str(),
                 max_num_buffer);
-    buffer_free_list = new MBlsq*[max_num_buffer];
-    for(size_t i = 0; i < max_num_buffer; i++)
+}
+
+FreeList::~FreeList()
+{
+}
+
+void FreeList::InsertBuffer(size_t offset, size_t buf_index, bool check_prev)
+{
+    size_t size = GetBufferSizeByIndex(buf_index);
+    std::map<size_t, size_t>::iterator it = buffer_map.insert(std::make_pair(offset, size)).first;
+    class_map[buf_index].insert(offset);
+    count++;
+    tot_size += size;
+
+    if(buffer_map.find(offset + size) != buffer_map.end())
+        merge_set.insert(offset);
+    if(check_prev && it != buffer_map.begin())
     {
-        buffer_free_list[i] = new MBlsq(NULL);
+        --it;
+        if(it->first + it->second == offset)
+            merge_set.insert(it->first);
     }
 }
 
-FreeList::~FreeList()
+void FreeList::EraseBuffer(size_t offset, size_t buf_index)
 {
-    if(buffer_free_list)
+    std::map<size_t, size_t>::iterator it = buffer_map.find(offset);
+    if(it != buffer_map.begin())
     {
-        for(size_t i = 0; i < max_num_buffer; i++)
-        {
-            if(buffer_free_list[i])
-            {
-                while(buffer_free_list[i]->Count())
-                    buffer_free_list[i]->RemoveIntFromHead();
-                delete buffer_free_list[i];
-            }
-        }
-        delete [] buffer_free_list;
+        std::map<size_t, size_t>::iterator prev = it;
+        --prev;
+        if(prev->first + prev->second == offset)
+            merge_set.erase(prev->first);
     }
+    buffer_map.erase(it);
+    merge_set.erase(offset);
+
+    std::map<size_t, std::set<size_t> >::iterator cit = class_map.find(buf_index);
+    cit->second.erase(offset);
+    if(cit->second.empty())
+        class_map.erase(cit);
+    count--;
+    tot_size -= GetBufferSizeByIndex(buf_index);
 }
 
 int FreeList::ReuseBuffer(size_t buf_index, size_t offset)
 {
     int rval = MBError::BUFFER_LOST;
+    if(buffer_map.find(offset) != buffer_map.end())
+        return rval;
+
     for(size_t i = buf_index - 1; i > 0; i--)
     {
-        if(buffer_free_list[i]->Count() > max_buffer_per_list)
+        if(GetBufferCountByIndex(i) > max_buffer_per_list)
             continue;
 
-        if(buffer_free_list[i]->AddIntToTail(offset) == MBError::SUCCESS)
-        {
-            count++;
-            tot_size += (i + 1) * alignment;
-            rval = MBError::SUCCESS;
-        }
+        InsertBuffer(offset, i);
+        rval = MBError::SUCCESS;
         break;
     }
 
@@ -91,39 +120,97 @@ int FreeList::ReuseBuffer(size_t buf_index, size_t offset)
 
 int FreeList::AddBuffer(size_t offset, size_t size)
 {
-    int rval = MBError::SUCCESS;
-
     size_t buf_index = GetBufferIndex(size);
 #ifdef __DEBUG__
     assert(buf_index < max_num_buffer);
 #endif
 
-    if(buffer_free_list[buf_index]->Count() > (unsigned)max_buffer_per_list)
+    return AddBufferByIndex(buf_index, offset);
+}
+
+int FreeList::RemoveBuffer(size_t &offset, size_t size)
+{
+    if(GetBufferByIndex(GetBufferIndex(size), offset))
+        return MBError::SUCCESS;
+
+    return MBError::NO_MEMORY;
+}
+
+// Take the lowest buffer of the size class, or split the smallest larger
+// buffer and keep its tail in the list.
+bool FreeList::FindBuffer(size_t buf_index, size_t &offset)
+{
+    std::map<size_t, std::set<size_t> >::iterator cit = class_map.lower_bound(buf_index);
+    if(cit == class_map.end())
+        return false;
+
+    size_t found_index = cit->first;
+    offset = *cit->second.begin();
+    EraseBuffer(offset, found_index);
+    if(found_index == buf_index)
     {
-        ReuseBuffer(buf_index, offset); 
-        return rval;
+        num_reuse++;
+        return true;
     }
 
-    buffer_free_list[buf_index]->AddIntToTail(offset);
-    count++;
-    tot_size += (buf_index + 1) * alignment;
-    return rval;
+    size_t size = GetBufferSizeByIndex(buf_index);
+    if(buffer_map.find(offset + size) == buffer_map.end())
+        InsertBuffer(offset + size, GetBufferIndex(GetBufferSizeByIndex(found_index) - size));
+    num_split++;
+    return true;
 }
 
-int FreeList::RemoveBuffer(size_t &offset, size_t size)
+// Merge the runs of adjacent free buffers. A buffer that could not be
+// merged with the one following it is not rechecked until either of them
+// is freed again.
+void FreeList::Coalesce()
 {
-    int rval = MBError::NO_MEMORY;
+    size_t max_size = GetBufferSizeByIndex(max_num_buffer - 1);
+    while(!merge_set.empty())
+    {
+        size_t start = *merge_set.begin();
+        merge_set.erase(merge_set.begin());
+        std::map<size_t, size_t>::iterator it = buffer_map.find(start);
+        if(it == buffer_map.end())
+            continue;
 
-    size_t buf_index = GetBufferIndex(size);
-    if(buffer_free_list[buf_index]->Count() > 0)
+        size_t size = it->second;
+        EraseBuffer(start, GetBufferIndex(size));
+        while(true)
+        {
+            it = buffer_map.find(start + size);
+            if(it == buffer_map.end() || size + it->second > max_size)
+                break;
+            if(block_size > 0 && start / block_size != (start + size + it->second - 1) / block_size)
+                break;
+
+            size_t next_size = it->second;
+            EraseBuffer(start + size, GetBufferIndex(next_size));
+            size += next_size;
+            num_coalesce++;
+        }
+        InsertBuffer(start, GetBufferIndex(size), false);
+        merge_set.erase(start);
+    }
+}
+
+bool FreeList::GetBufferByIndex(size_t buf_index, size_t &offset)
+{
+#ifdef __DEBUG__
+    assert(buf_index < max_num_buffer);
+#endif
+    if(FindBuffer(buf_index, offset))
+        return true;
+
+    if(!merge_set.empty())
     {
-        offset = buffer_free_list[buf_index]->RemoveIntFromHead();
-        rval = MBError::SUCCESS;
-        count--;
-        tot_size -= (buf_index + 1) * alignment;
+        Coalesce();
+        if(FindBuffer(buf_index, offset))
+            return true;
     }
 
-    return rval;
+    num_miss++;
+    return false;
 }
 
 size_t FreeList::GetTotSize() const
@@ -136,11 +223,65 @@ int64_t FreeList::Count() const
     return count;
 }
 
-int FreeList::StoreListOnDisk()
+void FreeList::GetStats(MBFreeListStats &stats) const
 {
-    if(buffer_free_list == NULL)
-        return MBError::NOT_ALLOWED;
+    stats.num_buffer = count;
+    stats.free_size = tot_size;
+    stats.largest_buffer = 0;
+    if(!class_map.empty())
+        stats.largest_buffer = GetBufferSizeByIndex(class_map.rbegin()->first);
+    stats.num_reuse = num_reuse;
+    stats.num_split = num_split;
+    stats.num_miss = num_miss;
+    stats.num_coalesce = num_coalesce;
+}
+
+void FreeList::PrintStats(std::ostream &out_stream) const
+{
+    MBFreeListStats stats;
+    GetStats(stats);
+    int64_t num_alloc = stats.num_reuse + stats.num_split + stats.num_miss;
+    out_stream << "\tFree buffers: " << stats.num_buffer << " largest: "
+               << stats.largest_buffer << " fragmentation: "
+               << (stats.free_size > 0 ? 100 - stats.largest_buffer * 100 / stats.free_size : 0)
+               << "% reuse rate: "
+               << (num_alloc > 0 ? (stats.num_reuse + stats.num_split) * 100 / num_alloc : 0)
+               << "% (split " << stats.num_split << " coalesced " << stats.num_coalesce
+               << ")" << std::endl;
+}
 
+static void write_varint(std::ofstream &out, uint64_t val)
+{
+    uint8_t buff[10];
+    int len = 0;
+    while(val >= 0x80)
+    {
+        buff[len++] = static_cast<uint8_t>(val | 0x80);
+        val >>= 7;
+    }
+    buff[len++] = static_cast<uint8_t>(val);
+    out.write((char *) buff, len);
+}
+
+static bool read_varint(std::ifstream &in, uint64_t &val)
+{
+    val = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        int c = in.get();
+        if(c == EOF)
+            return false;
+        val |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if(!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// The list is stored in offset order as the distance from the previous
+// buffer and the buffer index, both as varints.
+int FreeList::StoreListOnDisk()
+{
     int rval = MBError::SUCCESS;
 
     if(count == 0)
@@ -155,34 +296,50 @@ int FreeList::StoreListOnDisk()
 
     Logger::Log(LOG_LEVEL_INFO, "%s write %lld buffers to list disk: %llu", list_path.c_str(),
                 count, tot_size);
-    for(size_t buf_index = 0; buf_index < max_num_buffer; buf_index++)
+    uint64_t magic = FREE_LIST_FILE_MAGIC;
+    freelist_f.write((char *) &magic, sizeof(magic));
+    freelist_f.write((char *) &count, sizeof(count));
+    size_t prev_offset = 0;
+    for(std::map<size_t, size_t>::iterator it = buffer_map.begin(); it != buffer_map.end(); ++it)
     {
-        int64_t buf_count = buffer_free_list[buf_index]->Count();
-        if(buf_count > 0)
-        {
-            // write list header (buffer index, buffer count)
-            freelist_f.write((char *)&buf_index, sizeof(size_t));
-            freelist_f.write((char *)&buf_count, sizeof(int64_t));
-            for(int64_t i = 0; i < buf_count; i++)
-            {
-                size_t offset = buffer_free_list[buf_index]->RemoveIntFromHead();
-                freelist_f.write((char *) &offset, sizeof(size_t));
-                count--;
-                tot_size -= (buf_index + 1) * alignment;
-            }
-        }
+        write_varint(freelist_f, it->first - prev_offset);
+        write_varint(freelist_f, GetBufferIndex(it->second));
+        prev_offset = it->first;
     }
 
     freelist_f.close();
+    Empty();
 
     return rval;
 }
 
-int FreeList::LoadListFromDisk()
+int FreeList::LoadLegacyList(std::ifstream &freelist_f)
 {
-    if(buffer_free_list == NULL)
-        return MBError::NOT_ALLOWED;
+    while(!freelist_f.eof())
+    {
+        size_t buf_index;
+        int64_t buf_count;
+        // Read header
+        freelist_f.read((char *) &buf_index, sizeof(size_t));
+        freelist_f.read((char *) &buf_count, sizeof(int64_t));
+        if(freelist_f.eof())
+            break;
+        if(buf_index >= max_num_buffer)
+            return MBError::INVALID_SIZE;
+        for(int64_t i = 0; i < buf_count; i++)
+        {
+            size_t offset;
+            freelist_f.read((char *) &offset, sizeof(size_t));
+            if(buffer_map.find(offset) == buffer_map.end())
+                InsertBuffer(offset, buf_index);
+        }
+    }
+
+    return MBError::SUCCESS;
+}
 
+int FreeList::LoadListFromDisk()
+{
     if(access(list_path.c_str(), F_OK) != 0)
     {
         if(errno == ENOENT)
@@ -201,26 +358,38 @@ int FreeList::LoadListFromDisk()
     if(!freelist_f.is_open())
         return MBError::OPEN_FAILURE;
 
-    while(!freelist_f.eof())
+    int rval = MBError::SUCCESS;
+    uint64_t magic = 0;
+    freelist_f.read((char *) &magic, sizeof(magic));
+    if(magic == FREE_LIST_FILE_MAGIC)
     {
-        size_t buf_index;
-        int64_t buf_count;
-        // Read header
-        freelist_f.read((char *) &buf_index, sizeof(size_t));
-        freelist_f.read((char *) &buf_count, sizeof(int64_t));
-        if(freelist_f.eof())
-            break;
-        for(int64_t i = 0; i < buf_count; i++)
+        int64_t num = 0;
+        freelist_f.read((char *) &num, sizeof(num));
+        size_t offset = 0;
+        for(int64_t i = 0; i < num; i++)
         {
-            size_t offset;
-            freelist_f.read((char *) &offset, sizeof(size_t));
-            buffer_free_list[buf_index]->AddIntToTail(offset);
-            count++;
-            tot_size += (buf_index + 1) * alignment;
+            uint64_t delta, buf_index;
+            if(!read_varint(freelist_f, delta) || !read_varint(freelist_f, buf_index) ||
+               buf_index >= max_num_buffer)
+            {
+                rval = MBError::INVALID_SIZE;
+                break;
+            }
+            offset += delta;
+            if(buffer_map.find(offset) == buffer_map.end())
+                InsertBuffer(offset, buf_index);
         }
     }
+    else
+    {
+        freelist_f.clear();
+        freelist_f.seekg(0);
+        rval = LoadLegacyList(freelist_f);
+    }
 
     freelist_f.close();
+    if(rval != MBError::SUCCESS)
+        Logger::Log(LOG_LEVEL_ERROR, "%s is corrupted", list_path.c_str());
 
     // Remove the file
     if(unlink(list_path.c_str()) != 0)
@@ -233,7 +402,7 @@ int FreeList::LoadListFromDisk()
     Logger::Log(LOG_LEVEL_INFO, "%s read %lld buffers to free list: %llu",
                 list_path.c_str(), count, tot_size);
 
-    return MBError::SUCCESS;
+    return rval;
 }
 
 void FreeList::ReleaseAlignmentBuffer(size_t old_offset, size_t alignment_offset)
@@ -248,32 +417,11 @@ void FreeList::ReleaseAlignmentBuffer(size_t old_offset, size_t alignment_offset
 
 void FreeList::Empty()
 {
-    for(size_t i = 0; i < max_num_buffer; i++)
-    {
-        if(buffer_free_list[i])
-        {
-            buffer_free_list[i]->Clear();
-        }
-    }
+    buffer_map.clear();
+    class_map.clear();
+    merge_set.clear();
     count = 0;
     tot_size = 0;
 }
 
-bool FreeList::GetBufferByIndex(size_t buf_index, size_t &offset)
-{
-#ifdef __DEBUG__
-    assert(buf_index < max_num_buffer);
-#endif
-    MBlsq *flist = buffer_free_list[buf_index];
-    if(flist->Count() > 0)
-    {
-        offset = flist->RemoveIntFromHead();
-        count--;
-        tot_size -= (buf_index + 1) * alignment;
-        return true;
-    }
-
-    return false;
-}
-
 }
@@ -21,27 +21,38 @@
 
 #include <cstdlib>
 #include <string>
+#include <map>
+#include <set>
+#include <iostream>
 
-#include "mb_lsq.h"
 #include "error.h"
 #include "lock_free.h"
 
 #define MAX_BUFFER_PER_LIST    256
 
-// Manage resource allocation/free using linked list
+// Manage resource allocation/free using size classes
 namespace mabain {
 
+struct _MBFreeListStats;
+typedef struct _MBFreeListStats MBFreeListStats;
+
 typedef struct _BufferCache
 {
     size_t buf_index;
     size_t buf_offset;
 } BufferCache;
 
+// Free buffers are kept in segregated size classes, one per aligned size,
+// and handed out lowest offset first. A request is served from its own
+// class, or else by splitting the smallest larger buffer. Adjacent free
+// buffers are tracked as they are freed and merged when a request finds
+// no buffer large enough, so that exact sizes are still reused first.
+// Buffers are never merged across a block boundary.
 class FreeList
 {
 public:
     FreeList(const std::string &file_path, size_t buff_alignment, size_t max_n_buff,
-             size_t max_buff_per_list = MAX_BUFFER_PER_LIST);
+             size_t max_buff_per_list = MAX_BUFFER_PER_LIST, size_t block_sz = 0);
     ~FreeList();
 
     // Free a buffer by adding it to the free list
@@ -51,6 +62,7 @@ public:
     // Release alignment buffer
     void ReleaseAlignmentBuffer(size_t old_offset, size_t alignment_offset);
 
+    // Reserve a buffer of the size class, splitting a larger buffer if needed
     bool GetBufferByIndex(size_t buf_index, size_t &offset);
 
     void Empty();
@@ -64,6 +76,9 @@ public:
     // Get total freed buffer size in the list
     size_t GetTotSize() const;
 
+    void GetStats(MBFreeListStats &stats) const;
+    void PrintStats(std::ostream &out_stream) const;
+
     inline int      AddBufferByIndex(size_t buf_index, size_t offset);
     inline size_t   RemoveBufferByIndex(size_t buf_index);
     inline size_t   GetAlignmentSize(size_t size) const;
@@ -73,7 +88,12 @@ public:
     inline int      ReleaseBuffer(size_t offset, size_t size);
 
 private:
-    int ReuseBuffer(size_t buf_index, size_t offset);
+    int  ReuseBuffer(size_t buf_index, size_t offset);
+    void InsertBuffer(size_t offset, size_t buf_index, bool check_prev = true);
+    void EraseBuffer(size_t offset, size_t buf_index);
+    bool FindBuffer(size_t buf_index, size_t &offset);
+    void Coalesce();
+    int  LoadLegacyList(std::ifstream &freelist_f);
 
     // file path where the list will be serialized and stored
     std::string list_path;
@@ -84,12 +104,23 @@ private:
     // maximum buffer per list
     // This restriction is to limit memory usage.
     size_t max_buffer_per_list;
-    // number of separated buffers
-    MBlsq **buffer_free_list;
+    // buffers are not merged across blocks; zero if there are no blocks
+    size_t block_size;
+    // free buffer sizes by offset
+    std::map<size_t, size_t> buffer_map;
+    // free buffer offsets by buffer index; only non-empty classes are kept
+    std::map<size_t, std::set<size_t> > class_map;
+    // offsets of the free buffers that are followed by a free buffer
+    std::set<size_t> merge_set;
     // total count of freed buffers
     int64_t count;
     // totol size allocted for all the buffers
     size_t tot_size;
+
+    int64_t num_reuse;
+    int64_t num_split;
+    int64_t num_miss;
+    int64_t num_coalesce;
 };
 
 inline size_t FreeList::GetAlignmentSize(size_t size) const
@@ -116,7 +147,10 @@ inline uint64_t FreeList::GetBufferCountByIndex(size_t buf_index) const
 #ifdef __DEBUG__
     assert(buf_index < max_num_buffer);
 #endif
-    return buffer_free_list[buf_index]->Count();
+    std::map<size_t, std::set<size_t> >::const_iterator it = class_map.find(buf_index);
+    if(it == class_map.end())
+        return 0;
+    return it->second.size();
 }
 
 inline size_t FreeList::GetBufferSizeByIndex(size_t buf_index) const
@@ -133,15 +167,16 @@ inline int FreeList::AddBufferByIndex(size_t buf_index, size_t offset)
     assert(buf_index < max_num_buffer);
 #endif
 
-    if(buffer_free_list[buf_index]->Count() > (unsigned)max_buffer_per_list)
+    if(GetBufferCountByIndex(buf_index) > (unsigned)max_buffer_per_list)
     {
         ReuseBuffer(buf_index, offset);
         return MBError::SUCCESS;
     }
+    if(buffer_map.find(offset) != buffer_map.end())
+        return MBError::INVALID_ARG;
 
-    count++;
-    tot_size += (buf_index + 1) * alignment;
-    return buffer_free_list[buf_index]->AddIntToTail(offset);
+    InsertBuffer(offset, buf_index);
+    return MBError::SUCCESS;
 }
 
 inline size_t FreeList::RemoveBufferByIndex(size_t buf_index)
@@ -149,9 +184,10 @@ inline size_t FreeList::RemoveBufferByIndex(size_t buf_index)
 #ifdef __DEBUG__
     assert(buf_index < max_num_buffer);
 #endif
-    count--;
-    tot_size -= (buf_index + 1) * alignment;
-    return buffer_free_list[buf_index]->RemoveIntFromHead();
+    size_t offset = *class_map[buf_index].begin();
+    EraseBuffer(offset, buf_index);
+    num_reuse++;
+    return offset;
 }
 
 inline int FreeList::ReleaseBuffer(size_t offset, size_t size)
@@ -0,0 +1,196 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+
+#include "hot_node_cache.h"
+#include "db.h"
+#include "dict_mem.h"
+#include "error.h"
+#include "integer_4b_5b.h"
+
+namespace mabain {
+
+HotNodeCache::HotNodeCache(const DictMem *dict_mem, const LockFreeShmData *lock_free,
+                           size_t root_off, int depth, int max_nodes)
+                         : mm(dict_mem),
+                           shm_data_ptr(lock_free),
+                           root_offset(root_off),
+                           max_depth(depth),
+                           max_num_node(max_nodes),
+                           counter(0),
+                           curr_node(-1),
+                           curr_edge(0),
+                           curr_depth(0),
+                           num_hit(0),
+                           num_miss(0),
+                           num_invalidation(0)
+{
+}
+
+HotNodeCache::~HotNodeCache()
+{
+}
+
+void HotNodeCache::Begin(uint32_t snapshot_counter)
+{
+    if(snapshot_counter != counter)
+    {
+        if(!nodes.empty())
+        {
+            nodes.clear();
+            num_invalidation++;
+        }
+        counter = snapshot_counter;
+    }
+    curr_node = -1;
+}
+
+// Returns the index of the node in the cache or -1 if the node cannot be
+// cached. The node is not cached if the writer started or finished an
+// update while it was read, or if the cache was filled at another counter.
+int HotNodeCache::LoadNode(size_t node_off)
+{
+    if(static_cast<int>(nodes.size()) >= max_num_node)
+        return -1;
+    if(shm_data_ptr->counter.load(std::memory_order_acquire) != counter ||
+       shm_data_ptr->offset.load(std::memory_order_acquire) != MAX_6B_OFFSET)
+        return -1;
+
+    HotNode node;
+    uint8_t buff[NODE_EDGE_KEY_FIRST + NUM_ALPHABET];
+    if(mm->ReadData(buff, NODE_EDGE_KEY_FIRST, node_off) != NODE_EDGE_KEY_FIRST)
+        return -1;
+    node.offset = node_off;
+    node.nt = buff[1] + 1;
+    if(mm->ReadData(buff + NODE_EDGE_KEY_FIRST, node.nt, node_off + NODE_EDGE_KEY_FIRST)
+                   != node.nt)
+        return -1;
+    node.edges.resize(node.nt * EDGE_SIZE);
+    if(mm->ReadData(&node.edges[0], node.nt * EDGE_SIZE,
+                    node_off + NODE_EDGE_KEY_FIRST + node.nt) != node.nt * EDGE_SIZE)
+        return -1;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(shm_data_ptr->counter.load(std::memory_order_acquire) != counter ||
+       shm_data_ptr->offset.load(std::memory_order_acquire) != MAX_6B_OFFSET)
+        return -1;
+
+    for(int i = 0; i < NUM_ALPHABET; i++)
+        node.index[i] = -1;
+    for(int i = 0; i < node.nt; i++)
+        node.index[buff[NODE_EDGE_KEY_FIRST + i]] = i;
+    node.children.assign(node.nt, -1);
+    nodes.push_back(std::move(node));
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+void HotNodeCache::SetEdge(const HotNode &node, int index, EdgePtrs &edge_ptrs) const
+{
+    memcpy(edge_ptrs.edge_buff, &node.edges[index * EDGE_SIZE], EDGE_SIZE);
+    edge_ptrs.offset = node.offset + NODE_EDGE_KEY_FIRST + node.nt + index * EDGE_SIZE;
+}
+
+int HotNodeCache::GetRootEdge(int nt, EdgePtrs &edge_ptrs)
+{
+    if(nodes.empty())
+    {
+        num_miss++;
+        if(LoadNode(root_offset) != 0)
+            return mm->GetRootEdge(0, nt, edge_ptrs);
+    }
+    else
+    {
+        num_hit++;
+    }
+
+    const HotNode &root = nodes[0];
+    int index = root.index[nt];
+    if(index < 0)
+        return mm->GetRootEdge(0, nt, edge_ptrs);
+    SetEdge(root, index, edge_ptrs);
+    InitTempEdgePtrs(edge_ptrs);
+
+    curr_node = 0;
+    curr_edge = index;
+    curr_depth = 0;
+    return MBError::SUCCESS;
+}
+
+int HotNodeCache::NextEdge(const uint8_t *key, EdgePtrs &edge_ptrs, uint8_t *node_buff,
+                           MBData &mbdata)
+{
+    // The saved edge of a retry and removals take the regular path.
+    if(curr_node < 0 ||
+       (mbdata.options & (CONSTS::OPTION_READ_SAVED_EDGE | CONSTS::OPTION_FIND_AND_STORE_PARENT)))
+    {
+        curr_node = -1;
+        return mm->NextEdge(key, edge_ptrs, node_buff, mbdata);
+    }
+
+    size_t node_off = Get6BInteger(edge_ptrs.offset_ptr);
+    int child = nodes[curr_node].children[curr_edge];
+    if(child >= 0 && nodes[child].offset == node_off)
+    {
+        num_hit++;
+    }
+    else
+    {
+        if(curr_depth >= max_depth)
+        {
+            curr_node = -1;
+            return mm->NextEdge(key, edge_ptrs, node_buff, mbdata);
+        }
+        num_miss++;
+        child = LoadNode(node_off);
+        if(child < 0)
+        {
+            curr_node = -1;
+            return mm->NextEdge(key, edge_ptrs, node_buff, mbdata);
+        }
+        nodes[curr_node].children[curr_edge] = child;
+    }
+
+    const HotNode &node = nodes[child];
+    int index = node.index[key[0]];
+    if(index < 0)
+        return MBError::NOT_EXIST;
+    SetEdge(node, index, edge_ptrs);
+
+    curr_node = child;
+    curr_edge = index;
+    curr_depth++;
+    return MBError::SUCCESS;
+}
+
+void HotNodeCache::GetStats(MBHotNodeStats &stats) const
+{
+    stats.num_node = nodes.size();
+    stats.num_hit = num_hit;
+    stats.num_miss = num_miss;
+    stats.num_invalidation = num_invalidation;
+}
+
+void HotNodeCache::PrintStats(std::ostream &out_stream) const
+{
+    out_stream << "\tHot node cache: " << nodes.size() << " nodes, hits: " << num_hit
+               << " misses: " << num_miss << " invalidations: " << num_invalidation
+               << std::endl;
+}
+
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __HOT_NODE_CACHE_H__
+#define __HOT_NODE_CACHE_H__
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+
+#include "mb_data.h"
+#include "lock_free.h"
+
+namespace mabain {
+
+// default number of levels below the root that are cached
+#define HOT_NODE_DEPTH_DEFAULT     2
+// default maximum number of cached nodes
+#define HOT_NODE_MAX_DEFAULT       4096
+
+class DictMem;
+struct _MBHotNodeStats;
+typedef struct _MBHotNodeStats MBHotNodeStats;
+
+// Decoded copy of an index node
+typedef struct _HotNode
+{
+    size_t  offset;
+    int     nt;
+    // edge index by the first key byte of the edge; -1 if there is no edge
+    int16_t index[NUM_ALPHABET];
+    std::vector<uint8_t> edges;
+    // cached node each edge leads to; -1 if not cached
+    std::vector<int> children;
+} HotNode;
+
+// Reader-side cache of the root and the upper levels of the index. Lookups
+// go through the cached nodes instead of reading them from the shared
+// memory. The whole cache is dropped when the lock-free modification
+// counter shows that the writer changed the index since it was filled.
+// Nodes are only cached if no update was in progress while they were read.
+// A cache serves a single DB handle and is not thread-safe.
+class HotNodeCache
+{
+public:
+    HotNodeCache(const DictMem *dict_mem, const LockFreeShmData *lock_free,
+                 size_t root_off, int depth, int max_nodes);
+    ~HotNodeCache();
+
+    // Start a lookup with the lock-free snapshot of the lookup
+    void Begin(uint32_t counter);
+    // Same as DictMem::GetRootEdge and DictMem::NextEdge, from the cache
+    // where possible.
+    int  GetRootEdge(int nt, EdgePtrs &edge_ptrs);
+    int  NextEdge(const uint8_t *key, EdgePtrs &edge_ptrs, uint8_t *node_buff,
+                  MBData &mbdata);
+
+    void GetStats(MBHotNodeStats &stats) const;
+    void PrintStats(std::ostream &out_stream) const;
+
+private:
+    int  LoadNode(size_t node_off);
+    void SetEdge(const HotNode &node, int index, EdgePtrs &edge_ptrs) const;
+
+    const DictMem *mm;
+    const LockFreeShmData *shm_data_ptr;
+    size_t root_offset;
+    int max_depth;
+    int max_num_node;
+
+    std::vector<HotNode> nodes;
+    uint32_t counter;
+    // position of the lookup in the cache
+    int curr_node;
+    int curr_edge;
+    int curr_depth;
+
+    int64_t num_hit;
+    int64_t num_miss;
+    int64_t num_invalidation;
+};
+
+}
+
+#endif
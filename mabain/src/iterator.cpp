@@ -16,8 +16,12 @@
 
 // @author Changxue Deng <chadeng@cisco.com>
 
+#include <pthread.h>
+#include <vector>
+
 #include "db.h"
 #include "dict.h"
+#include "logger.h"
 #include "integer_4b_5b.h"
 #include "mbt_base.h"
 
@@ -29,6 +33,7 @@ typedef struct _iterator_node
     uint8_t     *data;
     int          data_len;
     uint16_t     bucket_index;
+    int64_t      expiry;
 } iterator_node;
 
 static void free_iterator_node(void *n)
@@ -55,6 +60,7 @@ static iterator_node* new_iterator_node(const std::string &key, MBData *mbdata)
     if(mbdata != NULL)
     {
 	inode->bucket_index = mbdata->bucket_index;
+        inode->expiry = mbdata->expiry;
         mbdata->TransferValueTo(inode->data, inode->data_len);
         if(inode->data == NULL || inode->data_len <= 0)
         {
@@ -66,24 +72,48 @@ static iterator_node* new_iterator_node(const std::string &key, MBData *mbdata)
     {
         inode->data = NULL;
         inode->data_len = 0;
+        inode->expiry = 0;
     }
 
     return inode;
 }
 
+// Smallest key greater than all keys starting with prefix. Empty if there
+// is none, i.e., the prefix is empty or all 0xFF.
+static std::string prefix_upper_bound(const std::string &prefix)
+{
+    std::string upper = prefix;
+    while(!upper.empty())
+    {
+        uint8_t c = static_cast<uint8_t>(upper[upper.size()-1]);
+        if(c != 0xFF)
+        {
+            upper[upper.size()-1] = static_cast<char>(c + 1);
+            break;
+        }
+        upper.resize(upper.size()-1);
+    }
+    return upper;
+}
+
 /////////////////////////////////////////////////////////////////////
 // DB iterator
 // Example to use DB iterator
 // for(DB::iterator iter = db.begin(); iter != db.end(); ++iter) {
 //     std::cout << iter.key << "\n";
 // }
+// Example to iterate over the keys with a given prefix
+// for(DB::iterator iter = db.prefix_begin("tenant1/"); iter != db.end(); ++iter) {
+//     std::cout << iter.key << "\n";
+// }
 /////////////////////////////////////////////////////////////////////
 
-const DB::iterator DB::begin(bool check_async_mode, bool rc_mode) const
+const DB::iterator DB::begin(bool check_async_mode, bool rc_mode, bool keep_expired) const
 {
     DB::iterator iter = iterator(*this, DB_ITER_STATE_INIT);
     if(rc_mode) iter.value.options |= CONSTS::OPTION_RC_MODE;
-    iter.init(check_async_mode);
+    // The rc tree is copied back with the expired entries.
+    iter.init(check_async_mode, keep_expired || rc_mode);
 
     return iter;
 }
@@ -93,11 +123,111 @@ const DB::iterator DB::end() const
     return iterator(*this, DB_ITER_STATE_DONE);
 }
 
+const DB::iterator DB::range_begin(const std::string &lower, const std::string &upper,
+                                   bool check_async_mode, bool keep_expired) const
+{
+    DB::iterator iter = iterator(*this, DB_ITER_STATE_INIT);
+    iter.init_range(lower, upper, check_async_mode, keep_expired);
+
+    return iter;
+}
+
+const DB::iterator DB::prefix_begin(const std::string &prefix, bool check_async_mode) const
+{
+    DB::iterator iter = iterator(*this, DB_ITER_STATE_INIT);
+    iter.init_range(prefix, prefix_upper_bound(prefix), check_async_mode);
+
+    return iter;
+}
+
+typedef struct _ParallelIterArg
+{
+    MBConfig config;
+    std::string lower;
+    std::string upper;
+    DB::IterCallback callback;
+    void *arg;
+    int rval;
+} ParallelIterArg;
+
+static void* parallel_iterate_thread(void *arg)
+{
+    ParallelIterArg *iter_arg = static_cast<ParallelIterArg *>(arg);
+    DB db(iter_arg->config);
+    iter_arg->rval = db.Status();
+    if(!db.is_open())
+        return NULL;
+
+    for(DB::iterator iter = db.range_begin(iter_arg->lower, iter_arg->upper);
+        iter != db.end(); ++iter)
+    {
+        iter_arg->callback(iter.key, iter.value, iter_arg->arg);
+    }
+    db.Close();
+    return NULL;
+}
+
+int DB::ParallelIterate(int num_threads, IterCallback callback, void *arg,
+                        const std::string &prefix) const
+{
+    if(num_threads <= 0 || num_threads > NUM_ALPHABET || callback == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    // Thread i walks the keys whose byte after the prefix is in
+    // [first_byte[i], first_byte[i+1]). The first range also holds the
+    // prefix itself and the last one ends at the prefix upper bound.
+    std::vector<ParallelIterArg> iter_args(num_threads);
+    for(int i = 0; i < num_threads; i++)
+    {
+        ParallelIterArg &iter_arg = iter_args[i];
+        GetDBConfig(iter_arg.config);
+        iter_arg.config.mbdir = mb_dir.c_str();
+        iter_arg.config.options = options & ~(CONSTS::ACCESS_MODE_WRITER | CONSTS::ASYNC_WRITER_MODE);
+        iter_arg.config.connect_id = 0;
+        iter_arg.lower = prefix;
+        if(i > 0)
+            iter_arg.lower += static_cast<char>(i * NUM_ALPHABET / num_threads);
+        if(i < num_threads - 1)
+            iter_arg.upper = prefix + static_cast<char>((i + 1) * NUM_ALPHABET / num_threads);
+        else
+            iter_arg.upper = prefix_upper_bound(prefix);
+        iter_arg.callback = callback;
+        iter_arg.arg = arg;
+        iter_arg.rval = MBError::SUCCESS;
+    }
+
+    std::vector<pthread_t> tids;
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num_threads; i++)
+    {
+        pthread_t tid;
+        if(pthread_create(&tid, NULL, parallel_iterate_thread, &iter_args[i]) != 0)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "failed to start iterator thread");
+            rval = MBError::THREAD_FAILED;
+            break;
+        }
+        tids.push_back(tid);
+    }
+    for(size_t i = 0; i < tids.size(); i++)
+    {
+        pthread_join(tids[i], NULL);
+        if(rval == MBError::SUCCESS)
+            rval = iter_args[i].rval;
+    }
+
+    return rval;
+}
+
 void DB::iterator::iter_obj_init()
 {
     node_stack = NULL;
     kv_per_node = NULL;
     lfree = NULL;
+    bounded = false;
+    keep_expired = false;
 
     if(!(db_ref.GetDBOptions() & CONSTS::ACCESS_MODE_WRITER))
     {
@@ -120,6 +250,7 @@ DB::iterator::iterator(const iterator &rhs)
                      : db_ref(rhs.db_ref), state(rhs.state)
 {
     iter_obj_init();
+    keep_expired = rhs.keep_expired;
 }
 
 DB::iterator::~iterator()
@@ -131,8 +262,9 @@ DB::iterator::~iterator()
 }
 
 // Initialize the iterator, get the very first key-value pair.
-void DB::iterator::init(bool check_async_mode)
+void DB::iterator::init(bool check_async_mode, bool keep_exp)
 {
+    keep_expired = keep_exp;
     // Writer in async mode cannot be used for lookup
     if(check_async_mode && (db_ref.options & CONSTS::ASYNC_WRITER_MODE))
     {
@@ -148,6 +280,32 @@ void DB::iterator::init(bool check_async_mode)
         state = DB_ITER_STATE_DONE;
 }
 
+void DB::iterator::init_range(const std::string &lower, const std::string &upper,
+                              bool check_async_mode, bool keep_exp)
+{
+    bounded = true;
+    lower_bound = lower;
+    upper_bound = upper;
+    init(check_async_mode, keep_exp);
+}
+
+bool DB::iterator::key_in_range(const std::string &curr_key) const
+{
+    return curr_key >= lower_bound && (upper_bound.empty() || curr_key < upper_bound);
+}
+
+// All keys under a node start with the node key. The node can be skipped if
+// that is beyond the upper bound, or below the lower bound without being a
+// prefix of it.
+bool DB::iterator::node_in_range(const std::string &node_key) const
+{
+    if(!upper_bound.empty() && node_key >= upper_bound)
+        return false;
+    if(node_key < lower_bound && lower_bound.compare(0, node_key.size(), node_key) != 0)
+        return false;
+    return true;
+}
+
 // Initialize the iterator, but do not get the first key-value pair.
 // This is used for resource collection.
 int DB::iterator::init_no_next()
@@ -237,7 +395,7 @@ int DB::iterator::load_kvs(const std::string &curr_node_key,
             break;
 
         match_str = curr_node_key + match_str;
-        if(child_node_off > 0)
+        if(child_node_off > 0 && (!bounded || node_in_range(match_str)))
         {
             inode = new_iterator_node(match_str, NULL);
             if(inode != NULL)
@@ -251,7 +409,7 @@ int DB::iterator::load_kvs(const std::string &curr_node_key,
             }
         }
 
-        if(match != MATCH_NONE)
+        if(match != MATCH_NONE && (!bounded || key_in_range(match_str)))
         {
             inode = new_iterator_node(match_str, &value);
             if(inode != NULL)
@@ -363,31 +521,38 @@ int DB::iterator::load_kv_for_node(const std::string &curr_node_key)
 DB::iterator* DB::iterator::next()
 {
     iterator_node *inode;
+    int64_t now = keep_expired ? 0 : CurrentTimeMs();
 
-    while(kv_per_node->Count() == 0)
+    while(true)
     {
-        inode = (iterator_node *) node_stack->RemoveFromHead();
-        if(inode == NULL)
-            return NULL;
+        while(kv_per_node->Count() == 0)
+        {
+            inode = (iterator_node *) node_stack->RemoveFromHead();
+            if(inode == NULL)
+                return NULL;
 
-        int rval = load_kv_for_node(*inode->key);
-        free_iterator_node(inode);
-        if(rval != MBError::SUCCESS)
-            return NULL;
-    }
+            int rval = load_kv_for_node(*inode->key);
+            free_iterator_node(inode);
+            if(rval != MBError::SUCCESS)
+                return NULL;
+        }
 
-    if(kv_per_node->Count() > 0)
-    {
         inode = (iterator_node *) kv_per_node->RemoveFromHead();
+        if(!keep_expired && inode->expiry != 0 && inode->expiry <= now)
+        {
+            // expired but not removed yet
+            free_iterator_node(inode);
+            continue;
+        }
+
         match = MATCH_NODE_OR_EDGE;
         key = *inode->key;
         value.TransferValueFrom(inode->data, inode->data_len);
 	value.bucket_index = inode->bucket_index;
+        value.expiry = inode->expiry;
         free_iterator_node(inode);
         return this;
     }
-
-    return NULL;
 }
 
 // There is no need to perform lock-free check in next_dbt_buffer
@@ -0,0 +1,254 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+#include <errno.h>
+
+#include "journal.h"
+#include "dict.h"
+#include "error.h"
+#include "logger.h"
+#include "mabain_consts.h"
+
+namespace mabain {
+
+static inline int journal_expiry_size(const JournalRecord &rec)
+{
+    return (rec.flags & JOURNAL_FLAG_EXPIRY) ? sizeof(int64_t) : 0;
+}
+
+// FNV-1a
+static uint32_t journal_checksum(const JournalRecord &rec, const uint8_t *expiry,
+                                 const uint8_t *key, const uint8_t *data)
+{
+    const uint8_t *parts[4] = { reinterpret_cast<const uint8_t *>(&rec.data_len), expiry,
+                                key, data };
+    size_t sizes[4] = { sizeof(rec) - sizeof(rec.checksum),
+                        static_cast<size_t>(journal_expiry_size(rec)), rec.key_len,
+                        rec.data_len };
+    uint32_t h = 2166136261U;
+    for(int i = 0; i < 4; i++)
+    {
+        for(size_t j = 0; j < sizes[i]; j++)
+        {
+            h ^= parts[i][j];
+            h *= 16777619U;
+        }
+    }
+    return h;
+}
+
+Journal::Journal(const std::string &jpath, int64_t max_size)
+                : FileIO(jpath, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR, false),
+                  file_size(0),
+                  max_file_size(max_size),
+                  num_record(0),
+                  num_commit(0),
+                  num_checkpoint(0),
+                  num_replayed(0)
+{
+}
+
+Journal::~Journal()
+{
+}
+
+int Journal::Init()
+{
+    if(Open() < 0)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to open journal %s: %d", path.c_str(), errno);
+        return MBError::OPEN_FAILURE;
+    }
+    buffer.reserve(JOURNAL_GROUP_SIZE + sizeof(JournalRecord) + CONSTS::MAX_KEY_LENGHTH +
+                   CONSTS::MAX_DATA_SIZE);
+    return MBError::SUCCESS;
+}
+
+// Apply the committed records to the DB. Replay stops at the first record
+// that is incomplete or fails the checksum, which is the tail of a commit
+// interrupted by the crash. The caller must checkpoint once replay is done.
+int Journal::Replay(Dict *dict)
+{
+    JournalRecord rec;
+    std::vector<uint8_t> body;
+    MBData mbd;
+    int rval = MBError::SUCCESS;
+    int64_t offset = 0;
+
+    try {
+        while(RandomRead(&rec, sizeof(rec), offset) == sizeof(rec))
+        {
+            if(rec.key_len > CONSTS::MAX_KEY_LENGHTH ||
+               rec.data_len > (uint32_t) CONSTS::MAX_DATA_SIZE ||
+               rec.type < JOURNAL_REC_ADD || rec.type > JOURNAL_REC_REMOVE_ALL)
+                break;
+            size_t body_len = journal_expiry_size(rec) + rec.key_len + rec.data_len;
+            body.resize(body_len + 1);
+            if(RandomRead(&body[0], body_len, offset + sizeof(rec)) != body_len)
+                break;
+            uint8_t *key = &body[journal_expiry_size(rec)];
+            if(journal_checksum(rec, &body[0], key, key + rec.key_len) != rec.checksum)
+                break;
+
+            switch(rec.type)
+            {
+                case JOURNAL_REC_ADD:
+                    mbd.buff = key + rec.key_len;
+                    mbd.data_len = rec.data_len;
+                    mbd.expiry = 0;
+                    if(rec.flags & JOURNAL_FLAG_EXPIRY)
+                        memcpy(&mbd.expiry, &body[0], sizeof(mbd.expiry));
+                    rval = dict->Add(key, rec.key_len, mbd, true);
+                    mbd.buff = NULL;
+                    break;
+                case JOURNAL_REC_REMOVE:
+                    rval = dict->Remove(key, rec.key_len);
+                    if(rval == MBError::NOT_EXIST)
+                        rval = MBError::SUCCESS;
+                    break;
+                case JOURNAL_REC_REMOVE_ALL:
+                    rval = dict->RemoveAll();
+                    break;
+            }
+            if(rval != MBError::SUCCESS)
+                break;
+
+            num_replayed++;
+            offset += sizeof(rec) + body_len;
+        }
+    } catch (int error) {
+        rval = error;
+    }
+
+    mbd.buff = NULL;
+    file_size = offset;
+    if(rval != MBError::SUCCESS)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to replay journal at offset %lld: %s",
+                    (long long) offset, MBError::get_error_str(rval));
+        return rval;
+    }
+
+    if(num_replayed > 0)
+        Logger::Log(LOG_LEVEL_INFO, "replayed %lld journal records", (long long) num_replayed);
+    return MBError::SUCCESS;
+}
+
+int Journal::Append(uint8_t type, const uint8_t *key, int len, const uint8_t *data,
+                    int data_len, int64_t expiry)
+{
+    JournalRecord rec;
+    rec.data_len = data_len;
+    rec.key_len = len;
+    rec.type = type;
+    rec.flags = (expiry != 0) ? JOURNAL_FLAG_EXPIRY : 0;
+    const uint8_t *expiry_ptr = reinterpret_cast<const uint8_t *>(&expiry);
+    rec.checksum = journal_checksum(rec, expiry_ptr, key, data);
+
+    const uint8_t *rec_ptr = reinterpret_cast<const uint8_t *>(&rec);
+    buffer.insert(buffer.end(), rec_ptr, rec_ptr + sizeof(rec));
+    buffer.insert(buffer.end(), expiry_ptr, expiry_ptr + journal_expiry_size(rec));
+    buffer.insert(buffer.end(), key, key + len);
+    buffer.insert(buffer.end(), data, data + data_len);
+    num_record++;
+
+    if(buffer.size() >= JOURNAL_GROUP_SIZE)
+        return Commit();
+    return MBError::SUCCESS;
+}
+
+int Journal::LogAdd(const uint8_t *key, int len, const uint8_t *data, int data_len,
+                    int64_t expiry)
+{
+    return Append(JOURNAL_REC_ADD, key, len, data, data_len, expiry);
+}
+
+int Journal::LogRemove(const uint8_t *key, int len)
+{
+    return Append(JOURNAL_REC_REMOVE, key, len, NULL, 0, 0);
+}
+
+int Journal::LogRemoveAll()
+{
+    return Append(JOURNAL_REC_REMOVE_ALL, NULL, 0, NULL, 0, 0);
+}
+
+// Write the buffered records and sync them. The records are kept in the
+// buffer if the write fails so that the next commit retries them.
+int Journal::Commit()
+{
+    if(buffer.empty())
+        return MBError::SUCCESS;
+
+    if(RandomWrite(&buffer[0], buffer.size(), file_size) != buffer.size())
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to write journal %s: %d", path.c_str(), errno);
+        return MBError::WRITE_ERROR;
+    }
+    if(FlushData() != 0)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to sync journal %s: %d", path.c_str(), errno);
+        return MBError::WRITE_ERROR;
+    }
+
+    file_size += buffer.size();
+    buffer.clear();
+    num_commit++;
+    return MBError::SUCCESS;
+}
+
+// Truncate the journal after the DB files have been flushed. The truncation
+// is synced before new records are appended; otherwise records of an earlier
+// generation could follow the new ones after a crash.
+int Journal::Reset()
+{
+    if(TruncateFile(0) != 0)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to truncate journal %s: %d", path.c_str(), errno);
+        return MBError::WRITE_ERROR;
+    }
+    Flush();
+    file_size = 0;
+    num_checkpoint++;
+    return MBError::SUCCESS;
+}
+
+bool Journal::Pending() const
+{
+    return !buffer.empty();
+}
+
+bool Journal::NeedCheckpoint() const
+{
+    return file_size >= max_file_size;
+}
+
+void Journal::PrintStats(std::ostream &out_stream) const
+{
+    out_stream << "Journal: " << path << std::endl;
+    out_stream << "\tsize: " << file_size << " of " << max_file_size << std::endl;
+    out_stream << "\trecords: " << num_record << std::endl;
+    out_stream << "\tcommits: " << num_commit << std::endl;
+    if(num_commit > 0)
+        out_stream << "\trecords per commit: " << num_record / num_commit << std::endl;
+    out_stream << "\tcheckpoints: " << num_checkpoint << std::endl;
+    out_stream << "\treplayed records: " << num_replayed << std::endl;
+}
+
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "file_io.h"
+
+namespace mabain {
+
+// default size the journal grows to before a checkpoint
+#define JOURNAL_SIZE_DEFAULT       (64LL*1024*1024)
+// buffered bytes that trigger a commit without waiting for the caller
+#define JOURNAL_GROUP_SIZE         (1024*1024)
+
+#define JOURNAL_REC_ADD            1
+#define JOURNAL_REC_REMOVE         2
+#define JOURNAL_REC_REMOVE_ALL     3
+// set if the expiry time of the value (8 bytes) precedes the key
+#define JOURNAL_FLAG_EXPIRY        0x01
+
+typedef struct _JournalRecord
+{
+    uint32_t checksum;  // FNV-1a of the rest of the record
+    uint32_t data_len;
+    uint16_t key_len;
+    uint8_t  type;
+    uint8_t  flags;
+} JournalRecord;
+
+class Dict;
+
+// Redo journal of the updates applied by the writer. Records are logged
+// after the update is applied, so the DB files may already hold updates
+// that are not committed; only committed updates survive a crash. Records are
+// buffered and appended to the journal file with one write and one
+// fdatasync per commit, so that all updates processed since the last
+// commit share the cost of the sync. Once the journal outgrows its limit,
+// the DB files are flushed and the journal is truncated (checkpoint).
+// Replaying the journal is idempotent: additions are replayed as overwrites
+// and removals of missing keys are ignored.
+class Journal : public FileIO
+{
+public:
+    Journal(const std::string &jpath, int64_t max_size);
+    ~Journal();
+
+    int  Init();
+    int  Replay(Dict *dict);
+    int  LogAdd(const uint8_t *key, int len, const uint8_t *data, int data_len,
+                int64_t expiry = 0);
+    int  LogRemove(const uint8_t *key, int len);
+    int  LogRemoveAll();
+    int  Commit();
+    int  Reset();
+    bool Pending() const;
+    bool NeedCheckpoint() const;
+    void PrintStats(std::ostream &out_stream) const;
+
+private:
+    int  Append(uint8_t type, const uint8_t *key, int len, const uint8_t *data,
+                int data_len, int64_t expiry);
+
+    std::vector<uint8_t> buffer;
+    int64_t file_size;
+    int64_t max_file_size;
+
+    int64_t num_record;
+    int64_t num_commit;
+    int64_t num_checkpoint;
+    int64_t num_replayed;
+};
+
+}
+
+#endif
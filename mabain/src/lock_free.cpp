@@ -17,6 +17,7 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <iostream>
+#include <time.h>
 
 #include "lock_free.h"
 #include "mabain_consts.h"
@@ -24,12 +25,30 @@
 #include "integer_4b_5b.h"
 #include "drm_base.h"
 #include "dict_mem.h"
+#include "db.h"
 
 namespace mabain {
 
+// Reader retry statistics of the process
+static std::atomic<int64_t> retry_num_lookup(0);
+static std::atomic<int64_t> retry_num_retry(0);
+static std::atomic<int64_t> retry_max_chain(0);
+static std::atomic<int64_t> retry_time_us(0);
+static std::atomic<int64_t> retry_num_starved(0);
+static std::atomic<int64_t> writer_yield_us(0);
+
+static uint64_t get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 LockFree::LockFree()
 {
     shm_data_ptr = NULL;
+    header = NULL;
+    starving_until = NULL;
 }
 
 LockFree::~LockFree()
@@ -40,8 +59,10 @@ void LockFree::LockFreeInit(LockFreeShmData *lock_free_ptr, IndexHeader *hdr, in
 {
     shm_data_ptr = lock_free_ptr;
     header = hdr;
+    starving_until = &hdr->reader_starving_until;
     if(mode & CONSTS::ACCESS_MODE_WRITER)
     {
+        starving_until->store(0, std::memory_order_relaxed);
         // Clear the lock free data
         shm_data_ptr->counter.store(0, MEMORY_ORDER_WRITER);
         shm_data_ptr->offset.store(MAX_6B_OFFSET, MEMORY_ORDER_WRITER);
@@ -142,4 +163,74 @@ int LockFree::ReaderLockFreeStop(const LockFreeData &snapshot, size_t reader_off
     return MBError::SUCCESS;
 }
 
+// Called before an update while readers are starving. The wait ends when
+// the readers stop asking for it, and is bounded so that the writer keeps
+// making progress. Readers that crashed while starving cannot hold up the
+// writer since their request times out.
+void LockFree::WriterYield()
+{
+    uint64_t now = get_time_us();
+    uint64_t until = starving_until->load(std::memory_order_relaxed);
+    if(now >= until)
+    {
+        starving_until->compare_exchange_strong(until, 0, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t start = now;
+    uint64_t end = now + LOCK_FREE_WRITER_YIELD_US;
+    while(now < end && now < starving_until->load(std::memory_order_relaxed))
+    {
+        nanosleep((const struct timespec[]){{0, 10000L}}, NULL);
+        now = get_time_us();
+    }
+    writer_yield_us.fetch_add(now - start, std::memory_order_relaxed);
+}
+
+void LockFree::GetRetryStats(MBRetryStats &stats)
+{
+    stats.num_lookup = retry_num_lookup.load(std::memory_order_relaxed);
+    stats.num_retry = retry_num_retry.load(std::memory_order_relaxed);
+    stats.max_retry_chain = retry_max_chain.load(std::memory_order_relaxed);
+    stats.retry_time_us = retry_time_us.load(std::memory_order_relaxed);
+    stats.num_starved = retry_num_starved.load(std::memory_order_relaxed);
+    stats.writer_yield_us = writer_yield_us.load(std::memory_order_relaxed);
+}
+
+LockFreeRetry::LockFreeRetry(LockFree &lock_free) : lfree(lock_free)
+{
+    num_retry = 0;
+    start_us = get_time_us();
+}
+
+LockFreeRetry::~LockFreeRetry()
+{
+    retry_num_lookup.fetch_add(1, std::memory_order_relaxed);
+    retry_num_retry.fetch_add(num_retry, std::memory_order_relaxed);
+    retry_time_us.fetch_add(get_time_us() - start_us, std::memory_order_relaxed);
+    int64_t max_chain = retry_max_chain.load(std::memory_order_relaxed);
+    while(num_retry > max_chain &&
+          !retry_max_chain.compare_exchange_weak(max_chain, num_retry, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LockFreeRetry::Wait()
+{
+    num_retry++;
+    if(num_retry >= LOCK_FREE_RETRY_BUDGET && lfree.starving_until != NULL)
+    {
+        if(num_retry == LOCK_FREE_RETRY_BUDGET)
+            retry_num_starved.fetch_add(1, std::memory_order_relaxed);
+        // Keep the writer backing off until shortly after this retry.
+        uint64_t until = get_time_us() + LOCK_FREE_WRITER_YIELD_US;
+        uint64_t curr = lfree.starving_until->load(std::memory_order_relaxed);
+        while(curr < until &&
+              !lfree.starving_until->compare_exchange_weak(curr, until, std::memory_order_relaxed))
+        {
+        }
+    }
+    nanosleep((const struct timespec[]){{0, 10L}}, NULL);
+}
+
 }
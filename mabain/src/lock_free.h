@@ -34,8 +34,15 @@ namespace mabain {
 #define MEMORY_ORDER_WRITER std::memory_order_release
 #define MEMORY_ORDER_READER std::memory_order_consume
 
+// retries after which a lookup asks the writer to back off
+#define LOCK_FREE_RETRY_BUDGET     32
+// longest time in microseconds the writer backs off before an update
+#define LOCK_FREE_WRITER_YIELD_US  100
+
 struct _IndexHeader;
 typedef struct _IndexHeader IndexHeader;
+struct _MBRetryStats;
+typedef struct _MBRetryStats MBRetryStats;
 
 typedef struct _LockFreeData
 {
@@ -64,13 +71,43 @@ public:
     int  ReaderLockFreeStop(const LockFreeData &snapshot, size_t reader_offset,
              MBData &mbdata);
 
+    // Reader retries of all DB handles in the process
+    static void GetRetryStats(MBRetryStats &stats);
+
 private:
+    friend class LockFreeRetry;
+
+    void WriterYield();
+
     LockFreeShmData *shm_data_ptr;
     const IndexHeader *header;
+    // time until which starving readers want the writer to back off
+    std::atomic<uint64_t> *starving_until;
+};
+
+// Retries of a lookup after ReaderLockFreeStop returned TRY_AGAIN. Once a
+// lookup has used up LOCK_FREE_RETRY_BUDGET retries, the writer holds back
+// each update for up to LOCK_FREE_WRITER_YIELD_US so that the lookup can
+// complete. This bounds the time readers spin under a stream of updates.
+class LockFreeRetry
+{
+public:
+    LockFreeRetry(LockFree &lock_free);
+    ~LockFreeRetry();
+
+    // Wait before the next retry
+    void Wait();
+
+private:
+    LockFree &lfree;
+    int num_retry;
+    uint64_t start_us;
 };
 
 inline void LockFree::WriterLockFreeStart(size_t offset)
 {
+    if(starving_until != NULL && starving_until->load(std::memory_order_relaxed) != 0)
+        WriterYield();
     shm_data_ptr->offset.store(offset, MEMORY_ORDER_WRITER);
 }
 
@@ -26,6 +26,10 @@ const int CONSTS::ASYNC_WRITER_MODE            = 0x2;
 const int CONSTS::SYNC_ON_WRITE                = 0x4;
 const int CONSTS::USE_SLIDING_WINDOW           = 0x8;
 const int CONSTS::MEMORY_ONLY_MODE             = 0x10;
+const int CONSTS::USE_JOURNAL                  = 0x20;
+const int CONSTS::PREFAULT_ON_OPEN             = 0x40;
+const int CONSTS::USE_HUGE_PAGES               = 0x80;
+const int CONSTS::USE_CHANGE_FEED              = 0x100;
 
 const int CONSTS::OPTION_ALL_PREFIX            = 0x1;
 const int CONSTS::OPTION_FIND_AND_STORE_PARENT = 0x2;
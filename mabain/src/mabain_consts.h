@@ -30,6 +30,10 @@ public:
     static const int SYNC_ON_WRITE;
     static const int USE_SLIDING_WINDOW;
     static const int MEMORY_ONLY_MODE;
+    static const int USE_JOURNAL;
+    static const int PREFAULT_ON_OPEN;
+    static const int USE_HUGE_PAGES;
+    static const int USE_CHANGE_FEED;
     static const int OPTION_ALL_PREFIX;
 
     static const int OPTION_FIND_AND_STORE_PARENT;
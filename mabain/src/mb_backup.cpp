@@ -20,6 +20,9 @@
 #include <fstream>
 #include <limits.h>
 #include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "mb_backup.h"
 #include "mb_data.h"
@@ -40,55 +43,43 @@ DBBackup::DBBackup(const DB &db) : db_ref(db)
     if(header == NULL)
         throw (int) MBError::NOT_INITIALIZED;
 
+    data_file = dict->GetKVFile();
+    index_file = dict->GetMM()->GetKVFile();
+    incremental = false;
+    tid = 0;
+    status = MBError::SUCCESS;
 }
 
 DBBackup::~DBBackup()
 {
+    Wait();
 }
 
-
-void DBBackup::copy_file (const std::string &src_path, const std::string &dest_path,
-                          char *buffer, int buffer_size)
+void DBBackup::copy_file (const std::string &src_path, const std::string &dest_path)
 {
-    FILE *fp_read, *fp_write;
-
-    if ((fp_read = fopen (src_path.c_str(),"rb")) == NULL)
+    int src_fd = open(src_path.c_str(), O_RDONLY);
+    if(src_fd < 0)
     {
         Logger::Log(LOG_LEVEL_ERROR, "Backup failed: Could not open file %s", src_path.c_str()); 
-        throw MBError::OPEN_FAILURE;
+        throw (int) MBError::OPEN_FAILURE;
     }
-    if ((fp_write = fopen(dest_path.c_str(),"wb")) == NULL)
+    int dest_fd = open(dest_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(dest_fd < 0)
     {
-        fclose(fp_read);
+        close(src_fd);
         Logger::Log(LOG_LEVEL_ERROR, "Backup failed: Could not open file %s", dest_path.c_str()); 
-        throw MBError::OPEN_FAILURE;
+        throw (int) MBError::OPEN_FAILURE;
     }
-    
-    int rval = MBError::SUCCESS;
-    int read_count, write_count;
 
-    while(true)
-    {
-        read_count = fread(buffer, buffer_size, 1, fp_read);
-
-        if(feof(fp_read) && read_count == 0)
-             break;
-        if (read_count != 1)
-        {
-            rval = MBError::READ_ERROR;
-            break;
-        }
+    int rval = MBError::READ_ERROR;
+    struct stat st;
+    if(fstat(src_fd, &st) == 0)
+        rval = RollableFile::CopyFileRange(src_fd, dest_fd, 0, st.st_size);
+    if(rval == MBError::SUCCESS && fsync(dest_fd) != 0)
+        rval = MBError::WRITE_ERROR;
+    close(src_fd);
+    close(dest_fd);
 
-        write_count = fwrite(buffer,buffer_size, 1, fp_write);
-        if(write_count != 1)
-        {
-            rval = MBError::WRITE_ERROR;
-            break;
-        }
-    }
-    fclose(fp_read);
-    fclose(fp_write);
-    
     if(rval != MBError::SUCCESS)
     {
         Logger::Log(LOG_LEVEL_ERROR, "Backup failed %s", MBError::get_error_str(rval)); 
@@ -96,15 +87,13 @@ void DBBackup::copy_file (const std::string &src_path, const std::string &dest_p
     }
 }
 
-int DBBackup::Backup(const char * bk_dir)
+// Select the blocks to copy and copy the header. Updates are blocked
+// while this runs so that the header and the blocks are consistent.
+void DBBackup::Snapshot(const char *bk_dir)
 {
     if(bk_dir == NULL)
         throw (int) MBError::INVALID_ARG;
 
-    std::string bk_header_path = std::string(bk_dir) + "/_mabain_h";
-    if(access(bk_header_path.c_str(), R_OK) == 0)
-        throw (int) MBError::OPEN_FAILURE;
-    
     if(!db_ref.is_open())
         throw (int) db_ref.Status();
    
@@ -114,60 +103,125 @@ int DBBackup::Backup(const char * bk_dir)
         throw (int) MBError::INVALID_SIZE;
     if(header->index_block_size == 0 || header->index_block_size % BLOCK_SIZE_ALIGN != 0)
         throw (int) MBError::INVALID_SIZE;
-    
-    db_ref.Flush();
 
-    int num_data_files, num_index_files;
-    // get the number of files from the header: max_bytes/number_of_bytes_per_file
-    num_data_files = (header->m_data_offset/header->data_block_size) + 1; 
-    num_index_files = (header->m_index_offset/header->index_block_size) + 1;
-    
-    char *buffer = (char *) malloc(BLOCK_SIZE_ALIGN);
-    if(buffer == NULL)
-        throw (int) MBError::NO_MEMORY;
-    
-    // loop through all data files
-    const std::string &orig_dir = db_ref.GetDBDir();
-    std::string read_file_path_base = orig_dir + "/_mabain_d";
-    std::string write_file_path_base = std::string(bk_dir) + "/_mabain_d";
-    std::string read_file_path;
-    std::string write_file_path;
-    
-    for (int i = 0; i < num_data_files; i++)
+    // An existing backup can only be updated if it is the last backup of
+    // this writer and the blocks written since then are known.
+    bk_path = std::string(bk_dir) + "/";
+    if(access((bk_path + "_mabain_h").c_str(), R_OK) == 0)
     {
-        read_file_path = read_file_path_base + std::to_string(i);
-        write_file_path = write_file_path_base + std::to_string(i);
-        copy_file(read_file_path, write_file_path, buffer, BLOCK_SIZE_ALIGN);
+        if(!data_file->CanBackupIncrementally(bk_path) ||
+           !index_file->CanBackupIncrementally(bk_path))
+            throw (int) MBError::OPEN_FAILURE;
+        incremental = true;
     }
-    
-    read_file_path_base = orig_dir + "/_mabain_i";
-    write_file_path_base = std::string(bk_dir) + "/_mabain_i";
-    for (int i = 0; i < num_index_files; i++)
+
+    int rval = data_file->StartBackup(bk_path, header->m_data_offset, incremental);
+    if(rval == MBError::SUCCESS)
+        rval = index_file->StartBackup(bk_path, header->m_index_offset, incremental);
+    if(rval == MBError::SUCCESS)
     {
-        read_file_path = read_file_path_base + std::to_string(i);
-        write_file_path = write_file_path_base + std::to_string(i);
-        copy_file(read_file_path, write_file_path, buffer, BLOCK_SIZE_ALIGN);
+        try {
+            copy_file(db_ref.GetDBDir() + "/_mabain_h", bk_path + "_mabain_h");
+        } catch (int error) {
+            rval = error;
+        }
     }
-    
-    read_file_path = orig_dir + "/_mabain_h";
-    write_file_path = std::string(bk_dir) + "/_mabain_h";
-    //header is size of page_size
-    copy_file(read_file_path, write_file_path, buffer, RollableFile::page_size);
-    
-    free(buffer);
-    
+
+    if(rval != MBError::SUCCESS)
+        throw Finish(rval);
+}
+
+int DBBackup::CopyBlocks()
+{
+    int rval = data_file->CopyBackupChunks();
+    int rval_index = index_file->CopyBackupChunks();
+    if(rval == MBError::SUCCESS)
+        rval = rval_index;
+    return rval;
+}
+
+int DBBackup::Finish(int rval)
+{
+    int rval_data = data_file->FinishBackup(rval);
+    rval = index_file->FinishBackup(rval_data);
+    if(rval != MBError::SUCCESS)
+    {
+        // Make sure a partial backup is neither used nor updated.
+        if(rval_data == MBError::SUCCESS)
+            data_file->FinishBackup(rval);
+        unlink((bk_path + "_mabain_h").c_str());
+        Logger::Log(LOG_LEVEL_ERROR, "Backup to %s failed: %s", bk_path.c_str(),
+                    MBError::get_error_str(rval));
+        return rval;
+    }
+
     //reset number readers/writers in backed up DB.
-    int rval;
-    DB db = DB(bk_dir, CONSTS::ACCESS_MODE_READER, 0, 0);
+    DB db = DB(bk_path.c_str(), CONSTS::ACCESS_MODE_READER, 0, 0);
     rval = db.UpdateNumHandlers(CONSTS::ACCESS_MODE_WRITER, -1);
     if(rval != MBError::SUCCESS)
-        Logger::Log(LOG_LEVEL_WARN,"failed to reset number of writer for DB %s", bk_dir);
+        Logger::Log(LOG_LEVEL_WARN,"failed to reset number of writer for DB %s", bk_path.c_str());
     
     rval = db.UpdateNumHandlers(CONSTS::ACCESS_MODE_READER, INT_MIN);
     if(rval != MBError::SUCCESS)
-        Logger::Log(LOG_LEVEL_WARN,"failed to reset number of writer for DB %s", bk_dir);
+        Logger::Log(LOG_LEVEL_WARN,"failed to reset number of writer for DB %s", bk_path.c_str());
     db.Close();
+
+    Logger::Log(LOG_LEVEL_INFO, "%s backup to %s completed, %llu bytes copied",
+                incremental ? "incremental" : "full", bk_path.c_str(),
+                (unsigned long long) BytesCopied());
     return MBError::SUCCESS;
 }
 
+int DBBackup::Backup(const char * bk_dir)
+{
+    Snapshot(bk_dir);
+    status = Finish(CopyBlocks());
+    return status;
+}
+
+void* DBBackup::backup_thread(void *arg)
+{
+    DBBackup *bk = static_cast<DBBackup *>(arg);
+    bk->status = bk->Finish(bk->CopyBlocks());
+    bk->header->backup_flag.store(0, std::memory_order_release);
+    return NULL;
+}
+
+int DBBackup::StartBackup(const char *bk_dir)
+{
+    Snapshot(bk_dir);
+
+    header->backup_flag.store(1, std::memory_order_release);
+    if(pthread_create(&tid, NULL, backup_thread, this) != 0)
+    {
+        Logger::Log(LOG_LEVEL_WARN, "failed to create backup thread");
+        tid = 0;
+        header->backup_flag.store(0, std::memory_order_release);
+        status = Finish(CopyBlocks());
+        return status;
+    }
+
+    return MBError::SUCCESS;
+}
+
+int DBBackup::Wait()
+{
+    if(tid != 0)
+    {
+        pthread_join(tid, NULL);
+        tid = 0;
+    }
+    return status;
+}
+
+bool DBBackup::Incremental() const
+{
+    return incremental;
+}
+
+size_t DBBackup::BytesCopied() const
+{
+    return data_file->BackupBytesCopied() + index_file->BackupBytesCopied();
+}
+
 }
@@ -20,25 +20,47 @@
 #define __DBBackup_H__
 
 #include <string>
+#include <pthread.h>
 
 #include "db.h"
 #include "dict.h"
 
 namespace mabain {
 
+// Backup of a writer's DB. Only the blocks written since the last backup to
+// the same directory are copied if the writer has been tracking them. The
+// writer is only stopped while the snapshot is taken; blocks not copied yet
+// are copied by the writer before it modifies them.
 class DBBackup
 {
 public:
 	DBBackup(const DB &db);
 	~DBBackup();
+	// Returns after all blocks are copied.
 	int Backup(const char* bkup_dir);
+	// Copies the blocks in a background thread. Must be called in the writer
+	// thread, which can keep updating the DB until Wait returns.
+	int StartBackup(const char* bkup_dir);
+	int Wait();
+	bool Incremental() const;
+	size_t BytesCopied() const;
 
 private:
     static void copy_file (const std::string &src_path,
-        const std::string &dest_path, char *buffer, int buffer_size);
-    
+        const std::string &dest_path);
+    static void* backup_thread(void *arg);
+    void Snapshot(const char *bkup_dir);
+    int  CopyBlocks();
+    int  Finish(int rval);
+
     const DB &db_ref;
-    const IndexHeader *header;
+    IndexHeader *header;
+    RollableFile *data_file;
+    RollableFile *index_file;
+    std::string bk_path;
+    bool incremental;
+    pthread_t tid;
+    int status;
 };
 
 }
@@ -32,6 +32,7 @@ MBData::MBData()
     match_len = 0;
     next = false;
     options = 0;
+    expiry = 0;
     free_buffer = false;
 }
 
@@ -56,6 +57,7 @@ MBData::MBData(int size, int match_options)
     match_len = 0;
     next = false;
     options = match_options;
+    expiry = 0;
 }
 
 // Caller must free data.
@@ -89,6 +89,9 @@ public:
     // data offset
     size_t data_offset;
     uint16_t bucket_index;
+    // expiry time in milliseconds since the epoch; zero if the value does
+    // not expire. Set by lookups and used by Add.
+    int64_t expiry;
 
     // Search options
     int options;
@@ -17,6 +17,8 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <sys/time.h>
+#include <time.h>
+#include <algorithm>
 
 #include "mb_rc.h"
 #include "dict.h"
@@ -24,10 +26,10 @@
 #include "integer_4b_5b.h"
 
 #define MAX_PRUNE_COUNT      3                 // maximum lru eviction attempts
-#define NUM_ASYNC_TASK       10                // number of other tasks to be checked during eviction
-#define PRUNE_TASK_CHECK     100               // every Xth eviction check Y number of other tasks
-#define RC_TASK_CHECK        100               // every Xth async task try to reclaim resources
+#define RC_PAUSE_CHECK       16                // check the slice time every Xth buffer or entry
 #define MIN_RC_OFFSET_GAP    1ULL*1024*1024    // 1M
+#define EVICTION_LOW_MARK    20                // evict until 1/20 below the cap
+#define CLOCK_NUM_RANGE      256               // number of key ranges in a sweep round
 
 
 namespace mabain {
@@ -36,18 +38,32 @@ ResourceCollection::ResourceCollection(const DB &db, int rct)
                    : DBTraverseBase(db), rc_type(rct)
 {
     async_writer_ptr = NULL;
+    rc_loop_counter = 0;
+    slice_start_us = 0;
+
+    MBConfig config;
+    db.GetDBConfig(config);
+    max_pause_us = config.rc_max_pause_us;
+    if(max_pause_us <= 0)
+        max_pause_us = MB_RC_MAX_PAUSE_DEFAULT;
 }
 
 ResourceCollection::~ResourceCollection()
 {
 }
 
+static uint64_t get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 #define CIRCULAR_INDEX_DIFF(x, y) ((x)>(y) ? ((x)-(y)) : (0xFFFF-(y)+(x)))
 #define CIRCULAR_PRUNE_DIFF(x, y) ((x)>=(y) ? ((x)-(y)) : (0xFFFF-(y)+(x)))
 int ResourceCollection::LRUEviction()
 {
     int64_t pruned = 0;
-    int64_t count = 0;
     int rval = MBError::SUCCESS;
 
     Logger::Log(LOG_LEVEL_INFO, "running LRU eviction for bucket %u", header->eviction_bucket_index);
@@ -68,26 +84,28 @@ int ResourceCollection::LRUEviction()
     if(prune_diff == 0)
         prune_diff = 1;
 
-    for(DB::iterator iter = db_ref.begin(false); iter != db_ref.end(); ++iter)
+    StartPhase(MB_RC_PHASE_EVICTION, header->count);
+    for(DB::iterator iter = db_ref.begin(false, false, true); iter != db_ref.end(); ++iter)
     {
+        header->rc_work_done++;
         if(CIRCULAR_PRUNE_DIFF(iter.value.bucket_index, header->eviction_bucket_index) < prune_diff)
         {
             rval = dict->Remove((const uint8_t *)iter.key.data(), iter.key.size());
             if(rval != MBError::SUCCESS)
+            {
                 Logger::Log(LOG_LEVEL_DEBUG, "failed to run eviction %s", MBError::get_error_str(rval));
+            }
             else
+            {
+                dict->FeedEviction((const uint8_t *)iter.key.data(), iter.key.size());
                 pruned++;
+            }
         }
 
-        if(async_writer_ptr != NULL)
+        if(CheckPause(false) == MBError::RC_SKIPPED)
         {
-            if(count++ > PRUNE_TASK_CHECK)
-            {
-                count = 0;
-                rval = async_writer_ptr->ProcessTask(NUM_ASYNC_TASK, false);
-                if(rval == MBError::RC_SKIPPED)
-                    break;
-            }
+            rval = MBError::RC_SKIPPED;
+            break;
         }
     }
 
@@ -120,9 +138,39 @@ void ResourceCollection::ReclaimResource(int64_t min_index_size,
         throw db_ref.Status();
 
     async_writer_ptr = awr;
+    header->rc_work_total = 0;
+    header->rc_work_done = 0;
+    header->rc_bytes_moved = 0;
+    header->rc_num_pause = 0;
+    header->rc_max_pause_us = 0;
+    header->rc_p99_pause_us = 0;
+    pause_samples.clear();
+    rc_loop_counter = 0;
+    slice_start_us = get_time_us();
+
+    try {
+        DoReclaimResource(min_index_size, min_data_size, max_dbsz, max_dbcnt);
+    } catch (int error) {
+        StartPhase(MB_RC_PHASE_NONE, 0);
+        async_writer_ptr = NULL;
+        throw error;
+    }
+    StartPhase(MB_RC_PHASE_NONE, 0);
+    async_writer_ptr = NULL;
+}
+
+void ResourceCollection::DoReclaimResource(int64_t min_index_size,
+                                           int64_t min_data_size,
+                                           int64_t max_dbsz,
+                                           int64_t max_dbcnt)
+{
     timeval start, stop;
     uint64_t timediff;
 
+    // Expired entries go first so that their buffers are collected below.
+    if(ExpireEntries(false) == MBError::RC_SKIPPED)
+        throw (int) MBError::RC_SKIPPED;
+
     // Check LRU eviction first
     if(header->m_data_offset + header->m_index_offset > (size_t) max_dbsz ||
             header->count > max_dbcnt)
@@ -161,7 +209,6 @@ void ResourceCollection::ReclaimResource(int64_t min_index_size,
         Finish();
 
         gettimeofday(&stop, NULL);
-        async_writer_ptr = NULL;
         timediff = (stop.tv_sec - start.tv_sec)*1000000 + (stop.tv_usec - start.tv_usec);
         if(timediff > 1000000)
         {
@@ -176,6 +223,133 @@ void ResourceCollection::ReclaimResource(int64_t min_index_size,
     }
 }
 
+int ResourceCollection::ClockEviction()
+{
+    int64_t cap = header->eviction_cap;
+    if(cap <= 0)
+        return MBError::SUCCESS;
+    int64_t low_mark = cap - cap / EVICTION_LOW_MARK;
+
+    ClockHand &hand = dict->GetClockHand();
+    uint64_t start_us = get_time_us();
+    // Keys looked up in the previous round survive at most two more rounds.
+    int64_t max_scan = 3 * header->count + 1;
+    int64_t scanned = 0;
+    int64_t evicted = 0;
+    int rval = MBError::TRY_AGAIN;
+
+    while(rval == MBError::TRY_AGAIN)
+    {
+        if(hand.pos >= hand.splits.size())
+        {
+            if(!hand.splits.empty())
+                dict->NextClockRound();
+            SplitClockRanges(hand);
+            if(header->count == 0)
+            {
+                rval = MBError::OUT_OF_BOUND;
+                break;
+            }
+        }
+
+        const std::string &lower = hand.splits[hand.pos];
+        std::string upper;
+        if(hand.pos + 1 < hand.splits.size())
+            upper = hand.splits[hand.pos + 1];
+        // Samples are only kept for the ranges swept to the end. A range the
+        // sweep stops in is swept again from its start.
+        std::vector<std::string> samples;
+        int64_t range_count = 0;
+        for(DB::iterator iter = db_ref.range_begin(lower, upper, false, true); iter != db_ref.end(); ++iter)
+        {
+            scanned++;
+            if(range_count++ % hand.sample_step == 0)
+                samples.push_back(iter.key);
+            const uint8_t *key = reinterpret_cast<const uint8_t *>(iter.key.data());
+            if(!dict->IsReferenced(key, iter.key.size()))
+            {
+                if(dict->Remove(key, iter.key.size()) == MBError::SUCCESS)
+                {
+                    dict->FeedEviction(key, iter.key.size());
+                    evicted++;
+                }
+            }
+
+            if(dict->LiveSize() <= low_mark)
+                rval = MBError::SUCCESS;
+            else if(scanned >= max_scan)
+                rval = MBError::OUT_OF_BOUND;
+            else
+                continue;
+            break;
+        }
+        if(rval != MBError::TRY_AGAIN)
+            break;
+
+        hand.samples.insert(hand.samples.end(), samples.begin(), samples.end());
+        hand.pos++;
+        if(int64_t(get_time_us() - start_us) >= max_pause_us)
+            break;
+    }
+
+    uint64_t sweep_us = get_time_us() - start_us;
+    header->num_evicted += evicted;
+    header->num_evict_scan += scanned;
+    header->evict_time_us += sweep_us;
+    Logger::Log(LOG_LEVEL_DEBUG, "clock eviction evicted %lld of %lld scanned in %llu us",
+                evicted, scanned, sweep_us);
+    if(rval == MBError::OUT_OF_BOUND)
+        Logger::Log(LOG_LEVEL_WARN, "db size %lld still over the eviction cap %lld",
+                    dict->LiveSize(), cap);
+    return rval;
+}
+
+int ResourceCollection::ExpireEntries(bool bounded)
+{
+    bool rebuild = !bounded && dict->GetExpiryIndex().rebuild;
+    if(!rebuild && !dict->ExpiryDue())
+        return MBError::SUCCESS;
+
+    uint64_t start_us = get_time_us();
+    int64_t now = CurrentTimeMs();
+    int64_t live_size = dict->LiveSize();
+    int64_t expired = 0;
+    int rval = MBError::SUCCESS;
+
+    if(rebuild)
+        rval = RebuildExpiryIndex(now, expired);
+
+    std::string key;
+    MBData mbd;
+    while(rval == MBError::SUCCESS && dict->NextExpiredKey(now, key))
+    {
+        if(dict->RemoveExpired((const uint8_t *)key.data(), key.size(), now, mbd) ==
+               MBError::SUCCESS)
+            expired++;
+
+        if(bounded && int64_t(get_time_us() - start_us) >= max_pause_us)
+        {
+            rval = MBError::TRY_AGAIN;
+            break;
+        }
+        if(CheckPause(false) == MBError::RC_SKIPPED)
+        {
+            rval = MBError::RC_SKIPPED;
+            break;
+        }
+    }
+
+    uint64_t sweep_us = get_time_us() - start_us;
+    // Buffers reused by adds during a bounded sweep are not counted.
+    int64_t freed = std::max(live_size - dict->LiveSize(), (int64_t) 0);
+    header->num_expired += expired;
+    header->expiry_bytes_reclaimed += freed;
+    header->expiry_time_us += sweep_us;
+    Logger::Log(LOG_LEVEL_DEBUG, "expiry sweep removed %lld entries freeing %lld bytes in %llu us",
+                expired, freed, sweep_us);
+    return rval;
+}
+
 /////////////////////////////////////////////////////////
 ////////////////// Private Methods //////////////////////
 /////////////////////////////////////////////////////////
@@ -261,6 +435,7 @@ void ResourceCollection::CollectBuffers()
        (data_reorder_status != MBError::SUCCESS))
         return;
 
+    StartPhase(MB_RC_PHASE_COLLECT, EstimateLiveSize());
     TraverseDB(RESOURCE_COLLECTION_PHASE_COLLECT);
 
     if(rc_type & RESOURCE_COLLECTION_TYPE_INDEX)
@@ -349,6 +524,7 @@ bool ResourceCollection::MoveIndexBuffer(int phase, size_t &offset_src, int size
 
     ptr_src = dmm->GetShmPtr(offset_src, size);
     BufferCopy(offset_dst, ptr_dst, offset_src, ptr_src, size, dmm);
+    header->rc_bytes_moved += size;
 
     offset_src = offset_dst;
     return true;
@@ -388,6 +564,7 @@ bool ResourceCollection::MoveDataBuffer(int phase, size_t &offset_src, int size)
 
     ptr_src = dict->GetShmPtr(offset_src, size);
     BufferCopy(offset_dst, ptr_dst, offset_src, ptr_src, size, dict);
+    header->rc_bytes_moved += size;
 
     offset_src = offset_dst;
     return true;
@@ -475,14 +652,12 @@ void ResourceCollection::DoTask(int phase, DBTraverseNode &dbt_node)
 
     header->excep_updating_status = 0;
 
-    if(async_writer_ptr != NULL)
-    {
-        if(rc_loop_counter++ > RC_TASK_CHECK)
-        {
-            rc_loop_counter = 0;
-            async_writer_ptr->ProcessTask(NUM_ASYNC_TASK, true);
-        }
-    }
+    header->rc_work_done = 0;
+    if(rc_type & RESOURCE_COLLECTION_TYPE_INDEX)
+        header->rc_work_done += index_size;
+    if(rc_type & RESOURCE_COLLECTION_TYPE_DATA)
+        header->rc_work_done += data_size;
+    CheckPause(true);
 }
 
 
@@ -496,6 +671,7 @@ void ResourceCollection::ReorderBuffers()
     db_cnt = 0;
     edge_str_size = 0;
     node_cnt = 0;
+    StartPhase(MB_RC_PHASE_REORDER, EstimateLiveSize());
     TraverseDB(RESOURCE_COLLECTION_PHASE_REORDER);
 
     if(rc_type & RESOURCE_COLLECTION_TYPE_INDEX)
@@ -527,19 +703,16 @@ void ResourceCollection::ProcessRCTree()
 {
     Logger::Log(LOG_LEVEL_INFO, "resource collection done, traversing the rc tree %llu entries", header->rc_count);
 
-    int count = 0;
     int rval;
+    StartPhase(MB_RC_PHASE_RC_TREE, header->rc_count);
     for(DB::iterator iter = db_ref.begin(false, true); iter != db_ref.end(); ++iter)
     {
         iter.value.options = 0;
         rval = dict->Add((const uint8_t *)iter.key.data(), iter.key.size(), iter.value, true);
         if(rval != MBError::SUCCESS)
             Logger::Log(LOG_LEVEL_WARN, "failed to add: %s", MBError::get_error_str(rval));
-        if(count++ > RC_TASK_CHECK)
-        {
-            count = 0;
-            async_writer_ptr->ProcessTask(NUM_ASYNC_TASK, false);
-        }
+        header->rc_work_done++;
+        CheckPause(false);
 
         if(header->m_index_offset > rc_index_offset ||
            header->m_data_offset > rc_data_offset)
@@ -557,6 +730,125 @@ void ResourceCollection::ProcessRCTree()
     dmm->ClearRootEdges_RC();
 }
 
+// Estimated end offsets of the segments being collected once the pending
+// buffers are removed. Used as the amount of work of a traversal phase.
+int64_t ResourceCollection::EstimateLiveSize() const
+{
+    int64_t live_size = 0;
+    if(rc_type & RESOURCE_COLLECTION_TYPE_INDEX)
+        live_size += header->rc_m_index_off_pre - header->pending_index_buff_size;
+    if(rc_type & RESOURCE_COLLECTION_TYPE_DATA)
+        live_size += header->rc_m_data_off_pre - header->pending_data_buff_size;
+    return live_size;
+}
+
+// Record the keys of the entries with an expiry time added before the writer
+// opened the DB, removing the ones that have expired already.
+int ResourceCollection::RebuildExpiryIndex(int64_t now, int64_t &expired)
+{
+    ExpiryIndex &index = dict->GetExpiryIndex();
+    // Keys recorded since the writer opened the DB are recorded again.
+    index.buckets.clear();
+    index.num_key = 0;
+    index.rebuild = false;
+    int64_t num_add = header->expiry_num_add;
+    int rval = MBError::SUCCESS;
+
+    for(DB::iterator iter = db_ref.begin(false, false, true); iter != db_ref.end(); ++iter)
+    {
+        const uint8_t *key = reinterpret_cast<const uint8_t *>(iter.key.data());
+        if(iter.value.expiry > now)
+            dict->RecordExpiry(key, iter.key.size(), iter.value.expiry);
+        else if(iter.value.expiry != 0 && dict->Remove(key, iter.key.size()) == MBError::SUCCESS)
+            expired++;
+
+        if(CheckPause(false) == MBError::RC_SKIPPED)
+        {
+            index.rebuild = true;
+            rval = MBError::RC_SKIPPED;
+            break;
+        }
+    }
+
+    header->expiry_num_add = num_add;
+    Logger::Log(LOG_LEVEL_INFO, "expiry index rebuilt with %lld keys", index.num_key);
+    return rval;
+}
+
+// Start a sweep round with the ranges split at the keys sampled in the
+// previous round. The first round splits at the first key byte instead.
+// The keys of the new round are sampled while it is swept so that no
+// separate scan of the DB is needed.
+void ResourceCollection::SplitClockRanges(ClockHand &hand)
+{
+    hand.splits.swap(hand.samples);
+    hand.samples.clear();
+    std::sort(hand.splits.begin(), hand.splits.end());
+    hand.splits.erase(std::unique(hand.splits.begin(), hand.splits.end()), hand.splits.end());
+    if(hand.splits.empty())
+    {
+        for(int c = 1; c < CLOCK_NUM_RANGE; c++)
+            hand.splits.push_back(std::string(1, static_cast<char>(c)));
+    }
+    // The first range starts from the smallest possible key.
+    if(!hand.splits[0].empty())
+        hand.splits.insert(hand.splits.begin(), std::string());
+    hand.sample_step = header->count / CLOCK_NUM_RANGE + 1;
+    hand.pos = 0;
+}
+
+// Switch to the next phase and publish the pause stats of the previous one.
+// The work counters of the last phase are kept once rc is done.
+void ResourceCollection::StartPhase(int phase, int64_t work_total)
+{
+    UpdatePauseStats();
+    header->rc_phase = phase;
+    if(phase == MB_RC_PHASE_NONE)
+        return;
+    header->rc_work_total = work_total;
+    header->rc_work_done = 0;
+}
+
+// End the current slice and process the queued async updates if the slice
+// has run for max_pause_us. The caller resumes from where it stopped since
+// its iterator is left untouched. Returns MBError::RC_SKIPPED if the async
+// writer is being stopped.
+int ResourceCollection::CheckPause(bool rc_mode)
+{
+    if(async_writer_ptr == NULL)
+        return MBError::SUCCESS;
+    if(rc_loop_counter++ < RC_PAUSE_CHECK)
+        return MBError::SUCCESS;
+    rc_loop_counter = 0;
+
+    int64_t pause_us = get_time_us() - slice_start_us;
+    if(pause_us < max_pause_us)
+        return MBError::SUCCESS;
+
+    pause_samples.push_back(pause_us);
+    header->rc_num_pause++;
+    if(pause_us > header->rc_max_pause_us)
+        header->rc_max_pause_us = pause_us;
+
+    // Only the updates already queued are processed so that the rc can make
+    // progress under a steady stream of updates.
+    int ntasks = header->async_queue_size > 0 ? header->async_queue_size :
+                                                MB_MAX_NUM_SHM_QUEUE_NODE;
+    int rval = async_writer_ptr->ProcessTask(ntasks, rc_mode);
+    slice_start_us = get_time_us();
+    return rval;
+}
+
+void ResourceCollection::UpdatePauseStats()
+{
+    if(pause_samples.empty())
+        return;
+
+    size_t k = pause_samples.size() * 99 / 100;
+    std::nth_element(pause_samples.begin(), pause_samples.begin() + k, pause_samples.end());
+    header->rc_p99_pause_us = pause_samples[k];
+}
+
 int ResourceCollection::ExceptionRecovery()
 {
     if(!db_ref.is_open())
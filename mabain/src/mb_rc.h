@@ -19,6 +19,8 @@
 #ifndef __MB_RC_H__
 #define __MB_RC_H__
 
+#include <vector>
+
 #include "db.h"
 #include "dict.h"
 #include "mbt_base.h"
@@ -48,7 +50,21 @@ public:
     // This function should be called when writer starts up.
     int  ExceptionRecovery();
 
+    // Evict entries not looked up in the current or the previous sweep round
+    // while the DB is over its eviction cap. A sweep runs for at most rc_max_pause_us; the next
+    // one resumes from the key it stopped at.
+    int  ClockEviction();
+
+    // Remove the entries in the expiry buckets that have expired. A bounded
+    // sweep stops after rc_max_pause_us and returns TRY_AGAIN if there is
+    // more to remove; it leaves the scan for the keys added before the
+    // writer opened the DB to a full sweep. A full sweep is run by
+    // ReclaimResource before the buffers are collected.
+    int  ExpireEntries(bool bounded);
+
 private:
+    void DoReclaimResource(int64_t min_index_size, int64_t min_data_size,
+                           int64_t max_dbsz, int64_t max_dbcnt);
     void DoTask(int phase, DBTraverseNode &dbt_node);
     void Prepare(int64_t min_index_size, int64_t min_data_size);
     void CollectBuffers();
@@ -58,6 +74,12 @@ private:
     bool MoveDataBuffer(int phase, size_t &offset_src, int size);
     int  LRUEviction();
     void ProcessRCTree();
+    void StartPhase(int phase, int64_t work_total);
+    int  CheckPause(bool rc_mode);
+    void UpdatePauseStats();
+    int64_t EstimateLiveSize() const;
+    int  RebuildExpiryIndex(int64_t now, int64_t &expired);
+    void SplitClockRanges(ClockHand &hand);
 
     int     rc_type;
     int     index_rc_status;
@@ -77,6 +99,13 @@ private:
     size_t  rc_data_offset;
     int64_t rc_loop_counter;
 
+    // The rc work is done in slices of at most max_pause_us. The queued
+    // async updates are processed at the end of each slice while the
+    // traversal iterator keeps the position to resume from.
+    int64_t  max_pause_us;
+    uint64_t slice_start_us;
+    std::vector<int64_t> pause_samples;
+
     int64_t db_cnt;
     size_t  edge_str_size;
     int64_t node_cnt;
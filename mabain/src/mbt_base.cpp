@@ -97,7 +97,7 @@ void DBTraverseBase::GetAlignmentSize(DBTraverseNode &dbt_node) const
         if(dict->ReadData((uint8_t *)&data_size[0], DATA_HDR_BYTE, dbt_node.data_offset)
                  != DATA_HDR_BYTE)
             throw (int) MBError::READ_ERROR;
-        dbt_node.data_size = data_free_lists->GetAlignmentSize(data_size[0] + DATA_HDR_BYTE);
+        dbt_node.data_size = data_free_lists->GetAlignmentSize(DATA_RECORD_SIZE(data_size));
     }
 }
 
@@ -87,8 +87,31 @@ uint8_t* MmapFileIO::MapFile(size_t size, off_t offset, bool sliding)
     if(options & MMAP_ANONYMOUS_MODE)
     {
         assert(offset == 0 && !sliding);
-        addr = static_cast<unsigned char *>(mmap(NULL, size, mode,
-                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+        addr = static_cast<unsigned char *>(MAP_FAILED);
+#ifdef MAP_HUGETLB
+        // Fall back to regular pages if no huge pages are reserved.
+        if((options & MMAP_HUGETLB_MODE) && size % MMAP_HUGE_PAGE_SIZE == 0)
+        {
+            addr = static_cast<unsigned char *>(mmap(NULL, size, mode,
+                                  MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+            if(addr == MAP_FAILED)
+                Logger::Log(LOG_LEVEL_INFO, "hugetlb mmap (%s) failed errno=%d, using "
+                            "regular pages", path.c_str(), errno);
+        }
+#endif
+        if(addr == MAP_FAILED)
+        {
+            addr = static_cast<unsigned char *>(mmap(NULL, size, mode,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+#ifdef MADV_HUGEPAGE
+            if(addr != MAP_FAILED && (options & MMAP_HUGEPAGE_MODE))
+            {
+                if(madvise(addr, size, MADV_HUGEPAGE) != 0)
+                    Logger::Log(LOG_LEVEL_INFO, "madvise MADV_HUGEPAGE (%s) failed errno=%d",
+                                path.c_str(), errno);
+            }
+#endif
+        }
     }
     else
     {
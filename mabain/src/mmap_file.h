@@ -32,6 +32,9 @@
 
 namespace mabain {
 
+// size of the huge pages used for MMAP_HUGETLB_MODE
+#define MMAP_HUGE_PAGE_SIZE  (2*1024*1024)
+
 // Memory mapped file class
 class MmapFileIO : public FileIO
 {
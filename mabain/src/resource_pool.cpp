@@ -91,7 +91,12 @@ std::shared_ptr<MmapFileIO> ResourcePool::OpenFile(const std::string &fpath,
         if(create_file)
             flags |= O_CREAT;
         if(mode & CONSTS::MEMORY_ONLY_MODE)
+        {
             flags |= MMAP_ANONYMOUS_MODE;
+            if(mode & CONSTS::USE_HUGE_PAGES)
+                flags |= MMAP_HUGEPAGE_MODE;
+            flags |= mode & MMAP_HUGETLB_MODE;
+        }
 
         mmap_file = std::shared_ptr<MmapFileIO>
                     (
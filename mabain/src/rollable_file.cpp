@@ -27,6 +27,14 @@
 #include <assert.h>
 #include <errno.h>
 #include <climits>
+#include <algorithm>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include "db.h"
 #include "rollable_file.h"
@@ -102,6 +110,25 @@ RollableFile::RollableFile(const std::string &fpath, size_t blocksize, size_t me
     files.assign(3, NULL);
     if(mode & CONSTS::SYNC_ON_WRITE)
         Logger::Log(LOG_LEVEL_INFO, "Sync is turned on for " + fpath);
+
+    track_dirty = (mode & CONSTS::ACCESS_MODE_WRITER) &&
+                  !(mode & (CONSTS::MEMORY_ONLY_MODE | MMAP_ANONYMOUS_MODE));
+    chunks_per_block = (block_size + BACKUP_CHUNK_SIZE - 1) / BACKUP_CHUNK_SIZE;
+    if(track_dirty)
+        chunk_states.resize(max_num_block);
+    backup_tracking = false;
+    backup_num_block = 0;
+    backup_bytes.store(0, std::memory_order_relaxed);
+    backup_status.store(MBError::SUCCESS, std::memory_order_relaxed);
+
+    prefault_next.store(0, std::memory_order_relaxed);
+    prefault_stop.store(false, std::memory_order_relaxed);
+    prefault_running.store(0, std::memory_order_relaxed);
+    prefault_bytes.store(0, std::memory_order_relaxed);
+    prefault_minflt.store(0, std::memory_order_relaxed);
+    prefault_majflt.store(0, std::memory_order_relaxed);
+    prefault_us.store(0, std::memory_order_relaxed);
+    prefault_start_us = 0;
 }
 
 void RollableFile::InitShmSlidingAddr(std::atomic<size_t> *shm_sliding_addr)
@@ -114,6 +141,7 @@ void RollableFile::InitShmSlidingAddr(std::atomic<size_t> *shm_sliding_addr)
 
 void RollableFile::Close()
 {
+    StopPrefault();
     if(sliding_addr != NULL)
     {
         munmap(sliding_addr, sliding_size);
@@ -203,6 +231,8 @@ uint8_t* RollableFile::GetShmPtr(size_t offset, int size)
     if(rval != MBError::SUCCESS)
         return NULL;
 
+    // The pointer is also used by rc for writing.
+    MarkDirty(offset, size);
     if(files[order]->IsMapped())
     {
         size_t index = offset % block_size;
@@ -222,6 +252,118 @@ uint8_t* RollableFile::GetShmPtr(size_t offset, int size)
     return NULL;
 }
 
+// Start loading the bytes at offset into the CPU cache without waiting for
+// them. Nothing is done if the block is not mapped yet.
+void RollableFile::Prefetch(size_t offset, int size) const
+{
+    size_t order = offset / block_size;
+    if(order >= files.size() || files[order] == NULL || !files[order]->IsMapped())
+        return;
+
+    const uint8_t *ptr = files[order]->GetMapAddr() + (offset % block_size);
+    for(int i = 0; i < size; i += 64)
+        __builtin_prefetch(ptr + i);
+}
+
+static uint64_t get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Blocks that are not mapped (beyond the memory cap) are not prefaulted.
+// MAP_POPULATE is not used since it would hold up the open until all pages
+// are in.
+void RollableFile::Prefault(size_t max_offset, int num_threads)
+{
+    if(!prefault_chunks.empty() || num_threads <= 0)
+        return;
+
+    for(size_t order = 0; order * block_size < max_offset; order++)
+    {
+        if(CheckAndOpenFile(order, false) != MBError::SUCCESS)
+            break;
+        if(!files[order]->IsMapped())
+            continue;
+
+        size_t size = std::min(block_size, max_offset - order * block_size);
+        prefault_files.push_back(files[order]);
+        uint8_t *addr = files[order]->GetMapAddr();
+        for(size_t off = 0; off < size; off += PREFAULT_CHUNK_SIZE)
+        {
+            prefault_chunks.push_back(std::make_pair(addr + off,
+                                      std::min(size - off, (size_t) PREFAULT_CHUNK_SIZE)));
+        }
+    }
+
+    prefault_start_us = get_time_us();
+    num_threads = std::min(num_threads, static_cast<int>(prefault_chunks.size()));
+    if(num_threads == 0)
+        return;
+    prefault_running.store(num_threads, std::memory_order_release);
+    for(int i = 0; i < num_threads; i++)
+        prefault_threads.push_back(std::thread(&RollableFile::PrefaultWorker, this));
+}
+
+void RollableFile::PrefaultWorker()
+{
+#ifdef RUSAGE_THREAD
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_THREAD, &ru_start);
+#endif
+
+    uint8_t sum = 0;
+    size_t index;
+    while(!prefault_stop.load(std::memory_order_relaxed) &&
+          (index = prefault_next.fetch_add(1, std::memory_order_relaxed)) <
+              prefault_chunks.size())
+    {
+        volatile const uint8_t *ptr = prefault_chunks[index].first;
+        size_t size = prefault_chunks[index].second;
+        // Start the read-ahead of the whole chunk before touching its pages.
+        madvise(prefault_chunks[index].first, size, MADV_WILLNEED);
+        for(size_t off = 0; off < size; off += RollableFile::page_size)
+            sum += ptr[off];
+        prefault_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    (void) sum;
+
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &ru_end);
+    prefault_minflt.fetch_add(ru_end.ru_minflt - ru_start.ru_minflt, std::memory_order_relaxed);
+    prefault_majflt.fetch_add(ru_end.ru_majflt - ru_start.ru_majflt, std::memory_order_relaxed);
+#endif
+    if(prefault_running.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        prefault_us.store(get_time_us() - prefault_start_us, std::memory_order_release);
+        Logger::Log(LOG_LEVEL_INFO, "prefaulted %lld bytes of %s in %lld us: %lld minor "
+                    "%lld major page faults", (long long) prefault_bytes.load(),
+                    path.c_str(), (long long) prefault_us.load(),
+                    (long long) prefault_minflt.load(), (long long) prefault_majflt.load());
+    }
+}
+
+void RollableFile::StopPrefault()
+{
+    prefault_stop.store(true, std::memory_order_relaxed);
+    for(size_t i = 0; i < prefault_threads.size(); i++)
+        prefault_threads[i].join();
+    prefault_threads.clear();
+    prefault_files.clear();
+}
+
+// Add the prefault counters of this file to stats
+void RollableFile::AddPrefaultStats(MBPrefaultStats &stats) const
+{
+    if(prefault_running.load(std::memory_order_acquire) > 0)
+        stats.done = false;
+    stats.bytes += prefault_bytes.load(std::memory_order_relaxed);
+    stats.minor_faults += prefault_minflt.load(std::memory_order_relaxed);
+    stats.major_faults += prefault_majflt.load(std::memory_order_relaxed);
+    stats.warm_us = std::max(stats.warm_us, prefault_us.load(std::memory_order_relaxed));
+}
+
 int RollableFile::Reserve(size_t &offset, int size, uint8_t* &ptr, bool map_new_sliding)
 {
     int rval;
@@ -233,6 +375,7 @@ int RollableFile::Reserve(size_t &offset, int size, uint8_t* &ptr, bool map_new_
     if(rval != MBError::SUCCESS)
         return rval;
 
+    MarkDirty(offset, size);
     if(files[order]->IsMapped())
     {
         size_t index = offset % block_size;
@@ -324,6 +467,7 @@ size_t RollableFile::RandomWrite(const void *data, size_t size, off_t offset)
     if(rval != MBError::SUCCESS)
         return 0;
 
+    MarkDirty(offset, size);
     // Check sliding map
     if(sliding_mmap && sliding_addr != NULL)
     {
@@ -403,6 +547,12 @@ void RollableFile::PrintStats(std::ostream &out_stream) const
         out_stream << "\tsliding mmap start: " << sliding_start << std::endl;
         out_stream << "\tsliding mmap size: " << sliding_mem_size << std::endl;
     }
+    if(!prefault_chunks.empty())
+    {
+        out_stream << "\tprefaulted: " << prefault_bytes << " bytes in " << prefault_us
+                   << "us, page faults: " << prefault_minflt << " minor "
+                   << prefault_majflt << " major" << std::endl;
+    }
 }
 
 void RollableFile::ResetSlidingWindow()
@@ -454,4 +604,286 @@ void RollableFile::RemoveUnused(size_t max_size, bool writer_mode)
     }
 }
 
+std::atomic<uint8_t>* RollableFile::ChunkStates(size_t order)
+{
+    if(chunk_states[order] == NULL)
+    {
+        // Content of a block not seen before is unknown to the last backup.
+        std::atomic<uint8_t> *states = new std::atomic<uint8_t>[chunks_per_block];
+        for(size_t i = 0; i < chunks_per_block; i++)
+            states[i].store(CHUNK_DIRTY, std::memory_order_relaxed);
+        chunk_states[order].reset(states);
+    }
+    return chunk_states[order].get();
+}
+
+// Called by the writer before modifying [offset, offset+size).
+void RollableFile::MarkDirty(size_t offset, int size)
+{
+    if(!track_dirty || size <= 0)
+        return;
+
+    size_t order = offset / block_size;
+    if(order >= chunk_states.size())
+        return;
+    std::atomic<uint8_t> *states = ChunkStates(order);
+    size_t first = (offset % block_size) / BACKUP_CHUNK_SIZE;
+    size_t last = (offset % block_size + size - 1) / BACKUP_CHUNK_SIZE;
+    if(last >= chunks_per_block)
+        last = chunks_per_block - 1;
+
+    for(size_t i = first; i <= last; i++)
+    {
+        uint8_t state = states[i].load(std::memory_order_acquire);
+        while(state != CHUNK_DIRTY)
+        {
+            if(state == CHUNK_COPYING)
+            {
+                // Wait for the backup thread to copy the old content.
+                sched_yield();
+                state = states[i].load(std::memory_order_acquire);
+            }
+            else if(state == CHUNK_PENDING)
+            {
+                if(states[i].compare_exchange_weak(state, CHUNK_COPYING,
+                                                   std::memory_order_acq_rel))
+                {
+                    CopyChunk(order, i);
+                    states[i].store(CHUNK_DIRTY, std::memory_order_release);
+                    break;
+                }
+            }
+            else if(states[i].compare_exchange_weak(state, CHUNK_DIRTY,
+                                                    std::memory_order_acq_rel))
+            {
+                break;
+            }
+        }
+    }
+}
+
+void RollableFile::CopyChunk(size_t order, size_t chunk)
+{
+    size_t offset = chunk * BACKUP_CHUNK_SIZE;
+    size_t size = BACKUP_CHUNK_SIZE;
+    if(offset + size > block_size)
+        size = block_size - offset;
+
+    int rval = CopyFileRange(backup_src_fds[order], backup_dst_fds[order], offset, size);
+    if(rval == MBError::SUCCESS)
+        backup_bytes.fetch_add(size, std::memory_order_relaxed);
+    else
+        backup_status.store(rval, std::memory_order_relaxed);
+}
+
+// Copy size bytes at offset from src_fd to the same offset in dst_fd. Try to
+// share the extents (reflink) first, then let the kernel copy the range
+// and finally fall back to pread/pwrite.
+int RollableFile::CopyFileRange(int src_fd, int dst_fd, off_t offset, size_t size)
+{
+#ifdef FICLONERANGE
+    struct file_clone_range range;
+    range.src_fd = src_fd;
+    range.src_offset = offset;
+    range.src_length = size;
+    range.dest_offset = offset;
+    if(ioctl(dst_fd, FICLONERANGE, &range) == 0)
+        return MBError::SUCCESS;
+#endif
+
+    off_t src_off = offset;
+    size_t remaining = size;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    off_t dst_off = offset;
+    while(remaining > 0)
+    {
+        ssize_t nbytes = copy_file_range(src_fd, &src_off, dst_fd, &dst_off, remaining, 0);
+        if(nbytes == 0)
+            return MBError::SUCCESS; // end of the source file
+        if(nbytes < 0)
+            break;
+        remaining -= nbytes;
+    }
+    if(remaining == 0)
+        return MBError::SUCCESS;
+#endif
+
+    uint8_t buffer[64*1024];
+    while(remaining > 0)
+    {
+        size_t len = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        ssize_t nbytes = pread(src_fd, buffer, len, src_off);
+        if(nbytes == 0)
+            break;
+        if(nbytes < 0)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "backup failed to read: %d", errno);
+            return MBError::READ_ERROR;
+        }
+        if(pwrite(dst_fd, buffer, nbytes, src_off) != nbytes)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "backup failed to write: %d", errno);
+            return MBError::WRITE_ERROR;
+        }
+        src_off += nbytes;
+        remaining -= nbytes;
+    }
+
+    return MBError::SUCCESS;
+}
+
+bool RollableFile::CanBackupIncrementally(const std::string &bk_path) const
+{
+    return backup_tracking && bk_path == last_backup_path;
+}
+
+size_t RollableFile::BackupBytesCopied() const
+{
+    return backup_bytes.load(std::memory_order_relaxed);
+}
+
+// Open the block files below max_offset in both directories and select the
+// chunks to copy. No write can happen until this returns.
+int RollableFile::StartBackup(const std::string &bk_path, size_t max_offset, bool incremental)
+{
+    if(!track_dirty)
+        return MBError::NOT_ALLOWED;
+
+    backup_path = bk_path;
+    backup_num_block = max_offset / block_size + 1;
+    if(backup_num_block > chunk_states.size())
+        backup_num_block = chunk_states.size();
+    backup_src_fds.assign(backup_num_block, -1);
+    backup_dst_fds.assign(backup_num_block, -1);
+    backup_bytes.store(0, std::memory_order_relaxed);
+    backup_status.store(MBError::SUCCESS, std::memory_order_relaxed);
+    if(!incremental)
+        last_backup_path.clear();
+
+    size_t num_chunk_used = (max_offset + BACKUP_CHUNK_SIZE - 1) / BACKUP_CHUNK_SIZE;
+    for(size_t order = 0; order < backup_num_block; order++)
+    {
+        std::stringstream ss;
+        ss << order;
+        backup_src_fds[order] = open((path + ss.str()).c_str(), O_RDONLY);
+        if(backup_src_fds[order] < 0)
+        {
+            if(errno == ENOENT && order + 1 == backup_num_block)
+            {
+                // The last block has not been created yet.
+                backup_num_block = order;
+                break;
+            }
+            Logger::Log(LOG_LEVEL_ERROR, "backup failed to open %s%d: %d",
+                        path.c_str(), (int) order, errno);
+            return MBError::OPEN_FAILURE;
+        }
+
+        int flags = O_WRONLY | O_CREAT;
+        if(!incremental)
+            flags |= O_TRUNC;
+        std::string bk_file = bk_path + path.substr(path.rfind('/') + 1) + ss.str();
+        backup_dst_fds[order] = open(bk_file.c_str(), flags, 0644);
+        struct stat st;
+        if(backup_dst_fds[order] < 0 || fstat(backup_src_fds[order], &st) != 0 ||
+           ftruncate(backup_dst_fds[order], st.st_size) != 0)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "backup failed to create %s: %d",
+                        bk_file.c_str(), errno);
+            return MBError::OPEN_FAILURE;
+        }
+
+        std::atomic<uint8_t> *states = ChunkStates(order);
+        bool cloned = false;
+#ifdef FICLONE
+        // Reflink the whole block file if the file system supports it.
+        if(!incremental && ioctl(backup_dst_fds[order], FICLONE, backup_src_fds[order]) == 0)
+            cloned = true;
+#endif
+        for(size_t i = 0; i < chunks_per_block; i++)
+        {
+            uint8_t state = states[i].load(std::memory_order_relaxed);
+            if(cloned)
+                state = CHUNK_CLEAN;
+            else if(order * chunks_per_block + i >= num_chunk_used)
+                state = incremental ? state : CHUNK_DIRTY;
+            else if(!incremental || state != CHUNK_CLEAN)
+                state = CHUNK_PENDING;
+            states[i].store(state, std::memory_order_release);
+        }
+    }
+
+    backup_tracking = true;
+    return MBError::SUCCESS;
+}
+
+// Copy the pending chunks. It can run concurrently with the writer.
+int RollableFile::CopyBackupChunks()
+{
+    for(size_t order = 0; order < backup_num_block; order++)
+    {
+        std::atomic<uint8_t> *states = chunk_states[order].get();
+        for(size_t i = 0; i < chunks_per_block; i++)
+        {
+            uint8_t state = states[i].load(std::memory_order_acquire);
+            while(state == CHUNK_PENDING || state == CHUNK_COPYING)
+            {
+                if(state == CHUNK_COPYING)
+                {
+                    // Being copied by the writer
+                    sched_yield();
+                    state = states[i].load(std::memory_order_acquire);
+                }
+                else if(states[i].compare_exchange_weak(state, CHUNK_COPYING,
+                                                        std::memory_order_acq_rel))
+                {
+                    CopyChunk(order, i);
+                    states[i].store(CHUNK_CLEAN, std::memory_order_release);
+                    break;
+                }
+            }
+        }
+    }
+
+    return backup_status.load(std::memory_order_relaxed);
+}
+
+// Close the files of the backup. rval is the status of the backup so far.
+int RollableFile::FinishBackup(int rval)
+{
+    if(rval == MBError::SUCCESS)
+        rval = backup_status.load(std::memory_order_relaxed);
+    for(size_t order = 0; order < backup_src_fds.size(); order++)
+    {
+        if(rval != MBError::SUCCESS && chunk_states[order] != NULL)
+        {
+            // Chunks left pending by an aborted backup
+            std::atomic<uint8_t> *states = chunk_states[order].get();
+            for(size_t i = 0; i < chunks_per_block; i++)
+            {
+                uint8_t state = CHUNK_PENDING;
+                states[i].compare_exchange_strong(state, CHUNK_DIRTY, std::memory_order_acq_rel);
+            }
+        }
+        if(backup_src_fds[order] >= 0)
+            close(backup_src_fds[order]);
+        if(backup_dst_fds[order] >= 0)
+        {
+            if(rval == MBError::SUCCESS && fsync(backup_dst_fds[order]) != 0)
+                rval = MBError::WRITE_ERROR;
+            close(backup_dst_fds[order]);
+        }
+    }
+    backup_src_fds.clear();
+    backup_dst_fds.clear();
+    backup_num_block = 0;
+
+    // Only a complete backup can be the base of an incremental one.
+    if(rval == MBError::SUCCESS)
+        last_backup_path = backup_path;
+    else
+        last_backup_path.clear();
+    return rval;
+}
+
 }
@@ -26,12 +26,21 @@
 #include <assert.h>
 #include <atomic>
 #include <memory>
+#include <thread>
 
 #include "mmap_file.h"
 #include "logger.h"
 
 namespace mabain {
 
+// Granularity of the dirty block tracking used by incremental backup
+#define BACKUP_CHUNK_SIZE    (1024*1024)        // 1M
+// Unit of work handed to the prefault threads
+#define PREFAULT_CHUNK_SIZE  (4*1024*1024)      // 4M
+
+struct _MBPrefaultStats;
+typedef struct _MBPrefaultStats MBPrefaultStats;
+
 // Memory mapped file that can be rolled based on block size
 class RollableFile {
 public:
@@ -44,6 +53,11 @@ public:
     void     InitShmSlidingAddr(std::atomic<size_t> *shm_sliding_addr);
     int      Reserve(size_t &offset, int size, uint8_t* &ptr, bool map_new_sliding=true);
     uint8_t* GetShmPtr(size_t offset, int size);
+    void     Prefetch(size_t offset, int size) const;
+    // Map the blocks up to max_offset and fault their pages in with
+    // background threads so that the first lookups do not take the faults.
+    void     Prefault(size_t max_offset, int num_threads);
+    void     AddPrefaultStats(MBPrefaultStats &stats) const;
     size_t   CheckAlignment(size_t offset, int size);
     void     PrintStats(std::ostream &out_stream = std::cout) const;
     void     Close();
@@ -53,14 +67,31 @@ public:
     size_t   GetResourceCollectionOffset() const;
     void     RemoveUnused(size_t max_size, bool writer_mode);
 
+    // Online backup. StartBackup runs in the writer thread and selects the
+    // chunks to copy: all of them for a full backup, or the ones written
+    // since the last backup to the same path. CopyBackupChunks can then run
+    // in another thread while the writer keeps updating; a chunk still
+    // pending is copied by the writer before it is modified.
+    int      StartBackup(const std::string &bk_path, size_t max_offset, bool incremental);
+    int      CopyBackupChunks();
+    int      FinishBackup(int rval);
+    bool     CanBackupIncrementally(const std::string &bk_path) const;
+    size_t   BackupBytesCopied() const;
+
     static const long page_size;
     static int ShmSync(uint8_t *addr, int size);
+    static int CopyFileRange(int src_fd, int dst_fd, off_t offset, size_t size);
 
 private:
     int      OpenAndMapBlockFile(size_t block_order, bool create_file);
     int      CheckAndOpenFile(size_t block_order, bool create_file);
     uint8_t* NewSlidingMapAddr(size_t order, size_t offset, int size);
     void*    NewReaderSlidingMap(size_t order);
+    void     MarkDirty(size_t offset, int size);
+    std::atomic<uint8_t>* ChunkStates(size_t order);
+    void     CopyChunk(size_t order, size_t chunk);
+    void     PrefaultWorker();
+    void     StopPrefault();
 
     std::string path;
     size_t block_size;
@@ -84,6 +115,41 @@ private:
 
     int rc_offset_percentage;
     size_t mem_used;
+
+    // Per-chunk backup state, only tracked by the writer
+    enum
+    {
+        CHUNK_CLEAN   = 0,  // same as in the last backup
+        CHUNK_DIRTY   = 1,  // written since the last backup
+        CHUNK_PENDING = 2,  // to be copied by the running backup
+        CHUNK_COPYING = 3   // being copied
+    };
+    bool track_dirty;
+    size_t chunks_per_block;
+    std::vector<std::unique_ptr<std::atomic<uint8_t>[]>> chunk_states;
+    // chunk states are relative to the backup at last_backup_path
+    bool backup_tracking;
+    std::string last_backup_path;
+    std::string backup_path;
+    size_t backup_num_block;
+    std::vector<int> backup_src_fds;
+    std::vector<int> backup_dst_fds;
+    std::atomic<size_t> backup_bytes;
+    std::atomic<int> backup_status;
+
+    // Prefault at open. The threads take the chunks in order; the files
+    // are held so that the chunks stay mapped until the threads finish.
+    std::vector<std::thread> prefault_threads;
+    std::vector<std::shared_ptr<MmapFileIO>> prefault_files;
+    std::vector<std::pair<uint8_t*, size_t>> prefault_chunks;
+    std::atomic<size_t>  prefault_next;
+    std::atomic<bool>    prefault_stop;
+    std::atomic<int>     prefault_running;
+    std::atomic<int64_t> prefault_bytes;
+    std::atomic<int64_t> prefault_minflt;
+    std::atomic<int64_t> prefault_majflt;
+    std::atomic<int64_t> prefault_us;
+    uint64_t             prefault_start_us;
 };
 
 }
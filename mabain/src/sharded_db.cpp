@@ -0,0 +1,662 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "sharded_db.h"
+#include "mabain_consts.h"
+#include "error.h"
+#include "logger.h"
+
+namespace mabain {
+
+// FNV-1a
+static uint32_t shard_hash(const char *key, int len)
+{
+    uint32_t h = 2166136261U;
+    for(int i = 0; i < len; i++)
+    {
+        h ^= static_cast<uint8_t>(key[i]);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int copy_value(MBData &dst, const MBData &src)
+{
+    if(dst.Resize(src.data_len) != MBError::SUCCESS)
+        return MBError::NO_MEMORY;
+    memcpy(dst.buff, src.buff, src.data_len);
+    dst.data_len = src.data_len;
+    dst.match_len = src.match_len;
+    return MBError::SUCCESS;
+}
+
+static int make_dir(const std::string &path)
+{
+    if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to create directory %s: %d",
+                    path.c_str(), errno);
+        return MBError::OPEN_FAILURE;
+    }
+    return MBError::SUCCESS;
+}
+
+ShardedDB::ShardedDB(const char *db_path, int db_options, int nshard, int part,
+                     int plen, size_t memcap_index, size_t memcap_data,
+                     uint32_t queue_size)
+                   : options(db_options),
+                     num_shards(nshard),
+                     partition(part),
+                     prefix_len(plen),
+                     status(MBError::NOT_INITIALIZED)
+{
+    if(db_path == NULL || db_path[0] == '\0')
+    {
+        status = MBError::INVALID_ARG;
+        return;
+    }
+    mb_dir = std::string(db_path);
+    if(mb_dir[mb_dir.length()-1] != '/')
+        mb_dir += "/";
+
+    if(options & CONSTS::ACCESS_MODE_WRITER)
+    {
+        status = make_dir(mb_dir);
+        if(status != MBError::SUCCESS)
+            return;
+    }
+
+    status = LoadLayout();
+    if(status != MBError::SUCCESS)
+        return;
+
+    status = OpenShards(memcap_index, memcap_data, queue_size);
+    if(status != MBError::SUCCESS)
+        Close();
+}
+
+ShardedDB::~ShardedDB()
+{
+    Close();
+}
+
+// The shard layout is saved by the writer in the top directory so that
+// readers do not need to know it and a reopen cannot reroute existing keys.
+int ShardedDB::LoadLayout()
+{
+    int saved_shards = 0;
+    int saved_partition = 0;
+    int saved_prefix_len = 0;
+    bool saved = false;
+
+    std::string meta_path = mb_dir + MB_SHARD_META_FILE;
+    FILE *meta_file = fopen(meta_path.c_str(), "r");
+    if(meta_file != NULL)
+    {
+        int nread = fscanf(meta_file, "%d %d %d", &saved_shards, &saved_partition,
+                           &saved_prefix_len);
+        fclose(meta_file);
+        if(nread != 3)
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "corrupted shard layout file %s", meta_path.c_str());
+            return MBError::READ_ERROR;
+        }
+        saved = true;
+    }
+
+    if(saved)
+    {
+        if(num_shards == 0)
+        {
+            num_shards = saved_shards;
+            partition = saved_partition;
+            prefix_len = saved_prefix_len;
+        }
+        else if(num_shards != saved_shards || partition != saved_partition ||
+                (partition == PARTITION_PREFIX && prefix_len != saved_prefix_len))
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "shard layout %d/%d/%d does not match %d/%d/%d in %s",
+                        num_shards, partition, prefix_len, saved_shards, saved_partition,
+                        saved_prefix_len, mb_dir.c_str());
+            return MBError::INVALID_ARG;
+        }
+    }
+    else if(num_shards == 0)
+    {
+        return MBError::NOT_EXIST;
+    }
+
+    if(num_shards < 0 || num_shards > MB_MAX_NUM_SHARD)
+        return MBError::INVALID_ARG;
+    if(partition == PARTITION_PREFIX)
+    {
+        if(prefix_len <= 0)
+            return MBError::INVALID_ARG;
+    }
+    else if(partition == PARTITION_HASH)
+    {
+        prefix_len = 0;
+    }
+    else
+    {
+        return MBError::INVALID_ARG;
+    }
+
+    if(!saved && (options & CONSTS::ACCESS_MODE_WRITER))
+        return SaveLayout();
+    return MBError::SUCCESS;
+}
+
+int ShardedDB::SaveLayout() const
+{
+    std::string meta_path = mb_dir + MB_SHARD_META_FILE;
+    FILE *meta_file = fopen(meta_path.c_str(), "w");
+    if(meta_file == NULL)
+    {
+        Logger::Log(LOG_LEVEL_ERROR, "failed to create %s: %d", meta_path.c_str(), errno);
+        return MBError::OPEN_FAILURE;
+    }
+    int rval = MBError::SUCCESS;
+    if(fprintf(meta_file, "%d %d %d\n", num_shards, partition, prefix_len) < 0)
+        rval = MBError::WRITE_ERROR;
+    if(fclose(meta_file) != 0)
+        rval = MBError::WRITE_ERROR;
+    return rval;
+}
+
+std::string ShardedDB::ShardDir(int shard) const
+{
+    return mb_dir + "shard_" + std::to_string(shard) + "/";
+}
+
+int ShardedDB::OpenShards(size_t memcap_index, size_t memcap_data, uint32_t queue_size)
+{
+    // Each shard writer runs its own async writer thread.
+    int writer_options = options | CONSTS::ASYNC_WRITER_MODE;
+    int reader_options = options & ~(CONSTS::ACCESS_MODE_WRITER | CONSTS::ASYNC_WRITER_MODE);
+
+    for(int i = 0; i < num_shards; i++)
+    {
+        std::string shard_dir = ShardDir(i);
+        if(options & CONSTS::ACCESS_MODE_WRITER)
+        {
+            int rval = make_dir(shard_dir);
+            if(rval != MBError::SUCCESS)
+                return rval;
+
+            DB *db = new DB(shard_dir.c_str(), writer_options, memcap_index,
+                            memcap_data, 0, queue_size);
+            writers.push_back(db);
+            if(!db->is_open())
+            {
+                Logger::Log(LOG_LEVEL_ERROR, "failed to open shard writer %s: %s",
+                            shard_dir.c_str(), db->StatusStr());
+                return db->Status();
+            }
+        }
+
+        DB *db = new DB(shard_dir.c_str(), reader_options, memcap_index,
+                        memcap_data, 0, queue_size);
+        readers.push_back(db);
+        if(!db->is_open())
+        {
+            Logger::Log(LOG_LEVEL_ERROR, "failed to open shard reader %s: %s",
+                        shard_dir.c_str(), db->StatusStr());
+            return db->Status();
+        }
+    }
+
+    return MBError::SUCCESS;
+}
+
+int ShardedDB::Close()
+{
+    int rval = MBError::SUCCESS;
+
+    // Writers must be the last to close.
+    for(size_t i = 0; i < readers.size(); i++)
+    {
+        readers[i]->Close();
+        delete readers[i];
+    }
+    readers.clear();
+    for(size_t i = 0; i < writers.size(); i++)
+    {
+        int ret = writers[i]->Close();
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+        delete writers[i];
+    }
+    writers.clear();
+
+    if(status == MBError::SUCCESS)
+        status = MBError::DB_CLOSED;
+    return rval;
+}
+
+int ShardedDB::GetShard(const char *key, int len) const
+{
+    if(partition == PARTITION_PREFIX && len > prefix_len)
+        len = prefix_len;
+    return shard_hash(key, len) % num_shards;
+}
+
+// Updates from the writer go to the shard writer, which queues them to the
+// async writer thread. Readers submit to the shard through the shared
+// memory queue.
+DB* ShardedDB::UpdateHandle(int shard) const
+{
+    if(writers.empty())
+        return readers[shard];
+    return writers[shard];
+}
+
+DB* ShardedDB::GetShardDB(int shard) const
+{
+    if(status != MBError::SUCCESS || shard < 0 || shard >= num_shards)
+        return NULL;
+    return readers[shard];
+}
+
+int ShardedDB::Add(const char* key, int len, const char* data, int data_len, bool overwrite)
+{
+    if(key == NULL || data == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    return UpdateHandle(GetShard(key, len))->Add(key, len, data, data_len, overwrite);
+}
+
+int ShardedDB::Add(const std::string &key, const std::string &value, bool overwrite)
+{
+    return Add(key.data(), key.size(), value.data(), value.size(), overwrite);
+}
+
+int ShardedDB::Remove(const char *key, int len)
+{
+    if(key == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    return UpdateHandle(GetShard(key, len))->Remove(key, len);
+}
+
+int ShardedDB::Remove(const std::string &key)
+{
+    return Remove(key.data(), key.size());
+}
+
+int ShardedDB::RemoveAll()
+{
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num_shards; i++)
+    {
+        int ret = UpdateHandle(i)->RemoveAll();
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+    }
+    return rval;
+}
+
+int ShardedDB::AddBatch(const std::vector<std::string> &keys,
+                        const std::vector<std::string> &values, bool overwrite)
+{
+    if(keys.size() != values.size())
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    std::vector<std::vector<std::string> > shard_keys(num_shards);
+    std::vector<std::vector<std::string> > shard_values(num_shards);
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        int shard = GetShard(keys[i].data(), keys[i].size());
+        shard_keys[shard].push_back(keys[i]);
+        shard_values[shard].push_back(values[i]);
+    }
+
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num_shards; i++)
+    {
+        if(shard_keys[i].empty())
+            continue;
+        int ret = UpdateHandle(i)->AddBatch(shard_keys[i], shard_values[i], overwrite);
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+    }
+    return rval;
+}
+
+int ShardedDB::RemoveBatch(const std::vector<std::string> &keys)
+{
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    std::vector<std::vector<std::string> > shard_keys(num_shards);
+    for(size_t i = 0; i < keys.size(); i++)
+        shard_keys[GetShard(keys[i].data(), keys[i].size())].push_back(keys[i]);
+
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num_shards; i++)
+    {
+        if(shard_keys[i].empty())
+            continue;
+        int ret = UpdateHandle(i)->RemoveBatch(shard_keys[i]);
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+    }
+    return rval;
+}
+
+int ShardedDB::Find(const char* key, int len, MBData &mdata) const
+{
+    if(key == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    return readers[GetShard(key, len)]->Find(key, len, mdata);
+}
+
+int ShardedDB::Find(const std::string &key, MBData &mdata) const
+{
+    return Find(key.data(), key.size(), mdata);
+}
+
+// With prefix partitioning, every key of length prefix_len or longer is in
+// the shard of its first prefix_len bytes, so the longest match of at least
+// that length is found in one shard. Shorter prefixes are hashed as a whole
+// and are checked with exact lookups from the longest down. With hash
+// partitioning, all shards are searched and the longest match is taken.
+int ShardedDB::FindLongestPrefix(const char* key, int len, MBData &data) const
+{
+    if(key == NULL)
+        return MBError::INVALID_ARG;
+    if(status != MBError::SUCCESS)
+        return MBError::NOT_INITIALIZED;
+
+    int rval;
+    if(partition == PARTITION_PREFIX)
+    {
+        int head_len = len < prefix_len ? len : prefix_len;
+        rval = readers[GetShard(key, len)]->FindLongestPrefix(key, len, data);
+        if(rval != MBError::SUCCESS && rval != MBError::NOT_EXIST)
+            return rval;
+        int found_len = rval == MBError::SUCCESS ? data.match_len : 0;
+        if(found_len >= head_len)
+            return rval;
+
+        for(int plen = head_len - 1; plen > found_len; plen--)
+        {
+            int shard = GetShard(key, plen);
+            if(shard == GetShard(key, len))
+                continue;
+            int ret = readers[shard]->Find(key, plen, data);
+            if(ret == MBError::SUCCESS)
+            {
+                data.match_len = plen;
+                return ret;
+            }
+            if(ret != MBError::NOT_EXIST)
+                return ret;
+        }
+        return rval;
+    }
+
+    MBData shard_data;
+    int best_len = 0;
+    rval = MBError::NOT_EXIST;
+    for(int i = 0; i < num_shards; i++)
+    {
+        int ret = readers[i]->FindLongestPrefix(key, len, shard_data);
+        if(ret == MBError::SUCCESS)
+        {
+            if(shard_data.match_len > best_len)
+            {
+                best_len = shard_data.match_len;
+                rval = copy_value(data, shard_data);
+                if(rval != MBError::SUCCESS)
+                    return rval;
+            }
+        }
+        else if(ret != MBError::NOT_EXIST)
+        {
+            return ret;
+        }
+    }
+    return rval;
+}
+
+int ShardedDB::FindLongestPrefix(const std::string &key, MBData &data) const
+{
+    return FindLongestPrefix(key.data(), key.size(), data);
+}
+
+void ShardedDB::Flush() const
+{
+    if(status != MBError::SUCCESS)
+        return;
+
+    for(int i = 0; i < num_shards; i++)
+        UpdateHandle(i)->Flush();
+}
+
+int ShardedDB::CollectResource(int64_t min_index_rc_size, int64_t min_data_rc_size,
+                               int64_t max_dbsz, int64_t max_dbcnt)
+{
+    if(status != MBError::SUCCESS)
+        return status;
+
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num_shards; i++)
+    {
+        int ret = UpdateHandle(i)->CollectResource(min_index_rc_size, min_data_rc_size,
+                                                   max_dbsz, max_dbcnt);
+        if(ret != MBError::SUCCESS && rval == MBError::SUCCESS)
+            rval = ret;
+    }
+    return rval;
+}
+
+bool ShardedDB::AsyncWriterBusy() const
+{
+    if(status != MBError::SUCCESS)
+        return false;
+
+    for(int i = 0; i < num_shards; i++)
+    {
+        if(UpdateHandle(i)->AsyncWriterBusy())
+            return true;
+    }
+    return false;
+}
+
+void ShardedDB::PrintStats(std::ostream &out_stream) const
+{
+    if(status != MBError::SUCCESS)
+        return;
+
+    for(int i = 0; i < num_shards; i++)
+    {
+        out_stream << "Shard " << i << ": " << readers[i]->GetDBDir() << std::endl;
+        readers[i]->PrintStats(out_stream);
+    }
+}
+
+int64_t ShardedDB::Count() const
+{
+    if(status != MBError::SUCCESS)
+        return -1;
+
+    int64_t count = 0;
+    for(int i = 0; i < num_shards; i++)
+        count += readers[i]->Count();
+    return count;
+}
+
+int ShardedDB::Status() const
+{
+    return status;
+}
+
+const char* ShardedDB::StatusStr() const
+{
+    return MBError::get_error_str(status);
+}
+
+bool ShardedDB::is_open() const
+{
+    return status == MBError::SUCCESS;
+}
+
+int ShardedDB::NumShards() const
+{
+    return num_shards;
+}
+
+int ShardedDB::Partition() const
+{
+    return partition;
+}
+
+int ShardedDB::PrefixLen() const
+{
+    return prefix_len;
+}
+
+void ShardedDB::ClearResources(const std::string &path)
+{
+    DB::ClearResources(path);
+}
+
+const ShardedDB::iterator ShardedDB::begin() const
+{
+    ShardedDB::iterator iter = iterator(*this, DB_ITER_STATE_INIT);
+    return iter;
+}
+
+const ShardedDB::iterator ShardedDB::end() const
+{
+    return iterator(*this, DB_ITER_STATE_DONE);
+}
+
+ShardedDB::iterator::iterator(const ShardedDB &sdb, int iter_state)
+                            : sdb_ref(sdb),
+                              state(iter_state),
+                              shard(-1),
+                              shard_iter(NULL)
+{
+    match = 0;
+    if(state == DB_ITER_STATE_INIT)
+    {
+        if(sdb_ref.status == MBError::SUCCESS)
+        {
+            state = DB_ITER_STATE_MORE;
+            next_shard();
+        }
+        else
+        {
+            state = DB_ITER_STATE_DONE;
+        }
+    }
+}
+
+// Same as DB::iterator, the copy only keeps the state.
+ShardedDB::iterator::iterator(const iterator &rhs)
+                            : sdb_ref(rhs.sdb_ref),
+                              state(rhs.state),
+                              shard(rhs.shard),
+                              shard_iter(NULL)
+{
+    match = 0;
+}
+
+ShardedDB::iterator::~iterator()
+{
+    if(shard_iter != NULL)
+        delete shard_iter;
+}
+
+// Move to the first key of the next non-empty shard.
+void ShardedDB::iterator::next_shard()
+{
+    while(true)
+    {
+        if(shard_iter != NULL)
+        {
+            delete shard_iter;
+            shard_iter = NULL;
+        }
+        shard++;
+        if(shard >= sdb_ref.num_shards)
+        {
+            state = DB_ITER_STATE_DONE;
+            return;
+        }
+
+        shard_iter = new DB::iterator(*sdb_ref.readers[shard], DB_ITER_STATE_INIT);
+        shard_iter->init();
+        if(*shard_iter != sdb_ref.readers[shard]->end())
+        {
+            load_kv();
+            return;
+        }
+    }
+}
+
+void ShardedDB::iterator::load_kv()
+{
+    key = shard_iter->key;
+    match = shard_iter->match;
+    copy_value(value, shard_iter->value);
+}
+
+const ShardedDB::iterator& ShardedDB::iterator::operator++()
+{
+    if(state != DB_ITER_STATE_MORE || shard_iter == NULL)
+    {
+        state = DB_ITER_STATE_DONE;
+        return *this;
+    }
+
+    ++(*shard_iter);
+    if(*shard_iter != sdb_ref.readers[shard]->end())
+        load_kv();
+    else
+        next_shard();
+
+    return *this;
+}
+
+bool ShardedDB::iterator::operator!=(const iterator &rhs)
+{
+    return state != rhs.state;
+}
+
+}
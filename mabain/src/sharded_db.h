@@ -0,0 +1,152 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __SHARDED_DB_H__
+#define __SHARDED_DB_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "db.h"
+
+namespace mabain {
+
+#define MB_MAX_NUM_SHARD        256
+#define MB_SHARD_META_FILE      "_mabain_shard"
+
+// A database split into a number of independent mabain instances, one per
+// shard directory (<db_path>/shard_<n>/). Each shard has its own writer and
+// async writer thread so that updates to different shards are applied in
+// parallel. Keys are routed to a shard either by hashing the whole key or by
+// hashing the first prefix_len bytes of the key. Prefix partitioning keeps all
+// keys sharing the same leading bytes in one shard so that longest prefix
+// lookups only need one shard plus at most prefix_len-1 exact lookups.
+//
+// A writer handle always runs the shards in async writer mode. Lookups and
+// iteration go through a reader handle of each shard. The same thread-safety
+// rules as DB apply: updates may be submitted from multiple threads, but each
+// reading thread should use its own handle.
+class ShardedDB
+{
+public:
+    enum
+    {
+        PARTITION_HASH   = 0,
+        PARTITION_PREFIX = 1
+    };
+
+    // Iterates over the shards one after another.
+    class iterator
+    {
+    public:
+        std::string key;
+        MBData value;
+        int match;
+
+        iterator(const ShardedDB &sdb, int iter_state);
+        iterator(const iterator &rhs);
+        ~iterator();
+
+        bool operator!=(const iterator &rhs);
+        const iterator& operator++();
+
+    private:
+        void next_shard();
+        void load_kv();
+
+        const ShardedDB &sdb_ref;
+        int state;
+        int shard;
+        DB::iterator *shard_iter;
+    };
+
+    // db_path: top directory holding the shard directories
+    // db_options: db access option (read/write)
+    // num_shards: number of shards; zero to use the layout saved by the writer.
+    // partition: PARTITION_HASH or PARTITION_PREFIX
+    // prefix_len: number of leading key bytes used for PARTITION_PREFIX
+    // memcap_index/memcap_data: memory caps for each shard
+    ShardedDB(const char *db_path, int db_options, int num_shards = 0,
+              int partition = PARTITION_HASH, int prefix_len = 0,
+              size_t memcap_index = 64*1024*1024LL, size_t memcap_data = 64*1024*1024LL,
+              uint32_t queue_size = MB_MAX_NUM_SHM_QUEUE_NODE);
+    ~ShardedDB();
+
+    int Add(const char* key, int len, const char* data, int data_len, bool overwrite = false);
+    int Add(const std::string &key, const std::string &value, bool overwrite = false);
+    int Find(const char* key, int len, MBData &mdata) const;
+    int Find(const std::string &key, MBData &mdata) const;
+    int FindLongestPrefix(const char* key, int len, MBData &data) const;
+    int FindLongestPrefix(const std::string &key, MBData &data) const;
+    int Remove(const char *key, int len);
+    int Remove(const std::string &key);
+    int RemoveAll();
+    // The batch is split by shard and each part is submitted as a batch.
+    int AddBatch(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                 bool overwrite = false);
+    int RemoveBatch(const std::vector<std::string> &keys);
+
+    int  Close();
+    void Flush() const;
+    int  CollectResource(int64_t min_index_rc_size = 33554432, int64_t min_data_rc_size = 33554432,
+                         int64_t max_dbsiz = MAX_6B_OFFSET, int64_t max_dbcnt = MAX_6B_OFFSET);
+    // True if the async writer of any shard still has pending updates.
+    bool AsyncWriterBusy() const;
+
+    void PrintStats(std::ostream &out_stream = std::cout) const;
+    int64_t Count() const;
+    int  Status() const;
+    const char *StatusStr() const;
+    bool is_open() const;
+
+    int NumShards() const;
+    int Partition() const;
+    int PrefixLen() const;
+    // Shard index the key is routed to
+    int GetShard(const char *key, int len) const;
+    // Reader handle of a shard
+    DB* GetShardDB(int shard) const;
+    static void ClearResources(const std::string &path);
+
+    const iterator begin() const;
+    const iterator end() const;
+
+private:
+    int  LoadLayout();
+    int  SaveLayout() const;
+    int  OpenShards(size_t memcap_index, size_t memcap_data, uint32_t queue_size);
+    DB*  UpdateHandle(int shard) const;
+    std::string ShardDir(int shard) const;
+
+    std::string mb_dir;
+    int options;
+    int num_shards;
+    int partition;
+    int prefix_len;
+    int status;
+
+    // Writer handles are only opened for the writer. Reader handles are
+    // opened for both and used for lookup and iteration.
+    std::vector<DB*> writers;
+    std::vector<DB*> readers;
+};
+
+}
+
+#endif
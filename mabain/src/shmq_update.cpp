@@ -17,6 +17,9 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <vector>
 
 #include "dict.h"
 #include "error.h"
@@ -28,65 +31,30 @@
 namespace mabain {
 
 int Dict::SHMQ_Add(const char *key, int key_len, const char *data, int data_len,
-                   bool overwrite)
+                   bool overwrite, int64_t expiry)
 {
-    if(key_len > MB_ASYNC_SHM_KEY_SIZE || data_len > MB_ASYNC_SHM_DATA_SIZE)
-    {
-        return MBError::OUT_OF_BOUND;
-    }
-
-    AsyncNode *node_ptr = SHMQ_AcquireSlot();
-    if(node_ptr == NULL)
-        return MBError::MUTEX_ERROR;
-
-    memcpy(node_ptr->key, key, key_len);
-    memcpy(node_ptr->data, data, data_len);
-    node_ptr->key_len = key_len;
-    node_ptr->data_len = data_len;
-    node_ptr->overwrite = overwrite;
-
-    node_ptr->type = MABAIN_ASYNC_TYPE_ADD;
-    return SHMQ_PrepareSlot(node_ptr);
+    return SHMQ_Submit(MABAIN_ASYNC_TYPE_ADD, key, key_len, data, data_len, overwrite,
+                       expiry);
 }
 
 int Dict::SHMQ_Remove(const char *key, int len)
 {
-    if(len > MB_ASYNC_SHM_KEY_SIZE)
-        return MBError::OUT_OF_BOUND;
-
-    AsyncNode *node_ptr = SHMQ_AcquireSlot();
-    if(node_ptr == NULL)
-        return MBError::MUTEX_ERROR;
-
-    memcpy(node_ptr->key, key, len);
-    node_ptr->key_len = len;
-    node_ptr->type = MABAIN_ASYNC_TYPE_REMOVE;
-    return SHMQ_PrepareSlot(node_ptr);
+    return SHMQ_Submit(MABAIN_ASYNC_TYPE_REMOVE, key, len, NULL, 0, false);
 }
 
 int Dict::SHMQ_RemoveAll()
 {
-    AsyncNode *node_ptr = SHMQ_AcquireSlot();
-    if(node_ptr == NULL)
-        return MBError::MUTEX_ERROR;
-
-    node_ptr->type = MABAIN_ASYNC_TYPE_REMOVE_ALL;
-    return SHMQ_PrepareSlot(node_ptr);
+    return SHMQ_Submit(MABAIN_ASYNC_TYPE_REMOVE_ALL, NULL, 0, NULL, 0, false);
 }
 
 int Dict::SHMQ_Backup(const char *backup_dir)
 {
     if(backup_dir == NULL)
         return MBError::INVALID_ARG;
-    if(strlen(backup_dir) >= MB_ASYNC_SHM_DATA_SIZE)
-        return MBError::OUT_OF_BOUND;
 
-    AsyncNode *node_ptr = SHMQ_AcquireSlot();
-    if(node_ptr == NULL)
-        return MBError::MUTEX_ERROR;
-    snprintf(node_ptr->data, MB_ASYNC_SHM_DATA_SIZE, "%s", backup_dir);
-    node_ptr->type = MABAIN_ASYNC_TYPE_BACKUP;
-    return SHMQ_PrepareSlot(node_ptr);
+    // The backup directory is passed with its terminating null.
+    return SHMQ_Submit(MABAIN_ASYNC_TYPE_BACKUP, NULL, 0, backup_dir,
+                       strlen(backup_dir) + 1, false);
 }
 
 int Dict::SHMQ_CollectResource(int64_t m_index_rc_size,
@@ -94,70 +62,362 @@ int Dict::SHMQ_CollectResource(int64_t m_index_rc_size,
                                int64_t max_dbsz,
                                int64_t max_dbcnt)
 {
-    AsyncNode *node_ptr = SHMQ_AcquireSlot();
-    if(node_ptr == NULL)
-        return MBError::MUTEX_ERROR;
+    int64_t data[4];
+    data[0] = m_index_rc_size;
+    data[1] = m_data_rc_size;
+    data[2] = max_dbsz;
+    data[3] = max_dbcnt;
+
+    return SHMQ_Submit(MABAIN_ASYNC_TYPE_RC, NULL, 0, reinterpret_cast<const char *>(data),
+                       sizeof(data), false);
+}
+
+// Copy the key and the data into an arena record and queue it.
+int Dict::SHMQ_Submit(char type, const char *key, int key_len, const char *data,
+                      int data_len, bool overwrite, int64_t expiry)
+{
+    uint64_t rec_off;
+    char *rec_buff;
+    int rval = SHMQ_AllocRecord(key_len, data_len, rec_off, rec_buff);
+    if(rval != MBError::SUCCESS)
+        return rval;
+    if(key_len > 0)
+        memcpy(rec_buff, key, key_len);
+    if(data_len > 0)
+        memcpy(rec_buff + key_len, data, data_len);
 
-    int64_t *data_ptr = (int64_t *) node_ptr->data;
-    node_ptr->data_len = sizeof(int64_t)*4;
-    data_ptr[0] = m_index_rc_size;
-    data_ptr[1] = m_data_rc_size;
-    data_ptr[2] = max_dbsz;
-    data_ptr[3] = max_dbcnt;
-    node_ptr->type = MABAIN_ASYNC_TYPE_RC;
+    AsyncNode *node_ptr;
+    rval = SHMQ_AcquireSlot(node_ptr);
+    if(rval != MBError::SUCCESS)
+    {
+        SHMQ_FreeRecord(rec_off);
+        return rval;
+    }
 
+    node_ptr->rec_off = rec_off;
+    node_ptr->key_len = key_len;
+    node_ptr->data_len = data_len;
+    node_ptr->overwrite = overwrite;
+    node_ptr->expiry = expiry;
+    node_ptr->type = type;
     return SHMQ_PrepareSlot(node_ptr);
 }
 
-AsyncNode* Dict::SHMQ_AcquireSlot() const
+// Submit updates for multiple keys. Each run of the batch reserves consecutive
+// queue slots with a single fetch_add on the queue index, fills them and
+// publishes them together, so that the async writer drains the run with one
+// wakeup. If any entry is too big for the queue, nothing is submitted.
+int Dict::SHMQ_AddBatch(const std::string *keys, const std::string *values, int num,
+                        bool overwrite)
+{
+    for(int i = 0; i < num; i++)
+    {
+        if(SHMQ_RecordSize(keys[i].size(), values[i].size()) == 0)
+            return MBError::OUT_OF_BOUND;
+    }
+    return SHMQ_SubmitBatch(MABAIN_ASYNC_TYPE_ADD, keys, values, num, overwrite);
+}
+
+int Dict::SHMQ_RemoveBatch(const std::string *keys, int num)
+{
+    for(int i = 0; i < num; i++)
+    {
+        if(SHMQ_RecordSize(keys[i].size(), 0) == 0)
+            return MBError::OUT_OF_BOUND;
+    }
+    return SHMQ_SubmitBatch(MABAIN_ASYNC_TYPE_REMOVE, keys, NULL, num, false);
+}
+
+int Dict::SHMQ_SubmitBatch(char type, const std::string *keys, const std::string *values,
+                           int num, bool overwrite)
+{
+    // A run is limited to half of the queue and half of the arena so that
+    // other producers can still make progress.
+    int max_run = header->async_queue_size / 2;
+    if(max_run < 1)
+        max_run = 1;
+    uint64_t max_run_bytes = MB_SHMQ_ARENA_SIZE(header->async_queue_size) / 2;
+    std::vector<AsyncNode*> node_ptrs(max_run);
+    std::vector<uint64_t> rec_offs(max_run);
+
+    int rval = MBError::SUCCESS;
+    int start = 0;
+    while(start < num)
+    {
+        // Copy the entries into the arena before reserving queue positions.
+        int run = 0;
+        uint64_t run_bytes = 0;
+        while(start + run < num && run < max_run)
+        {
+            const std::string &key = keys[start + run];
+            int data_len = (values != NULL) ? values[start + run].size() : 0;
+            uint32_t rec_size = SHMQ_RecordSize(key.size(), data_len);
+            if(run > 0 && run_bytes + rec_size > max_run_bytes)
+                break;
+
+            char *rec_buff;
+            rval = SHMQ_AllocRecord(key.size(), data_len, rec_offs[run], rec_buff);
+            if(rval != MBError::SUCCESS)
+                break;
+            memcpy(rec_buff, key.data(), key.size());
+            if(data_len > 0)
+                memcpy(rec_buff + key.size(), values[start + run].data(), data_len);
+            run_bytes += rec_size;
+            run++;
+        }
+
+        if(rval == MBError::SUCCESS)
+            rval = SHMQ_AcquireSlots(&node_ptrs[0], run);
+        if(rval != MBError::SUCCESS)
+        {
+            for(int i = 0; i < run; i++)
+                SHMQ_FreeRecord(rec_offs[i]);
+            break;
+        }
+
+        for(int i = 0; i < run; i++)
+        {
+            AsyncNode *node_ptr = node_ptrs[i];
+            node_ptr->rec_off = rec_offs[i];
+            node_ptr->key_len = keys[start + i].size();
+            node_ptr->data_len = (values != NULL) ? values[start + i].size() : 0;
+            node_ptr->overwrite = overwrite;
+            node_ptr->expiry = 0;
+            node_ptr->type = type;
+        }
+
+        rval = SHMQ_PrepareSlots(&node_ptrs[0], run);
+        if(rval != MBError::SUCCESS)
+            break;
+        start += run;
+    }
+
+    return rval;
+}
+
+// Size of the arena record for an entry, or 0 if the entry is too big for
+// the queue.
+uint32_t Dict::SHMQ_RecordSize(int key_len, int data_len) const
 {
-    uint32_t index = header->queue_index.fetch_add(1, std::memory_order_release);
-    AsyncNode *node_ptr = queue + (index % header->async_queue_size);
+    uint64_t size = MB_SHMQ_REC_HDR_SIZE + (uint64_t) key_len + data_len;
+    size = (size + 7) & ~7ULL;
+    if(size > MB_SHMQ_ARENA_SIZE(header->async_queue_size) / 2 || size > MB_SHMQ_REC_MAX_SIZE)
+        return 0;
+    return static_cast<uint32_t>(size);
+}
 
-    struct timespec tm_exp;
-    tm_exp.tv_sec = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
-    tm_exp.tv_nsec = 0;
-    int rval = pthread_mutex_timedlock(&node_ptr->mutex, &tm_exp);
-    if(rval != 0)
+// Take the arena claim word, which serializes the producers between reading
+// the tail and moving it. The word holds the pid of the owner so that a
+// claim left by a dead producer can be taken over. Return false if a live
+// producer holds it.
+bool Dict::SHMQ_ClaimArena(uint32_t pid) const
+{
+    uint32_t owner = 0;
+    if(header->arena_claim.compare_exchange_strong(owner, pid, std::memory_order_seq_cst))
+        return true;
+    if(!ShmqProducerAlive(owner))
     {
-        Logger::Log(LOG_LEVEL_ERROR, "shared memory mutex lock failed: %d", rval);
-        return NULL;
+        // The owner may have written the first word of its record without
+        // moving the tail; the next claim overwrites it.
+        header->arena_claim.compare_exchange_strong(owner, 0, std::memory_order_seq_cst);
     }
+    return false;
+}
 
-    while(node_ptr->in_use.load(std::memory_order_consume))
+// Allocate a record at the arena tail. The first word of the record, which
+// carries its size and the producer pid, is written at the tail before the
+// tail is moved past it, both while holding the arena claim word. The tail
+// is always current then, and every record between the head and the tail
+// has its first word. Records that do not fit before the end of the arena
+// are preceded by a consumed padding record.
+int Dict::SHMQ_AllocRecord(int key_len, int data_len, uint64_t &rec_off, char* &rec_buff) const
+{
+    uint32_t size = SHMQ_RecordSize(key_len, data_len);
+    if(size == 0)
+        return MBError::OUT_OF_BOUND;
+
+    uint64_t arena_size = MB_SHMQ_ARENA_SIZE(header->async_queue_size);
+    uint32_t pid = getpid();
+    int spin = 0;
+    time_t tm_exp = 0;
+
+    while(true)
     {
-        tm_exp.tv_sec += MB_ASYNC_SHM_LOCK_TMOUT;
-        rval =  pthread_cond_timedwait(&node_ptr->cond, &node_ptr->mutex, &tm_exp);
-        if(rval != 0)
+        if(!SHMQ_ClaimArena(pid))
+        {
+            sched_yield();
+            continue;
+        }
+
+        // Only the async writer moves the head, and never past the tail.
+        uint64_t head = header->arena_head.load(std::memory_order_seq_cst);
+        uint64_t tail = header->arena_tail.load(std::memory_order_relaxed);
+        uint64_t room = arena_size - tail % arena_size;
+        uint32_t alloc_size = (room < size) ? static_cast<uint32_t>(room) : size;
+        if(tail + alloc_size - head <= arena_size)
+        {
+            uint64_t consumed = (alloc_size != size) ? MB_SHMQ_REC_CONSUMED : 0;
+            std::atomic<uint64_t> *rec_ptr = ShmqRecordPtr(header, tail);
+            rec_ptr->store(MB_SHMQ_REC(MB_SHMQ_REC_TAG(tail, arena_size), alloc_size, pid,
+                                       consumed), std::memory_order_relaxed);
+            header->arena_tail.store(tail + alloc_size, std::memory_order_seq_cst);
+            header->arena_claim.store(0, std::memory_order_release);
+            if(consumed)
+                continue; // padded to the end of the arena
+            rec_off = tail;
+            rec_buff = reinterpret_cast<char *>(rec_ptr) + MB_SHMQ_REC_HDR_SIZE;
+            return MBError::SUCCESS;
+        }
+        header->arena_claim.store(0, std::memory_order_release);
+
+        // The arena is full.
+        if(++spin < MB_SHMQ_SPIN_COUNT)
+            continue;
+        if(tm_exp == 0)
+        {
+            tm_exp = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
+        }
+        else if(time(NULL) >= tm_exp)
         {
-            Logger::Log(LOG_LEVEL_ERROR, "shared memory conditional wait failed: %d", rval);
-            if(rval == ETIMEDOUT)
+            Logger::Log(LOG_LEVEL_INFO, "shared memory queue arena wait timedout, "
+                        "check if async writer is running");
+            return MBError::TRY_AGAIN;
+        }
+
+        uint32_t ticket = header->arena_futex.load(std::memory_order_acquire);
+        header->num_arena_waiting.fetch_add(1, std::memory_order_seq_cst);
+        if(header->arena_head.load(std::memory_order_seq_cst) == head)
+        {
+            // Let the async writer check for records left by dead producers.
+            if(header->writer_waiting.load(std::memory_order_seq_cst) != 0)
             {
-                 Logger::Log(LOG_LEVEL_INFO, "pthread_cond_timedwait timedout, "
-                             "check if async writer is running");
+                header->writer_futex.fetch_add(1, std::memory_order_release);
+                ShmFutexWake(&header->writer_futex);
             }
-            if((rval = pthread_mutex_unlock(&node_ptr->mutex)) != 0)
-                Logger::Log(LOG_LEVEL_ERROR, "shm mutex unlock failed: %d", rval);
-            return NULL;
+            ShmFutexWait(&header->arena_futex, ticket, MB_SHMQ_WAIT_INTERVAL);
         }
+        header->num_arena_waiting.fetch_sub(1, std::memory_order_release);
     }
+}
 
-    return node_ptr;
+// Give up a record that will not be queued.
+void Dict::SHMQ_FreeRecord(uint64_t rec_off) const
+{
+    ShmqRecordPtr(header, rec_off)->fetch_or(MB_SHMQ_REC_CONSUMED, std::memory_order_release);
 }
 
-int Dict::SHMQ_PrepareSlot(AsyncNode *node_ptr) const
+int Dict::SHMQ_AcquireSlot(AsyncNode* &node_ptr) const
+{
+    return SHMQ_AcquireSlots(&node_ptr, 1);
+}
+
+// Reserve num consecutive positions with one fetch_add and claim their slots.
+// num must not be bigger than the queue size. Otherwise we would wait for a
+// slot claimed by ourselves.
+int Dict::SHMQ_AcquireSlots(AsyncNode **node_ptrs, int num) const
 {
-    node_ptr->in_use.store(true, std::memory_order_release);
-    pthread_cond_signal(&node_ptr->cond);
-    if(pthread_mutex_unlock(&node_ptr->mutex) != 0)
-        return MBError::MUTEX_ERROR;
+    uint64_t index = header->queue_index.fetch_add(num, std::memory_order_acq_rel);
+    for(int i = 0; i < num; i++)
+    {
+        int rval = SHMQ_ClaimSlot(index + i, node_ptrs[i]);
+        if(rval != MBError::SUCCESS)
+        {
+            // The reserved positions cannot be given back. Publish the claimed
+            // slots as no-ops. The async writer skips the unclaimed ones in the
+            // same way as the slots reserved by a client that exited unexpectedly.
+            for(int j = 0; j < i; j++)
+                node_ptrs[j]->type = MABAIN_ASYNC_TYPE_NONE;
+            SHMQ_PrepareSlots(node_ptrs, i);
+            return rval;
+        }
+    }
 
     return MBError::SUCCESS;
 }
 
+// Claim the slot of a reserved queue position. Spin for a short while and then
+// sleep on the slot if it is still used by the previous lap.
+int Dict::SHMQ_ClaimSlot(uint64_t index, AsyncNode* &node_ptr) const
+{
+    uint64_t lap = index / header->async_queue_size;
+    uint32_t free_seq = MB_SHMQ_SEQ_FREE(lap);
+    uint64_t claimed = MB_SHMQ_STATE(MB_SHMQ_SEQ_CLAIMED(lap), getpid());
+    int spin = 0;
+    time_t tm_exp = 0;
+
+    node_ptr = queue + (index % header->async_queue_size);
+    while(true)
+    {
+        uint64_t state = node_ptr->state.load(std::memory_order_acquire);
+        uint32_t seq = MB_SHMQ_STATE_SEQ(state);
+        if(seq == free_seq)
+        {
+            if(node_ptr->state.compare_exchange_weak(state, claimed, std::memory_order_acq_rel))
+                return MBError::SUCCESS;
+            continue;
+        }
+        if(static_cast<int32_t>(seq - free_seq) > 0)
+        {
+            Logger::Log(LOG_LEVEL_WARN, "shared memory queue slot %llu was skipped by async writer",
+                        static_cast<unsigned long long>(index));
+            return MBError::TRY_AGAIN;
+        }
+
+        // The queue is full.
+        if(++spin < MB_SHMQ_SPIN_COUNT)
+            continue;
+        if(tm_exp == 0)
+        {
+            tm_exp = time(NULL) + MB_ASYNC_SHM_LOCK_TMOUT;
+        }
+        else if(time(NULL) >= tm_exp)
+        {
+            Logger::Log(LOG_LEVEL_INFO, "shared memory queue wait timedout, "
+                        "check if async writer is running");
+            return MBError::TRY_AGAIN;
+        }
+
+        header->num_producer_waiting.fetch_add(1, std::memory_order_seq_cst);
+        ShmFutexWait(ShmqSeqWord(node_ptr), seq, MB_SHMQ_WAIT_INTERVAL);
+        header->num_producer_waiting.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+int Dict::SHMQ_PrepareSlot(AsyncNode *node_ptr) const
+{
+    return SHMQ_PrepareSlots(&node_ptr, 1);
+}
+
+// Publish a run of claimed slots and wake up the async writer only if it is
+// sleeping.
+int Dict::SHMQ_PrepareSlots(AsyncNode **node_ptrs, int num) const
+{
+    int rval = MBError::SUCCESS;
+    for(int i = 0; i < num; i++)
+    {
+        uint64_t state = node_ptrs[i]->state.load(std::memory_order_relaxed);
+        uint64_t published = MB_SHMQ_STATE(MB_SHMQ_STATE_SEQ(state) + 1, MB_SHMQ_STATE_PID(state));
+        // This only fails if the async writer has given up on the slot.
+        if(!node_ptrs[i]->state.compare_exchange_strong(state, published,
+                                                        std::memory_order_seq_cst))
+            rval = MBError::TRY_AGAIN;
+    }
+
+    if(header->writer_waiting.load(std::memory_order_seq_cst) != 0)
+    {
+        header->writer_futex.fetch_add(1, std::memory_order_release);
+        ShmFutexWake(&header->writer_futex);
+    }
+
+    return rval;
+}
+
 bool Dict::SHMQ_Busy() const
 {
-    if((header->queue_index.load(std::memory_order_consume) != header->writer_index) || header->rc_flag == 1)
+    if((header->queue_index.load(std::memory_order_consume) !=
+        header->writer_index.load(std::memory_order_consume)) || header->rc_flag == 1 ||
+       header->backup_flag.load(std::memory_order_consume) != 0 ||
+       header->journal_pending.load(std::memory_order_consume) != 0)
         return true;
 
     size_t rc_off = header->rc_root_offset.load(std::memory_order_consume);
@@ -13,6 +13,7 @@
 #include "../mb_data.h"
 #include "../mb_backup.h"
 #include "../resource_pool.h"
+#include "../dict.h"
 #include "./test_key.h"
 
 #define MB_DIR "/var/tmp/mabain_test/"
@@ -182,4 +183,125 @@ TEST_F(BackupTest, Create_backup_db)
     db->Close();
     delete db;
 }
+
+TEST_F(BackupTest, Incremental_backup_db)
+{
+    int num = 20000;
+    std::string value(200, 'v');
+    DB *db = new DB(MB_DIR, CONSTS::WriterOptions());
+    assert(db->is_open());
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), value));
+
+    size_t full_size;
+    {
+        DBBackup bk(*db);
+        EXPECT_EQ(MBError::SUCCESS, bk.Backup(MB_BACKUP_DIR));
+        EXPECT_FALSE(bk.Incremental());
+        IndexHeader *header = db->GetDictPtr()->GetHeaderPtr();
+        full_size = header->m_data_offset + header->m_index_offset;
+    }
+
+    // Only the blocks touched by the updates are copied.
+    for(int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), "new", true));
+        EXPECT_EQ(MBError::SUCCESS, db->Add("new_key" + std::to_string(i), "new"));
+        EXPECT_EQ(MBError::SUCCESS, db->Remove("key" + std::to_string(num - 1 - i)));
+    }
+    {
+        DBBackup bk(*db);
+        EXPECT_EQ(MBError::SUCCESS, bk.Backup(MB_BACKUP_DIR));
+        EXPECT_TRUE(bk.Incremental());
+        EXPECT_LT(bk.BytesCopied(), full_size / 2);
+    }
+
+    DB *db_bkp = new DB(MB_BACKUP_DIR, CONSTS::ReaderOptions());
+    assert(db_bkp->is_open());
+    EXPECT_EQ(num, db_bkp->Count());
+    MBData mbd;
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        if(i >= num - 100)
+        {
+            EXPECT_EQ(MBError::NOT_EXIST, db_bkp->Find(key, mbd));
+            continue;
+        }
+        EXPECT_EQ(MBError::SUCCESS, db_bkp->Find(key, mbd));
+        EXPECT_EQ(i < 100 ? std::string("new") : value,
+                  std::string((const char *) mbd.buff, mbd.data_len));
+    }
+    for(int i = 0; i < 100; i++)
+        EXPECT_EQ(MBError::SUCCESS, db_bkp->Find("new_key" + std::to_string(i), mbd));
+    db_bkp->Close();
+    delete db_bkp;
+
+    // The first backup is no longer the base of incremental backups.
+    {
+        DBBackup bk(*db);
+        EXPECT_EQ(MBError::SUCCESS, bk.Backup(MB_BACKUP_DIR_2));
+        EXPECT_FALSE(bk.Incremental());
+    }
+    int rval = MBError::SUCCESS;
+    try {
+        DBBackup bk(*db);
+        rval = bk.Backup(MB_BACKUP_DIR);
+    } catch (int error) {
+        rval = error;
+    }
+    EXPECT_EQ(MBError::OPEN_FAILURE, rval);
+
+    db->Close();
+    delete db;
+}
+
+TEST_F(BackupTest, Online_backup_db)
+{
+    int num = 20000;
+    DB *db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    assert(db->is_open());
+    DB *db_r = new DB(MB_DIR, CONSTS::ReaderOptions());
+    assert(db_r->is_open());
+#ifndef __SHM_QUEUE__
+    assert(db_r->SetAsyncWriterPtr(db) == MBError::SUCCESS);
+#endif
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db_r->Add(key, key));
+    }
+
+    // Updates submitted after the backup do not change the backup.
+    EXPECT_EQ(MBError::SUCCESS, db_r->Backup(MB_BACKUP_DIR));
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db_r->Add(key, "updated", true));
+        EXPECT_EQ(MBError::SUCCESS, db_r->Add("more" + key, key));
+    }
+    while(db_r->AsyncWriterBusy())
+        usleep(1000);
+#ifndef __SHM_QUEUE__
+    assert(db_r->UnsetAsyncWriterPtr(db) == MBError::SUCCESS);
+#endif
+    EXPECT_EQ(2 * num, db_r->Count());
+    db_r->Close();
+    delete db_r;
+    db->Close();
+    delete db;
+
+    DB *db_bkp = new DB(MB_BACKUP_DIR, CONSTS::ReaderOptions());
+    assert(db_bkp->is_open());
+    EXPECT_EQ(num, db_bkp->Count());
+    MBData mbd;
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db_bkp->Find(key, mbd));
+        EXPECT_EQ(key, std::string((const char *) mbd.buff, mbd.data_len));
+    }
+    db_bkp->Close();
+    delete db_bkp;
+}
 }
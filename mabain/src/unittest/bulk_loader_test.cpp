@@ -0,0 +1,203 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../dict.h"
+#include "../bulk_loader.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+#define INCR_DIR "/var/tmp/mabain_test/incremental/"
+
+class BulkLoaderTest : public ::testing::Test
+{
+public:
+    BulkLoaderTest() {
+    }
+    virtual ~BulkLoaderTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+        cmd = std::string("rm -rf ") + INCR_DIR + " && mkdir -p " + INCR_DIR;
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    // Keys with shared prefixes, keys that are prefixes of other keys,
+    // long edges and single byte keys, in random order
+    void MakeKeys(int num, std::map<std::string, std::string> &kvs,
+                  std::vector<std::pair<std::string, std::string> > &input) {
+        srand(123);
+        for(int i = 0; i < num; i++) {
+            std::string key = "user:" + std::to_string(rand() % (num * 4));
+            if(i % 5 == 0)
+                key += ":" + std::string(rand() % 20, 'x');
+            std::string value = "value_" + std::to_string(i);
+            kvs[key] = value;
+            input.push_back(std::make_pair(key, value));
+        }
+        for(int i = 0; i < 10; i++) {
+            std::string key = "user";
+            key += std::string(1, '0' + i);
+            kvs[key] = key;
+            input.push_back(std::make_pair(key, key));
+            key = std::string(1, 'A' + i);
+            kvs[key] = key;
+            input.push_back(std::make_pair(key, key));
+        }
+        std::string long_key(255, 'L');
+        kvs[long_key] = "long";
+        input.push_back(std::make_pair(long_key, "long"));
+        kvs[long_key + "M"] = "longest";
+        input.push_back(std::make_pair(long_key + "M", "longest"));
+        long_key = std::string(256, 'N');
+        kvs[long_key] = "longest single";
+        input.push_back(std::make_pair(long_key, "longest single"));
+        // duplicates: the last value is kept
+        kvs["user"] = "second";
+        input.push_back(std::make_pair("user", "first"));
+        input.push_back(std::make_pair("user", "second"));
+    }
+
+    void CheckKeys(DB &db, const std::map<std::string, std::string> &kvs) {
+        MBData mbd;
+        for(std::map<std::string, std::string>::const_iterator it = kvs.begin();
+            it != kvs.end(); ++it) {
+            EXPECT_EQ(MBError::SUCCESS, db.Find(it->first, mbd)) << it->first;
+            EXPECT_EQ(it->second, std::string((const char *) mbd.buff, mbd.data_len));
+        }
+        std::map<std::string, std::string> found;
+        for(DB::iterator iter = db.begin(); iter != db.end(); ++iter)
+            found[iter.key] = std::string((const char *) iter.value.buff, iter.value.data_len);
+        EXPECT_TRUE(found == kvs);
+        EXPECT_EQ((int64_t) kvs.size(), db.Count());
+    }
+
+protected:
+};
+
+TEST_F(BulkLoaderTest, bulk_load_test)
+{
+    std::map<std::string, std::string> kvs;
+    std::vector<std::pair<std::string, std::string> > input;
+    MakeKeys(20000, kvs, input);
+
+    DB db(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db.is_open());
+    BulkLoader loader(db, 3);
+    for(size_t i = 0; i < input.size(); i++)
+        EXPECT_EQ(MBError::SUCCESS, loader.Add(input[i].first, input[i].second));
+    EXPECT_EQ(MBError::OUT_OF_BOUND, loader.Add(std::string(257, 'a'), "v"));
+    EXPECT_EQ(MBError::OUT_OF_BOUND, loader.Add("", "v"));
+    EXPECT_EQ((int64_t) input.size(), loader.Count());
+    EXPECT_EQ(MBError::SUCCESS, loader.Load());
+    EXPECT_EQ((int64_t) kvs.size(), loader.Loaded());
+    EXPECT_EQ(0, loader.Count());
+    CheckKeys(db, kvs);
+
+    // The result is a regular DB for readers and the writer.
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    CheckKeys(db_r, kvs);
+    MBData mbd;
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindLongestPrefix("user:1:xyz", mbd));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("user:new", "new"));
+    kvs["user:new"] = "new";
+    EXPECT_EQ(MBError::SUCCESS, db.Add("user", "third", true));
+    kvs["user"] = "third";
+    EXPECT_EQ(MBError::SUCCESS, db.Remove("A"));
+    kvs.erase("A");
+    for(int i = 0; i < 1000; i++) {
+        std::string key = "user:" + std::to_string(i);
+        if(kvs.find(key) != kvs.end()) {
+            EXPECT_EQ(MBError::SUCCESS, db.Remove(key));
+            kvs.erase(key);
+        }
+    }
+    CheckKeys(db_r, kvs);
+
+    // Only an empty DB can be loaded.
+    EXPECT_EQ(MBError::SUCCESS, loader.Add("user:more", "more"));
+    EXPECT_EQ(MBError::NOT_ALLOWED, loader.Load());
+    db_r.Close();
+    db.Close();
+
+    DB db_reopen(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_reopen.is_open());
+    CheckKeys(db_reopen, kvs);
+    db_reopen.Close();
+}
+
+TEST_F(BulkLoaderTest, compact_index_test)
+{
+    std::map<std::string, std::string> kvs;
+    std::vector<std::pair<std::string, std::string> > input;
+    MakeKeys(20000, kvs, input);
+
+    DB db(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db.is_open());
+    BulkLoader loader(db);
+    for(size_t i = 0; i < input.size(); i++)
+        loader.Add(input[i].first, input[i].second);
+    EXPECT_EQ(MBError::SUCCESS, loader.Load());
+
+    DB db_incr(INCR_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db_incr.is_open());
+    for(std::map<std::string, std::string>::iterator it = kvs.begin(); it != kvs.end(); ++it) {
+        if(it->first.size() <= 255) {
+            EXPECT_EQ(MBError::SUCCESS, db_incr.Add(it->first, it->second));
+        }
+    }
+
+    IndexHeader *header = db.GetDictPtr()->GetHeaderPtr();
+    IndexHeader *header_incr = db_incr.GetDictPtr()->GetHeaderPtr();
+    EXPECT_LT(header->m_index_offset, header_incr->m_index_offset);
+    EXPECT_EQ(0, header->pending_index_buff_size);
+    db_incr.Close();
+    db.Close();
+
+    // Loading needs a writer without the async writer.
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    bool thrown = false;
+    try {
+        BulkLoader reader_loader(db_r);
+    } catch (int error) {
+        EXPECT_EQ(MBError::NOT_ALLOWED, error);
+        thrown = true;
+    }
+    EXPECT_TRUE(thrown);
+    db_r.Close();
+}
+
+}
@@ -0,0 +1,281 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <unistd.h>
+#include <string.h>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../change_feed.h"
+#include "../bulk_loader.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+#define REPLICA_DIR "/var/tmp/mabain_test/replica/"
+
+class ChangeFeedTest : public ::testing::Test
+{
+public:
+    ChangeFeedTest() {
+    }
+    virtual ~ChangeFeedTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+        cmd = std::string("rm -rf ") + REPLICA_DIR + " && mkdir -p " + REPLICA_DIR;
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    MBConfig FeedConfig(int64_t size) {
+        MBConfig config;
+        memset(&config, 0, sizeof(config));
+        config.mbdir = MB_DIR;
+        config.options = CONSTS::WriterOptions() | CONSTS::USE_CHANGE_FEED;
+        config.change_feed_size = size;
+        return config;
+    }
+
+    int ApplyAll(ChangeSubscriber &sub, DB &replica) {
+        MBChange change;
+        int num = 0;
+        int rval;
+        while((rval = sub.Next(change)) == MBError::SUCCESS) {
+            EXPECT_EQ(MBError::SUCCESS, ChangeSubscriber::Apply(replica, change));
+            num++;
+        }
+        EXPECT_EQ(MBError::TRY_AGAIN, rval);
+        return num;
+    }
+
+    void CheckSame(DB &db, DB &replica) {
+        EXPECT_EQ(db.Count(), replica.Count());
+        MBData mbd;
+        for(DB::iterator iter = db.begin(); iter != db.end(); ++iter) {
+            EXPECT_EQ(MBError::SUCCESS, replica.Find(iter.key, mbd)) << iter.key;
+            EXPECT_EQ(std::string((const char *) iter.value.buff, iter.value.data_len),
+                      std::string((const char *) mbd.buff, mbd.data_len));
+        }
+    }
+
+protected:
+};
+
+TEST_F(ChangeFeedTest, subscribe_test)
+{
+    MBConfig config = FeedConfig(0);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+
+    ChangeSubscriber sub(MB_DIR);
+    ASSERT_TRUE(sub.is_open());
+    EXPECT_EQ(1ULL, sub.Position());
+    MBChange change;
+    EXPECT_EQ(MBError::TRY_AGAIN, sub.Next(change));
+
+    // Only applied updates are in the feed.
+    EXPECT_EQ(MBError::SUCCESS, db.Add("apple", "red"));
+    EXPECT_EQ(MBError::IN_DICT, db.Add("apple", "green"));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("apple", "green", true));
+    EXPECT_EQ(MBError::NOT_EXIST, db.Remove("pear"));
+    EXPECT_EQ(MBError::SUCCESS, db.Remove("apple"));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("kiwi", "brown"));
+    EXPECT_EQ(MBError::SUCCESS, db.RemoveAll());
+    EXPECT_EQ(6ULL, sub.EndSeq());
+
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(1ULL, change.seq);
+    EXPECT_EQ(CHANGE_FEED_ADD, change.type);
+    EXPECT_EQ("apple", change.key);
+    EXPECT_EQ("red", change.value);
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(2ULL, change.seq);
+    EXPECT_EQ("green", change.value);
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(CHANGE_FEED_REMOVE, change.type);
+    EXPECT_EQ("apple", change.key);
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(CHANGE_FEED_REMOVE_ALL, change.type);
+    EXPECT_EQ(5ULL, change.seq);
+    EXPECT_EQ(MBError::TRY_AGAIN, sub.Next(change));
+    EXPECT_EQ(6ULL, sub.Position());
+
+    // Any retained change can be read again.
+    EXPECT_EQ(MBError::SUCCESS, sub.Subscribe(4));
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ("kiwi", change.key);
+    EXPECT_EQ(MBError::INVALID_ARG, sub.Subscribe(7));
+    EXPECT_EQ(MBError::SUCCESS, sub.Subscribe(0));
+    EXPECT_EQ(1ULL, sub.Position());
+
+    // Sequence numbers continue after the writer is reopened.
+    db.Close();
+    DB db2(config);
+    ASSERT_TRUE(db2.is_open());
+    EXPECT_EQ(MBError::SUCCESS, db2.Add("plum", "purple"));
+    EXPECT_EQ(MBError::SUCCESS, sub.Subscribe(6));
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ(6ULL, change.seq);
+    EXPECT_EQ("plum", change.key);
+    db2.Close();
+
+    // No feed without the option
+    ResourcePool::getInstance().RemoveAll();
+    std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+    if(system(cmd.c_str()) != 0) {
+    }
+    DB db3(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db3.is_open());
+    ChangeSubscriber sub2(MB_DIR);
+    EXPECT_FALSE(sub2.is_open());
+    EXPECT_EQ(MBError::NOT_INITIALIZED, sub2.Next(change));
+    db3.Close();
+}
+
+TEST_F(ChangeFeedTest, replica_test)
+{
+    MBConfig config = FeedConfig(0);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB replica(REPLICA_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(replica.is_open());
+    ChangeSubscriber sub(MB_DIR);
+    ASSERT_TRUE(sub.is_open());
+
+    int num = 5000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.Add("key" + std::to_string(i), std::to_string(i)));
+    EXPECT_EQ(num, ApplyAll(sub, replica));
+    CheckSame(db, replica);
+
+    for(int i = 0; i < num; i += 3)
+        EXPECT_EQ(MBError::SUCCESS, db.Remove("key" + std::to_string(i)));
+    for(int i = 1; i < num; i += 3)
+        EXPECT_EQ(MBError::SUCCESS, db.Add("key" + std::to_string(i), "new", true));
+    ApplyAll(sub, replica);
+    CheckSame(db, replica);
+
+    // Applying changes again does not change the replica.
+    EXPECT_EQ(MBError::SUCCESS, sub.Subscribe(num / 2));
+    ApplyAll(sub, replica);
+    CheckSame(db, replica);
+
+    // Updates applied by the async writer go to the feed too.
+    db.Close();
+    config.options |= CONSTS::ASYNC_WRITER_MODE;
+    DB db_async(config);
+    ASSERT_TRUE(db_async.is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.SetAsyncWriterPtr(&db_async));
+#endif
+    for(int i = 0; i < 1000; i++)
+        EXPECT_EQ(MBError::SUCCESS, db_r.Add("async" + std::to_string(i), "value"));
+    while(db_r.AsyncWriterBusy())
+        usleep(1000);
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.UnsetAsyncWriterPtr(&db_async));
+#endif
+    EXPECT_EQ(1000, ApplyAll(sub, replica));
+    CheckSame(db_r, replica);
+    db_r.Close();
+    db_async.Close();
+    replica.Close();
+}
+
+TEST_F(ChangeFeedTest, ring_wrap_test)
+{
+    MBConfig config = FeedConfig(CHANGE_FEED_SIZE_MIN);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    ChangeSubscriber sub(MB_DIR);
+    ASSERT_TRUE(sub.is_open());
+
+    // The ring holds about 40 of these changes.
+    std::string value(25000, 'v');
+    for(int i = 0; i < 100; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.Add("key" + std::to_string(i), value + std::to_string(i)));
+    EXPECT_GT(sub.FirstSeq(), 50ULL);
+    EXPECT_LT(sub.FirstSeq(), 70ULL);
+    EXPECT_EQ(101ULL, sub.EndSeq());
+
+    // The subscriber fell behind.
+    MBChange change;
+    EXPECT_EQ(MBError::BUFFER_LOST, sub.Next(change));
+    EXPECT_EQ(MBError::BUFFER_LOST, sub.Subscribe(10));
+    uint64_t first = sub.FirstSeq();
+    EXPECT_EQ(MBError::SUCCESS, sub.Subscribe(first));
+    for(uint64_t seq = first; seq < 101; seq++) {
+        ASSERT_EQ(MBError::SUCCESS, sub.Next(change));
+        EXPECT_EQ(seq, change.seq);
+        EXPECT_EQ("key" + std::to_string(seq - 1), change.key);
+        EXPECT_EQ(value + std::to_string(seq - 1), change.value);
+    }
+    EXPECT_EQ(MBError::TRY_AGAIN, sub.Next(change));
+    db.Close();
+}
+
+TEST_F(ChangeFeedTest, eviction_test)
+{
+    MBConfig config = FeedConfig(0);
+    config.eviction_cap = 1024*1024LL;
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB replica(REPLICA_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(replica.is_open());
+    ChangeSubscriber sub(MB_DIR);
+    ASSERT_TRUE(sub.is_open());
+
+    // Evicted keys are removed from the replica as well.
+    int num = 20000;
+    std::string value(100, 'v');
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.Add("key" + std::to_string(i), value));
+    MBEvictionStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db.GetEvictionStats(stats));
+    EXPECT_GT(stats.num_evicted, 0);
+    EXPECT_EQ(num + stats.num_evicted, ApplyAll(sub, replica));
+    CheckSame(db, replica);
+
+    // Bulk loaded pairs would bypass the feed.
+    bool thrown = false;
+    try {
+        BulkLoader loader(db);
+    } catch (int error) {
+        EXPECT_EQ(MBError::NOT_ALLOWED, error);
+        thrown = true;
+    }
+    EXPECT_TRUE(thrown);
+    replica.Close();
+    db.Close();
+}
+
+}
@@ -143,6 +143,61 @@ TEST_F(EvictionTest, bucket_256_test)
     }
 }
 
+TEST_F(EvictionTest, clock_eviction_test)
+{
+    int64_t cap = 4*1024*1024LL;
+    int num_hot = 100;
+    int num = 100000;
+    std::string value(100, 'v');
+    mbconf.eviction_cap = cap;
+    OpenDB(1000);
+
+    TestKey tkey(MABAIN_TEST_KEY_TYPE_INT);
+    MBData mbd;
+    std::string key;
+    for(int i = 0; i < num; i++) {
+        key = tkey.get_key(i);
+        EXPECT_EQ(MBError::SUCCESS, db->Add(key, value));
+        // Keep looking up the first keys so that the sweeper skips them.
+        if(i >= num_hot && i % 1000 == 0) {
+            while(db->AsyncWriterBusy()) {
+                usleep(100);
+            }
+            for(int j = 0; j < num_hot; j++) {
+                key = tkey.get_key(j);
+                EXPECT_EQ(MBError::SUCCESS, db->Find(key, mbd));
+            }
+        }
+    }
+    while(db->AsyncWriterBusy()) {
+        usleep(100);
+    }
+
+    // The writer runs the eviction pass after it drains the queue, so the
+    // last pass may still be running when AsyncWriterBusy turns false. The
+    // pass adds to the eviction stats once it is done.
+    MBEvictionStats stats;
+    for(int i = 0; i < 1000; i++) {
+        EXPECT_EQ(MBError::SUCCESS, db->GetEvictionStats(stats));
+        if(stats.live_size <= cap && stats.num_evicted + db->Count() == num)
+            break;
+        usleep(1000);
+    }
+    EXPECT_EQ(MBError::SUCCESS, db->GetEvictionStats(stats));
+    EXPECT_EQ(cap, stats.cap);
+    EXPECT_LE(stats.live_size, cap);
+    EXPECT_GT(stats.num_evicted, 0);
+    EXPECT_GE(stats.num_scanned, stats.num_evicted);
+    EXPECT_EQ(num, stats.num_evicted + db->Count());
+    EXPECT_EQ(stats.num_hit, stats.num_lookup);
+    EXPECT_GT(stats.num_lookup, 0);
+
+    for(int j = 0; j < num_hot; j++) {
+        key = tkey.get_key(j);
+        EXPECT_EQ(MBError::SUCCESS, db->Find(key, mbd));
+    }
+}
+
 #ifdef __SHM_QUEUE__
 TEST_F(EvictionTest, different_queue_size_test)
 {
@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+
+class FindBatchTest : public ::testing::Test
+{
+public:
+    FindBatchTest() {
+        db = NULL;
+    }
+    virtual ~FindBatchTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+        db = new DB(MB_DIR, CONSTS::WriterOptions());
+        ASSERT_TRUE(db->is_open());
+    }
+    virtual void TearDown() {
+        if(db != NULL) {
+            db->Close();
+            delete db;
+            db = NULL;
+        }
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    // Compare FindBatch with Find key by key.
+    void CheckBatch(DB *handle, const std::vector<std::string> &keys) {
+        std::vector<MBData> data(keys.size());
+        std::vector<int> rvals;
+        EXPECT_EQ(MBError::SUCCESS, handle->FindBatch(keys, &data[0], rvals));
+        ASSERT_EQ(keys.size(), rvals.size());
+        for(size_t i = 0; i < keys.size(); i++) {
+            MBData mbd;
+            int rval = handle->Find(keys[i], mbd);
+            EXPECT_EQ(rval, rvals[i]) << "key: " << keys[i];
+            if(rval != MBError::SUCCESS || rvals[i] != MBError::SUCCESS)
+                continue;
+            EXPECT_EQ(std::string((const char *) mbd.buff, mbd.data_len),
+                      std::string((const char *) data[i].buff, data[i].data_len));
+            EXPECT_EQ((int) keys[i].size(), data[i].match_len);
+        }
+    }
+
+protected:
+    DB *db;
+};
+
+TEST_F(FindBatchTest, find_batch_test)
+{
+    std::vector<std::string> added;
+    std::string prefixes[] = { "a", "ab", "abc", "abcdefghijkl", "abcdefghijklmnop",
+                               "tenant1/", "tenant10/", "\xff" };
+    for(size_t i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+        added.push_back(prefixes[i]);
+        for(int j = 0; j < 200; j++)
+            added.push_back(prefixes[i] + std::to_string(j * 7919));
+    }
+    srand(4321);
+    for(int i = 0; i < 3000; i++)
+        added.push_back(std::to_string(rand()) + "_" + std::to_string(i));
+    for(size_t i = 0; i < added.size(); i++)
+        EXPECT_EQ(MBError::SUCCESS, db->Add(added[i], added[i] + "_value", true));
+
+    // Hits, prefixes and extensions of keys, and keys sharing no edge
+    std::vector<std::string> keys;
+    for(size_t i = 0; i < added.size(); i += 3) {
+        keys.push_back(added[i]);
+        keys.push_back(added[i] + "x");
+        keys.push_back(added[i].substr(0, added[i].size() / 2));
+    }
+    keys.push_back("");
+    keys.push_back("zzz");
+    keys.push_back("abcdefghijkX");
+    CheckBatch(db, keys);
+
+    std::vector<MBData> data(keys.size());
+    std::vector<int> rvals;
+    db->FindBatch(keys, &data[0], rvals);
+    EXPECT_EQ(MBError::SUCCESS, rvals[0]);
+    EXPECT_EQ(added[0] + "_value", std::string((const char *) data[0].buff, data[0].data_len));
+    EXPECT_EQ(MBError::NOT_EXIST, rvals[keys.size() - 1]);
+
+    // A reader handle and batches smaller than the interleave width
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    CheckBatch(&db_r, keys);
+    CheckBatch(&db_r, std::vector<std::string>(keys.begin(), keys.begin() + 5));
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindBatch(std::vector<std::string>(), &data[0], rvals));
+    EXPECT_TRUE(rvals.empty());
+    EXPECT_EQ(MBError::INVALID_ARG, db_r.FindBatch(keys, NULL, rvals));
+    db_r.Close();
+}
+
+static void update_keys(DB *db, const std::vector<std::string> *keys, std::atomic<bool> *stop)
+{
+    int round = 0;
+    while(!stop->load()) {
+        for(size_t i = 0; i < keys->size(); i++) {
+            const std::string &key = (*keys)[i];
+            db->Add(key, key + "_" + std::to_string(round), true);
+            db->Add(key + "_tmp", key);
+            db->Remove(key + "_tmp");
+        }
+        round++;
+    }
+}
+
+TEST_F(FindBatchTest, concurrent_update_test)
+{
+    std::vector<std::string> keys;
+    for(int i = 0; i < 500; i++) {
+        keys.push_back("key" + std::to_string(i * 31));
+        EXPECT_EQ(MBError::SUCCESS, db->Add(keys.back(), keys.back() + "_init"));
+    }
+
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    std::atomic<bool> stop(false);
+    std::thread writer(update_keys, db, &keys, &stop);
+
+    std::vector<MBData> data(keys.size());
+    std::vector<int> rvals;
+    for(int n = 0; n < 200; n++) {
+        EXPECT_EQ(MBError::SUCCESS, db_r.FindBatch(keys, &data[0], rvals));
+        for(size_t i = 0; i < keys.size(); i++) {
+            ASSERT_EQ(MBError::SUCCESS, rvals[i]) << "key: " << keys[i];
+            std::string value((const char *) data[i].buff, data[i].data_len);
+            EXPECT_EQ(keys[i] + "_", value.substr(0, keys[i].size() + 1));
+        }
+    }
+
+    stop.store(true);
+    writer.join();
+    db_r.Close();
+}
+
+}
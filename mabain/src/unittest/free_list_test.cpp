@@ -19,10 +19,12 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <list>
+#include <fstream>
 
 #include <gtest/gtest.h>
 
 #include "../free_list.h"
+#include "../db.h"
 #include "../error.h"
 
 using namespace mabain;
@@ -330,4 +332,93 @@ TEST_F(FreeListTest, StoreLoadHalfFilling_test)
     EXPECT_EQ(rval, MBError::NO_MEMORY);
 }
 
+TEST_F(FreeListTest, BestFitSplit_test)
+{
+    FreeList flist("./freelist", 4, 555);
+    size_t offset;
+    MBFreeListStats stats;
+
+    flist.AddBuffer(400, 100);
+    flist.AddBuffer(100, 40);
+    // The smallest larger buffer is split and its tail is kept.
+    EXPECT_TRUE(flist.GetBufferByIndex(flist.GetBufferIndex(24), offset));
+    EXPECT_EQ(100u, offset);
+    EXPECT_EQ(flist.GetBufferCountByIndex(flist.GetBufferIndex(16)), 1u);
+    EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 16));
+    EXPECT_EQ(124u, offset);
+    EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 100));
+    EXPECT_EQ(400u, offset);
+    EXPECT_EQ(MBError::NO_MEMORY, flist.RemoveBuffer(offset, 4));
+    flist.GetStats(stats);
+    EXPECT_EQ(2, stats.num_reuse);
+    EXPECT_EQ(1, stats.num_split);
+    EXPECT_EQ(1, stats.num_miss);
+    EXPECT_EQ(0, flist.Count());
+    EXPECT_EQ(0u, flist.GetTotSize());
+}
+
+TEST_F(FreeListTest, Coalesce_test)
+{
+    FreeList flist("./freelist", 4, 555, MAX_BUFFER_PER_LIST, 1024);
+    size_t offset;
+    MBFreeListStats stats;
+
+    // Adjacent buffers, also across a block boundary at 1024
+    flist.AddBuffer(1000, 24);
+    flist.AddBuffer(1024, 24);
+    flist.AddBuffer(900, 100);
+    flist.AddBuffer(800, 100);
+    flist.AddBuffer(0, 8);
+    EXPECT_EQ(5, flist.Count());
+
+    // Exact sizes are still reused first.
+    EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 8));
+    EXPECT_EQ(0u, offset);
+    flist.GetStats(stats);
+    EXPECT_EQ(100, stats.largest_buffer);
+    EXPECT_EQ(0, stats.num_coalesce);
+
+    // No single buffer is large enough; the neighbors are merged.
+    EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 200));
+    EXPECT_EQ(800u, offset);
+    flist.GetStats(stats);
+    EXPECT_EQ(2, stats.num_coalesce);
+    EXPECT_EQ(2, stats.num_buffer);
+    EXPECT_EQ(24, stats.largest_buffer);
+    EXPECT_EQ(48, stats.free_size);
+    // The buffers on either side of the block boundary stay apart.
+    EXPECT_EQ(MBError::NO_MEMORY, flist.RemoveBuffer(offset, 48));
+    EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 24));
+    EXPECT_EQ(1000u, offset);
+
+    // A buffer is freed only once.
+    EXPECT_EQ(MBError::SUCCESS, flist.AddBuffer(2000, 16));
+    EXPECT_EQ(MBError::INVALID_ARG, flist.AddBuffer(2000, 16));
+    EXPECT_EQ(2, flist.Count());
+}
+
+TEST_F(FreeListTest, StoreLoadCompact_test)
+{
+    FreeList flist("./freelist", 4, 555, MAX_BUFFER_PER_LIST, 4096);
+    size_t offset;
+
+    for(int i = 0; i < 100; i++)
+        flist.AddBuffer(i * 64, 32);
+    size_t tot = flist.GetTotSize();
+    EXPECT_EQ(MBError::SUCCESS, flist.StoreListOnDisk());
+    // offset deltas and buffer indexes take one byte each
+    std::ifstream in("./freelist", std::ifstream::ate | std::ifstream::binary);
+    EXPECT_EQ(16 + 100 * 2, in.tellg());
+    in.close();
+
+    EXPECT_EQ(MBError::SUCCESS, flist.LoadListFromDisk());
+    EXPECT_EQ(100, flist.Count());
+    EXPECT_EQ(tot, flist.GetTotSize());
+    for(int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(MBError::SUCCESS, flist.RemoveBuffer(offset, 32));
+        EXPECT_EQ(i * 64u, offset);
+    }
+}
+
 }
@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../mabain_consts.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+
+class HotNodeCacheTest : public ::testing::Test
+{
+public:
+    HotNodeCacheTest() {
+    }
+    virtual ~HotNodeCacheTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    std::string Key(int i) {
+        return "hot" + std::to_string(i % 10) + "_key_" + std::to_string(i);
+    }
+
+    void CheckKeys(DB &db, int start, int end) {
+        MBData mbd;
+        for(int i = start; i < end; i++) {
+            EXPECT_EQ(MBError::SUCCESS, db.Find(Key(i), mbd)) << Key(i);
+            EXPECT_EQ("value" + std::to_string(i),
+                      std::string((const char *) mbd.buff, mbd.data_len));
+        }
+    }
+
+protected:
+};
+
+TEST_F(HotNodeCacheTest, lookup_test)
+{
+    DB db(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db.is_open());
+    int num = 5000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.Add(Key(i), "value" + std::to_string(i)));
+
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    MBHotNodeStats stats;
+    CheckKeys(db_r, 0, num);
+    EXPECT_EQ(MBError::SUCCESS, db_r.GetHotNodeStats(stats));
+    EXPECT_GT(stats.num_node, 1);
+    EXPECT_EQ(0, stats.num_invalidation);
+    int64_t num_node = stats.num_node;
+    int64_t num_miss = stats.num_miss;
+    EXPECT_EQ(num_node, num_miss);
+
+    // The second pass only hits the cache.
+    CheckKeys(db_r, 0, num);
+    EXPECT_EQ(MBError::SUCCESS, db_r.GetHotNodeStats(stats));
+    EXPECT_EQ(num_node, stats.num_node);
+    EXPECT_EQ(num_miss, stats.num_miss);
+    EXPECT_GT(stats.num_hit, 2 * num);
+    MBData mbd;
+    EXPECT_EQ(MBError::NOT_EXIST, db_r.Find("hot1_key_x", mbd));
+    EXPECT_EQ(MBError::NOT_EXIST, db_r.Find("zzz", mbd));
+
+    // Updates invalidate the cache.
+    EXPECT_EQ(MBError::SUCCESS, db.Add("hot1_new", "new_value"));
+    EXPECT_EQ(MBError::SUCCESS, db_r.Find("hot1_new", mbd));
+    EXPECT_EQ(MBError::SUCCESS, db_r.GetHotNodeStats(stats));
+    EXPECT_EQ(1, stats.num_invalidation);
+    for(int i = 0; i < num; i += 2)
+        EXPECT_EQ(MBError::SUCCESS, db.Remove(Key(i)));
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(i % 2 == 0 ? MBError::NOT_EXIST : MBError::SUCCESS, db_r.Find(Key(i), mbd));
+    EXPECT_EQ(MBError::SUCCESS, db_r.GetHotNodeStats(stats));
+    EXPECT_EQ(2, stats.num_invalidation);
+
+    // Disabled cache and cache with a single level
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = MB_DIR;
+    config.options = CONSTS::ReaderOptions();
+    config.hot_node_depth = -1;
+    DB db_r2(config);
+    ASSERT_TRUE(db_r2.is_open());
+    CheckKeys(db_r2, 1, 2);
+    EXPECT_EQ(MBError::SUCCESS, db_r2.GetHotNodeStats(stats));
+    EXPECT_EQ(0, stats.num_node);
+    config.hot_node_depth = 2;
+    config.hot_node_max = 3;
+    DB db_r3(config);
+    ASSERT_TRUE(db_r3.is_open());
+    for(int i = 1; i < num; i += 2)
+        CheckKeys(db_r3, i, i + 1);
+    EXPECT_EQ(MBError::SUCCESS, db_r3.GetHotNodeStats(stats));
+    EXPECT_EQ(3, stats.num_node);
+
+    db_r3.Close();
+    db_r2.Close();
+    db_r.Close();
+    db.Close();
+}
+
+TEST_F(HotNodeCacheTest, concurrent_writer_test)
+{
+    DB db(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db.is_open());
+    int num = 2000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.Add(Key(i), "value" + std::to_string(i)));
+
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        for(int i = 0; !stop.load(); i++)
+        {
+            db.Add(Key(num + i % 20000), "value");
+            if(i >= 50)
+                db.Remove(Key(num + (i - 50) % 20000));
+        }
+    });
+
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    // The writer thread may not get to run for the first rounds.
+    MBHotNodeStats stats;
+    for(int round = 0; round < 1000; round++)
+    {
+        CheckKeys(db_r, 0, num);
+        EXPECT_EQ(MBError::SUCCESS, db_r.GetHotNodeStats(stats));
+        if(round >= 5 && stats.num_invalidation > 0)
+            break;
+    }
+    stop.store(true);
+    writer.join();
+    EXPECT_GT(stats.num_invalidation, 0);
+    db_r.Close();
+    db.Close();
+}
+
+}
@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+
+class IteratorTest : public ::testing::Test
+{
+public:
+    IteratorTest() {
+        db = NULL;
+    }
+    virtual ~IteratorTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+        db = new DB(MB_DIR, CONSTS::WriterOptions());
+        ASSERT_TRUE(db->is_open());
+
+        std::string tenants[] = { "tenant1/", "tenant2/", "tenant10/", "tenant", "ten",
+                                  "tenant1", "t", "\xff\xff", "\xff\xff" "a" };
+        for(size_t i = 0; i < sizeof(tenants)/sizeof(tenants[0]); i++) {
+            AddKey(tenants[i]);
+            for(int j = 0; j < 300; j++) {
+                AddKey(tenants[i] + std::to_string(j));
+            }
+        }
+        srand(1234);
+        for(int i = 0; i < 1000; i++) {
+            AddKey(std::to_string(rand()));
+        }
+    }
+    virtual void TearDown() {
+        if(db != NULL) {
+            db->Close();
+            delete db;
+            db = NULL;
+        }
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    void AddKey(const std::string &key) {
+        EXPECT_EQ(MBError::SUCCESS, db->Add(key, key + "_value", true));
+        all_keys.insert(key);
+    }
+
+    // Expected keys in [lower, upper)
+    std::set<std::string> KeysInRange(const std::string &lower, const std::string &upper) {
+        std::set<std::string> keys;
+        for(auto it = all_keys.begin(); it != all_keys.end(); ++it) {
+            if(*it >= lower && (upper.empty() || *it < upper))
+                keys.insert(*it);
+        }
+        return keys;
+    }
+
+    std::set<std::string> KeysWithPrefix(const std::string &prefix) {
+        std::set<std::string> keys;
+        for(auto it = all_keys.begin(); it != all_keys.end(); ++it) {
+            if(it->compare(0, prefix.size(), prefix) == 0)
+                keys.insert(*it);
+        }
+        return keys;
+    }
+
+    std::set<std::string> IterKeys(DB::iterator iter) {
+        std::set<std::string> keys;
+        for(; iter != db->end(); ++iter) {
+            EXPECT_EQ(iter.key + "_value", std::string((const char *) iter.value.buff,
+                                                       iter.value.data_len));
+            EXPECT_TRUE(keys.insert(iter.key).second);
+        }
+        return keys;
+    }
+
+protected:
+    DB *db;
+    std::set<std::string> all_keys;
+};
+
+typedef struct _IterResult
+{
+    pthread_mutex_t mutex;
+    std::set<std::string> keys;
+    int num_dup;
+} IterResult;
+
+static void collect_key(const std::string &key, const MBData &value, void *arg)
+{
+    IterResult *result = static_cast<IterResult *>(arg);
+    EXPECT_EQ(key + "_value", std::string((const char *) value.buff, value.data_len));
+    pthread_mutex_lock(&result->mutex);
+    if(!result->keys.insert(key).second)
+        result->num_dup++;
+    pthread_mutex_unlock(&result->mutex);
+}
+
+TEST_F(IteratorTest, prefix_iterator_test)
+{
+    std::string prefixes[] = { "tenant1/", "tenant1", "tenant", "ten", "t", "",
+                               "\xff", "\xff\xff", "tenant3", "tenant1/29" };
+    for(size_t i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+        std::set<std::string> keys = IterKeys(db->prefix_begin(prefixes[i]));
+        EXPECT_EQ(KeysWithPrefix(prefixes[i]), keys) << "prefix: " << prefixes[i];
+    }
+    EXPECT_EQ(301u, KeysWithPrefix("tenant1/").size());
+}
+
+TEST_F(IteratorTest, range_iterator_test)
+{
+    std::string bounds[][2] = {
+        { "", "" },
+        { "tenant1/", "tenant2/" },
+        { "tenant1/100", "tenant1/200" },
+        { "1", "5" },
+        { "5", "" },
+        { "tenant", "tenant" },
+        { "\xff", "" },
+        { "", "tenant10/5" },
+    };
+    for(size_t i = 0; i < sizeof(bounds)/sizeof(bounds[0]); i++) {
+        std::set<std::string> keys = IterKeys(db->range_begin(bounds[i][0], bounds[i][1]));
+        EXPECT_EQ(KeysInRange(bounds[i][0], bounds[i][1]), keys)
+            << "range: " << bounds[i][0] << " " << bounds[i][1];
+    }
+}
+
+TEST_F(IteratorTest, parallel_iterate_test)
+{
+    int num_threads[] = { 1, 3, 7, 256 };
+    std::string prefixes[] = { "", "tenant1", "\xff" };
+    for(size_t i = 0; i < sizeof(num_threads)/sizeof(num_threads[0]); i++) {
+        for(size_t j = 0; j < sizeof(prefixes)/sizeof(prefixes[0]); j++) {
+            IterResult result;
+            pthread_mutex_init(&result.mutex, NULL);
+            result.num_dup = 0;
+            EXPECT_EQ(MBError::SUCCESS, db->ParallelIterate(num_threads[i], collect_key,
+                                                            &result, prefixes[j]));
+            EXPECT_EQ(0, result.num_dup);
+            EXPECT_EQ(KeysWithPrefix(prefixes[j]), result.keys)
+                << "threads: " << num_threads[i] << " prefix: " << prefixes[j];
+            pthread_mutex_destroy(&result.mutex);
+        }
+    }
+
+    EXPECT_EQ(MBError::INVALID_ARG, db->ParallelIterate(0, collect_key, NULL));
+}
+
+}
@@ -0,0 +1,220 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../mabain_consts.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+#define MB_SNAPSHOT_DIR "/var/tmp/mabain_test_snapshot/"
+
+class JournalTest : public ::testing::Test
+{
+public:
+    JournalTest() {
+    }
+    virtual ~JournalTest() {
+    }
+    virtual void SetUp() {
+        RunCmd(std::string("mkdir -p ") + MB_SNAPSHOT_DIR);
+        RunCmd(std::string("rm -f ") + MB_DIR + "_* " + MB_SNAPSHOT_DIR + "_*");
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    void RunCmd(const std::string &cmd) {
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+
+    DB* OpenWriter(int options) {
+        MBConfig config;
+        memset(&config, 0, sizeof(config));
+        config.mbdir = MB_DIR;
+        config.options = CONSTS::WriterOptions() | CONSTS::USE_JOURNAL | options;
+        return new DB(config);
+    }
+
+    void CloseDB(DB *db) {
+        db->Close();
+        delete db;
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    off_t JournalSize() {
+        struct stat st;
+        if(stat(MB_DIR "_mabain_j", &st) != 0)
+            return -1;
+        return st.st_size;
+    }
+
+    // DB files as they were before the updates, with the journal written
+    // since; this is what a crash looks like if the pages of the DB files
+    // did not make it to disk.
+    void SimulateCrash(const std::string &journal_copy) {
+        RunCmd(std::string("cp ") + MB_DIR + "_mabain_j " + journal_copy);
+    }
+    void RestoreSnapshot(const std::string &journal_copy) {
+        RunCmd(std::string("rm -f ") + MB_DIR + "_*");
+        RunCmd(std::string("cp ") + MB_SNAPSHOT_DIR + "_* " + MB_DIR);
+        RunCmd(std::string("cp ") + journal_copy + " " + MB_DIR + "_mabain_j");
+    }
+
+protected:
+};
+
+TEST_F(JournalTest, replay_test)
+{
+    DB *db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(MBError::SUCCESS, db->Add("old_key", "old_value"));
+    CloseDB(db);
+    EXPECT_EQ(0, JournalSize());
+    RunCmd(std::string("cp ") + MB_DIR + "_* " + MB_SNAPSHOT_DIR);
+
+    int num = 2000;
+    db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db->Add(key, key));
+    }
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for(int i = 0; i < num; i += 2)
+    {
+        keys.push_back("key" + std::to_string(i));
+        values.push_back("updated");
+    }
+    EXPECT_EQ(MBError::SUCCESS, db->AddBatch(keys, values, true));
+    for(int i = 0; i < num; i += 10)
+        EXPECT_EQ(MBError::SUCCESS, db->Remove("key" + std::to_string(i)));
+    EXPECT_EQ(MBError::SUCCESS, db->Remove("old_key"));
+    EXPECT_GT(JournalSize(), 0);
+    SimulateCrash("/var/tmp/mabain_test_snapshot/journal");
+    CloseDB(db);
+
+    // A torn record at the tail is ignored.
+    RunCmd("printf 'torn record' >> /var/tmp/mabain_test_snapshot/journal");
+    RestoreSnapshot("/var/tmp/mabain_test_snapshot/journal");
+    db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(0, JournalSize());
+    EXPECT_EQ(num - num / 10, db->Count());
+    MBData mbd;
+    EXPECT_EQ(MBError::NOT_EXIST, db->Find("old_key", mbd));
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        if(i % 10 == 0)
+        {
+            EXPECT_EQ(MBError::NOT_EXIST, db->Find(key, mbd));
+            continue;
+        }
+        EXPECT_EQ(MBError::SUCCESS, db->Find(key, mbd));
+        std::string value = (i % 2 == 0) ? "updated" : key;
+        EXPECT_EQ(value, std::string((const char *) mbd.buff, mbd.data_len));
+    }
+
+    // Replaying again over the updated files gives the same result.
+    CloseDB(db);
+    RunCmd(std::string("cp /var/tmp/mabain_test_snapshot/journal ") + MB_DIR + "_mabain_j");
+    db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(num - num / 10, db->Count());
+    CloseDB(db);
+}
+
+TEST_F(JournalTest, async_group_commit_test)
+{
+    DB *db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    CloseDB(db);
+    RunCmd(std::string("cp ") + MB_DIR + "_* " + MB_SNAPSHOT_DIR);
+
+    int num = 5000;
+    db = OpenWriter(CONSTS::ASYNC_WRITER_MODE);
+    ASSERT_TRUE(db->is_open());
+    DB *db_r = new DB(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r->is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r->SetAsyncWriterPtr(db));
+#endif
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db_r->Add(key, key));
+    }
+    EXPECT_EQ(MBError::SUCCESS, db_r->RemoveAll());
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "async_key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db_r->Add(key, key));
+    }
+    // Not busy only once the updates are committed to the journal.
+    while(db_r->AsyncWriterBusy())
+        usleep(1000);
+    EXPECT_GT(JournalSize(), 0);
+    SimulateCrash("/var/tmp/mabain_test_snapshot/journal");
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r->UnsetAsyncWriterPtr(db));
+#endif
+    db_r->Close();
+    delete db_r;
+    CloseDB(db);
+
+    RestoreSnapshot("/var/tmp/mabain_test_snapshot/journal");
+    db = OpenWriter(0);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(num, db->Count());
+    MBData mbd;
+    EXPECT_EQ(MBError::NOT_EXIST, db->Find("key1", mbd));
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "async_key" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, db->Find(key, mbd));
+        EXPECT_EQ(key, std::string((const char *) mbd.buff, mbd.data_len));
+    }
+    CloseDB(db);
+}
+
+TEST_F(JournalTest, memory_only_test)
+{
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = MB_DIR;
+    config.options = CONSTS::WriterOptions() | CONSTS::USE_JOURNAL | CONSTS::MEMORY_ONLY_MODE;
+    DB db(config);
+    EXPECT_FALSE(db.is_open());
+}
+
+}
@@ -16,6 +16,7 @@
 
 // @author Changxue Deng <chadeng@cisco.com>
 
+#include <unistd.h>
 #include <string>
 
 #include <gtest/gtest.h>
@@ -24,6 +25,7 @@
 #include "../mabain_consts.h"
 #include "../error.h"
 #include "../drm_base.h"
+#include "../db.h"
 
 using namespace mabain;
 
@@ -280,4 +282,43 @@ TEST_F(LockFreeTest, ReaderLockFreeStop_test_6)
     EXPECT_FALSE(mbd.options & CONSTS::OPTION_READ_SAVED_EDGE);
 }
 
+TEST_F(LockFreeTest, reader_retry_test)
+{
+    MBRetryStats before, after;
+    LockFree::GetRetryStats(before);
+    {
+        LockFreeRetry retry(lfree);
+        for(int i = 0; i < LOCK_FREE_RETRY_BUDGET - 1; i++)
+            retry.Wait();
+        EXPECT_EQ(0u, header.reader_starving_until.load());
+    }
+    LockFree::GetRetryStats(after);
+    EXPECT_EQ(before.num_lookup + 1, after.num_lookup);
+    EXPECT_EQ(before.num_retry + LOCK_FREE_RETRY_BUDGET - 1, after.num_retry);
+    EXPECT_GE(after.max_retry_chain, LOCK_FREE_RETRY_BUDGET - 1);
+    EXPECT_EQ(before.num_starved, after.num_starved);
+
+    // A lookup over the budget makes the writer back off.
+    {
+        LockFreeRetry retry(lfree);
+        for(int i = 0; i < LOCK_FREE_RETRY_BUDGET + 10; i++)
+            retry.Wait();
+        EXPECT_NE(0u, header.reader_starving_until.load());
+        lfree.WriterLockFreeStart(100);
+        lfree.WriterLockFreeStop();
+    }
+    LockFree::GetRetryStats(after);
+    EXPECT_EQ(before.num_lookup + 2, after.num_lookup);
+    EXPECT_EQ(before.num_starved + 1, after.num_starved);
+    EXPECT_GE(after.max_retry_chain, LOCK_FREE_RETRY_BUDGET + 10);
+    EXPECT_GT(after.writer_yield_us, before.writer_yield_us);
+    EXPECT_GE(after.retry_time_us, before.retry_time_us);
+
+    // The writer no longer backs off once the request has timed out.
+    usleep(2 * LOCK_FREE_WRITER_YIELD_US);
+    lfree.WriterLockFreeStart(100);
+    lfree.WriterLockFreeStop();
+    EXPECT_EQ(0u, header.reader_starving_until.load());
+}
+
 }
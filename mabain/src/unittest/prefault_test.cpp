@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <unistd.h>
+#include <string.h>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../mabain_consts.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+
+class PrefaultTest : public ::testing::Test
+{
+public:
+    PrefaultTest() {
+    }
+    virtual ~PrefaultTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    void WaitForWarm(DB &db, MBPrefaultStats &stats) {
+        for(int i = 0; i < 10000; i++) {
+            EXPECT_EQ(MBError::SUCCESS, db.GetPrefaultStats(stats));
+            if(stats.done)
+                break;
+            usleep(1000);
+        }
+    }
+
+    void AddKeys(DB &db, int num) {
+        for(int i = 0; i < num; i++) {
+            std::string key = "key" + std::to_string(i);
+            EXPECT_EQ(MBError::SUCCESS, db.Add(key, key + std::string(200, 'v')));
+        }
+    }
+
+    void CheckKeys(DB &db, int num) {
+        MBData mbd;
+        for(int i = 0; i < num; i++) {
+            std::string key = "key" + std::to_string(i);
+            EXPECT_EQ(MBError::SUCCESS, db.Find(key, mbd));
+            EXPECT_EQ(key + std::string(200, 'v'),
+                      std::string((const char *) mbd.buff, mbd.data_len));
+        }
+    }
+
+protected:
+};
+
+TEST_F(PrefaultTest, prefault_on_open_test)
+{
+    int num = 20000;
+    DB db(MB_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(db.is_open());
+    AddKeys(db, num);
+
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = MB_DIR;
+    config.options = CONSTS::ReaderOptions() | CONSTS::PREFAULT_ON_OPEN;
+    config.prefault_threads = 2;
+    // Only the blocks within the memory cap are mapped and prefaulted.
+    config.memcap_index = 128*1024*1024LL;
+    config.memcap_data = 128*1024*1024LL;
+    DB db_r(config);
+    ASSERT_TRUE(db_r.is_open());
+    MBPrefaultStats stats;
+    WaitForWarm(db_r, stats);
+    EXPECT_TRUE(stats.done);
+    EXPECT_GT(stats.bytes, 20000 * 200);
+    EXPECT_GE(stats.warm_us, 0);
+    CheckKeys(db_r, num);
+    db_r.Close();
+
+    // Nothing is prefaulted without the option.
+    DB db_r2(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r2.is_open());
+    EXPECT_EQ(MBError::SUCCESS, db_r2.GetPrefaultStats(stats));
+    EXPECT_TRUE(stats.done);
+    EXPECT_EQ(0, stats.bytes);
+
+    // Closing while the threads are still running stops them.
+    DB db_r3(config);
+    ASSERT_TRUE(db_r3.is_open());
+    db_r3.Close();
+    db_r2.Close();
+    db.Close();
+}
+
+TEST_F(PrefaultTest, huge_pages_test)
+{
+    // Huge pages are used where available and regular pages otherwise.
+    MBConfig config;
+    memset(&config, 0, sizeof(config));
+    config.mbdir = MB_DIR;
+    config.options = CONSTS::WriterOptions() | CONSTS::MEMORY_ONLY_MODE |
+                     CONSTS::USE_HUGE_PAGES | CONSTS::PREFAULT_ON_OPEN;
+    config.memcap_index = 128*1024*1024LL;
+    config.memcap_data = 128*1024*1024LL;
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    int num = 5000;
+    AddKeys(db, num);
+    CheckKeys(db, num);
+    db.Close();
+}
+
+}
@@ -18,6 +18,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <openssl/sha.h>
 #include <sys/time.h>
@@ -296,4 +297,71 @@ TEST_F(ResourceCollectionTest, RC_delete_random_collect_index_data_add_test)
     delete [] exist;
 }
 
+TEST_F(ResourceCollectionTest, RC_async_pause_test)
+{
+    db->Close();
+    delete db;
+    ResourcePool::getInstance().RemoveAll();
+
+    MBConfig mbconf;
+    memset(&mbconf, 0, sizeof(mbconf));
+    mbconf.mbdir = DB_DIR;
+    mbconf.options = CONSTS::ACCESS_MODE_WRITER | CONSTS::ASYNC_WRITER_MODE;
+    mbconf.memcap_index = 128ULL*1024*1024;
+    mbconf.memcap_data = 128ULL*1024*1024;
+    mbconf.rc_max_pause_us = 200;
+    DB *db_async = new DB(mbconf);
+    ASSERT_TRUE(db_async->is_open());
+    db = new DB(DB_DIR, CONSTS::ACCESS_MODE_READER, 128ULL*1024*1024, 128ULL*1024*1024);
+    ASSERT_TRUE(db->is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db->SetAsyncWriterPtr(db_async));
+#endif
+
+    key_type = MABAIN_TEST_KEY_TYPE_SHA_256;
+    long tot = 40000;
+    bool *exist = new bool[tot + 1000];
+    Populate(tot, exist);
+    while(db->AsyncWriterBusy()) {
+        usleep(100);
+    }
+    DeleteOdd(tot, exist);
+    while(db->AsyncWriterBusy()) {
+        usleep(100);
+    }
+
+    // Updates submitted while rc is running are let through between slices.
+    EXPECT_EQ(MBError::SUCCESS, db->CollectResource(1, 1));
+    TestKey tkey = TestKey(key_type);
+    for(long i = tot; i < tot + 1000; i++) {
+        std::string key = tkey.get_key(i);
+        EXPECT_EQ(MBError::SUCCESS, db->Add(key, key));
+        exist[i] = true;
+    }
+    while(db->AsyncWriterBusy()) {
+        usleep(100);
+    }
+
+    for(long i = 0; i < tot + 1000; i++) {
+        VerifyKeyValue(i, exist[i]);
+    }
+
+    MBRCStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db->GetRCStats(stats));
+    EXPECT_EQ(MB_RC_PHASE_NONE, stats.phase);
+    EXPECT_GT(stats.work_total, 0);
+    EXPECT_GT(stats.work_done, 0);
+    EXPECT_GT(stats.bytes_moved, 0);
+    EXPECT_GT(stats.num_pause, 0);
+    EXPECT_GE(stats.max_pause_us, stats.p99_pause_us);
+    EXPECT_GE(stats.p99_pause_us, 200);
+
+#ifndef __SHM_QUEUE__
+    db->UnsetAsyncWriterPtr(db_async);
+#endif
+    db_async->Close();
+    delete db_async;
+    delete [] exist;
+}
+
 }
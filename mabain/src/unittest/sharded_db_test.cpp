@@ -0,0 +1,184 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <unistd.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "../sharded_db.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define SHARD_DIR "/var/tmp/mabain_test/sharded/"
+
+class ShardedDBTest : public ::testing::Test
+{
+public:
+    ShardedDBTest() {
+    }
+    virtual ~ShardedDBTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -rf ") + SHARD_DIR;
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    void WaitForWriter(ShardedDB &sdb) {
+        while(sdb.AsyncWriterBusy()) {
+            usleep(100);
+        }
+    }
+
+protected:
+};
+
+static void add_keys(ShardedDB *sdb, int id, int num)
+{
+    for(int i = 0; i < num; i++) {
+        std::string key = "key_" + std::to_string(id) + "_" + std::to_string(i);
+        EXPECT_EQ(MBError::SUCCESS, sdb->Add(key, key + "_value"));
+    }
+}
+
+TEST_F(ShardedDBTest, hash_partition_test)
+{
+    int num_thread = 4;
+    int num = 1000;
+    ShardedDB sdb(SHARD_DIR, CONSTS::WriterOptions(), 4);
+    ASSERT_TRUE(sdb.is_open());
+    EXPECT_EQ(4, sdb.NumShards());
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < num_thread; i++)
+        threads.push_back(std::thread(add_keys, &sdb, i, num));
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    WaitForWriter(sdb);
+
+    // The reader picks up the layout saved by the writer.
+    ShardedDB sdb_r(SHARD_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(sdb_r.is_open());
+    EXPECT_EQ(4, sdb_r.NumShards());
+    EXPECT_EQ(num_thread * num, sdb_r.Count());
+
+    MBData mbd;
+    for(int t = 0; t < num_thread; t++) {
+        for(int i = 0; i < num; i++) {
+            std::string key = "key_" + std::to_string(t) + "_" + std::to_string(i);
+            EXPECT_EQ(MBError::SUCCESS, sdb_r.Find(key, mbd));
+            EXPECT_EQ(key + "_value", std::string((const char *) mbd.buff, mbd.data_len));
+        }
+    }
+
+    // All shards are used.
+    for(int i = 0; i < sdb_r.NumShards(); i++)
+        EXPECT_GT(sdb_r.GetShardDB(i)->Count(), 0);
+
+    std::set<std::string> keys;
+    for(ShardedDB::iterator iter = sdb_r.begin(); iter != sdb_r.end(); ++iter) {
+        EXPECT_EQ(iter.key + "_value", std::string((const char *) iter.value.buff,
+                                                   iter.value.data_len));
+        keys.insert(iter.key);
+    }
+    EXPECT_EQ((size_t) num_thread * num, keys.size());
+
+    std::vector<std::string> remove_keys;
+    for(int i = 0; i < num; i++)
+        remove_keys.push_back("key_0_" + std::to_string(i));
+    EXPECT_EQ(MBError::SUCCESS, sdb.RemoveBatch(remove_keys));
+    WaitForWriter(sdb);
+    EXPECT_EQ((num_thread - 1) * num, sdb_r.Count());
+    EXPECT_EQ(MBError::NOT_EXIST, sdb_r.Find("key_0_10", mbd));
+
+    sdb_r.Close();
+    sdb.Close();
+}
+
+TEST_F(ShardedDBTest, longest_prefix_test)
+{
+    const char *keys[] = { "a", "ab", "abc", "abcd", "abcdef", "b", "xyz" };
+    int partitions[] = { ShardedDB::PARTITION_PREFIX, ShardedDB::PARTITION_HASH };
+
+    for(int n = 0; n < 2; n++) {
+        SetUp();
+        ShardedDB sdb(SHARD_DIR, CONSTS::WriterOptions(), 8, partitions[n], 3);
+        ASSERT_TRUE(sdb.is_open());
+        std::vector<std::string> kvec;
+        std::vector<std::string> vvec;
+        for(size_t i = 0; i < sizeof(keys)/sizeof(keys[0]); i++) {
+            kvec.push_back(keys[i]);
+            vvec.push_back(std::string(keys[i]) + "_value");
+        }
+        EXPECT_EQ(MBError::SUCCESS, sdb.AddBatch(kvec, vvec));
+        WaitForWriter(sdb);
+
+        MBData mbd;
+        const char *lookup[] = { "abcde", "abx", "a1", "abcdefg", "abc", "bcd", "x" };
+        const char *expect[] = { "abcd", "ab", "a", "abcdef", "abc", "b", NULL };
+        for(size_t i = 0; i < sizeof(lookup)/sizeof(lookup[0]); i++) {
+            int rval = sdb.FindLongestPrefix(lookup[i], mbd);
+            if(expect[i] == NULL) {
+                EXPECT_EQ(MBError::NOT_EXIST, rval);
+                continue;
+            }
+            EXPECT_EQ(MBError::SUCCESS, rval);
+            EXPECT_EQ(strlen(expect[i]), (size_t) mbd.match_len);
+            EXPECT_EQ(std::string(expect[i]) + "_value",
+                      std::string((const char *) mbd.buff, mbd.data_len));
+        }
+
+        sdb.Close();
+        TearDown();
+    }
+}
+
+TEST_F(ShardedDBTest, layout_test)
+{
+    ShardedDB sdb_r(SHARD_DIR, CONSTS::ReaderOptions());
+    EXPECT_EQ(MBError::NOT_EXIST, sdb_r.Status());
+
+    ShardedDB sdb(SHARD_DIR, CONSTS::WriterOptions(), 2, ShardedDB::PARTITION_PREFIX, 4);
+    ASSERT_TRUE(sdb.is_open());
+    sdb.Close();
+
+    ShardedDB sdb_3(SHARD_DIR, CONSTS::WriterOptions(), 3);
+    EXPECT_EQ(MBError::INVALID_ARG, sdb_3.Status());
+
+    ShardedDB sdb_2(SHARD_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(sdb_2.is_open());
+    EXPECT_EQ(2, sdb_2.NumShards());
+    EXPECT_EQ(ShardedDB::PARTITION_PREFIX, sdb_2.Partition());
+    EXPECT_EQ(4, sdb_2.PrefixLen());
+    // Keys sharing the first prefix_len bytes go to the same shard.
+    EXPECT_EQ(sdb_2.GetShard("abcd1", 5), sdb_2.GetShard("abcd2222", 8));
+    sdb_2.Close();
+}
+
+}
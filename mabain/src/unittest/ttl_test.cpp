@@ -0,0 +1,451 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <unistd.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../change_feed.h"
+#include "../drm_base.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+#define MB_SNAPSHOT_DIR "/var/tmp/mabain_test_snapshot/"
+#define REPLICA_DIR "/var/tmp/mabain_test/replica/"
+
+class TTLTest : public ::testing::Test
+{
+public:
+    TTLTest() {
+    }
+    virtual ~TTLTest() {
+    }
+    virtual void SetUp() {
+        RunCmd(std::string("mkdir -p ") + MB_SNAPSHOT_DIR);
+        RunCmd(std::string("rm -f ") + MB_DIR + "_* " + MB_SNAPSHOT_DIR + "_*");
+        RunCmd(std::string("rm -rf ") + REPLICA_DIR + " && mkdir -p " + REPLICA_DIR);
+    }
+    virtual void TearDown() {
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    void RunCmd(const std::string &cmd) {
+        if(system(cmd.c_str()) != 0) {
+        }
+    }
+
+    MBConfig WriterConfig(int options) {
+        MBConfig config;
+        memset(&config, 0, sizeof(config));
+        config.mbdir = MB_DIR;
+        config.options = CONSTS::WriterOptions() | options;
+        return config;
+    }
+
+    // Add with an absolute expiry time
+    int AddExpiry(DB &db, const std::string &key, const std::string &value, int64_t expiry) {
+        MBData mbd;
+        mbd.buff = (uint8_t *) value.data();
+        mbd.data_len = value.size();
+        mbd.expiry = expiry;
+        int rval = db.Add(key.data(), key.size(), mbd);
+        mbd.buff = NULL;
+        return rval;
+    }
+
+    // Wait until the one-second buckets of the keys expiring now are due.
+    void WaitForBuckets() {
+        usleep(1200000);
+    }
+
+protected:
+};
+
+TEST_F(TTLTest, find_expired_test)
+{
+    MBConfig config = WriterConfig(0);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+
+    EXPECT_EQ(MBError::INVALID_ARG, db.AddWithTTL("apple", "red", 0));
+    EXPECT_EQ(MBError::INVALID_ARG, db.AddWithTTL("apple", "red", -1));
+    EXPECT_EQ(MBError::OUT_OF_BOUND, AddExpiry(db, "apple", "red", -1));
+
+    int64_t start = CurrentTimeMs();
+    EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("apple", "red", 200));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("pear", "green"));
+    MBData mbd;
+    EXPECT_EQ(MBError::SUCCESS, db_r.Find("apple", mbd));
+    EXPECT_EQ("red", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_GE(mbd.expiry, start + 200);
+    EXPECT_LE(mbd.expiry, CurrentTimeMs() + 200);
+    EXPECT_EQ(MBError::SUCCESS, db_r.Find("pear", mbd));
+    EXPECT_EQ(0, mbd.expiry);
+
+    // Expired entries are not found before the writer removes them.
+    usleep(300000);
+    EXPECT_EQ(MBError::NOT_EXIST, db.Find("apple", mbd));
+    EXPECT_EQ(MBError::NOT_EXIST, db_r.Find("apple", mbd));
+    EXPECT_EQ(MBError::NOT_EXIST, db_r.FindLongestPrefix("apple_pie", mbd));
+    std::vector<std::string> keys;
+    keys.push_back("pear");
+    keys.push_back("apple");
+    MBData data[2];
+    std::vector<int> rvals;
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindBatch(keys, data, rvals));
+    EXPECT_EQ(MBError::SUCCESS, rvals[0]);
+    EXPECT_EQ(MBError::NOT_EXIST, rvals[1]);
+    int count = 0;
+    for(DB::iterator iter = db_r.begin(); iter != db_r.end(); ++iter) {
+        EXPECT_EQ("pear", iter.key);
+        count++;
+    }
+    EXPECT_EQ(1, count);
+    count = 0;
+    for(DB::iterator iter = db_r.prefix_begin("app"); iter != db_r.end(); ++iter)
+        count++;
+    EXPECT_EQ(0, count);
+
+    // An expired entry is replaced without overwrite.
+    EXPECT_EQ(MBError::SUCCESS, db.Add("apple", "yellow"));
+    EXPECT_EQ(MBError::SUCCESS, db_r.Find("apple", mbd));
+    EXPECT_EQ("yellow", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(0, mbd.expiry);
+    EXPECT_EQ(MBError::IN_DICT, db.AddWithTTL("apple", "red", 1000));
+    EXPECT_EQ(2, db.Count());
+
+    db_r.Close();
+    db.Close();
+}
+
+TEST_F(TTLTest, find_prefix_expired_test)
+{
+    MBConfig config = WriterConfig(0);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+
+    EXPECT_EQ(MBError::SUCCESS, db.Add("a", "1"));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("app", "3"));
+    EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("appl", "4", 200));
+    EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("apple", "5", 200));
+    MBData mbd;
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindLongestPrefix("apple_pie", mbd));
+    EXPECT_EQ("5", std::string((const char *) mbd.buff, mbd.data_len));
+
+    // The longest live prefix is found behind the expired ones.
+    usleep(300000);
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindLongestPrefix("apple_pie", mbd));
+    EXPECT_EQ("3", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(3, mbd.match_len);
+    EXPECT_EQ(MBError::SUCCESS, db.FindLongestPrefix("appl", mbd));
+    EXPECT_EQ("3", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindLongestPrefix("apx", mbd));
+    EXPECT_EQ("1", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(MBError::SUCCESS, db.Remove("app"));
+    EXPECT_EQ(MBError::SUCCESS, db_r.FindLongestPrefix("apple", mbd));
+    EXPECT_EQ("1", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(MBError::SUCCESS, db.Remove("a"));
+    EXPECT_EQ(MBError::NOT_EXIST, db_r.FindLongestPrefix("apple", mbd));
+    db_r.Close();
+    db.Close();
+}
+
+TEST_F(TTLTest, bulk_expire_test)
+{
+    MBConfig config = WriterConfig(0);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+
+    // The writer removes the entries once their bucket is due.
+    int num = 1000;
+    int64_t past = CurrentTimeMs() - 5000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, AddExpiry(db, "past" + std::to_string(i), "value", past));
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("short" + std::to_string(i), "value", 100));
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("long" + std::to_string(i), "value", 3600000));
+    EXPECT_EQ(2 * num, db.Count());
+
+    MBExpiryStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db.GetExpiryStats(stats));
+    EXPECT_EQ(3 * num, stats.num_add);
+    EXPECT_EQ(num, stats.num_expired);
+    EXPECT_GT(stats.bytes_reclaimed, 0);
+    EXPECT_EQ(2 * num, stats.num_pending);
+
+    WaitForBuckets();
+    EXPECT_EQ(MBError::SUCCESS, db.ExpireEntries());
+    EXPECT_EQ(num, db.Count());
+    EXPECT_EQ(MBError::SUCCESS, db.GetExpiryStats(stats));
+    EXPECT_EQ(2 * num, stats.num_expired);
+    EXPECT_EQ(num, stats.num_pending);
+    MBData mbd;
+    for(int i = 0; i < num; i++)
+    {
+        EXPECT_EQ(MBError::NOT_EXIST, db.Find("short" + std::to_string(i), mbd));
+        EXPECT_EQ(MBError::SUCCESS, db.Find("long" + std::to_string(i), mbd));
+    }
+
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    EXPECT_EQ(MBError::NOT_ALLOWED, db_r.ExpireEntries());
+    EXPECT_EQ(MBError::SUCCESS, db_r.GetExpiryStats(stats));
+    EXPECT_EQ(2 * num, stats.num_expired);
+    EXPECT_EQ(0, stats.num_pending);
+    db_r.Close();
+    db.Close();
+}
+
+TEST_F(TTLTest, collect_resource_test)
+{
+    MBConfig config = WriterConfig(0);
+    DB *db = new DB(config);
+    ASSERT_TRUE(db->is_open());
+    int num = 2000;
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        if(i % 2 == 0)
+            EXPECT_EQ(MBError::SUCCESS, db->AddWithTTL(key, std::string(100, 'v'), 100));
+        else
+            EXPECT_EQ(MBError::SUCCESS, db->AddWithTTL(key, std::string(100, 'v'), 3600000));
+    }
+    db->Close();
+    delete db;
+    ResourcePool::getInstance().RemoveAll();
+
+    // The expiry index of the reopened writer is rebuilt by resource
+    // collection, which also removes the expired entries.
+    db = new DB(config);
+    ASSERT_TRUE(db->is_open());
+    WaitForBuckets();
+    EXPECT_EQ(num, db->Count());
+    EXPECT_EQ(MBError::SUCCESS, db->CollectResource(1, 1));
+    EXPECT_EQ(num / 2, db->Count());
+    MBExpiryStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db->GetExpiryStats(stats));
+    EXPECT_EQ(num, stats.num_add);
+    EXPECT_EQ(num / 2, stats.num_expired);
+    EXPECT_GT(stats.bytes_reclaimed, num / 2 * 100);
+    EXPECT_EQ(num / 2, stats.num_pending);
+
+    MBData mbd;
+    for(int i = 0; i < num; i++)
+    {
+        int rval = db->Find("key" + std::to_string(i), mbd);
+        EXPECT_EQ(i % 2 == 0 ? MBError::NOT_EXIST : MBError::SUCCESS, rval);
+    }
+    db->Close();
+    delete db;
+}
+
+TEST_F(TTLTest, async_collect_resource_test)
+{
+    MBConfig config = WriterConfig(CONSTS::ASYNC_WRITER_MODE);
+    config.rc_max_pause_us = 200;
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.SetAsyncWriterPtr(&db));
+#endif
+
+    int num = 20000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db_r.AddWithTTL("key" + std::to_string(i),
+                                                    std::string(100, 'v'), 3600000));
+    while(db_r.AsyncWriterBusy())
+        usleep(1000);
+    for(int i = 0; i < num; i += 2)
+        EXPECT_EQ(MBError::SUCCESS, db_r.Remove("key" + std::to_string(i)));
+
+    // The updates let through while rc is running go to the rc tree first
+    // and are moved to the main tree at the end; each is recorded once.
+    EXPECT_EQ(MBError::SUCCESS, db_r.CollectResource(1, 1));
+    int num_rc = 1000;
+    for(int i = num; i < num + num_rc; i++)
+        EXPECT_EQ(MBError::SUCCESS, db_r.AddWithTTL("key" + std::to_string(i),
+                                                    std::string(100, 'v'), 3600000));
+    while(db_r.AsyncWriterBusy())
+        usleep(1000);
+
+    MBExpiryStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db.GetExpiryStats(stats));
+    EXPECT_EQ(num + num_rc, stats.num_add);
+    EXPECT_EQ(num + num_rc, stats.num_pending);
+    EXPECT_EQ(num / 2 + num_rc, db_r.Count());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.UnsetAsyncWriterPtr(&db));
+#endif
+    db_r.Close();
+    db.Close();
+}
+
+TEST_F(TTLTest, journal_replay_test)
+{
+    MBConfig config = WriterConfig(CONSTS::USE_JOURNAL);
+    DB *db = new DB(config);
+    ASSERT_TRUE(db->is_open());
+    db->Close();
+    delete db;
+    ResourcePool::getInstance().RemoveAll();
+    RunCmd(std::string("cp ") + MB_DIR + "_* " + MB_SNAPSHOT_DIR);
+
+    db = new DB(config);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(MBError::SUCCESS, db->AddWithTTL("apple", "red", 3600000));
+    EXPECT_EQ(MBError::SUCCESS, db->Add("pear", "green"));
+    MBData mbd;
+    EXPECT_EQ(MBError::SUCCESS, db->Find("apple", mbd));
+    int64_t expiry = mbd.expiry;
+    RunCmd(std::string("cp ") + MB_DIR + "_mabain_j " + MB_SNAPSHOT_DIR + "journal");
+    db->Close();
+    delete db;
+    ResourcePool::getInstance().RemoveAll();
+
+    // Replay the journal over the files from before the updates.
+    RunCmd(std::string("rm -f ") + MB_DIR + "_*");
+    RunCmd(std::string("cp ") + MB_SNAPSHOT_DIR + "_* " + MB_DIR);
+    RunCmd(std::string("cp ") + MB_SNAPSHOT_DIR + "journal " + MB_DIR + "_mabain_j");
+    db = new DB(config);
+    ASSERT_TRUE(db->is_open());
+    EXPECT_EQ(2, db->Count());
+    EXPECT_EQ(MBError::SUCCESS, db->Find("apple", mbd));
+    EXPECT_EQ("red", std::string((const char *) mbd.buff, mbd.data_len));
+    EXPECT_EQ(expiry, mbd.expiry);
+    EXPECT_EQ(MBError::SUCCESS, db->Find("pear", mbd));
+    EXPECT_EQ(0, mbd.expiry);
+
+    // Replayed entries are recorded by the first full sweep, not counted again.
+    MBExpiryStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db->GetExpiryStats(stats));
+    EXPECT_EQ(0, stats.num_add);
+    EXPECT_EQ(0, stats.num_pending);
+    EXPECT_EQ(MBError::SUCCESS, db->ExpireEntries());
+    EXPECT_EQ(MBError::SUCCESS, db->GetExpiryStats(stats));
+    EXPECT_EQ(0, stats.num_add);
+    EXPECT_EQ(1, stats.num_pending);
+    db->Close();
+    delete db;
+}
+
+TEST_F(TTLTest, change_feed_test)
+{
+    MBConfig config = WriterConfig(CONSTS::USE_CHANGE_FEED);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB replica(REPLICA_DIR, CONSTS::WriterOptions());
+    ASSERT_TRUE(replica.is_open());
+    ChangeSubscriber sub(MB_DIR);
+    ASSERT_TRUE(sub.is_open());
+
+    EXPECT_EQ(MBError::SUCCESS, db.AddWithTTL("apple", "red", 3600000));
+    EXPECT_EQ(MBError::SUCCESS, db.Add("pear", "green"));
+    MBData mbd;
+    EXPECT_EQ(MBError::SUCCESS, db.Find("apple", mbd));
+    int64_t expiry = mbd.expiry;
+
+    MBChange change;
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ("apple", change.key);
+    EXPECT_EQ("red", change.value);
+    EXPECT_EQ(expiry, change.expiry);
+    EXPECT_EQ(MBError::SUCCESS, ChangeSubscriber::Apply(replica, change));
+    EXPECT_EQ(MBError::SUCCESS, sub.Next(change));
+    EXPECT_EQ("pear", change.key);
+    EXPECT_EQ(0, change.expiry);
+    EXPECT_EQ(MBError::SUCCESS, ChangeSubscriber::Apply(replica, change));
+    EXPECT_EQ(MBError::TRY_AGAIN, sub.Next(change));
+
+    // The replica keeps the expiry time of the writer.
+    EXPECT_EQ(MBError::SUCCESS, replica.Find("apple", mbd));
+    EXPECT_EQ(expiry, mbd.expiry);
+    EXPECT_EQ(MBError::SUCCESS, replica.Find("pear", mbd));
+    EXPECT_EQ(0, mbd.expiry);
+    replica.Close();
+    db.Close();
+}
+
+TEST_F(TTLTest, async_writer_test)
+{
+    MBConfig config = WriterConfig(CONSTS::ASYNC_WRITER_MODE);
+    DB db(config);
+    ASSERT_TRUE(db.is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.SetAsyncWriterPtr(&db));
+#endif
+    EXPECT_EQ(MBError::NOT_ALLOWED, db.ExpireEntries());
+
+    int num = 1000;
+    int64_t past = CurrentTimeMs() - 5000;
+    for(int i = 0; i < num; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        if(i % 2 == 0)
+            EXPECT_EQ(MBError::SUCCESS, AddExpiry(db_r, key, "value", past));
+        else
+            EXPECT_EQ(MBError::SUCCESS, db_r.AddWithTTL(key, "value", 3600000));
+    }
+    while(db_r.AsyncWriterBusy())
+        usleep(1000);
+    // The async writer thread removes the expired entries after the updates.
+    for(int i = 0; i < 1000 && db_r.Count() > num / 2; i++)
+        usleep(1000);
+
+    MBData mbd;
+    for(int i = 0; i < num; i++)
+    {
+        int rval = db_r.Find("key" + std::to_string(i), mbd);
+        if(i % 2 == 0)
+        {
+            EXPECT_EQ(MBError::NOT_EXIST, rval);
+            continue;
+        }
+        EXPECT_EQ(MBError::SUCCESS, rval);
+        EXPECT_GT(mbd.expiry, past + 3600000);
+    }
+    EXPECT_EQ(num / 2, db_r.Count());
+    MBExpiryStats stats;
+    EXPECT_EQ(MBError::SUCCESS, db.GetExpiryStats(stats));
+    EXPECT_EQ(num / 2, stats.num_expired);
+    EXPECT_EQ(num / 2, stats.num_pending);
+
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.UnsetAsyncWriterPtr(&db));
+#endif
+    db_r.Close();
+    db.Close();
+}
+
+}
@@ -1,13 +1,16 @@
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/wait.h>
 #include <list>
 #include <cstdlib>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "../db.h"
 #include "../mb_data.h"
 #include "../resource_pool.h"
+#include "../async_writer.h"
 #include "./test_key.h"
 
 #define MB_DIR "/var/tmp/mabain_test/"
@@ -162,4 +165,207 @@ TEST_F(UpdateTest, Update_random)
     delete [] added;
 }
 
+TEST_F(UpdateTest, Update_batch)
+{
+    TestKey tkey(MABAIN_TEST_KEY_TYPE_SHA_128);
+    int num = 2000;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for(int i = 0; i < num; i++) {
+        keys.push_back(tkey.get_key(i));
+        values.push_back(keys.back() + "_batch");
+    }
+
+    EXPECT_EQ(db->AddBatch(keys, values), MBError::SUCCESS);
+    EXPECT_EQ(db->Count(), num);
+    EXPECT_EQ(db->AddBatch(keys, values), MBError::IN_DICT);
+    values.pop_back();
+    EXPECT_EQ(db->AddBatch(keys, values), MBError::INVALID_ARG);
+
+    MBData mbd;
+    for(int i = 0; i < num; i++) {
+        EXPECT_EQ(db->Find(keys[i], mbd), MBError::SUCCESS);
+        EXPECT_EQ(std::string((const char*)mbd.buff, mbd.data_len), keys[i] + "_batch");
+    }
+
+    keys.resize(num/2);
+    EXPECT_EQ(db->RemoveBatch(keys), MBError::SUCCESS);
+    EXPECT_EQ(db->Count(), num - num/2);
+    EXPECT_EQ(db->Find(keys[0], mbd), MBError::NOT_EXIST);
+}
+
+TEST_F(UpdateTest, Update_batch_async)
+{
+    db->Close();
+    delete db;
+    db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    assert(db->is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    assert(db_r.is_open());
+#ifndef __SHM_QUEUE__
+    assert(db_r.SetAsyncWriterPtr(db) == MBError::SUCCESS);
+#endif
+
+    // more keys than queue slots
+    TestKey tkey(MABAIN_TEST_KEY_TYPE_INT);
+    int num = 5000;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for(int i = 0; i < num; i++) {
+        keys.push_back(tkey.get_key(i));
+        values.push_back(keys.back() + "_async");
+    }
+    EXPECT_EQ(db_r.AddBatch(keys, values), MBError::SUCCESS);
+    while(db_r.AsyncWriterBusy()) {
+        usleep(1000);
+    }
+
+    EXPECT_EQ(db_r.Count(), num);
+    MBData mbd;
+    for(int i = 0; i < num; i++) {
+        EXPECT_EQ(db_r.Find(keys[i], mbd), MBError::SUCCESS);
+        EXPECT_EQ(std::string((const char*)mbd.buff, mbd.data_len), keys[i] + "_async");
+    }
+
+    EXPECT_EQ(db_r.RemoveBatch(keys), MBError::SUCCESS);
+    while(db_r.AsyncWriterBusy()) {
+        usleep(1000);
+    }
+    EXPECT_EQ(db_r.Count(), 0);
+
+#ifndef __SHM_QUEUE__
+    assert(db_r.UnsetAsyncWriterPtr(db) == MBError::SUCCESS);
+#endif
+    db_r.Close();
+}
+
+
+#ifdef __SHM_QUEUE__
+TEST_F(UpdateTest, Update_async_dead_producer)
+{
+    db->Close();
+    delete db;
+    db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    assert(db->is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    assert(db_r.is_open());
+
+    IndexHeader *header = db->GetDictPtr()->GetHeaderPtr();
+    AsyncNode *queue = reinterpret_cast<AsyncNode *>((char *) header + RollableFile::page_size);
+    pid_t pid = fork();
+    if(pid == 0) {
+        // Reserve two queue positions, claim the first one and exit
+        // without publishing either of them.
+        uint64_t index = header->queue_index.fetch_add(2);
+        uint64_t lap = index / header->async_queue_size;
+        AsyncNode *node_ptr = &queue[index % header->async_queue_size];
+        uint64_t state = node_ptr->state.load();
+        node_ptr->state.compare_exchange_strong(state,
+                MB_SHMQ_STATE(MB_SHMQ_SEQ_CLAIMED(lap), getpid()));
+        _exit(0);
+    }
+    assert(pid > 0);
+    waitpid(pid, NULL, 0);
+
+    // The async writer skips both slots and processes the update behind them.
+    std::string key = "dead_producer_key";
+    EXPECT_EQ(db_r.Add(key, key), MBError::SUCCESS);
+    while(db_r.AsyncWriterBusy()) {
+        usleep(1000);
+    }
+    MBData mbd;
+    EXPECT_EQ(db_r.Find(key, mbd), MBError::SUCCESS);
+    EXPECT_EQ(db_r.Count(), 1);
+    db_r.Close();
+}
+
+TEST_F(UpdateTest, Update_async_large_value)
+{
+    db->Close();
+    delete db;
+    db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    assert(db->is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    assert(db_r.is_open());
+
+    IndexHeader *header = db->GetDictPtr()->GetHeaderPtr();
+    uint64_t arena_size = MB_SHMQ_ARENA_SIZE(header->async_queue_size);
+    pid_t pid = fork();
+    if(pid == 0) {
+        // Allocate an arena record and exit without queuing it.
+        uint64_t tail = header->arena_tail.load();
+        ShmqRecordPtr(header, tail)->store(MB_SHMQ_REC(MB_SHMQ_REC_TAG(tail, arena_size),
+                                                       64, getpid(), 0));
+        header->arena_tail.store(tail + 64);
+        _exit(0);
+    }
+    assert(pid > 0);
+    waitpid(pid, NULL, 0);
+
+    // Values bigger than a queue slot, several laps of the arena in total
+    std::string key;
+    int num = 200;
+    for(int i = 0; i < num; i++) {
+        key = std::string("large_") + std::to_string(i);
+        EXPECT_EQ(db_r.Add(key, std::string(1024 + (i % 8) * 1024, 'a' + i % 26)),
+                  MBError::SUCCESS);
+    }
+    EXPECT_EQ(db_r.Add("too_large", std::string(arena_size, 'x')), MBError::OUT_OF_BOUND);
+    while(db_r.AsyncWriterBusy()) {
+        usleep(1000);
+    }
+
+    EXPECT_EQ(db_r.Count(), num);
+    MBData mbd;
+    for(int i = 0; i < num; i++) {
+        key = std::string("large_") + std::to_string(i);
+        EXPECT_EQ(db_r.Find(key, mbd), MBError::SUCCESS);
+        EXPECT_EQ(std::string((const char*)mbd.buff, mbd.data_len),
+                  std::string(1024 + (i % 8) * 1024, 'a' + i % 26));
+    }
+    db_r.Close();
+}
+
+TEST_F(UpdateTest, Update_async_dead_arena_claim)
+{
+    db->Close();
+    delete db;
+    db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    assert(db->is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    assert(db_r.is_open());
+
+    IndexHeader *header = db->GetDictPtr()->GetHeaderPtr();
+    uint64_t arena_size = MB_SHMQ_ARENA_SIZE(header->async_queue_size);
+    pid_t pid = fork();
+    if(pid == 0) {
+        // Take the arena claim, write the first word of a record and exit
+        // before moving the tail past it.
+        header->arena_claim.store(getpid());
+        uint64_t tail = header->arena_tail.load();
+        ShmqRecordPtr(header, tail)->store(MB_SHMQ_REC(MB_SHMQ_REC_TAG(tail, arena_size),
+                                                       64, getpid(), 0));
+        _exit(0);
+    }
+    assert(pid > 0);
+    waitpid(pid, NULL, 0);
+    EXPECT_NE(0u, header->arena_claim.load());
+
+    // Enough updates for several laps of the arena
+    std::string key;
+    int num = 200;
+    for(int i = 0; i < num; i++) {
+        key = std::string("claim_") + std::to_string(i);
+        EXPECT_EQ(db_r.Add(key, std::string(2048, 'a' + i % 26)), MBError::SUCCESS);
+    }
+    while(db_r.AsyncWriterBusy()) {
+        usleep(1000);
+    }
+
+    EXPECT_EQ(db_r.Count(), num);
+    EXPECT_EQ(0u, header->arena_claim.load());
+    db_r.Close();
+}
+#endif
+
 }
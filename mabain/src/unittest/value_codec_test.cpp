@@ -0,0 +1,218 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../db.h"
+#include "../dict.h"
+#include "../value_codec.h"
+#include "../resource_pool.h"
+
+using namespace mabain;
+
+namespace {
+
+#define MB_DIR "/var/tmp/mabain_test/"
+
+class ValueCodecTest : public ::testing::Test
+{
+public:
+    ValueCodecTest() {
+        db = NULL;
+    }
+    virtual ~ValueCodecTest() {
+    }
+    virtual void SetUp() {
+        std::string cmd = std::string("rm -f ") + MB_DIR + "_*";
+        if(system(cmd.c_str()) != 0) {
+        }
+        db = new DB(MB_DIR, CONSTS::WriterOptions());
+        ASSERT_TRUE(db->is_open());
+    }
+    virtual void TearDown() {
+        if(db != NULL) {
+            db->Close();
+            delete db;
+            db = NULL;
+        }
+        ResourcePool::getInstance().RemoveAll();
+    }
+
+    std::string JsonValue(int i) {
+        return "{\"id\":" + std::to_string(i) + ",\"name\":\"user" + std::to_string(i * 7) +
+               "\",\"status\":\"active\",\"roles\":[\"reader\",\"writer\"],\"region\":\"" +
+               (i % 2 ? "us-west-2" : "eu-central-1") + "\",\"score\":" +
+               std::to_string(i % 100) + "}";
+    }
+
+    void CheckValue(DB *handle, const std::string &key, const std::string &value) {
+        MBData mbd;
+        EXPECT_EQ(MBError::SUCCESS, handle->Find(key, mbd)) << "key: " << key;
+        EXPECT_EQ(value, std::string((const char *) mbd.buff, mbd.data_len));
+    }
+
+protected:
+    DB *db;
+};
+
+TEST_F(ValueCodecTest, codec_test)
+{
+    std::vector<std::string> samples;
+    for(int i = 0; i < 200; i++)
+        samples.push_back(JsonValue(i));
+    uint8_t dict[VALUE_CODEC_DICT_SIZE];
+    int dict_len = ValueCodec::TrainDictionary(samples, dict, VALUE_CODEC_DICT_SIZE);
+    EXPECT_GT(dict_len, 0);
+    EXPECT_LE(dict_len, VALUE_CODEC_DICT_SIZE);
+
+    ValueCodec codec;
+    std::string value = JsonValue(12345);
+    const uint8_t *cbuff;
+    int csize = codec.Compress(dict, dict_len, (const uint8_t *) value.data(), value.size(), cbuff);
+    EXPECT_GT(csize, 0);
+    EXPECT_LT(csize * 3, (int) value.size());
+    EXPECT_EQ((int) value.size(), ValueCodec::RawLength(cbuff));
+    std::vector<uint8_t> out(value.size());
+    EXPECT_TRUE(ValueCodec::Decompress(dict, dict_len, cbuff, csize, &out[0], out.size()));
+    EXPECT_EQ(value, std::string((const char *) &out[0], out.size()));
+
+    // Long runs use extended lengths; random bytes do not compress.
+    std::string run = std::string(5000, 'a') + value + std::string(300, 'b');
+    csize = codec.Compress(NULL, 0, (const uint8_t *) run.data(), run.size(), cbuff);
+    EXPECT_GT(csize, 0);
+    out.resize(run.size());
+    EXPECT_TRUE(ValueCodec::Decompress(NULL, 0, cbuff, csize, &out[0], out.size()));
+    EXPECT_EQ(run, std::string((const char *) &out[0], out.size()));
+    std::string noise;
+    srand(100);
+    for(int i = 0; i < 1000; i++)
+        noise.push_back((char) rand());
+    EXPECT_EQ(0, codec.Compress(dict, dict_len, (const uint8_t *) noise.data(), noise.size(),
+                                cbuff));
+
+    // Truncated input is detected.
+    csize = codec.Compress(dict, dict_len, (const uint8_t *) value.data(), value.size(), cbuff);
+    std::vector<uint8_t> comp(cbuff, cbuff + csize);
+    out.resize(value.size());
+    EXPECT_FALSE(ValueCodec::Decompress(dict, dict_len, &comp[0], csize - 1, &out[0],
+                                        out.size()));
+    EXPECT_FALSE(ValueCodec::Decompress(NULL, 0, &comp[0], csize, &out[0], out.size()));
+
+    // The raw length has to match the output buffer.
+    EXPECT_FALSE(ValueCodec::Decompress(dict, dict_len, &comp[0], csize, &out[0],
+                                        out.size() - 1));
+    uint16_t raw_len = value.size() + 100;
+    memcpy(&comp[0], &raw_len, sizeof(raw_len));
+    out.resize(value.size() + 100);
+    EXPECT_FALSE(ValueCodec::Decompress(dict, dict_len, &comp[0], csize, &out[0],
+                                        value.size()));
+}
+
+TEST_F(ValueCodecTest, db_value_codec_test)
+{
+    int num = 3000;
+    for(int i = 0; i < num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), JsonValue(i)));
+    IndexHeader *header = db->GetDictPtr()->GetHeaderPtr();
+    size_t raw_size = header->m_data_offset;
+
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+    EXPECT_EQ(MBError::NOT_ALLOWED, db_r.TrainValueCodec());
+    EXPECT_EQ(MBError::SUCCESS, db->TrainValueCodec(500));
+    EXPECT_EQ(MBError::NOT_ALLOWED, db->TrainValueCodec(500));
+    EXPECT_GT(header->codec_dict_size, 0);
+
+    for(int i = num; i < 2 * num; i++)
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), JsonValue(i)));
+    EXPECT_EQ(num, header->codec_num_compressed);
+    EXPECT_LT((header->m_data_offset - raw_size) * 2, raw_size);
+
+    // Raw and compressed values side by side, through both handles
+    for(int i = 0; i < 2 * num; i += 7)
+    {
+        CheckValue(db, "key" + std::to_string(i), JsonValue(i));
+        CheckValue(&db_r, "key" + std::to_string(i), JsonValue(i));
+    }
+    int count = 0;
+    for(DB::iterator iter = db_r.begin(); iter != db_r.end(); ++iter)
+    {
+        int i = atoi(iter.key.c_str() + 3);
+        EXPECT_EQ(JsonValue(i), std::string((const char *) iter.value.buff, iter.value.data_len));
+        count++;
+    }
+    EXPECT_EQ(2 * num, count);
+
+    // Overwrites and removals release the stored size of compressed values.
+    for(int i = 0; i < 2 * num; i += 2)
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), "short", true));
+    for(int i = 1; i < 2 * num; i += 4)
+        EXPECT_EQ(MBError::SUCCESS, db->Remove("key" + std::to_string(i)));
+    size_t pending = header->pending_data_buff_size;
+    for(int i = 1; i < 2 * num; i += 4)
+        EXPECT_EQ(MBError::SUCCESS, db->Add("key" + std::to_string(i), JsonValue(i)));
+    EXPECT_LT(header->pending_data_buff_size, (int64_t) pending);
+    for(int i = 0; i < 2 * num; i++)
+        CheckValue(&db_r, "key" + std::to_string(i), i % 2 == 0 ? "short" : JsonValue(i));
+
+    EXPECT_EQ(MBError::SUCCESS, db->CollectResource(1, 1));
+    for(int i = 0; i < 2 * num; i++)
+        CheckValue(db, "key" + std::to_string(i), i % 2 == 0 ? "short" : JsonValue(i));
+    db_r.Close();
+}
+
+TEST_F(ValueCodecTest, async_writer_test)
+{
+    db->Close();
+    delete db;
+    db = new DB(MB_DIR, CONSTS::WriterOptions() | CONSTS::ASYNC_WRITER_MODE);
+    ASSERT_TRUE(db->is_open());
+    DB db_r(MB_DIR, CONSTS::ReaderOptions());
+    ASSERT_TRUE(db_r.is_open());
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.SetAsyncWriterPtr(db));
+#endif
+
+    int num = 1000;
+    std::vector<std::string> samples;
+    for(int i = 0; i < num; i++)
+    {
+        EXPECT_EQ(MBError::SUCCESS, db_r.Add("key" + std::to_string(i), JsonValue(i)));
+        samples.push_back(JsonValue(i));
+    }
+    // The async writer is still applying the updates.
+    EXPECT_EQ(MBError::NOT_ALLOWED, db->TrainValueCodec(500));
+    EXPECT_EQ(MBError::NOT_ALLOWED, db->TrainValueCodec(samples));
+    while(db_r.AsyncWriterBusy())
+        usleep(1000);
+    EXPECT_EQ(VALUE_CODEC_NONE, db->GetDictPtr()->GetHeaderPtr()->value_codec.load());
+    for(int i = 0; i < num; i++)
+        CheckValue(&db_r, "key" + std::to_string(i), JsonValue(i));
+
+#ifndef __SHM_QUEUE__
+    ASSERT_EQ(MBError::SUCCESS, db_r.UnsetAsyncWriterPtr(db));
+#endif
+    db_r.Close();
+}
+
+}
@@ -17,6 +17,12 @@
 // @author Changxue Deng <chadeng@cisco.com>
 
 #include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 #include "shm_mutex.h"
 #include "../logger.h"
 #include "../error.h"
@@ -111,6 +117,42 @@ int InitShmCond(pthread_cond_t *cond)
     return MBError::SUCCESS;
 }
 
+#ifdef __linux__
+void ShmFutexWait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms)
+{
+    struct timespec tm_wait;
+    tm_wait.tv_sec = timeout_ms / 1000;
+    tm_wait.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    // Not FUTEX_PRIVATE_FLAG since the word is shared between processes.
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT, val,
+            &tm_wait, NULL, 0);
+}
+
+void ShmFutexWake(std::atomic<uint32_t> *addr)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE, INT_MAX,
+            NULL, NULL, 0);
+}
+#else
+// No futex available. Poll the word until it changes or the wait times out.
+#define MB_SHM_FUTEX_POLL_INTERVAL 100000L // in nano seconds
+void ShmFutexWait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms)
+{
+    struct timespec tm_sleep = {0, MB_SHM_FUTEX_POLL_INTERVAL};
+    int64_t waited = 0;
+    while(addr->load(std::memory_order_acquire) == val &&
+          waited < (int64_t) timeout_ms * 1000000L)
+    {
+        nanosleep(&tm_sleep, NULL);
+        waited += MB_SHM_FUTEX_POLL_INTERVAL;
+    }
+}
+
+void ShmFutexWake(std::atomic<uint32_t> *addr)
+{
+}
+#endif
+
 #ifdef __APPLE__
 // pthread_mutex_timedlock is not supported in Mac OS.
 // Simple implementation using pthread_mutex_trylock
@@ -20,6 +20,8 @@
 #define __SHM_MUTEX_H__
 
 #include <pthread.h>
+#include <stdint.h>
+#include <atomic>
 
 namespace mabain {
 
@@ -27,6 +29,12 @@ int  InitShmMutex(pthread_mutex_t *mutex);
 int  InitShmRWLock(pthread_rwlock_t *lock);
 int  InitShmCond(pthread_cond_t *cond);
 
+// Futex wait/wake on a 32-bit word in shared memory. ShmFutexWait returns
+// when the word is no longer val, when woken up or when timeout_ms expires.
+// It can also return spuriously, so callers have to check the word again.
+void ShmFutexWait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms);
+void ShmFutexWake(std::atomic<uint32_t> *addr);
+
 #ifdef __APPLE__
 int pthread_mutex_timedlock(pthread_mutex_t *mutex, const struct timespec *abs_timeout);
 #endif
@@ -0,0 +1,328 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "value_codec.h"
+
+namespace mabain {
+
+#define VALUE_CODEC_MIN_MATCH      4
+#define VALUE_CODEC_HASH_BITS      12
+#define VALUE_CODEC_MAX_DISTANCE   0xFFFF
+// k-mer and segment sizes used in dictionary training
+#define VALUE_CODEC_KMER           8
+#define VALUE_CODEC_SEGMENT        48
+
+static inline uint32_t codec_hash(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761U) >> (32 - VALUE_CODEC_HASH_BITS);
+}
+
+static inline int length_bytes(int len)
+{
+    return len < 15 ? 0 : (len - 15) / 255 + 1;
+}
+
+static inline void put_length(uint8_t *out, int &pos, int len)
+{
+    len -= 15;
+    while(len >= 255)
+    {
+        out[pos++] = 255;
+        len -= 255;
+    }
+    out[pos++] = static_cast<uint8_t>(len);
+}
+
+static inline bool get_length(const uint8_t *src, int len, int &pos, int &val)
+{
+    int b;
+    do {
+        if(pos >= len)
+            return false;
+        b = src[pos++];
+        val += b;
+    } while(b == 255);
+    return true;
+}
+
+ValueCodec::ValueCodec() : hash_table(1 << VALUE_CODEC_HASH_BITS)
+{
+}
+
+ValueCodec::~ValueCodec()
+{
+}
+
+int ValueCodec::Compress(const uint8_t *dict, int dict_len, const uint8_t *src, int len,
+                         const uint8_t* &dst)
+{
+    if(len < VALUE_CODEC_MIN_SIZE || len > 0xFFFF)
+        return 0;
+
+    int end = dict_len + len;
+    window.resize(end);
+    if(dict_len > 0)
+        memcpy(&window[0], dict, dict_len);
+    memcpy(&window[dict_len], src, len);
+    // The compressed value has to be smaller than the raw one.
+    int limit = len - 1;
+    output.resize(len);
+    const uint8_t *w = &window[0];
+    uint8_t *out = &output[0];
+
+    // Positions are stored plus one so that zero means an empty slot.
+    std::fill(hash_table.begin(), hash_table.end(), 0);
+    for(int i = 0; i + VALUE_CODEC_MIN_MATCH <= dict_len; i++)
+        hash_table[codec_hash(w + i)] = i + 1;
+
+    uint16_t raw_len = static_cast<uint16_t>(len);
+    memcpy(out, &raw_len, sizeof(raw_len));
+    int pos = sizeof(raw_len);
+    int anchor = dict_len;
+    int i = dict_len;
+    while(i + VALUE_CODEC_MIN_MATCH <= end)
+    {
+        uint32_t h = codec_hash(w + i);
+        int cand = static_cast<int>(hash_table[h]) - 1;
+        hash_table[h] = i + 1;
+        if(cand < 0 || i - cand > VALUE_CODEC_MAX_DISTANCE ||
+           memcmp(w + cand, w + i, VALUE_CODEC_MIN_MATCH) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        int mlen = VALUE_CODEC_MIN_MATCH;
+        while(i + mlen < end && w[cand + mlen] == w[i + mlen])
+            mlen++;
+
+        int lit = i - anchor;
+        int mcode = mlen - VALUE_CODEC_MIN_MATCH;
+        if(pos + 1 + length_bytes(lit) + lit + 2 + length_bytes(mcode) > limit)
+            return 0;
+
+        uint8_t token = static_cast<uint8_t>((std::min(lit, 15) << 4) | std::min(mcode, 15));
+        out[pos++] = token;
+        if(lit >= 15)
+            put_length(out, pos, lit);
+        memcpy(out + pos, w + anchor, lit);
+        pos += lit;
+        uint16_t dist = static_cast<uint16_t>(i - cand);
+        memcpy(out + pos, &dist, sizeof(dist));
+        pos += sizeof(dist);
+        if(mcode >= 15)
+            put_length(out, pos, mcode);
+
+        // Index part of the matched bytes so that later repeats find them.
+        for(int j = i + 1; j < i + mlen && j + VALUE_CODEC_MIN_MATCH <= end; j += 2)
+            hash_table[codec_hash(w + j)] = j + 1;
+        i += mlen;
+        anchor = i;
+    }
+
+    int lit = end - anchor;
+    if(pos + 1 + length_bytes(lit) + lit > limit)
+        return 0;
+    out[pos++] = static_cast<uint8_t>(std::min(lit, 15) << 4);
+    if(lit >= 15)
+        put_length(out, pos, lit);
+    memcpy(out + pos, w + anchor, lit);
+    pos += lit;
+
+    dst = out;
+    return pos;
+}
+
+int ValueCodec::RawLength(const uint8_t *src)
+{
+    uint16_t raw_len;
+    memcpy(&raw_len, src, sizeof(raw_len));
+    return raw_len;
+}
+
+// The input is not trusted: lock-free readers can see a buffer that was
+// reused by the writer while being read.
+bool ValueCodec::Decompress(const uint8_t *dict, int dict_len, const uint8_t *src,
+                            int len, uint8_t *dst, int dst_len)
+{
+    if(len < 3)
+        return false;
+
+    // The raw length is read again from src, which may have changed since
+    // the caller sized dst.
+    int raw_len = RawLength(src);
+    if(raw_len != dst_len)
+        return false;
+    int ip = sizeof(uint16_t);
+    int op = 0;
+    while(true)
+    {
+        if(ip >= len)
+            return false;
+        int token = src[ip++];
+        int lit = token >> 4;
+        if(lit == 15 && !get_length(src, len, ip, lit))
+            return false;
+        if(lit > len - ip || lit > raw_len - op)
+            return false;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if(ip == len)
+            break;
+
+        uint16_t dist;
+        if(len - ip < static_cast<int>(sizeof(dist)))
+            return false;
+        memcpy(&dist, src + ip, sizeof(dist));
+        ip += sizeof(dist);
+        int mlen = token & 0x0F;
+        if(mlen == 15 && !get_length(src, len, ip, mlen))
+            return false;
+        mlen += VALUE_CODEC_MIN_MATCH;
+        if(dist == 0 || dist > op + dict_len || mlen > raw_len - op)
+            return false;
+
+        // Matches can start in the dictionary and overlap their own output.
+        int from = op - dist;
+        for(int j = 0; j < mlen; j++, from++)
+            dst[op++] = from < 0 ? dict[dict_len + from] : dst[from];
+    }
+
+    return op == raw_len;
+}
+
+typedef struct _CodecSegment
+{
+    int64_t score;
+    int     sample;
+    int     pos;
+
+    bool operator<(const struct _CodecSegment &other) const
+    {
+        return score < other.score;
+    }
+} CodecSegment;
+
+static inline uint64_t codec_kmer(const std::string &sample, int pos)
+{
+    uint64_t kmer;
+    memcpy(&kmer, sample.data() + pos, sizeof(kmer));
+    return kmer;
+}
+
+// Sum of the sample frequencies of the distinct k-mers in a segment
+static int64_t segment_score(const std::string &sample, int pos,
+                             const std::unordered_map<uint64_t, int> &freq)
+{
+    std::vector<uint64_t> kmers;
+    int seg_end = std::min(static_cast<int>(sample.size()), pos + VALUE_CODEC_SEGMENT);
+    for(int i = pos; i + VALUE_CODEC_KMER <= seg_end; i++)
+        kmers.push_back(codec_kmer(sample, i));
+    std::sort(kmers.begin(), kmers.end());
+    kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+
+    int64_t score = 0;
+    for(size_t i = 0; i < kmers.size(); i++)
+    {
+        std::unordered_map<uint64_t, int>::const_iterator it = freq.find(kmers[i]);
+        // k-mers seen in a single sample do not help other values
+        if(it != freq.end() && it->second > 1)
+            score += it->second;
+    }
+    return score;
+}
+
+// Greedy segment selection: the segment covering the most frequent k-mers
+// is taken first and its k-mers no longer count for the other segments.
+// Scores only decrease, so a segment is rescored when it reaches the top
+// of the queue and taken if it is still ahead of the next one.
+int ValueCodec::TrainDictionary(const std::vector<std::string> &samples,
+                                uint8_t *dict, int max_size)
+{
+    std::unordered_map<uint64_t, int> freq;
+    for(size_t s = 0; s < samples.size(); s++)
+    {
+        std::unordered_set<uint64_t> seen;
+        for(int i = 0; i + VALUE_CODEC_KMER <= static_cast<int>(samples[s].size()); i++)
+        {
+            uint64_t kmer = codec_kmer(samples[s], i);
+            if(seen.insert(kmer).second)
+                freq[kmer]++;
+        }
+    }
+
+    std::priority_queue<CodecSegment> queue;
+    for(size_t s = 0; s < samples.size(); s++)
+    {
+        int size = static_cast<int>(samples[s].size());
+        for(int pos = 0; pos + VALUE_CODEC_KMER <= size; pos += VALUE_CODEC_SEGMENT / 2)
+        {
+            CodecSegment seg;
+            seg.score = segment_score(samples[s], pos, freq);
+            seg.sample = static_cast<int>(s);
+            seg.pos = pos;
+            if(seg.score > 0)
+                queue.push(seg);
+        }
+    }
+
+    std::vector<std::string> selected;
+    int total = 0;
+    while(!queue.empty() && total < max_size)
+    {
+        CodecSegment seg = queue.top();
+        queue.pop();
+        const std::string &sample = samples[seg.sample];
+        seg.score = segment_score(sample, seg.pos, freq);
+        if(seg.score == 0)
+            continue;
+        if(!queue.empty() && seg.score < queue.top().score)
+        {
+            queue.push(seg);
+            continue;
+        }
+
+        int seg_len = std::min(static_cast<int>(sample.size()) - seg.pos, VALUE_CODEC_SEGMENT);
+        seg_len = std::min(seg_len, max_size - total);
+        selected.push_back(sample.substr(seg.pos, seg_len));
+        total += seg_len;
+        for(int i = seg.pos; i + VALUE_CODEC_KMER <= seg.pos + seg_len; i++)
+            freq[codec_kmer(sample, i)] = 0;
+    }
+
+    // The best segments go last, closest to the values.
+    int pos = 0;
+    for(std::vector<std::string>::reverse_iterator it = selected.rbegin();
+        it != selected.rend(); ++it)
+    {
+        memcpy(dict + pos, it->data(), it->size());
+        pos += it->size();
+    }
+    return pos;
+}
+
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2017 Cisco Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// @author Changxue Deng <chadeng@cisco.com>
+
+#ifndef __VALUE_CODEC_H__
+#define __VALUE_CODEC_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mabain {
+
+#define VALUE_CODEC_NONE           0
+#define VALUE_CODEC_LZ_DICT        1
+
+// maximum size of the codec dictionary kept in the DB header
+#define VALUE_CODEC_DICT_SIZE      2048
+// values shorter than this are always stored raw
+#define VALUE_CODEC_MIN_SIZE       16
+
+// LZ77 codec for values with a dictionary shared by all values of a DB.
+// The dictionary is used as if it preceded each value, so that matches can
+// refer back into it; this is what makes small, similar values compress.
+// A compressed value is the raw length (2 bytes) followed by sequences of
+//     token, literal length, literals, match distance, match length
+// where the token holds the literal length in its high and the match length
+// minus VALUE_CODEC_MIN_MATCH in its low 4 bits. A nibble of 15 is extended
+// by the following bytes until one is less than 255. The last sequence has
+// literals only.
+class ValueCodec
+{
+public:
+    ValueCodec();
+    ~ValueCodec();
+
+    // Compress a value; returns the compressed size, or 0 if the value
+    // does not get smaller. The output is valid until the next call.
+    int Compress(const uint8_t *dict, int dict_len, const uint8_t *src, int len,
+                 const uint8_t* &dst);
+
+    // Decompress into dst of dst_len bytes, which must not overlap src.
+    // Returns false if the compressed data is corrupted or its raw length
+    // is not dst_len.
+    static bool Decompress(const uint8_t *dict, int dict_len, const uint8_t *src,
+                           int len, uint8_t *dst, int dst_len);
+    static int  RawLength(const uint8_t *src);
+
+    // Build a dictionary from the most frequent segments of the samples.
+    // Returns the dictionary size.
+    static int  TrainDictionary(const std::vector<std::string> &samples,
+                                uint8_t *dict, int max_size);
+
+private:
+    std::vector<uint8_t>  window;
+    std::vector<uint8_t>  output;
+    std::vector<uint32_t> hash_table;
+};
+
+}
+
+#endif
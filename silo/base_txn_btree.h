@@ -67,6 +67,20 @@ public:
     underlying_btree.print();
   }
 
+  /**
+   * Shadow the underlying btree with a hash index, so that exact match
+   * lookups skip the tree descent. Meant for tables which are (mostly) only
+   * accessed by exact key; scans still work, through the btree.
+   *
+   * only call before the first operation on this txn_btree- is not
+   * threadsafe
+   */
+  inline void
+  enable_point_index(size_t nbuckets_hint = 0)
+  {
+    underlying_btree.enable_point_index(nbuckets_hint);
+  }
+
   /**
    * only call when you are sure there are no concurrent modifications on the
    * tree. is neither threadsafe nor transactional
@@ -200,7 +214,7 @@ protected:
                    dbtuple::tuple_writer_t writer,
                    bool expect_new);
 
-  concurrent_btree underlying_btree;
+  point_indexed_btree underlying_btree;
   size_type value_size_hint;
   std::string name;
   bool been_destructed;
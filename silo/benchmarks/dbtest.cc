@@ -5,6 +5,7 @@
 #include <utility>
 #include <string>
 #include <set>
+#include <map>
 
 #include <getopt.h>
 #include <stdlib.h>
@@ -75,6 +76,8 @@ main(int argc, char **argv)
   int disable_snapshots = 0;
   vector<string> logfiles;
   vector<vector<unsigned>> assignments;
+  map<string, string> index_engines;
+  set<string> point_index_tables;
   string stats_server_sockfile;
   while (1) {
     static struct option long_options[] =
@@ -103,11 +106,13 @@ main(int argc, char **argv)
       {"disable-gc"                 , no_argument       , &disable_gc                , 1}   ,
       {"disable-snapshots"          , no_argument       , &disable_snapshots         , 1}   ,
       {"stats-server-sockfile"      , required_argument , 0                          , 'x'} ,
+      {"index-engine"               , required_argument , 0                          , 'i'} ,
+      {"point-index"                , required_argument , 0                          , 'p'} ,
       {"no-reset-counters"          , no_argument       , &no_reset_counters         , 1}   ,
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:i:p:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -185,6 +190,23 @@ main(int argc, char **argv)
       stats_server_sockfile = optarg;
       break;
 
+    case 'i':
+      // [table=]engine[,[table=]engine...]; a bare engine sets the default
+      for (auto &tok : split(optarg, ',')) {
+        const size_t pos = tok.find('=');
+        if (pos == string::npos)
+          index_engines["default"] = tok;
+        else
+          index_engines[tok.substr(0, pos)] = tok.substr(pos + 1);
+      }
+      break;
+
+    case 'p':
+      // table[,table...]
+      for (auto &tok : split(optarg, ','))
+        point_index_tables.insert(tok);
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -247,6 +269,29 @@ main(int argc, char **argv)
     return 1;
   }
 
+  // only kvdb indexes can pick their tree per table; the ndb protocols
+  // validate scans against node versions of the built-in concurrent_btree
+  const set<string> has_index_engines({"kvdb", "kvdb-st"});
+  if (!index_engines.empty() && !has_index_engines.count(db_type)) {
+    cerr << "[ERROR] benchmark " << db_type
+         << " does not support per-index engines" << endl;
+    return 1;
+  }
+  for (auto &p : index_engines) {
+    if (!kvdb_index_engines<true>::IsValidEngine(p.second)) {
+      cerr << "[ERROR] unknown index engine " << p.second
+           << " for index " << p.first << endl;
+      return 1;
+    }
+  }
+
+  const set<string> has_point_indexes({"ndb-proto1", "ndb-proto2"});
+  if (!point_index_tables.empty() && !has_point_indexes.count(db_type)) {
+    cerr << "[ERROR] benchmark " << db_type
+         << " does not support point indexes" << endl;
+    return 1;
+  }
+
 #ifdef PROTO2_CAN_DISABLE_GC
   const set<string> has_gc({"ndb-proto1", "ndb-proto2"});
   if (disable_gc && !has_gc.count(db_type)) {
@@ -283,7 +328,8 @@ main(int argc, char **argv)
   } else if (db_type == "ndb-proto1") {
     // XXX: hacky simulation of proto1
     db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
+        logfiles, assignments, !nofsync, do_compress, fake_writes,
+        point_index_tables);
     transaction_proto2_static::set_hack_status(true);
     ALWAYS_ASSERT(transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
@@ -292,7 +338,8 @@ main(int argc, char **argv)
 #endif
   } else if (db_type == "ndb-proto2") {
     db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
+        logfiles, assignments, !nofsync, do_compress, fake_writes,
+        point_index_tables);
     ALWAYS_ASSERT(!transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
     if (!disable_gc)
@@ -303,9 +350,9 @@ main(int argc, char **argv)
       transaction_proto2_static::DisableSnapshots();
 #endif
   } else if (db_type == "kvdb") {
-    db = new kvdb_wrapper<true>;
+    db = new kvdb_wrapper<true>(index_engines);
   } else if (db_type == "kvdb-st") {
-    db = new kvdb_wrapper<false>;
+    db = new kvdb_wrapper<false>(index_engines);
 #if !NO_MYSQL
   } else if (db_type == "mysql") {
     string dbdir = basedir + "/mysql-db";
@@ -371,10 +418,18 @@ main(int argc, char **argv)
     cerr << "  disable-gc : " << disable_gc                 << endl;
     cerr << "  disable-snapshots : " << disable_snapshots   << endl;
     cerr << "  stats-server-sockfile: " << stats_server_sockfile << endl;
+    cerr << "  index-engines : "
+         << vector<pair<string, string>>(index_engines.begin(), index_engines.end())
+         << endl;
+    cerr << "  point-index-tables : "
+         << vector<string>(point_index_tables.begin(), point_index_tables.end())
+         << endl;
 
     cerr << "system properties:" << endl;
     cerr << "  btree_internal_node_size: " << concurrent_btree::InternalNodeSize() << endl;
     cerr << "  btree_leaf_node_size    : " << concurrent_btree::LeafNodeSize() << endl;
+    cerr << "  silotree_internal_node_size: " << silotree_concurrent_btree::InternalNodeSize() << endl;
+    cerr << "  silotree_leaf_node_size    : " << silotree_concurrent_btree::LeafNodeSize() << endl;
 
 #ifdef TUPLE_PREFETCH
     cerr << "  tuple_prefetch          : yes" << endl;
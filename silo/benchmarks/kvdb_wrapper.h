@@ -1,14 +1,74 @@
 #ifndef _KVDB_WRAPPER_H_
 #define _KVDB_WRAPPER_H_
 
+#include <map>
+#include <string>
+
 #include "abstract_db.h"
 #include "../btree_choice.h"
 #include "../rcu.h"
 
+/**
+ * Index engines which kvdb can back a table with. The default engine is
+ * concurrent_btree, whichever tree the binary was built with
+ */
+template <bool UseConcurrencyControl>
+struct kvdb_index_engines {
+  typedef
+    typename std::conditional<
+      UseConcurrencyControl,
+      concurrent_btree,
+      single_threaded_btree>::type
+    default_btree;
+  typedef
+    typename std::conditional<
+      UseConcurrencyControl,
+      silotree_concurrent_btree,
+      silotree_single_threaded_btree>::type
+    silotree_btree;
+  typedef
+    typename std::conditional<
+      UseConcurrencyControl,
+      silotree_u64_concurrent_btree,
+      silotree_u64_single_threaded_btree>::type
+    silotree_u64_btree;
+#if NDB_MASSTREE
+  typedef
+    typename std::conditional<
+      UseConcurrencyControl,
+      masstree_concurrent_btree,
+      masstree_single_threaded_btree>::type
+    masstree_btree;
+#endif
+
+  // is engine a name open_index() knows how to build?
+  static inline bool
+  IsValidEngine(const std::string &engine)
+  {
+#if NDB_MASSTREE
+    if (engine == "masstree")
+      return true;
+#endif
+    return engine == "default" || engine == "silotree" ||
+           engine == "silotree-u64";
+  }
+};
+
 template <bool UseConcurrencyControl>
 class kvdb_wrapper : public abstract_db {
 public:
 
+  /**
+   * index_engines maps a table name to an engine name ("silotree",
+   * "silotree-u64", "masstree", or "default"). "silotree-u64" may only be
+   * used for tables whose keys are all exactly 8 bytes. The key "default" sets the engine for
+   * tables which are not listed. A partitioned table "name_<n>" matches
+   * an entry for "name"
+   */
+  kvdb_wrapper(const std::map<std::string, std::string> &index_engines =
+                 std::map<std::string, std::string>())
+    : index_engines(index_engines) {}
+
   virtual ssize_t txn_max_batch_size() const OVERRIDE { return 100; }
 
   virtual void do_txn_epoch_sync() const { }
@@ -47,9 +107,14 @@ public:
   {
     delete idx;
   }
+
+private:
+  const std::string &index_engine(const std::string &name) const;
+
+  std::map<std::string, std::string> index_engines;
 };
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 class kvdb_ordered_index : public abstract_ordered_index {
 public:
   kvdb_ordered_index(const std::string &name)
@@ -85,12 +150,7 @@ public:
   virtual std::map<std::string, uint64_t> clear();
 private:
   std::string name;
-  typedef
-    typename std::conditional<
-      UseConcurrencyControl,
-      concurrent_btree,
-      single_threaded_btree>::type
-    my_btree;
+  typedef Btree my_btree;
   typedef typename my_btree::key_type key_type;
   my_btree btr;
 };
@@ -309,9 +309,9 @@ public:
 
 } PACKED;
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 bool
-kvdb_ordered_index<UseConcurrencyControl>::get(
+kvdb_ordered_index<UseConcurrencyControl, Btree>::get(
     void *txn,
     const std::string &key,
     std::string &value, size_t max_bytes_read)
@@ -329,9 +329,9 @@ kvdb_ordered_index<UseConcurrencyControl>::get(
   return false;
 }
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 const char *
-kvdb_ordered_index<UseConcurrencyControl>::put(
+kvdb_ordered_index<UseConcurrencyControl, Btree>::put(
     void *txn,
     const std::string &key,
     const std::string &value)
@@ -362,9 +362,9 @@ kvdb_ordered_index<UseConcurrencyControl>::put(
   return 0;
 }
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 const char *
-kvdb_ordered_index<UseConcurrencyControl>::insert(void *txn,
+kvdb_ordered_index<UseConcurrencyControl, Btree>::insert(void *txn,
                            const std::string &key,
                            const std::string &value)
 {
@@ -404,9 +404,9 @@ private:
   str_arena *arena;
 };
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 void
-kvdb_ordered_index<UseConcurrencyControl>::scan(
+kvdb_ordered_index<UseConcurrencyControl, Btree>::scan(
     void *txn,
     const std::string &start_key,
     const std::string *end_key,
@@ -419,9 +419,9 @@ kvdb_ordered_index<UseConcurrencyControl>::scan(
   btr.search_range_call(key_type(start_key), end_key ? &end : 0, c, arena->next());
 }
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 void
-kvdb_ordered_index<UseConcurrencyControl>::rscan(
+kvdb_ordered_index<UseConcurrencyControl, Btree>::rscan(
     void *txn,
     const std::string &start_key,
     const std::string *end_key,
@@ -434,9 +434,9 @@ kvdb_ordered_index<UseConcurrencyControl>::rscan(
   btr.rsearch_range_call(key_type(start_key), end_key ? &end : 0, c, arena->next());
 }
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 void
-kvdb_ordered_index<UseConcurrencyControl>::remove(void *txn, const std::string &key)
+kvdb_ordered_index<UseConcurrencyControl, Btree>::remove(void *txn, const std::string &key)
 {
   typedef basic_kvdb_record<UseConcurrencyControl> kvdb_record;
   ANON_REGION("kvdb_ordered_index::remove:", &private_::kvdb_remove_probe0_cg);
@@ -447,9 +447,9 @@ kvdb_ordered_index<UseConcurrencyControl>::remove(void *txn, const std::string &
   }
 }
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 size_t
-kvdb_ordered_index<UseConcurrencyControl>::size() const
+kvdb_ordered_index<UseConcurrencyControl, Btree>::size() const
 {
   return btr.size();
 }
@@ -531,9 +531,9 @@ private:
   std::vector<std::pair<typename Btree::value_type, bool>> spec_values;
 };
 
-template <bool UseConcurrencyControl>
+template <bool UseConcurrencyControl, typename Btree>
 std::map<std::string, uint64_t>
-kvdb_ordered_index<UseConcurrencyControl>::clear()
+kvdb_ordered_index<UseConcurrencyControl, Btree>::clear()
 {
 
   purge_tree_walker<my_btree, UseConcurrencyControl> w;
@@ -547,12 +547,49 @@ kvdb_ordered_index<UseConcurrencyControl>::clear()
   return std::map<std::string, uint64_t>();
 }
 
+template <bool UseConcurrencyControl>
+const std::string &
+kvdb_wrapper<UseConcurrencyControl>::index_engine(const std::string &name) const
+{
+  static const std::string s_default("default");
+  auto it = index_engines.find(name);
+  if (it != index_engines.end())
+    return it->second;
+  // partitioned tables are opened as <name>_<partition id>
+  const size_t pos = name.rfind('_');
+  if (pos != std::string::npos && pos + 1 < name.size() &&
+      name.find_first_not_of("0123456789", pos + 1) == std::string::npos) {
+    it = index_engines.find(name.substr(0, pos));
+    if (it != index_engines.end())
+      return it->second;
+  }
+  it = index_engines.find("default");
+  if (it != index_engines.end())
+    return it->second;
+  return s_default;
+}
+
 template <bool UseConcurrencyControl>
 abstract_ordered_index *
 kvdb_wrapper<UseConcurrencyControl>::open_index(
     const std::string &name, size_t value_size_hint, bool mostly_append)
 {
-  return new kvdb_ordered_index<UseConcurrencyControl>(name);
+  typedef kvdb_index_engines<UseConcurrencyControl> engines;
+  const std::string &engine = index_engine(name);
+  ALWAYS_ASSERT(engines::IsValidEngine(engine));
+  if (engine == "silotree")
+    return new kvdb_ordered_index<
+      UseConcurrencyControl, typename engines::silotree_btree>(name);
+  if (engine == "silotree-u64")
+    return new kvdb_ordered_index<
+      UseConcurrencyControl, typename engines::silotree_u64_btree>(name);
+#if NDB_MASSTREE
+  if (engine == "masstree")
+    return new kvdb_ordered_index<
+      UseConcurrencyControl, typename engines::masstree_btree>(name);
+#endif
+  return new kvdb_ordered_index<
+    UseConcurrencyControl, typename engines::default_btree>(name);
 }
 
 #endif /* _KVDB_WRAPPER_IMPL_H_ */
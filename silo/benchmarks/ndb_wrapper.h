@@ -1,6 +1,8 @@
 #ifndef _NDB_WRAPPER_H_
 #define _NDB_WRAPPER_H_
 
+#include <set>
+
 #include "abstract_db.h"
 #include "../txn_btree.h"
 
@@ -39,12 +41,19 @@ protected:
 
 public:
 
+  /**
+   * point_index_tables names the tables whose indexes are shadowed by a hash
+   * index for exact match lookups (see point_indexed_btree); partitioned
+   * tables <name>_<partition id> are matched by <name>
+   */
   ndb_wrapper(
       const std::vector<std::string> &logfiles,
       const std::vector<std::vector<unsigned>> &assignments_given,
       bool call_fsync,
       bool use_compression,
-      bool fake_writes);
+      bool fake_writes,
+      const std::set<std::string> &point_index_tables =
+        std::set<std::string>());
 
   virtual ssize_t txn_max_batch_size() const OVERRIDE { return 100; }
 
@@ -105,6 +114,10 @@ public:
   virtual void
   close_index(abstract_ordered_index *idx);
 
+private:
+  bool uses_point_index(const std::string &name) const;
+
+  std::set<std::string> point_index_tables;
 };
 
 template <template <typename> class Transaction>
@@ -115,7 +128,8 @@ protected:
     using cast = private_::cast_base<Transaction, Traits>;
 
 public:
-  ndb_ordered_index(const std::string &name, size_t value_size_hint, bool mostly_append);
+  ndb_ordered_index(const std::string &name, size_t value_size_hint,
+                    bool mostly_append, bool point_index = false);
   virtual bool get(
       void *txn,
       const std::string &key,
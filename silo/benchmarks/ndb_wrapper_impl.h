@@ -127,7 +127,9 @@ ndb_wrapper<Transaction>::ndb_wrapper(
     const std::vector<std::vector<unsigned>> &assignments_given,
     bool call_fsync,
     bool use_compression,
-    bool fake_writes)
+    bool fake_writes,
+    const std::set<std::string> &point_index_tables)
+  : point_index_tables(point_index_tables)
 {
   if (logfiles.empty())
     return;
@@ -280,7 +282,21 @@ template <template <typename> class Transaction>
 abstract_ordered_index *
 ndb_wrapper<Transaction>::open_index(const std::string &name, size_t value_size_hint, bool mostly_append)
 {
-  return new ndb_ordered_index<Transaction>(name, value_size_hint, mostly_append);
+  return new ndb_ordered_index<Transaction>(
+      name, value_size_hint, mostly_append, uses_point_index(name));
+}
+
+template <template <typename> class Transaction>
+bool
+ndb_wrapper<Transaction>::uses_point_index(const std::string &name) const
+{
+  if (point_index_tables.count(name))
+    return true;
+  // partitioned tables are opened as <name>_<partition id>
+  const size_t pos = name.rfind('_');
+  return pos != std::string::npos && pos + 1 < name.size() &&
+         name.find_first_not_of("0123456789", pos + 1) == std::string::npos &&
+         point_index_tables.count(name.substr(0, pos));
 }
 
 template <template <typename> class Transaction>
@@ -292,9 +308,12 @@ ndb_wrapper<Transaction>::close_index(abstract_ordered_index *idx)
 
 template <template <typename> class Transaction>
 ndb_ordered_index<Transaction>::ndb_ordered_index(
-    const std::string &name, size_t value_size_hint, bool mostly_append)
+    const std::string &name, size_t value_size_hint, bool mostly_append,
+    bool point_index)
   : name(name), btr(value_size_hint, mostly_append, name)
 {
+  if (point_index)
+    btr.enable_point_index();
   // for debugging
   //std::cerr << name << " : btree= "
   //          << btr.get_underlying_btree()
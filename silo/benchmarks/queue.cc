@@ -3,9 +3,12 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <limits>
+#include <cmath>
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "../macros.h"
 #include "../varkey.h"
@@ -20,6 +23,13 @@ using namespace util;
 
 static size_t nkeys;
 
+// queue table mode: the first nproducers workers each append to their own
+// queue (key range), the remaining nconsumers workers dequeue from them in
+// batches. with nconsumers == 0 every worker is a producer
+static size_t nproducers = 0;
+static size_t nconsumers = 0;
+static size_t dequeue_batch_size = 16;
+
 static inline string
 queue_key(uint64_t id0, uint64_t id1)
 {
@@ -31,31 +41,140 @@ queue_key(uint64_t id0, uint64_t id1)
   return buf;
 }
 
+// inverse of queue_key() for the sequence number (id1)
+static inline uint64_t
+queue_key_seq(const string &k)
+{
+  INVARIANT(k.size() == 2 * sizeof(uint64_t));
+  host_endian_trfm<uint64_t> t;
+  return t(((const uint64_t *) k.data())[1]);
+}
+
 static const string queue_values("ABCDEFGH");
 
+/**
+ * Committed txn latencies (usec) plus entry counts for one worker. The
+ * histogram has 16 linear buckets per power of two, so percentiles are
+ * within ~6% of the true value
+ */
+class queue_worker_stats {
+public:
+  static const size_t NSubBuckets = 16;
+  static const size_t NBuckets = NSubBuckets * (64 - 4 + 1);
+
+  queue_worker_stats()
+    : nentries(0), ntxns(0), nempty(0),
+      first_usec(numeric_limits<uint64_t>::max()), last_usec(0),
+      buckets(NBuckets, 0) {}
+
+  inline void
+  record(uint64_t start_usec, uint64_t latency_usec, size_t n)
+  {
+    first_usec = min(first_usec, start_usec);
+    last_usec = max(last_usec, start_usec + latency_usec);
+    ntxns++;
+    nentries += n;
+    if (!n)
+      nempty++;
+    buckets[BucketOf(latency_usec)]++;
+  }
+
+  void
+  merge(const queue_worker_stats &that)
+  {
+    nentries += that.nentries;
+    ntxns += that.ntxns;
+    nempty += that.nempty;
+    first_usec = min(first_usec, that.first_usec);
+    last_usec = max(last_usec, that.last_usec);
+    for (size_t i = 0; i < NBuckets; i++)
+      buckets[i] += that.buckets[i];
+  }
+
+  // smallest latency (usec) such that at least fraction p of txns were as fast
+  uint64_t
+  percentile(double p) const
+  {
+    const uint64_t target = ceil(p * double(ntxns));
+    uint64_t n = 0;
+    for (size_t i = 0; i < NBuckets; i++) {
+      n += buckets[i];
+      if (n && n >= target)
+        return BucketValue(i);
+    }
+    return 0;
+  }
+
+  // non-empty buckets as "lower_bound_usec:count" pairs
+  void
+  print_histogram(ostream &o) const
+  {
+    bool first = true;
+    for (size_t i = 0; i < NBuckets; i++) {
+      if (!buckets[i])
+        continue;
+      o << (first ? "" : " ") << BucketValue(i) << ":" << buckets[i];
+      first = false;
+    }
+  }
+
+  uint64_t nentries;
+  uint64_t ntxns;
+  uint64_t nempty;
+  uint64_t first_usec;
+  uint64_t last_usec;
+
+private:
+  static inline size_t
+  BucketOf(uint64_t v)
+  {
+    if (v < NSubBuckets)
+      return v;
+    const size_t b = 63 - __builtin_clzll(v); // b >= 4
+    return NSubBuckets * (b - 3) + ((v >> (b - 4)) & (NSubBuckets - 1));
+  }
+
+  static inline uint64_t
+  BucketValue(size_t i)
+  {
+    if (i < NSubBuckets)
+      return i;
+    const size_t b = i / NSubBuckets + 3;
+    return (NSubBuckets + (i % NSubBuckets)) << (b - 4);
+  }
+
+  vector<uint64_t> buckets;
+};
+
 class queue_worker : public bench_worker {
 public:
   queue_worker(unsigned int worker_id,
                unsigned long seed, abstract_db *db,
                const map<string, abstract_ordered_index *> &open_tables,
                spin_barrier *barrier_a, spin_barrier *barrier_b,
-               uint64_t id, bool consumer)
+               uint64_t id, bool consumer,
+               queue_worker_stats *stats,
+               const vector<uint64_t> &queues = vector<uint64_t>())
     : bench_worker(worker_id, false, seed, db,
                    open_tables, barrier_a, barrier_b),
       tbl(open_tables.at("table")), id(id), consumer(consumer),
-      ctr(consumer ? 0 : nkeys)
+      ctr(consumer ? 0 : nkeys), stats(stats),
+      queues(queues), heads(queues.size(), 0), next_queue(0)
   {
+    ALWAYS_ASSERT(!consumer || !queues.empty());
   }
 
   txn_result
   txn_produce()
   {
+    const uint64_t start = timer::cur_usec();
     void *txn = db->new_txn(txn_flags, arena, txn_buf());
     try {
       const string k = queue_key(id, ctr);
       tbl->insert(txn, k, queue_values);
       if (likely(db->commit_txn(txn))) {
         ctr++;
+        stats->record(start, timer::cur_usec() - start, 1);
         return txn_result(true, queue_values.size());
       }
     } catch (abstract_db::abstract_abort_exception &ex) {
@@ -162,12 +281,56 @@ public:
     return static_cast<queue_worker *>(w)->txn_consume_noscan();
   }
 
+  /**
+   * Dequeue up to dequeue_batch_size entries from one of our queues (round
+   * robin) with a single scan, removing all of them in the same txn. The
+   * entries are removed one key at a time, as the tables have no range
+   * remove.
+   *
+   * The scan starts at our head for that queue rather than at the start of
+   * its key range: everything below the head has been dequeued by us
+   * already, and its keys linger as tombstones until GC reclaims them, so
+   * starting at the head never walks over them
+   */
+  txn_result
+  txn_consume_batch()
+  {
+    const size_t idx = next_queue;
+    next_queue = (next_queue + 1) % queues.size();
+    const uint64_t start = timer::cur_usec();
+    void *txn = db->new_txn(txn_flags, arena, txn_buf());
+    try {
+      const string lowk = queue_key(queues[idx], heads[idx]);
+      const string highk = queue_key(queues[idx], numeric_limits<uint64_t>::max());
+      limit_callback c(dequeue_batch_size);
+      tbl->scan(txn, lowk, &highk, c);
+      for (auto &p : c.values)
+        tbl->remove(txn, p.first);
+      if (likely(db->commit_txn(txn))) {
+        if (!c.values.empty())
+          heads[idx] = queue_key_seq(c.values.back().first) + 1;
+        stats->record(start, timer::cur_usec() - start, c.values.size());
+        return txn_result(true, -ssize_t(c.values.size() * queue_values.size()));
+      }
+    } catch (abstract_db::abstract_abort_exception &ex) {
+      db->abort_txn(txn);
+    }
+    return txn_result(false, 0);
+  }
+
+  static txn_result
+  TxnConsumeBatch(bench_worker *w)
+  {
+    return static_cast<queue_worker *>(w)->txn_consume_batch();
+  }
+
   virtual workload_desc_vec
   get_workload() const
   {
     workload_desc_vec w;
     if (consumer)
-      w.push_back(workload_desc("Consume", 1.0, TxnConsume));
+      w.push_back(workload_desc("ConsumeBatch", 1.0, TxnConsumeBatch));
+      //w.push_back(workload_desc("Consume", 1.0, TxnConsume));
       //w.push_back(workload_desc("ConsumeScanHint", 1.0, TxnConsumeScanHint));
       //w.push_back(workload_desc("ConsumeNoScan", 1.0, TxnConsumeNoScan));
     else
@@ -180,6 +343,13 @@ private:
   uint64_t id;
   bool consumer;
   uint64_t ctr;
+  queue_worker_stats *stats;
+
+  // consumers only: the producer queues we drain, and the sequence number
+  // of the next entry we expect in each
+  vector<uint64_t> queues;
+  vector<uint64_t> heads;
+  size_t next_queue;
 };
 
 class queue_table_loader : public bench_loader {
@@ -201,7 +371,7 @@ protected:
         10000 : db->txn_max_batch_size();
       ALWAYS_ASSERT(batchsize > 0);
       const size_t nbatches = nkeys / batchsize;
-      for (size_t id = 0; id < nthreads / 2; id++) {
+      for (size_t id = 0; id < nproducers; id++) {
         if (nbatches == 0) {
           void *txn = db->new_txn(txn_flags, arena, txn_buf());
           for (size_t j = 0; j < nkeys; j++) {
@@ -238,12 +408,29 @@ protected:
 
 class queue_bench_runner : public bench_runner {
 public:
-  queue_bench_runner(abstract_db *db, bool write_only)
-    : bench_runner(db), write_only(write_only)
+  queue_bench_runner(abstract_db *db)
+    : bench_runner(db), stats(nthreads)
   {
     open_tables["table"] = db->open_index("table", queue_values.size());
   }
 
+  void
+  print_stats() const
+  {
+    queue_worker_stats producer_stats, consumer_stats;
+    for (size_t i = 0; i < nproducers; i++)
+      producer_stats.merge(stats[i]);
+    for (size_t i = nproducers; i < nthreads; i++)
+      consumer_stats.merge(stats[i]);
+    cerr << "--- queue statistics ---" << endl;
+    cerr << "producers: " << nproducers
+         << " consumers: " << nconsumers
+         << " dequeue_batch_size: " << dequeue_batch_size << endl;
+    print_role_stats("enqueue", producer_stats);
+    if (nconsumers)
+      print_role_stats("dequeue", consumer_stats);
+  }
+
 protected:
   virtual vector<bench_loader *>
   make_loaders()
@@ -258,32 +445,49 @@ protected:
   {
     fast_random r(8544290);
     vector<bench_worker *> ret;
-    if (write_only) {
-      for (size_t i = 0; i < nthreads; i++)
-        ret.push_back(
-          new queue_worker(
-            i, r.next(), db, open_tables,
-            &barrier_a, &barrier_b, i, false));
-    } else {
-      ALWAYS_ASSERT(nthreads >= 2);
-      if (verbose && (nthreads % 2))
-        cerr << "queue_bench_runner: odd number of workers given" << endl;
-      for (size_t i = 0; i < nthreads / 2; i++) {
-        ret.push_back(
-          new queue_worker(
-            i, r.next(), db, open_tables,
-            &barrier_a, &barrier_b, i, true));
-        ret.push_back(
-          new queue_worker(
-            i + 1, r.next(), db, open_tables,
-            &barrier_a, &barrier_b, i, false));
-      }
+    ALWAYS_ASSERT(nproducers + nconsumers == nthreads);
+    for (size_t i = 0; i < nproducers; i++)
+      ret.push_back(
+        new queue_worker(
+          i, r.next(), db, open_tables,
+          &barrier_a, &barrier_b, i, false, &stats[i]));
+    // consumer c drains queues c, c + nconsumers, c + 2 * nconsumers, ...
+    for (size_t c = 0; c < nconsumers; c++) {
+      vector<uint64_t> queues;
+      for (size_t q = c; q < nproducers; q += nconsumers)
+        queues.push_back(q);
+      ret.push_back(
+        new queue_worker(
+          nproducers + c, r.next(), db, open_tables,
+          &barrier_a, &barrier_b, nproducers + c, true,
+          &stats[nproducers + c], queues));
     }
     return ret;
   }
 
 private:
-  bool write_only;
+  static void
+  print_role_stats(const char *role, const queue_worker_stats &s)
+  {
+    const double elapsed_sec =
+      (s.last_usec > s.first_usec) ?
+        double(s.last_usec - s.first_usec) / 1000000.0 : 0.0;
+    cerr << role << "_throughput: "
+         << (elapsed_sec > 0.0 ? double(s.nentries) / elapsed_sec : 0.0)
+         << " entries/sec" << endl;
+    cerr << role << "_txns: " << s.ntxns;
+    if (s.nempty)
+      cerr << " (" << s.nempty << " empty)";
+    cerr << endl;
+    cerr << role << "_latency_p50: " << s.percentile(0.50) << " us" << endl;
+    cerr << role << "_latency_p99: " << s.percentile(0.99) << " us" << endl;
+    cerr << role << "_latency_histogram: ";
+    s.print_histogram(cerr);
+    cerr << endl;
+  }
+
+  // one per worker, indexed by worker id (producers first)
+  vector<queue_worker_stats> stats;
 };
 
 void
@@ -291,6 +495,72 @@ queue_do_test(abstract_db *db, int argc, char **argv)
 {
   nkeys = size_t(scale_factor * 1000.0);
   ALWAYS_ASSERT(nkeys > 0);
-  queue_bench_runner r(db, true);
+
+  // parse options
+  optind = 1;
+  bool did_spec_producers = false;
+  while (1) {
+    static struct option long_options[] = {
+      {"producers"          , required_argument , 0 , 'p'},
+      {"consumers"          , required_argument , 0 , 'c'},
+      {"dequeue-batch-size" , required_argument , 0 , 'b'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "p:c:b:", long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+    case 0:
+      if (long_options[option_index].flag != 0)
+        break;
+      abort();
+      break;
+
+    case 'p':
+      nproducers = strtoul(optarg, nullptr, 10);
+      did_spec_producers = true;
+      break;
+
+    case 'c':
+      nconsumers = strtoul(optarg, nullptr, 10);
+      break;
+
+    case 'b':
+      dequeue_batch_size = strtoul(optarg, nullptr, 10);
+      ALWAYS_ASSERT(dequeue_batch_size > 0);
+      break;
+
+    case '?':
+      /* getopt_long already printed an error message. */
+      exit(1);
+
+    default:
+      abort();
+    }
+  }
+
+  if (!did_spec_producers)
+    nproducers = nthreads - min(nconsumers, nthreads);
+  if (nproducers + nconsumers != nthreads) {
+    cerr << "[ERROR] producers (" << nproducers << ") + consumers ("
+         << nconsumers << ") must equal num-threads (" << nthreads << ")"
+         << endl;
+    exit(1);
+  }
+  if (!nproducers || nconsumers > nproducers) {
+    cerr << "[ERROR] need at least one producer per consumer" << endl;
+    exit(1);
+  }
+
+  if (verbose) {
+    cerr << "queue settings:" << endl;
+    cerr << "  producers          : " << nproducers << endl;
+    cerr << "  consumers          : " << nconsumers << endl;
+    cerr << "  dequeue_batch_size : " << dequeue_batch_size << endl;
+  }
+
+  queue_bench_runner r(db);
   r.run();
+  r.print_stats();
 }
@@ -67,6 +67,8 @@ KNOB_ENABLE_TPCC_SCALE_ALLPERSIST_NOFSYNC=False
 KNOB_ENABLE_TPCC_SCALE_FAKEWRITES=False
 KNOB_ENABLE_TPCC_SCALE_GC=False
 KNOB_ENABLE_TPCC_FACTOR_ANALYSIS_1=False
+KNOB_ENABLE_INDEX_ENGINE_MATRIX=False
+KNOB_ENABLE_QUEUE_SCALE=False
 
 def binary_path(tpe):
   prog_suffix= '.masstree' if USE_MASSTREE else '.silotree'
@@ -596,6 +598,67 @@ if KNOB_ENABLE_TPCC_SCALE_GC:
   THREADS = get_scale_threads(4)
   grids += [mk_grid('scale_tpcc', 'tpcc', t) for t in THREADS]
 
+# queue table mode: scale producers and consumers separately. the
+# enqueue/dequeue throughput and p50/p99 latencies are printed to stderr
+# (--- queue statistics ---)
+if KNOB_ENABLE_QUEUE_SCALE:
+  def mk_grid(name, nproducers, nconsumers, batch):
+    return {
+      'name' : name,
+      'dbs' : ['ndb-proto2'],
+      'threads' : [nproducers + nconsumers],
+      'scale_factors' : [10],
+      'benchmarks' : ['queue'],
+      'bench_opts' : ['--producers %d --consumers %d --dequeue-batch-size %d' % (nproducers, nconsumers, batch)],
+      'par_load' : [False],
+      'retry' : [False],
+      'persist' : [PERSIST_NONE],
+      'numa_memory' : ['%dG' % (2 * (nproducers + nconsumers))],
+    }
+  for nconsumers in [1, 2, 4, 8]:
+    for nproducers in [nconsumers, 2 * nconsumers]:
+      for batch in [1, 16, 64]:
+        grids += [mk_grid('scale_queue', nproducers, nconsumers, batch)]
+
+# per-index engine comparison (kvdb only, needs a masstree binary so
+# both engines are compiled in). oorder_c_id_idx does reverse scans,
+# which silotree does not implement, so it always stays on masstree
+if KNOB_ENABLE_INDEX_ENGINE_MATRIX:
+  INDEX_ENGINES = [
+    'masstree',
+    'silotree,oorder_c_id_idx=masstree',
+    'silotree,customer_name_idx=masstree,oorder_c_id_idx=masstree',
+    'masstree,stock=silotree,item=silotree,district=silotree,warehouse=silotree',
+  ]
+  grids += [
+    {
+      'name' : 'index_engine_matrix',
+      'dbs' : ['kvdb'],
+      'threads' : [1, 8],
+      'scale_factors' : [8],
+      'benchmarks' : ['tpcc'],
+      'bench_opts' : [''],
+      'par_load' : [False],
+      'retry' : [False],
+      'persist' : [PERSIST_NONE],
+      'numa_memory' : ['%dG' % (4 * 8)],
+      'index_engine' : INDEX_ENGINES,
+    },
+    {
+      'name' : 'index_engine_matrix',
+      'dbs' : ['kvdb'],
+      'threads' : [1, 8],
+      'scale_factors' : [160000],
+      'benchmarks' : ['ycsb'],
+      'bench_opts' : ['--workload-mix 80,0,20,0'],
+      'par_load' : [True],
+      'retry' : [False],
+      'persist' : [PERSIST_NONE],
+      'numa_memory' : ['%dG' % (40 + 2 * 8)],
+      'index_engine' : ['masstree', 'silotree', 'silotree-u64'],
+    },
+  ]
+
 def check_binary_executable(binary):
   return os.path.isfile(binary) and os.access(binary, os.X_OK)
 
@@ -604,7 +667,7 @@ def run_configuration(
     basedir, dbtype, bench, scale_factor, nthreads, bench_opts,
     par_load, retry_aborted_txn, backoff_aborted_txn, numa_memory, logfiles,
     assignments, log_fake_writes, log_nofsync, log_compress,
-    disable_gc, disable_snapshots, ntries=5):
+    disable_gc, disable_snapshots, index_engine='', ntries=5):
   # Note: assignments is a list of list of ints
   assert len(logfiles) == len(assignments)
   assert not log_fake_writes or len(logfiles)
@@ -630,7 +693,8 @@ def run_configuration(
     + ([] if not log_nofsync else ['--log-nofsync']) \
     + ([] if not log_compress else ['--log-compress']) \
     + ([] if not disable_gc else ['--disable-gc']) \
-    + ([] if not disable_snapshots else ['--disable-snapshots'])
+    + ([] if not disable_snapshots else ['--disable-snapshots']) \
+    + ([] if not index_engine else ['--index-engine', index_engine])
   print >>sys.stderr, '[INFO] running command:'
   print >>sys.stderr, ('DISABLE_MADV_WILLNEED=1' if disable_madv_willneed else ''), ' '.join([x.replace(' ', r'\ ') for x in args])
   if not DRYRUN:
@@ -656,7 +720,7 @@ def run_configuration(
           basedir, dbtype, bench, scale_factor, nthreads, bench_opts,
           par_load, retry_aborted_txn, backoff_aborted_txn, numa_memory, logfiles,
           assignments, log_fake_writes, log_nofsync, log_compress,
-          disable_gc, disable_snapshots, ntries - 1)
+          disable_gc, disable_snapshots, index_engine, ntries - 1)
     else:
       print "Out of tries!"
       assert False
@@ -692,7 +756,7 @@ if __name__ == '__main__':
     for (binary, db, bench, scale_factor, threads, bench_opts,
          par_load, retry, backoff, numa_memory, persist,
          log_fake_writes, log_nofsync, log_compress,
-         disable_gc, disable_snapshots) in it.product(
+         disable_gc, disable_snapshots, index_engine) in it.product(
         grid.get('binary', [DEFAULT_BINARY]),
         grid['dbs'], grid['benchmarks'], grid['scale_factors'],
         grid['threads'], grid.get('bench_opts', ['']), grid['par_load'],
@@ -702,7 +766,8 @@ if __name__ == '__main__':
         grid.get('log_nofsync', [False]),
         grid.get('log_compress', [False]),
         grid.get('disable_gc', [False]),
-        grid.get('disable_snapshots', [False])):
+        grid.get('disable_snapshots', [False]),
+        grid.get('index_engine', [''])):
       node = platform.node()
       disable_madv_willneed = MACHINE_CONFIG[node]['disable_madv_willneed']
       config = {
@@ -724,6 +789,7 @@ if __name__ == '__main__':
         'log_compress'          : log_compress,
         'disable_gc'            : disable_gc,
         'disable_snapshots'     : disable_snapshots,
+        'index_engine'          : index_engine,
       }
       print >>sys.stderr, '[INFO] running config %s' % (str(config))
       if persist != PERSIST_NONE:
@@ -746,7 +812,7 @@ if __name__ == '__main__':
             bench_opts, par_load, retry, backoff, numa_memory,
             logfiles, assignments, log_fake_writes,
             log_nofsync, log_compress, disable_gc,
-            disable_snapshots)
+            disable_snapshots, index_engine)
         values.append(value)
       results.append((config, values))
 
@@ -31,6 +31,18 @@ struct testing_concurrent_btree_traits : public concurrent_btree_traits {
 typedef btree<testing_concurrent_btree_traits> testing_concurrent_btree;
 #endif
 
+// the fixed-u64 perf test compares against the generic silotree leaf,
+// even in masstree builds
+struct testing_silotree_btree_traits : public concurrent_btree_traits {
+  static const bool RcuRespCaller = false;
+};
+typedef btree<testing_silotree_btree_traits> testing_silotree_btree;
+
+struct testing_u64_btree_traits : public concurrent_u64_btree_traits {
+  static const bool RcuRespCaller = false;
+};
+typedef btree<testing_u64_btree_traits> testing_u64_btree;
+
 using namespace std;
 using namespace util;
 
@@ -813,6 +825,69 @@ test_random_keys()
   ALWAYS_ASSERT(btr.size() == 0);
 }
 
+static void
+test_fixed_u64_keys()
+{
+  fast_random r(4398);
+  const size_t nkeys = 20000;
+  set<uint64_t> keyset;
+  while (keyset.size() < nkeys)
+    keyset.insert(r.next() % (nkeys * 4));
+  vector<uint64_t> keys(keyset.begin(), keyset.end());
+  for (size_t i = keys.size() - 1; i > 0; i--)
+    swap(keys[i], keys[r.next() % (i + 1)]);
+
+  testing_u64_btree btr;
+  for (size_t i = 0; i < keys.size(); i++) {
+    ALWAYS_ASSERT(btr.insert(u64_varkey(keys[i]), (typename testing_u64_btree::value_type) keys[i]));
+    if ((i % 1000) == 0)
+      btr.invariant_checker();
+  }
+  btr.invariant_checker();
+  ALWAYS_ASSERT(btr.size() == nkeys);
+
+  for (uint64_t k = 0; k < nkeys * 4; k++) {
+    typename testing_u64_btree::value_type v = 0;
+    const bool found = btr.search(u64_varkey(k), v);
+    ALWAYS_ASSERT(found == (keyset.count(k) == 1));
+    ALWAYS_ASSERT(!found || v == (typename testing_u64_btree::value_type) k);
+  }
+
+  // keys of other lengths are never present, but still order correctly as
+  // scan bounds
+  const string k7 = u64_varkey(keys[0]).str().substr(0, 7);
+  const string k9 = u64_varkey(keys[0]).str() + string(1, '\0');
+  typename testing_u64_btree::value_type v = 0;
+  ALWAYS_ASSERT(!btr.search(varkey(k7), v));
+  ALWAYS_ASSERT(!btr.search(varkey(k9), v));
+
+  for (size_t i = 0; i < 100; i++) {
+    const uint64_t a = r.next() % (nkeys * 4);
+    const uint64_t b = a + (r.next() % 1000);
+    const string lower = u64_varkey(a).str() + string(1, '\0'); // (a, b)
+    const string upper = u64_varkey(b).str();
+    set<string> expected;
+    for (auto it = keyset.upper_bound(a); it != keyset.end() && *it < b; ++it)
+      expected.insert(u64_varkey(*it).str());
+    const varkey vupper(upper);
+    vector<string> scanned;
+    auto collect = [&scanned](const string &k, typename testing_u64_btree::value_type) {
+      scanned.push_back(k);
+      return true;
+    };
+    btr.search_range(varkey(lower), &vupper, collect);
+    ALWAYS_ASSERT(scanned == vector<string>(expected.begin(), expected.end()));
+  }
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    ALWAYS_ASSERT(btr.remove(u64_varkey(keys[i])));
+    if ((i % 1000) == 0)
+      btr.invariant_checker();
+  }
+  btr.invariant_checker();
+  ALWAYS_ASSERT(btr.size() == 0);
+}
+
 static void
 test_insert_remove_mix()
 {
@@ -1967,6 +2042,66 @@ write_only_perf_test()
   cerr << "avg_per_core_write_throughput: " << avg_per_core_throughput << " puts/sec/core" << endl;
 }
 
+// compares the generic leaf with the fixed 8-byte key leaf: node bytes per
+// record and single-threaded get latency over the same random keys
+namespace fixed_u64_perf_test_ns {
+  const size_t nkeys = 10000000;
+  const size_t nlookups = 10000000;
+
+  template <typename Btree>
+  class node_bytes_callback : public Btree::tree_walk_callback {
+  public:
+    node_bytes_callback() : bytes(0), spec_bytes(0) {}
+    virtual void on_node_begin(const typename Btree::node_opaque_t *n)
+    {
+      spec_bytes = n->is_leaf_node() ?
+        Btree::LeafNodeSize() : Btree::InternalNodeSize();
+    }
+    virtual void on_node_success() { bytes += spec_bytes; }
+    virtual void on_node_failure() {}
+    size_t bytes;
+  private:
+    size_t spec_bytes;
+  };
+
+  template <typename Btree>
+  static void
+  run(const char *name, const vector<uint64_t> &keys)
+  {
+    Btree btr;
+    for (size_t i = 0; i < keys.size(); i++)
+      btr.insert(u64_varkey(keys[i]), (typename Btree::value_type) keys[i]);
+    node_bytes_callback<Btree> c;
+    btr.tree_walk(c);
+
+    fast_random r(2381);
+    util::timer t;
+    for (size_t i = 0; i < nlookups; i++) {
+      typename Btree::value_type v = 0;
+      ALWAYS_ASSERT(btr.search(u64_varkey(keys[r.next() % keys.size()]), v));
+    }
+    const double get_ns = double(t.lap()) * 1000.0 / double(nlookups);
+
+    cerr << name << ": " << double(c.bytes) / double(keys.size())
+         << " node bytes/record, " << get_ns << " ns/get" << endl;
+  }
+}
+
+static void fixed_u64_perf_test() UNUSED;
+static void
+fixed_u64_perf_test()
+{
+  using namespace fixed_u64_perf_test_ns;
+
+  // YCSB-style keys: random 64-bit integers inserted in random order
+  fast_random r(9126);
+  vector<uint64_t> keys(nkeys);
+  for (size_t i = 0; i < nkeys; i++)
+    keys[i] = r.next();
+  run<testing_silotree_btree>("generic leaf", keys);
+  run<testing_u64_btree>("fixed u64 leaf", keys);
+}
+
 void
 TestConcurrentBtreeFast()
 {
@@ -1985,6 +2120,7 @@ TestConcurrentBtreeFast()
   test_null_keys_2();
   test_random_keys();
   test_insert_remove_mix();
+  test_fixed_u64_keys();
   mp_test_pinning();
   mp_test_inserts_removes();
   cout << "testing_concurrent_btree::TestFast passed" << endl;
@@ -2006,5 +2142,6 @@ TestConcurrentBtreeSlow()
   //perf_test();
   //read_only_perf_test();
   //write_only_perf_test();
+  //fixed_u64_perf_test();
   cout << "testing_concurrent_btree::TestSlow passed" << endl;
 }
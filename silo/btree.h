@@ -480,6 +480,19 @@ public:
 struct base_btree_config {
   static const unsigned int NKeysPerNode = 15;
   static const bool RcuRespCaller = true;
+  static const bool FixedU64Keys = false;
+};
+
+/**
+ * For trees whose keys are all exactly 8 bytes (ie big-endian encoded
+ * uint64_t's). Leaves drop the per-key length/type byte and never hold
+ * suffixes or layers, which buys two more keys in the same number of cache
+ * lines as the generic leaf, and lets key search run branch-free on the key
+ * slices alone
+ */
+struct fixed_u64_key_btree_config : public base_btree_config {
+  static const unsigned int NKeysPerNode = 17;
+  static const bool FixedU64Keys = true;
 };
 
 struct concurrent_btree_traits : public base_btree_config {
@@ -490,6 +503,37 @@ struct single_threaded_btree_traits : public base_btree_config {
   typedef uint64_t VersionType;
 };
 
+struct concurrent_u64_btree_traits : public fixed_u64_key_btree_config {
+  typedef std::atomic<uint64_t> VersionType;
+};
+
+struct single_threaded_u64_btree_traits : public fixed_u64_key_btree_config {
+  typedef uint64_t VersionType;
+};
+
+/**
+ * Per-key length/type bytes of a leaf node, format is:
+ * [ slice_length | type | unused ]
+ * [    0:4       |  4:5 |  5:8   ]
+ *
+ * FixedU64Keys leaves use the empty specialization below: every slice has
+ * length 8 and no layer, so the bytes are not stored at all
+ */
+template <unsigned int NKeysPerNode, bool FixedU64Keys>
+struct btree_leaf_lengths {
+  uint8_t lengths_[NKeysPerNode];
+
+  inline uint8_t *lengths() { return &lengths_[0]; }
+  inline const uint8_t *lengths() const { return &lengths_[0]; }
+};
+
+template <unsigned int NKeysPerNode>
+struct btree_leaf_lengths<NKeysPerNode, true> {
+  // never dereferenced, callers check FixedU64Keys first
+  inline uint8_t *lengths() { return nullptr; }
+  inline const uint8_t *lengths() const { return nullptr; }
+};
+
 /**
  * A concurrent, variable key length b+-tree, optimized for read heavy
  * workloads.
@@ -523,6 +567,7 @@ public:
   // public to assist in testing
   static const unsigned int NKeysPerNode    = P::NKeysPerNode;
   static const unsigned int NMinKeysPerNode = P::NKeysPerNode / 2;
+  static const bool FixedU64Keys = P::FixedU64Keys;
 
 private:
 
@@ -747,7 +792,8 @@ private:
     inline void prefetch() const;
   };
 
-  struct leaf_node : public node {
+  struct leaf_node : public node,
+                     public btree_leaf_lengths<NKeysPerNode, FixedU64Keys> {
     union value_or_node_ptr {
       value_type v_;
       node *n_;
@@ -756,11 +802,6 @@ private:
     key_slice min_key_; // really is min_key's key slice
     value_or_node_ptr values_[NKeysPerNode];
 
-    // format is:
-    // [ slice_length | type | unused ]
-    // [    0:4       |  4:5 |  5:8   ]
-    uint8_t lengths_[NKeysPerNode];
-
     leaf_node *prev_;
     leaf_node *next_;
 
@@ -813,7 +854,9 @@ private:
     keyslice_length(size_t n) const
     {
       INVARIANT(n < NKeysPerNode);
-      return lengths_[n] & LEN_LEN_MASK;
+      if (FixedU64Keys)
+        return 8;
+      return this->lengths()[n] & LEN_LEN_MASK;
     }
 
     inline void
@@ -823,14 +866,20 @@ private:
       INVARIANT(this->is_modifying());
       INVARIANT(len <= 9);
       INVARIANT(!layer || len == 9);
-      lengths_[n] = (len | (layer ? LEN_TYPE_MASK : 0));
+      if (FixedU64Keys) {
+        INVARIANT(len == 8);
+        return;
+      }
+      this->lengths()[n] = (len | (layer ? LEN_TYPE_MASK : 0));
     }
 
     inline bool
     value_is_layer(size_t n) const
     {
       INVARIANT(n < NKeysPerNode);
-      return lengths_[n] & LEN_TYPE_MASK;
+      if (FixedU64Keys)
+        return false;
+      return this->lengths()[n] & LEN_TYPE_MASK;
     }
 
     inline void
@@ -838,19 +887,48 @@ private:
     {
       INVARIANT(n < NKeysPerNode);
       INVARIANT(this->is_modifying());
+      if (FixedU64Keys) {
+        // slices are never longer than 8 bytes, so there are no layers
+        INVARIANT(false);
+        return;
+      }
       INVARIANT(keyslice_length(n) == 9);
       INVARIANT(!value_is_layer(n));
-      lengths_[n] |= LEN_TYPE_MASK;
+      this->lengths()[n] |= LEN_TYPE_MASK;
     }
 
     /**
      * keys[key_search(k).first] == k if key_search(k).first != -1
      * key does not exist otherwise. considers key length also
      */
+    /**
+     * number of key slices in [0, n) which are strictly less than k.
+     * branch-free (the compare compiles to a cmov), only valid for
+     * FixedU64Keys trees, where slices in a leaf are unique
+     */
+    inline size_t
+    fixed_key_rank(key_slice k, size_t n) const
+    {
+      const key_slice *base = this->keys_;
+      size_t len = n;
+      while (len > 1) {
+        const size_t half = len / 2;
+        base = (base[half] < k) ? base + half : base;
+        len -= half;
+      }
+      return (base - this->keys_) + (n && *base < k);
+    }
+
     inline key_search_ret
     key_search(key_slice k, size_t len) const
     {
       size_t n = this->key_slots_used();
+      if (FixedU64Keys) {
+        const size_t i = fixed_key_rank(k, n);
+        if (len == 8 && i < n && this->keys_[i] == k)
+          return key_search_ret(i, n);
+        return key_search_ret(-1, n);
+      }
       ssize_t lower = 0;
       ssize_t upper = n;
       while (lower < upper) {
@@ -876,6 +954,13 @@ private:
     {
       ssize_t ret = -1;
       size_t n = this->key_slots_used();
+      if (FixedU64Keys) {
+        // every stored key is (slice, 8), so an equal slice is a lower bound
+        // of k iff k is at least 8 bytes long
+        const size_t i = fixed_key_rank(k, n);
+        const bool eq = i < n && this->keys_[i] == k && len >= 8;
+        return key_search_ret(ssize_t(i) - 1 + eq, n);
+      }
       ssize_t lower = 0;
       ssize_t upper = n;
       while (lower < upper) {
@@ -1422,12 +1507,15 @@ public:
    *
    * If false and old_v is not NULL, then the overwritten value of v
    * is written into old_v
+   *
+   * For FixedU64Keys trees, k must be exactly 8 bytes
    */
   inline bool
   insert(const key_type &k, value_type v,
          value_type *old_v = NULL,
          insert_info_t *insert_info = NULL)
   {
+    ALWAYS_ASSERT(!FixedU64Keys || k.size() == 8);
     rcu_region guard;
     return insert_stable_location((node **) &root_, k, v, false, old_v, insert_info);
   }
@@ -1440,6 +1528,7 @@ public:
   insert_if_absent(const key_type &k, value_type v,
                    insert_info_t *insert_info = NULL)
   {
+    ALWAYS_ASSERT(!FixedU64Keys || k.size() == 8);
     rcu_region guard;
     return insert_stable_location((node **) &root_, k, v, true, NULL, insert_info);
   }
@@ -1720,7 +1809,8 @@ private:
     }
     sift_left(leaf->keys_, pos, n);
     sift_left(leaf->values_, pos, n);
-    sift_left(leaf->lengths_, pos, n);
+    if (!FixedU64Keys)
+      sift_left(leaf->lengths(), pos, n);
     if (leaf->suffixes_)
       sift_swap_left(leaf->suffixes_, pos, n);
     leaf->dec_key_slots_used();
@@ -2,7 +2,25 @@
 
 #if NDB_MASSTREE
 #include "masstree_btree.h"
-#else
+#endif
 #include "btree.h"
 #include "btree_impl.h"
+
+/**
+ * concurrent_btree is the index engine picked at build time (MASSTREE=1 in
+ * the Makefile selects masstree). The engines below are always available
+ * by name, so that callers which only need the common btree interface
+ * (search/insert/remove/search_range_call/tree_walk) can pick one per index
+ * at runtime, see kvdb_wrapper::open_index()
+ */
+typedef btree<concurrent_btree_traits> silotree_concurrent_btree;
+typedef btree<single_threaded_btree_traits> silotree_single_threaded_btree;
+
+// silotree with the fixed 8-byte key leaf layout; only usable by indexes
+// whose keys are all exactly 8 bytes long
+typedef btree<concurrent_u64_btree_traits> silotree_u64_concurrent_btree;
+typedef btree<single_threaded_u64_btree_traits> silotree_u64_single_threaded_btree;
+#if NDB_MASSTREE
+typedef mbtree<masstree_params> masstree_concurrent_btree;
+typedef mbtree<masstree_single_threaded_params> masstree_single_threaded_btree;
 #endif
@@ -32,8 +32,8 @@ btree<P>::node::base_invariant_unique_keys_check() const
     prev.first = keys_[0];
     prev.second = leaf->keyslice_length(0);
     ALWAYS_ASSERT(prev.second <= 9);
-    ALWAYS_ASSERT(!leaf->is_layer(0) || prev.second == 9);
-    if (!leaf->is_layer(0) && prev.second == 9) {
+    ALWAYS_ASSERT(!leaf->value_is_layer(0) || prev.second == 9);
+    if (!leaf->value_is_layer(0) && prev.second == 9) {
       ALWAYS_ASSERT(leaf->suffixes_);
       ALWAYS_ASSERT(leaf->suffixes_[0].size() >= 1);
     }
@@ -42,8 +42,8 @@ btree<P>::node::base_invariant_unique_keys_check() const
       cur_key.first = keys_[i];
       cur_key.second = leaf->keyslice_length(i);
       ALWAYS_ASSERT(cur_key.second <= 9);
-      ALWAYS_ASSERT(!leaf->is_layer(i) || cur_key.second == 9);
-      if (!leaf->is_layer(i) && cur_key.second == 9) {
+      ALWAYS_ASSERT(!leaf->value_is_layer(i) || cur_key.second == 9);
+      if (!leaf->value_is_layer(i) && cur_key.second == 9) {
         ALWAYS_ASSERT(leaf->suffixes_);
         ALWAYS_ASSERT(leaf->suffixes_[i].size() >= 1);
       }
@@ -136,7 +136,7 @@ btree<P>::leaf_node::invariant_checker_impl(const key_slice *min_key,
   ALWAYS_ASSERT(is_root || this->key_slots_used() > 0);
   size_t n = this->key_slots_used();
   for (size_t i = 0; i < n; i++)
-    if (this->is_layer(i))
+    if (this->value_is_layer(i))
       this->values_[i].n_->invariant_checker(NULL, NULL, NULL, NULL, true);
 }
 
@@ -210,7 +210,7 @@ btree<P>::recursive_delete(node *n)
 #endif
     size_t n = leaf->key_slots_used();
     for (size_t i = 0; i < n; i++)
-      if (leaf->is_layer(i))
+      if (leaf->value_is_layer(i))
         recursive_delete(leaf->values_[i].n_);
     leaf_node::deleter(leaf);
   } else {
@@ -278,7 +278,7 @@ process:
       if (ret != -1) {
         // found
         typename leaf_node::value_or_node_ptr vn = leaf->values_[ret];
-        const bool is_layer = leaf->is_layer(ret);
+        const bool is_layer = leaf->value_is_layer(ret);
         INVARIANT(!is_layer || kslicelen == 9);
         varkey suffix(leaf->suffix(ret));
         if (unlikely(!leaf->check_version(version)))
@@ -434,7 +434,7 @@ btree<P>::search_range_at_layer(
         buf.emplace_back(
             leaf->keys_[i],
             leaf->values_[i],
-            leaf->is_layer(i),
+            leaf->value_is_layer(i),
             leaf->keyslice_length(i),
             leaf->suffix(i));
     }
@@ -653,7 +653,7 @@ btree<P>::tree_walk(tree_walk_callback &callback) const
       const size_t n = leaf->key_slots_used();
       std::vector<node *> layers;
       for (size_t i = 0; i < n; i++)
-        if (leaf->is_layer(i))
+        if (leaf->value_is_layer(i))
           layers.push_back(leaf->values_[i].n_);
       leaf_node *next = leaf->next_;
       callback.on_node_begin(leaf);
@@ -677,7 +677,7 @@ btree<P>::size_walk_callback::on_node_begin(const node_opaque_t *n)
   const leaf_node *leaf = (const leaf_node *) n;
   const size_t sz = leaf->key_slots_used();
   for (size_t i = 0; i < sz; i++)
-    if (!leaf->is_layer(i))
+    if (!leaf->value_is_layer(i))
       spec_size_++;
 }
 
@@ -843,7 +843,7 @@ retry_cur_leaf:
     if (lenmatch != -1) {
       // exact match case
       if (kslicelen <= 8 ||
-          (!resp_leaf->is_layer(lenmatch) &&
+          (!resp_leaf->value_is_layer(lenmatch) &&
            resp_leaf->suffix(lenmatch) == k.shift())) {
         const uint64_t locked_version = resp_leaf->lock();
         if (unlikely(!btree::CheckVersion(version, locked_version))) {
@@ -861,7 +861,7 @@ retry_cur_leaf:
         return UnlockAndReturn(locked_nodes, I_NONE_NOMOD);
       }
       INVARIANT(kslicelen == 9);
-      if (resp_leaf->is_layer(lenmatch)) {
+      if (resp_leaf->value_is_layer(lenmatch)) {
         node *subroot = resp_leaf->values_[lenmatch].n_;
         INVARIANT(subroot);
         if (unlikely(!resp_leaf->check_version(version)))
@@ -900,7 +900,7 @@ retry_cur_leaf:
           }
 
           INVARIANT(lenmatch != -1);
-          INVARIANT(resp_leaf->is_layer(lenmatch));
+          INVARIANT(resp_leaf->value_is_layer(lenmatch));
           subroot = resp_leaf->values_[lenmatch].n_;
           INVARIANT(subroot->is_modifying());
           INVARIANT(subroot->is_lock_owner());
@@ -999,7 +999,8 @@ retry_cur_leaf:
       resp_leaf->keys_[lenlowerbound + 1] = kslice;
       sift_right(resp_leaf->values_, lenlowerbound + 1, n);
       resp_leaf->values_[lenlowerbound + 1].v_ = v;
-      sift_right(resp_leaf->lengths_, lenlowerbound + 1, n);
+      if (!FixedU64Keys)
+        sift_right(resp_leaf->lengths(), lenlowerbound + 1, n);
       resp_leaf->keyslice_set_length(lenlowerbound + 1, kslicelen, false);
       if (resp_leaf->suffixes_)
         sift_swap_right(resp_leaf->suffixes_, lenlowerbound + 1, n);
@@ -1157,9 +1158,11 @@ retry_cur_leaf:
           new_leaf->values_[pos].v_ = v;
           copy_into(&new_leaf->values_[pos + 1], resp_leaf->values_, lenlowerbound + 1, NKeysPerNode);
 
-          copy_into(&new_leaf->lengths_[0], resp_leaf->lengths_, split_point, lenlowerbound + 1);
-          new_leaf->keyslice_set_length(pos, kslicelen, false);
-          copy_into(&new_leaf->lengths_[pos + 1], resp_leaf->lengths_, lenlowerbound + 1, NKeysPerNode);
+          if (!FixedU64Keys) {
+            copy_into(&new_leaf->lengths()[0], resp_leaf->lengths(), split_point, lenlowerbound + 1);
+            new_leaf->keyslice_set_length(pos, kslicelen, false);
+            copy_into(&new_leaf->lengths()[pos + 1], resp_leaf->lengths(), lenlowerbound + 1, NKeysPerNode);
+          }
 
           if (resp_leaf->suffixes_) {
             new_leaf->ensure_suffixes();
@@ -1195,7 +1198,8 @@ retry_cur_leaf:
           // put new key in original leaf
           copy_into(&new_leaf->keys_[0], resp_leaf->keys_, split_point, NKeysPerNode);
           copy_into(&new_leaf->values_[0], resp_leaf->values_, split_point, NKeysPerNode);
-          copy_into(&new_leaf->lengths_[0], resp_leaf->lengths_, split_point, NKeysPerNode);
+          if (!FixedU64Keys)
+            copy_into(&new_leaf->lengths()[0], resp_leaf->lengths(), split_point, NKeysPerNode);
           if (resp_leaf->suffixes_) {
             new_leaf->ensure_suffixes();
             swap_with(&new_leaf->suffixes_[0], resp_leaf->suffixes_, split_point, NKeysPerNode);
@@ -1205,7 +1209,8 @@ retry_cur_leaf:
           resp_leaf->keys_[lenlowerbound + 1] = kslice;
           sift_right(resp_leaf->values_, lenlowerbound + 1, split_point);
           resp_leaf->values_[lenlowerbound + 1].v_ = v;
-          sift_right(resp_leaf->lengths_, lenlowerbound + 1, split_point);
+          if (!FixedU64Keys)
+            sift_right(resp_leaf->lengths(), lenlowerbound + 1, split_point);
           resp_leaf->keyslice_set_length(lenlowerbound + 1, kslicelen, false);
           if (resp_leaf->suffixes_)
             sift_swap_right(resp_leaf->suffixes_, lenlowerbound + 1, split_point);
@@ -1446,7 +1451,7 @@ retry_cur_leaf:
       return UnlockAndReturn(locked_nodes, R_NONE_NOMOD);
     }
     if (kslicelen == 9) {
-      if (resp_leaf->is_layer(ret)) {
+      if (resp_leaf->value_is_layer(ret)) {
         node *subroot = resp_leaf->values_[ret].n_;
         INVARIANT(subroot);
         if (unlikely(!resp_leaf->check_version(version)))
@@ -1516,7 +1521,7 @@ retry_cur_leaf:
       }
     }
 
-    //INVARIANT(!resp_leaf->is_layer(ret));
+    //INVARIANT(!resp_leaf->value_is_layer(ret));
     if (n > NMinKeysPerNode) {
       const uint64_t locked_version = resp_leaf->lock();
       if (unlikely(!btree::CheckVersion(version, locked_version))) {
@@ -1636,8 +1641,10 @@ retry_cur_leaf:
             copy_into(&leaf->keys_[n - 1], right_sibling->keys_, 0, steal_point);
             sift_left(leaf->values_, ret, n);
             copy_into(&leaf->values_[n - 1], right_sibling->values_, 0, steal_point);
-            sift_left(leaf->lengths_, ret, n);
-            copy_into(&leaf->lengths_[n - 1], right_sibling->lengths_, 0, steal_point);
+            if (!FixedU64Keys) {
+              sift_left(leaf->lengths(), ret, n);
+              copy_into(&leaf->lengths()[n - 1], right_sibling->lengths(), 0, steal_point);
+            }
             if (leaf->suffixes_)
               sift_swap_left(leaf->suffixes_, ret, n);
             if (right_sibling->suffixes_) {
@@ -1647,7 +1654,8 @@ retry_cur_leaf:
 
             sift_left(right_sibling->keys_, 0, right_n, steal_point);
             sift_left(right_sibling->values_, 0, right_n, steal_point);
-            sift_left(right_sibling->lengths_, 0, right_n, steal_point);
+            if (!FixedU64Keys)
+              sift_left(right_sibling->lengths(), 0, right_n, steal_point);
             if (right_sibling->suffixes_)
               sift_swap_left(right_sibling->suffixes_, 0, right_n, steal_point);
             leaf->set_key_slots_used(n - 1 + steal_point);
@@ -1684,8 +1692,10 @@ retry_cur_leaf:
         sift_left(leaf->values_, ret, n);
         copy_into(&leaf->values_[n - 1], right_sibling->values_, 0, right_n);
 
-        sift_left(leaf->lengths_, ret, n);
-        copy_into(&leaf->lengths_[n - 1], right_sibling->lengths_, 0, right_n);
+        if (!FixedU64Keys) {
+          sift_left(leaf->lengths(), ret, n);
+          copy_into(&leaf->lengths()[n - 1], right_sibling->lengths(), 0, right_n);
+        }
 
         if (leaf->suffixes_)
           sift_swap_left(leaf->suffixes_, ret, n);
@@ -1742,9 +1752,11 @@ retry_cur_leaf:
             sift_right(leaf->values_, 0, ret, nstolen);
             copy_into(&leaf->values_[0], &left_sibling->values_[0], left_n - nstolen, left_n);
 
-            sift_right(leaf->lengths_, ret + 1, n, nstolen - 1);
-            sift_right(leaf->lengths_, 0, ret, nstolen);
-            copy_into(&leaf->lengths_[0], &left_sibling->lengths_[0], left_n - nstolen, left_n);
+            if (!FixedU64Keys) {
+              sift_right(leaf->lengths(), ret + 1, n, nstolen - 1);
+              sift_right(leaf->lengths(), 0, ret, nstolen);
+              copy_into(&leaf->lengths()[0], &left_sibling->lengths()[0], left_n - nstolen, left_n);
+            }
 
             if (leaf->suffixes_) {
               sift_swap_right(leaf->suffixes_, ret + 1, n, nstolen - 1);
@@ -1786,8 +1798,10 @@ retry_cur_leaf:
         copy_into(&left_sibling->values_[left_n], leaf->values_, 0, ret);
         copy_into(&left_sibling->values_[left_n + ret], leaf->values_, ret + 1, n);
 
-        copy_into(&left_sibling->lengths_[left_n], leaf->lengths_, 0, ret);
-        copy_into(&left_sibling->lengths_[left_n + ret], leaf->lengths_, ret + 1, n);
+        if (!FixedU64Keys) {
+          copy_into(&left_sibling->lengths()[left_n], leaf->lengths(), 0, ret);
+          copy_into(&left_sibling->lengths()[left_n + ret], leaf->lengths(), ret + 1, n);
+        }
 
         if (leaf->suffixes_) {
           left_sibling->ensure_suffixes();
@@ -2013,7 +2027,7 @@ btree<P>::NodeStringify(const node_opaque_t *n)
     std::vector<std::string> lengths;
     for (size_t i = 0; i < leaf->key_slots_used(); i++) {
       std::ostringstream inf;
-      inf << "<l=" << leaf->keyslice_length(i) << ",is_layer=" << leaf->is_layer(i) << ">";
+      inf << "<l=" << leaf->keyslice_length(i) << ",is_layer=" << leaf->value_is_layer(i) << ">";
       lengths.push_back(inf.str());
     }
     b << ", lengths=" << util::format_list(lengths.begin(), lengths.end());
@@ -2036,7 +2050,7 @@ btree<P>::ExtractValues(const node_opaque_t *n)
   const leaf_node *leaf = (const leaf_node *) n;
   const size_t sz = leaf->key_slots_used();
   for (size_t i = 0; i < sz; i++)
-    if (!leaf->is_layer(i))
+    if (!leaf->value_is_layer(i))
       ret.emplace_back(leaf->values_[i].v_, leaf->keyslice_length(i) > 8);
   return ret;
 }
@@ -0,0 +1,206 @@
+#include "point_index.h"
+#include "counter.h"
+#include "log2.hh"
+
+using namespace std;
+using namespace util;
+
+static event_counter evt_point_index_grows("point_index_grows");
+
+// the smallest table we will build
+static const size_t MinBuckets = concurrent_point_index::NLockStripes;
+
+concurrent_point_index::entry *
+concurrent_point_index::entry::alloc(
+    uint64_t h, const uint8_t *k, size_t len, value_type v)
+{
+  const size_t sz = sizeof(entry) + len;
+  void * const p = rcu::s_instance.alloc(sz);
+  INVARIANT(p);
+  entry * const e = new (p) entry;
+  e->next_.store(nullptr, memory_order_relaxed);
+  e->value_.store(v, memory_order_relaxed);
+  e->hash_ = h;
+  e->len_ = len;
+  e->alloc_size_ = sz;
+  NDB_MEMCPY(const_cast<uint8_t *>(e->key()), k, len);
+  return e;
+}
+
+void
+concurrent_point_index::entry::deleter(void *p)
+{
+  entry * const e = (entry *) p;
+  const size_t sz = e->alloc_size_;
+  e->~entry();
+  rcu::s_instance.dealloc(p, sz);
+}
+
+void
+concurrent_point_index::entry::release(entry *e)
+{
+  rcu::s_instance.free_with_fn(e, deleter);
+}
+
+concurrent_point_index::table::table(size_t nbuckets)
+  : mask_(nbuckets - 1),
+    buckets_(new atomic<entry *>[nbuckets]),
+    stripes_(new aligned_padded_elem<stripe, false>[NLockStripes])
+{
+  INVARIANT(nbuckets >= NLockStripes);
+  INVARIANT(!(nbuckets & mask_));
+  for (size_t i = 0; i < nbuckets; i++)
+    buckets_[i].store(nullptr, memory_order_relaxed);
+}
+
+concurrent_point_index::table::~table()
+{
+  delete [] buckets_;
+  delete [] stripes_;
+}
+
+void
+concurrent_point_index::table::deleter(void *p)
+{
+  // maybe_grow() releases the entries of a replaced table one by one
+  delete (table *) p;
+}
+
+concurrent_point_index::concurrent_point_index(size_t nbuckets_hint)
+  : table_(new table(
+        max(MinBuckets, size_t(1) << ceil_log2(max(nbuckets_hint, size_t(1))))))
+{
+}
+
+concurrent_point_index::~concurrent_point_index()
+{
+  clear();
+  delete table_.load(memory_order_relaxed);
+}
+
+concurrent_point_index::table *
+concurrent_point_index::lock_stripe(uint64_t h)
+{
+  for (;;) {
+    table * const t = table_.load(memory_order_acquire);
+    stripe &s = t->stripe_for(h);
+    s.lock_.lock();
+    if (likely(table_.load(memory_order_acquire) == t))
+      return t;
+    // lost a race with maybe_grow()
+    s.lock_.unlock();
+  }
+}
+
+void
+concurrent_point_index::put(const key_type &k, value_type v)
+{
+  const uint64_t h = Hash(k);
+  table * const t = lock_stripe(h);
+  stripe &s = t->stripe_for(h);
+  atomic<entry *> &b = t->buckets_[h & t->mask_];
+  for (entry *e = b.load(memory_order_relaxed); e;
+       e = e->next_.load(memory_order_relaxed)) {
+    if (e->matches(h, k)) {
+      e->value_.store(v, memory_order_release);
+      s.lock_.unlock();
+      return;
+    }
+  }
+  entry * const e = entry::alloc(h, k.data(), k.size(), v);
+  e->next_.store(b.load(memory_order_relaxed), memory_order_relaxed);
+  b.store(e, memory_order_release);
+  const bool should_grow = ++s.count_ > 2 * ((t->mask_ + 1) / NLockStripes);
+  s.lock_.unlock();
+  if (unlikely(should_grow))
+    maybe_grow(t);
+}
+
+bool
+concurrent_point_index::remove(const key_type &k, value_type *old_v)
+{
+  const uint64_t h = Hash(k);
+  table * const t = lock_stripe(h);
+  stripe &s = t->stripe_for(h);
+  atomic<entry *> *prev = &t->buckets_[h & t->mask_];
+  for (entry *e = prev->load(memory_order_relaxed); e;
+       prev = &e->next_, e = prev->load(memory_order_relaxed)) {
+    if (e->matches(h, k)) {
+      if (old_v)
+        *old_v = e->value_.load(memory_order_relaxed);
+      // readers currently at e still see a valid e->next_
+      prev->store(e->next_.load(memory_order_relaxed), memory_order_release);
+      s.count_--;
+      s.lock_.unlock();
+      entry::release(e);
+      return true;
+    }
+  }
+  s.lock_.unlock();
+  return false;
+}
+
+size_t
+concurrent_point_index::size() const
+{
+  const table * const t = table_.load(memory_order_acquire);
+  size_t n = 0;
+  for (size_t i = 0; i < NLockStripes; i++)
+    n += t->stripes_[i]->count_;
+  return n;
+}
+
+void
+concurrent_point_index::clear()
+{
+  table * const t = table_.load(memory_order_relaxed);
+  for (size_t i = 0; i <= t->mask_; i++) {
+    entry *e = t->buckets_[i].load(memory_order_relaxed);
+    while (e) {
+      entry * const next = e->next_.load(memory_order_relaxed);
+      entry::deleter(e);
+      e = next;
+    }
+    t->buckets_[i].store(nullptr, memory_order_relaxed);
+  }
+  for (size_t i = 0; i < NLockStripes; i++)
+    t->stripes_[i]->count_ = 0;
+}
+
+void
+concurrent_point_index::maybe_grow(table *t)
+{
+  for (size_t i = 0; i < NLockStripes; i++)
+    t->stripes_[i]->lock_.lock();
+  if (table_.load(memory_order_acquire) != t) {
+    // someone else already grew it
+    for (size_t i = 0; i < NLockStripes; i++)
+      t->stripes_[i]->lock_.unlock();
+    return;
+  }
+
+  // readers may still be walking the old chains, so entries are copied
+  // rather than relinked
+  table * const nt = new table(2 * (t->mask_ + 1));
+  for (size_t i = 0; i <= t->mask_; i++) {
+    for (entry *e = t->buckets_[i].load(memory_order_relaxed); e;
+         e = e->next_.load(memory_order_relaxed)) {
+      entry * const ne = entry::alloc(
+          e->hash_, e->key(), e->len_, e->value_.load(memory_order_relaxed));
+      atomic<entry *> &b = nt->buckets_[e->hash_ & nt->mask_];
+      ne->next_.store(b.load(memory_order_relaxed), memory_order_relaxed);
+      b.store(ne, memory_order_relaxed);
+      nt->stripe_for(e->hash_).count_++;
+    }
+  }
+  table_.store(nt, memory_order_release);
+  ++evt_point_index_grows;
+
+  for (size_t i = 0; i <= t->mask_; i++)
+    for (entry *e = t->buckets_[i].load(memory_order_relaxed); e;
+         e = e->next_.load(memory_order_relaxed))
+      entry::release(e);
+  for (size_t i = 0; i < NLockStripes; i++)
+    t->stripes_[i]->lock_.unlock();
+  rcu::s_instance.free_with_fn(t, table::deleter);
+}
@@ -0,0 +1,268 @@
+#ifndef _NDB_POINT_INDEX_H_
+#define _NDB_POINT_INDEX_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+#include "btree_choice.h"
+#include "macros.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "util.h"
+#include "varkey.h"
+
+/**
+ * A concurrent hash table mapping keys to opaque pointers, which only
+ * supports exact match lookups.
+ *
+ * Readers never lock, and never retry: entries are immutable once published
+ * (except for their value pointer, which is replaced atomically), chains are
+ * only modified by publishing fully built entries, and unlinked entries are
+ * freed through RCU. Writers serialize on one of NLockStripes spinlocks.
+ *
+ * Once the table holds twice as many entries as buckets, the next writer
+ * doubles it: it takes every stripe lock of the old table, copies all
+ * entries into a new one, publishes it, and RCU frees the old one.
+ *
+ * Like concurrent_btree, the caller is responsible for being inside an RCU
+ * region for all of search/put/remove.
+ */
+class concurrent_point_index {
+public:
+  typedef varkey key_type;
+  typedef uint8_t* value_type;
+
+  static const size_t NLockStripes = 256;
+
+  concurrent_point_index(size_t nbuckets_hint = 0);
+  ~concurrent_point_index();
+
+  concurrent_point_index(const concurrent_point_index &) = delete;
+  concurrent_point_index(concurrent_point_index &&) = delete;
+  concurrent_point_index &operator=(const concurrent_point_index &) = delete;
+
+  inline bool
+  search(const key_type &k, value_type &v) const
+  {
+    const uint64_t h = Hash(k);
+    const table *t = table_.load(std::memory_order_acquire);
+    for (const entry *e = t->buckets_[h & t->mask_].load(std::memory_order_acquire);
+         e; e = e->next_.load(std::memory_order_acquire)) {
+      if (e->matches(h, k)) {
+        v = e->value_.load(std::memory_order_acquire);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * maps k => v, whether or not k was already present
+   */
+  void put(const key_type &k, value_type v);
+
+  /**
+   * returns true if k was removed, false if it was not present. if old_v is
+   * not null, the removed value is written into it
+   */
+  bool remove(const key_type &k, value_type *old_v = nullptr);
+
+  /**
+   * not exact while there are concurrent writers
+   */
+  size_t size() const;
+
+  /**
+   * NOT THREAD SAFE
+   */
+  void clear();
+
+  static inline uint64_t
+  Hash(const key_type &k)
+  {
+    const uint8_t *p = k.data();
+    size_t n = k.size();
+    uint64_t h = 0x9e3779b97f4a7c15UL ^ n;
+    while (n >= sizeof(uint64_t)) {
+      uint64_t w;
+      memcpy(&w, p, sizeof(w));
+      h = (h ^ w) * 0xff51afd7ed558ccdUL;
+      h ^= h >> 32;
+      p += sizeof(uint64_t);
+      n -= sizeof(uint64_t);
+    }
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 29;
+    return h;
+  }
+
+private:
+
+  struct entry {
+    std::atomic<entry *> next_;
+    std::atomic<value_type> value_;
+    uint64_t hash_;
+    uint32_t len_;
+    uint32_t alloc_size_;
+
+    inline const uint8_t *
+    key() const
+    {
+      return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+
+    inline bool
+    matches(uint64_t h, const key_type &k) const
+    {
+      return hash_ == h && len_ == k.size() &&
+             memcmp(key(), k.data(), len_) == 0;
+    }
+
+    static entry *alloc(uint64_t h, const uint8_t *k, size_t len, value_type v);
+    static void deleter(void *p);
+    static void release(entry *e);
+  };
+
+  struct stripe {
+    stripe() : count_(0) {}
+    spinlock lock_;
+    size_t count_; // protected by lock_
+  };
+
+  struct table {
+    explicit table(size_t nbuckets);
+    ~table();
+    const uint64_t mask_;
+    std::atomic<entry *> *const buckets_;
+    util::aligned_padded_elem<stripe, false> *const stripes_;
+
+    inline stripe &
+    stripe_for(uint64_t h) const
+    {
+      return stripes_[h & (NLockStripes - 1)].elem;
+    }
+
+    static void deleter(void *p);
+  };
+
+  // locks the stripe responsible for h in the current table
+  table *lock_stripe(uint64_t h);
+
+  void maybe_grow(table *t);
+
+  std::atomic<table *> table_;
+};
+
+/**
+ * The index a txn_btree keeps its key => dbtuple mapping in: a
+ * concurrent_btree which can be shadowed by a concurrent_point_index
+ * holding the same mapping, so that exact match lookups which hit skip the
+ * tree descent.
+ *
+ * The tree stays authoritative. It alone serves scans, and its node
+ * versions back absent-set (phantom) validation, so lookups which miss in
+ * the point index fall back to the tree. Every mutation updates the tree
+ * first and the point index second, while the caller holds the lock of the
+ * dbtuple being linked or unlinked. So a reader can see a dbtuple which was
+ * just unlinked, but never one which has been freed: unlinked dbtuples are
+ * RCU freed only after their point index entry is gone, and they are no
+ * longer latest, so such a read fails validation.
+ *
+ * The transaction layer only ever mutates the index through this type, so
+ * that both stay in sync.
+ */
+class point_indexed_btree : public concurrent_btree {
+public:
+  point_indexed_btree() : point_index_(nullptr) {}
+
+  ~point_indexed_btree()
+  {
+    delete point_index_;
+  }
+
+  /**
+   * NOT THREAD SAFE: must be called before the tree is first used
+   */
+  void
+  enable_point_index(size_t nbuckets_hint = 0)
+  {
+    ALWAYS_ASSERT(!point_index_);
+    {
+      scoped_rcu_region guard;
+      ALWAYS_ASSERT(!concurrent_btree::size());
+    }
+    point_index_ = new concurrent_point_index(nbuckets_hint);
+  }
+
+  inline bool
+  has_point_index() const
+  {
+    return point_index_;
+  }
+
+  /**
+   * if k is found through the point index, search_info is left untouched;
+   * it is only needed to record misses
+   */
+  inline bool
+  search(const key_type &k, value_type &v,
+         versioned_node_t *search_info = nullptr) const
+  {
+    if (point_index_ && point_index_->search(k, v))
+      return true;
+    return concurrent_btree::search(k, v, search_info);
+  }
+
+  inline bool
+  insert(const key_type &k, value_type v,
+         value_type *old_v = nullptr,
+         insert_info_t *insert_info = nullptr)
+  {
+    const bool ret = concurrent_btree::insert(k, v, old_v, insert_info);
+    if (point_index_)
+      point_index_->put(k, v);
+    return ret;
+  }
+
+  inline bool
+  insert_if_absent(const key_type &k, value_type v,
+                   insert_info_t *insert_info = nullptr)
+  {
+    if (!concurrent_btree::insert_if_absent(k, v, insert_info))
+      return false;
+    if (point_index_)
+      point_index_->put(k, v);
+    return true;
+  }
+
+  inline bool
+  remove(const key_type &k, value_type *old_v = nullptr)
+  {
+    if (!concurrent_btree::remove(k, old_v))
+      return false;
+    if (point_index_)
+      point_index_->remove(k);
+    return true;
+  }
+
+  /**
+   * NOT THREAD SAFE
+   */
+  inline void
+  clear()
+  {
+    concurrent_btree::clear();
+    if (point_index_)
+      point_index_->clear();
+  }
+
+private:
+  concurrent_point_index *point_index_;
+};
+
+#endif /* _NDB_POINT_INDEX_H_ */
@@ -20,6 +20,7 @@
 
 #include "amd64.h"
 #include "btree_choice.h"
+#include "point_index.h"
 #include "core.h"
 #include "counter.h"
 #include "macros.h"
@@ -41,6 +42,9 @@
 template <template <typename> class Transaction, typename P>
   class base_txn_btree;
 
+// point_index.h needs btree_impl.h, which includes this file
+class point_indexed_btree;
+
 class transaction_unusable_exception {};
 class transaction_read_only_exception {};
 
@@ -195,7 +199,7 @@ protected:
                           const string_type *k,
                           const void *r,
                           dbtuple::tuple_writer_t w,
-                          concurrent_btree *btr,
+                          point_indexed_btree *btr,
                           bool insert)
       : tuple(tuple),
         k(k),
@@ -231,7 +235,7 @@ protected:
       INVARIANT(!do_write());
       btr.or_flags(FLAGS_DOWRITE);
     }
-    inline concurrent_btree *
+    inline point_indexed_btree *
     get_btree() const
     {
       return btr.get();
@@ -256,7 +260,7 @@ protected:
     const string_type *k;
     const void *r;
     dbtuple::tuple_writer_t w;
-    marked_ptr<concurrent_btree> btr; // first bit for inserted, 2nd for dowrite
+    marked_ptr<point_indexed_btree> btr; // first bit for inserted, 2nd for dowrite
   };
 
   friend std::ostream &
@@ -689,7 +693,7 @@ protected:
   // latest: removes marker from tree, and clears latest
   void cleanup_inserted_tuple_marker(
       dbtuple *marker, const std::string &key,
-      concurrent_btree *btr);
+      point_indexed_btree *btr);
 
   // low-level API for txn_btree
 
@@ -712,7 +716,7 @@ protected:
   // NOTE: assumes key/value are stable
   std::pair< dbtuple *, bool >
   try_insert_new_tuple(
-      concurrent_btree &btr,
+      point_indexed_btree &btr,
       const std::string *key,
       const void *value,
       dbtuple::tuple_writer_t writer);
@@ -761,7 +765,7 @@ protected:
   // Called when the latest value written to ln is an empty
   // (delete) marker. The protocol can then decide how to schedule
   // the logical node for actual deletion
-  void on_logical_delete(dbtuple *tuple, const std::string &key, concurrent_btree *btr);
+  void on_logical_delete(dbtuple *tuple, const std::string &key, point_indexed_btree *btr);
 
   // if gen_commit_tid() is called, then on_tid_finish() will be called
   // with the commit tid. before on_tid_finish() is called, state is updated
@@ -834,6 +834,108 @@ mp_stress_test_insert_removes()
 
 }
 
+namespace test_point_index_ns {
+
+  static const size_t nkeys = 4096;
+
+  // overwrites the evens and removes the odds. the removes are done off the
+  // main thread, so that their delayed unlinks are not left queued behind
+  // on a thread which outlives the btree
+  template <template <typename> class TxnType, typename Traits>
+  class worker : public txn_btree_worker<TxnType> {
+  public:
+    worker(txn_btree<TxnType> &btr, uint64_t txn_flags)
+      : txn_btree_worker<TxnType>(btr, txn_flags) {}
+    ~worker() {}
+    virtual void run()
+    {
+      for (size_t i = 0; i < nkeys; i++) {
+        typename Traits::StringAllocator arena;
+        TxnType<Traits> t(this->txn_flags, arena);
+        if (i % 2)
+          this->btr->remove(t, u64_varkey(i));
+        else
+          this->btr->insert_object(t, u64_varkey(i), rec(i + 1));
+        AssertSuccessfulCommit(t);
+      }
+    }
+  };
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_point_index()
+{
+  using namespace test_point_index_ns;
+  for (size_t txn_flags_idx = 0;
+       txn_flags_idx < ARRAY_NELEMS(TxnFlags);
+       txn_flags_idx++) {
+    const uint64_t txn_flags = TxnFlags[txn_flags_idx];
+    txn_btree<TxnType> btr(sizeof(rec));
+    btr.enable_point_index();
+    typename Traits::StringAllocator arena;
+
+    // enough keys to grow the point index a few times
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert_object(t, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t);
+    }
+
+    // aborted inserts must not leave their markers behind
+    {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert_object(t, u64_varkey(nkeys), rec(nkeys));
+      t.abort();
+    }
+
+    for (size_t i = 0; i <= nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      const bool found = btr.search(t, u64_varkey(i), v);
+      ALWAYS_ASSERT_COND_IN_TXN(t, found == (i < nkeys));
+      if (found)
+        AssertByteEquality(rec(i), v);
+      AssertSuccessfulCommit(t);
+    }
+
+    worker<TxnType, Traits> w(btr, txn_flags);
+    w.start();
+    w.join();
+
+    {
+      TxnType<Traits> t(txn_flags, arena);
+      for (size_t i = 0; i < nkeys; i++) {
+        string v;
+        const bool found = btr.search(t, u64_varkey(i), v);
+        ALWAYS_ASSERT_COND_IN_TXN(t, found == !(i % 2));
+        if (found)
+          AssertByteEquality(rec(i + 1), v);
+      }
+      const u64_varkey vend(nkeys);
+      size_t ctr = 0;
+      test_callback_ctr cb(&ctr);
+      btr.search_range(t, u64_varkey(0), &vend, cb);
+      ALWAYS_ASSERT_COND_IN_TXN(t, ctr == nkeys / 2);
+      AssertSuccessfulCommit(t);
+    }
+
+    // a point read of a key a concurrent txn overwrites must fail validation
+    {
+      TxnType<Traits> t0(txn_flags, arena), t1(txn_flags, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t0, btr.search(t0, u64_varkey(0), v));
+      btr.insert_object(t1, u64_varkey(0), rec(2));
+      AssertSuccessfulCommit(t1);
+      btr.insert_object(t0, u64_varkey(2), rec(2));
+      AssertFailedCommit(t0);
+    }
+
+    txn_epoch_sync<TxnType>::sync();
+    txn_epoch_sync<TxnType>::finish();
+  }
+}
+
 namespace mp_test1_ns {
   // read-modify-write test (counters)
 
@@ -1895,6 +1997,7 @@ void txn_btree_test()
 
   //mp_stress_test_allocator<transaction_proto2, default_transaction_traits>();
   mp_stress_test_insert_removes<transaction_proto2, default_transaction_traits>();
+  test_point_index<transaction_proto2, default_transaction_traits>();
   mp_test1<transaction_proto2, default_transaction_traits>();
   mp_test2<transaction_proto2, default_transaction_traits>();
   mp_test3<transaction_proto2, default_transaction_traits>();
@@ -80,7 +80,7 @@ transaction<Protocol, Traits>::abort_impl(abort_reason reason)
 template <template <typename> class Protocol, typename Traits>
 void
 transaction<Protocol, Traits>::cleanup_inserted_tuple_marker(
-    dbtuple *marker, const std::string &key, concurrent_btree *btr)
+    dbtuple *marker, const std::string &key, point_indexed_btree *btr)
 {
   // XXX: this code should really live in txn_proto2_impl.h
   INVARIANT(marker->version == dbtuple::MAX_TID);
@@ -498,7 +498,7 @@ do_abort:
 template <template <typename> class Protocol, typename Traits>
 std::pair< dbtuple *, bool >
 transaction<Protocol, Traits>::try_insert_new_tuple(
-    concurrent_btree &btr,
+    point_indexed_btree &btr,
     const std::string *key,
     const void *value,
     dbtuple::tuple_writer_t writer)
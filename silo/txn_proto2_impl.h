@@ -511,7 +511,7 @@ protected:
 
     dbtuple *tuple_;
     marked_ptr<std::string> key_;
-    concurrent_btree *btr_;
+    point_indexed_btree *btr_;
 
     delete_entry()
       :
@@ -527,7 +527,7 @@ protected:
                  uint64_t trigger_tid,
                  dbtuple *tuple,
                  const marked_ptr<std::string> &key,
-                 concurrent_btree *btr)
+                 point_indexed_btree *btr)
       :
 #ifdef CHECK_INVARIANTS
         tuple_ahead_(tuple_ahead),
@@ -1082,7 +1082,7 @@ public:
   }
 
   inline ALWAYS_INLINE void
-  on_logical_delete(dbtuple *tuple, const std::string &key, concurrent_btree *btr)
+  on_logical_delete(dbtuple *tuple, const std::string &key, point_indexed_btree *btr)
   {
 #ifdef PROTO2_CAN_DISABLE_GC
     if (!IsGCEnabled())